@@ -0,0 +1,247 @@
+#include "CityRotation.h"
+
+CityRotation::CityRotation()
+{
+  memset(_cities, 0, sizeof(_cities));
+  memset(_pixels, 0, sizeof(_pixels));
+  _count = 1;
+  _current = 0;
+  _shownAt = 0;
+  _lastFetchAt = 0;
+  _widgetBytes = 0;
+  _mux = portMUX_INITIALIZER_UNLOCKED;
+  _swaps = 0;
+  _renders = 0;
+  _swapUsSum = 0;
+  _swapUsMax = 0;
+  _allocFailures = 0;
+}
+
+void CityRotation::begin()
+{
+  uint32_t codes[CityMax - 1];
+  _prefs.begin(CityNamespace, false);
+  size_t len = _prefs.getBytes("codes", codes, sizeof(codes));
+  uint8_t n = len / sizeof(uint32_t);
+  portENTER_CRITICAL(&_mux);
+  for (uint8_t i = 0; i < n; i++)
+    resetCity(i + 1, codes[i], millis());
+  _count = n + 1;
+  portEXIT_CRITICAL(&_mux);
+  if (n > 0)
+    Serial.printf("轮播%u个城市\n", _count);
+}
+
+// 新城市错开取数，开机或修改后很快就能显示
+void CityRotation::resetCity(uint8_t idx, uint32_t code, uint32_t now)
+{
+  CityState &c = _cities[idx];
+  memset(&c, 0, sizeof(c));
+  c.code = code;
+  c.nextFetch = now + idx * CityStaggerMs;
+}
+
+bool CityRotation::setCities(const uint32_t *codes, uint8_t count)
+{
+  if (count > CityMax - 1)
+    return false;
+  uint32_t now = millis();
+  portENTER_CRITICAL(&_mux);
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (_cities[i + 1].code != codes[i] || i + 1 >= _count)
+      resetCity(i + 1, codes[i], now);
+  }
+  _count = count + 1;
+  if (_current >= _count)
+    _current = 0; // 由调用者重画
+  _shownAt = now;
+  portEXIT_CRITICAL(&_mux);
+  if (count > 0)
+    _prefs.putBytes("codes", codes, count * sizeof(uint32_t));
+  else
+    _prefs.remove("codes");
+  return true;
+}
+
+uint32_t CityRotation::code(uint8_t idx)
+{
+  return idx < _count ? _cities[idx].code : 0;
+}
+
+// 一次只返回一个城市，和上次取数至少间隔CityStaggerMs
+int CityRotation::nextDue(uint32_t now)
+{
+  if (!enabled() || now - _lastFetchAt < CityStaggerMs)
+    return -1;
+  for (uint8_t i = 1; i < _count; i++)
+  {
+    if ((int32_t)(now - _cities[i].nextFetch) >= 0)
+      return i;
+  }
+  return -1;
+}
+
+// 失败后按CityRetryMs翻倍退避，最长为正常间隔
+void CityRotation::onFetched(uint8_t idx, bool ok, uint32_t ms, uint32_t intervalMs)
+{
+  if (idx == 0 || idx >= _count)
+    return;
+  uint32_t now = millis();
+  CityState &c = _cities[idx];
+  _lastFetchAt = now;
+  c.fetches++;
+  c.fetchMs += ms;
+  if (ok)
+  {
+    c.failStreak = 0;
+    c.lastSuccess = now;
+    c.nextFetch = now + intervalMs;
+  }
+  else
+  {
+    c.failures++;
+    uint32_t backoff = CityRetryMs << (c.failStreak < 4 ? c.failStreak : 4);
+    c.nextFetch = now + (backoff < intervalMs ? backoff : intervalMs);
+    if (c.failStreak < 255)
+      c.failStreak++;
+  }
+}
+
+uint32_t CityRotation::weatherHash(uint8_t idx)
+{
+  return idx < CityMax ? _cities[idx].weatherHash : 0;
+}
+
+void CityRotation::setWeather(uint8_t idx, const WeatherRecord &rec, uint32_t hash)
+{
+  if (idx >= CityMax)
+    return;
+  portENTER_CRITICAL(&_mux);
+  CityState &c = _cities[idx];
+  c.weather = rec;
+  c.weatherHash = hash;
+  c.valid = true;
+  c.dirty = true;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void CityRotation::setWarn(uint8_t idx, const String &warn)
+{
+  if (idx >= CityMax)
+    return;
+  char text[CacheTextLen];
+  DataCache::copyText(text, sizeof(text), warn);
+  portENTER_CRITICAL(&_mux);
+  memcpy(_cities[idx].warn, text, sizeof(text));
+  portEXIT_CRITICAL(&_mux);
+}
+
+bool CityRotation::getWeather(uint8_t idx, WeatherRecord &rec)
+{
+  if (idx >= _count)
+    return false;
+  portENTER_CRITICAL(&_mux);
+  rec = _cities[idx].weather;
+  bool valid = _cities[idx].valid;
+  portEXIT_CRITICAL(&_mux);
+  return valid;
+}
+
+void CityRotation::getLine(uint8_t idx, uint8_t line, String &out)
+{
+  char text[CacheTextLen];
+  text[0] = '\0';
+  portENTER_CRITICAL(&_mux);
+  if (idx < _count && line < 6)
+    memcpy(text, _cities[idx].weather.scroll[line], sizeof(text));
+  else if (idx < _count && line == 6)
+    memcpy(text, _cities[idx].warn, sizeof(text));
+  portEXIT_CRITICAL(&_mux);
+  out = text;
+}
+
+// 分配失败时保留dirty，下次再画
+uint8_t *CityRotation::beginRender(uint8_t idx, WeatherRecord &rec)
+{
+  if (idx >= _count)
+    return NULL;
+  portENTER_CRITICAL(&_mux);
+  bool dirty = _cities[idx].valid && _cities[idx].dirty;
+  portEXIT_CRITICAL(&_mux);
+  if (!dirty)
+    return NULL;
+  if (_pixels[idx] == NULL)
+  {
+    _pixels[idx] = (uint8_t *)malloc(widgetBytes());
+    if (_pixels[idx] == NULL)
+    {
+      _allocFailures++;
+      return NULL;
+    }
+  }
+  portENTER_CRITICAL(&_mux);
+  rec = _cities[idx].weather;
+  _cities[idx].dirty = false;
+  _cities[idx].rendered = true;
+  portEXIT_CRITICAL(&_mux);
+  _renders++;
+  return _pixels[idx];
+}
+
+uint8_t *CityRotation::rendered(uint8_t idx)
+{
+  return idx < _count && _cities[idx].rendered ? _pixels[idx] : NULL;
+}
+
+void CityRotation::releaseUnused()
+{
+  for (uint8_t i = _count; i < CityMax; i++)
+  {
+    if (_pixels[i] != NULL)
+    {
+      free(_pixels[i]);
+      _pixels[i] = NULL;
+    }
+  }
+}
+
+// 跳过还没有数据的城市，都没有数据时不切换
+int CityRotation::rotateDue(uint32_t now)
+{
+  if (!enabled() || now - _shownAt < CityRotateMs)
+    return -1;
+  _shownAt = now;
+  uint8_t count = _count;
+  for (uint8_t k = 1; k <= count; k++)
+  {
+    uint8_t idx = (_current + k) % count;
+    if (_cities[idx].valid)
+      return idx == _current ? -1 : idx;
+  }
+  return -1;
+}
+
+void CityRotation::onShown(uint8_t idx, uint32_t us)
+{
+  _current = idx;
+  _swaps++;
+  _swapUsSum += us;
+  if (us > _swapUsMax)
+    _swapUsMax = us;
+}
+
+void CityRotation::print(Print &out)
+{
+  out.printf("城市轮播 %u个 当前:%u 切换:%u次 平均%uus 最大%uus 重画小部件:%u次 分配失败:%u\n",
+             _count, _current, _swaps, _swaps ? _swapUsSum / _swaps : 0, _swapUsMax, _renders, _allocFailures);
+  out.printf("  每增加一个城市内存:状态%u字节+小部件%u字节\n", (unsigned)sizeof(CityState), widgetBytes());
+  uint32_t now = millis();
+  for (uint8_t i = 1; i < _count; i++)
+  {
+    CityState &c = _cities[i];
+    out.printf("  %u %s 取数:%u次 失败:%u 平均%ums 数据年龄:%us 下次:%ds后%s\n", c.code, c.valid ? c.weather.city : "-",
+               c.fetches, c.failures, c.fetches ? c.fetchMs / c.fetches : 0, c.lastSuccess ? (now - c.lastSuccess) / 1000 : 0,
+               (int)(c.nextFetch - now) / 1000, c.warn[0] ? " (预警)" : "");
+  }
+}
@@ -0,0 +1,93 @@
+#ifndef _CITY_ROTATION_H_
+#define _CITY_ROTATION_H_
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "DataCache.h"
+
+/* *****************************************************************
+ * 多城市轮播：第0个是设置中的主城市，数据仍由原来的取数流程更新；
+ * 其余城市的天气和预警保存在紧凑的CityState中，由任务A错开几秒依次取数，
+ * 共用一个保持连接的HTTPClient。每个城市的天气小部件在数据变化时预先画好，
+ * 轮播时只把画好的像素推送到屏幕，不重新排版文字。
+ * 小部件像素只由任务C分配和释放，其余状态在_mux内读写。
+ * *****************************************************************/
+#define CityNamespace "cities"
+#define CityMax 4             // 最多轮播的城市数(含主城市)
+#define CityRotateMs 15000    // 每个城市显示的时间
+#define CityStaggerMs 3000    // 两个城市取数的间隔，在服务器保持连接的时间内
+#define CityRetryMs 60000     // 取数失败后的首次重试时间
+#define CityWidgetCount 6     // 城市名、空气质量、温度、温度条、湿度、湿度条，位置在布局表中
+
+struct CityState
+{
+  uint32_t code;           // 城市代码，主城市为0
+  WeatherRecord weather;   // 天气实况和滚动字幕
+  char warn[CacheTextLen]; // 预警简称，没有预警时为空
+  uint32_t weatherHash;    // 天气内容哈希，没变时不重画
+  uint32_t nextFetch;      // 下次取数时间(millis)
+  uint32_t lastSuccess;
+  uint32_t fetches;
+  uint32_t failures;
+  uint32_t fetchMs;        // 累计取数耗时
+  uint8_t failStreak;
+  bool valid;              // 已有天气数据
+  bool dirty;              // 数据变化，小部件需要重画
+  bool rendered;           // 小部件像素已画好
+};
+
+class CityRotation
+{
+public:
+  CityRotation();
+  void begin(); // 读取保存的轮播城市
+  bool setCities(const uint32_t *codes, uint8_t count); // 设置主城市以外的城市，count为0时关闭轮播
+  bool enabled() const { return _count > 1; }
+  uint8_t count() const { return _count; }
+  uint32_t code(uint8_t idx);
+
+  // 取数，在任务A中调用
+  int nextDue(uint32_t now); // 到期的城市，没有时返回-1
+  void onFetched(uint8_t idx, bool ok, uint32_t ms, uint32_t intervalMs);
+  uint32_t weatherHash(uint8_t idx);
+  void setWeather(uint8_t idx, const WeatherRecord &rec, uint32_t hash);
+  void setWarn(uint8_t idx, const String &warn);
+
+  // 显示，在任务C中调用
+  bool getWeather(uint8_t idx, WeatherRecord &rec);
+  void getLine(uint8_t idx, uint8_t line, String &out); // 滚动字幕，第6行是预警
+  uint8_t *beginRender(uint8_t idx, WeatherRecord &rec); // 数据有变化时返回要画的像素缓冲区，第一次使用时分配
+  uint8_t *rendered(uint8_t idx); // 画好的像素，还没画时返回NULL
+  void releaseUnused();         // 释放已删除城市的像素
+  uint8_t current() const { return _current; }
+  int rotateDue(uint32_t now);  // 到了切换时间返回下一个城市
+  void onShown(uint8_t idx, uint32_t us);
+
+  void setWidgetBytes(uint32_t bytes) { _widgetBytes = bytes; } // 全部小部件的像素(8位色)，在分配前设置
+  uint32_t widgetBytes() const { return _widgetBytes; }
+  void print(Print &out);
+
+private:
+  Preferences _prefs;
+  CityState _cities[CityMax];
+  uint8_t *_pixels[CityMax];
+  volatile uint8_t _count;
+  volatile uint8_t _current;
+  uint32_t _shownAt;
+  uint32_t _lastFetchAt;
+  uint32_t _widgetBytes;
+  portMUX_TYPE _mux;
+
+  // 统计
+  uint32_t _swaps;
+  uint32_t _renders;
+  uint32_t _swapUsSum;
+  uint32_t _swapUsMax;
+  uint32_t _allocFailures;
+
+  void resetCity(uint8_t idx, uint32_t code, uint32_t now);
+};
+
+extern CityRotation cities;
+
+#endif
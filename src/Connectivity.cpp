@@ -0,0 +1,568 @@
+#include "Connectivity.h"
+
+#define ConnOnlineBit (1 << 0)
+#define ConnReasonLeave 8 // WIFI_REASON_ASSOC_LEAVE，自己断开时的原因
+
+static const char *stateNames[] = {"未连接", "扫描中", "连接中", "在线", "等待重试", "模拟断网"};
+static const char *sourceNames[FETCH_SOURCE_COUNT] = {"天气", "预警", "农历"};
+
+Connectivity::Connectivity()
+{
+  memset(_creds, 0, sizeof(_creds));
+  _credCount = 0;
+  memset(&_ap, 0, sizeof(_ap));
+  memset(&_seenAp, 0, sizeof(_seenAp));
+  memset(_cands, 0, sizeof(_cands));
+  _candCount = 0;
+  _candIdx = 0;
+  _events = NULL;
+  _mux = portMUX_INITIALIZER_UNLOCKED;
+  _online = false;
+  _state = CONN_IDLE;
+  _fastAttempt = false;
+  _roaming = false;
+  _roamScanning = false;
+  _attemptStart = 0;
+  _attemptTimeout = 0;
+  _scanStart = 0;
+  _lastRoamScan = 0;
+  _retryAt = 0;
+  _backoff = ConnBackoffMin;
+  _suspendUntil = 0;
+  _discEvents = 0;
+  _ipEvents = 0;
+  _seenDisc = 0;
+  _seenIp = 0;
+  _lastReason = 0;
+  _downSince = 0;
+  _recoverStart = 0;
+  _onlineSince = 0;
+  _queued = 0;
+  _outageQueued = 0;
+  _drops = 0;
+  _recoveries = 0;
+  _fastHits = 0;
+  _fastMisses = 0;
+  _lastReconnectMs = 0;
+  _maxReconnectMs = 0;
+  _sumReconnectMs = 0;
+  _lastDownMs = 0;
+  _maxDownMs = 0;
+  memset(_maxStaleMs, 0, sizeof(_maxStaleMs));
+  memset(_lastRefreshMs, 0, sizeof(_lastRefreshMs));
+  _attempts = 0;
+  _retries = 0;
+  _scans = 0;
+  _roams = 0;
+  _roamFailures = 0;
+  _lastRoamMs = 0;
+  _rssiAt = 0;
+  _rssi = 0;
+  _rssiMin = 0;
+  _rssiEma = 0;
+  _lastFetchSrc = 0;
+  _lastFetchBytes = 0;
+  _lastFetchMs = 0;
+}
+
+// ssid和psk是设置中保存的WiFi，不在已保存列表中或密码变了时加到最前面
+bool Connectivity::begin(const char *ssid, const char *psk)
+{
+  _events = xEventGroupCreate();
+  _prefs.begin(ConnNamespace, false);
+  if (_prefs.getBytes("ap", &_ap, sizeof(_ap)) != sizeof(_ap))
+    _ap.valid = 0;
+  size_t len = _prefs.getBytes("creds", _creds, sizeof(_creds));
+  _credCount = len % sizeof(Credential) == 0 ? len / sizeof(Credential) : 0;
+  for (uint8_t i = 0; i < _credCount; i++)
+  {
+    _creds[i].ssid[sizeof(_creds[i].ssid) - 1] = '\0';
+    _creds[i].psk[sizeof(_creds[i].psk) - 1] = '\0';
+  }
+  int i = findCredential(ssid);
+  if (ssid[0] != '\0' && (i < 0 || strcmp(_creds[i].psk, psk) != 0) && addCredential(ssid, psk) && i != 0 && _credCount > 1)
+    _ap.valid = 0; // 换了第一个WiFi，缓存的AP不再对应
+  WiFi.onEvent(onEvent);
+  if (!WiFi.mode(WIFI_STA))
+    return false;
+  WiFi.setAutoReconnect(false); // 由loop()负责重连
+  if (_credCount > 0)
+    connect(true);
+  return true;
+}
+
+// 已在最前面时不写NVS，返回是否修改了列表
+bool Connectivity::addCredential(const char *ssid, const char *psk)
+{
+  if (ssid[0] == '\0' || strlen(ssid) >= sizeof(_creds[0].ssid) || strlen(psk) >= sizeof(_creds[0].psk))
+    return false;
+  if (_credCount > 0 && strcmp(_creds[0].ssid, ssid) == 0 && strcmp(_creds[0].psk, psk) == 0)
+    return false;
+  int i = findCredential(ssid);
+  if (i < 0)
+  {
+    if (_credCount < ConnMaxCreds)
+      _credCount++;
+    i = _credCount - 1; // 列表满时覆盖最后一个
+  }
+  for (; i > 0; i--)
+    _creds[i] = _creds[i - 1];
+  memset(&_creds[0], 0, sizeof(_creds[0]));
+  strcpy(_creds[0].ssid, ssid);
+  strcpy(_creds[0].psk, psk);
+  saveCreds();
+  return true;
+}
+
+bool Connectivity::removeCredential(const char *ssid)
+{
+  int i = findCredential(ssid);
+  if (i < 0)
+    return false;
+  if (i == 0)
+    _ap.valid = 0;
+  for (; i + 1 < _credCount; i++)
+    _creds[i] = _creds[i + 1];
+  _credCount--;
+  saveCreds();
+  return true;
+}
+
+int Connectivity::findCredential(const char *ssid)
+{
+  for (uint8_t i = 0; i < _credCount; i++)
+    if (strcmp(_creds[i].ssid, ssid) == 0)
+      return i;
+  return -1;
+}
+
+void Connectivity::clearCredentials()
+{
+  _credCount = 0;
+  _ap.valid = 0;
+  _prefs.remove("creds");
+  _prefs.remove("ap");
+}
+
+void Connectivity::saveCreds()
+{
+  _prefs.putBytes("creds", _creds, _credCount * sizeof(Credential));
+}
+
+// 在WiFi事件任务中运行，只记录状态
+void Connectivity::onEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+  Connectivity &c = conn;
+  if (event == ARDUINO_EVENT_WIFI_STA_CONNECTED)
+  {
+    portENTER_CRITICAL(&c._mux);
+    memcpy(c._seenAp.bssid, info.wifi_sta_connected.bssid, sizeof(c._seenAp.bssid));
+    c._seenAp.channel = info.wifi_sta_connected.channel;
+    c._seenAp.valid = 1;
+    portEXIT_CRITICAL(&c._mux);
+  }
+  else if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+  {
+    portENTER_CRITICAL(&c._mux);
+    c._ipEvents++;
+    c._online = true;
+    portEXIT_CRITICAL(&c._mux);
+    xEventGroupSetBits(c._events, ConnOnlineBit);
+  }
+  else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED || event == ARDUINO_EVENT_WIFI_STA_LOST_IP)
+  {
+    xEventGroupClearBits(c._events, ConnOnlineBit);
+    portENTER_CRITICAL(&c._mux);
+    if (c._online && c._downSince == 0)
+      c._downSince = millis();
+    c._online = false;
+    c._discEvents++;
+    c._lastReason = (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) ? info.wifi_sta_disconnected.reason : 0;
+    portEXIT_CRITICAL(&c._mux);
+  }
+}
+
+bool Connectivity::waitOnline(uint32_t ms)
+{
+  if (_events == NULL)
+    return false;
+  return (xEventGroupWaitBits(_events, ConnOnlineBit, pdFALSE, pdTRUE, pdMS_TO_TICKS(ms)) & ConnOnlineBit) != 0;
+}
+
+// fast为true且有缓存时按BSSID和信道直接连接最近用过的WiFi，否则先扫描
+void Connectivity::connect(bool fast)
+{
+  if (fast && _ap.valid)
+  {
+    connectTo(_creds[0], _ap.bssid, _ap.channel, ConnFastTimeout);
+    _fastAttempt = true;
+  }
+  else
+    startScan(false);
+}
+
+// bssid为NULL时由驱动自己扫描
+void Connectivity::connectTo(const Credential &cred, const uint8_t *bssid, uint8_t channel, uint32_t timeout)
+{
+  if (bssid != NULL)
+    WiFi.begin(cred.ssid, cred.psk, channel, bssid, true);
+  else
+    WiFi.begin(cred.ssid, cred.psk);
+  _fastAttempt = false;
+  _attempts++;
+  _attemptStart = millis();
+  _attemptTimeout = timeout;
+  _state = CONN_CONNECTING;
+}
+
+// 异步扫描，结果在loop()中处理
+void Connectivity::startScan(bool roam)
+{
+  if (!roam)
+    WiFi.disconnect(); // 停止正在进行的连接，否则扫描会失败
+  _scans++;
+  _scanStart = millis();
+  if (WiFi.scanNetworks(true) == WIFI_SCAN_FAILED)
+  {
+    if (!roam)
+    {
+      // 扫描不可用，直接连接最近用过的WiFi
+      _candCount = 0;
+      _candIdx = 0;
+      connectTo(_creds[0], NULL, 0, ConnScanTimeout);
+    }
+    return;
+  }
+  if (roam)
+  {
+    _roamScanning = true;
+    _lastRoamScan = _scanStart;
+  }
+  else
+    _state = CONN_SCANNING;
+}
+
+// 在扫描结果中找已保存的WiFi，按RSSI从强到弱插入候选列表
+uint8_t Connectivity::collectScan()
+{
+  _candCount = 0;
+  _candIdx = 0;
+  int16_t n = WiFi.scanComplete();
+  for (int16_t i = 0; i < n; i++)
+  {
+    int cred = findCredential(WiFi.SSID(i).c_str());
+    if (cred < 0)
+      continue;
+    int8_t rssi = WiFi.RSSI(i);
+    int pos = _candCount;
+    while (pos > 0 && _cands[pos - 1].rssi < rssi)
+      pos--;
+    if (pos >= ConnMaxCands)
+      continue;
+    int last = _candCount < ConnMaxCands ? _candCount : ConnMaxCands - 1;
+    for (int k = last; k > pos; k--)
+      _cands[k] = _cands[k - 1];
+    Candidate &c = _cands[pos];
+    memcpy(c.bssid, WiFi.BSSID(i), sizeof(c.bssid));
+    c.channel = WiFi.channel(i);
+    c.cred = cred;
+    c.rssi = rssi;
+    if (_candCount < ConnMaxCands)
+      _candCount++;
+  }
+  WiFi.scanDelete();
+  return _candCount;
+}
+
+// 连上后把当前WiFi移到最前面，AP变化时才写NVS
+void Connectivity::onConnected(uint32_t now)
+{
+  addCredential(WiFi.SSID().c_str(), WiFi.psk().c_str());
+  portENTER_CRITICAL(&_mux);
+  ApCache seen = _seenAp;
+  portEXIT_CRITICAL(&_mux);
+  if (seen.valid && (seen.channel != _ap.channel || memcmp(seen.bssid, _ap.bssid, sizeof(_ap.bssid)) != 0 || !_ap.valid))
+  {
+    _ap = seen;
+    saveAp();
+  }
+  _onlineSince = now;
+  _backoff = ConnBackoffMin;
+  _rssiEma = 0; // 换了AP，重新采样
+  _rssiAt = now - ConnRssiPeriod;
+  _state = CONN_ONLINE;
+}
+
+// 采样RSSI，平均值用1/4权重的指数平均
+void Connectivity::sampleRssi(uint32_t now)
+{
+  if (now - _rssiAt < ConnRssiPeriod)
+    return;
+  _rssiAt = now;
+  int8_t rssi = WiFi.RSSI();
+  if (rssi >= 0)
+    return; // 没有读到
+  _rssi = rssi;
+  if (_rssiMin == 0 || rssi < _rssiMin)
+    _rssiMin = rssi;
+  _rssiEma = _rssiEma == 0 ? rssi * 4 : _rssiEma + rssi - _rssiEma / 4;
+}
+
+void Connectivity::saveAp()
+{
+  _prefs.putBytes("ap", &_ap, sizeof(_ap));
+  Serial.printf("已缓存AP %02X:%02X:%02X:%02X:%02X:%02X 信道%u\n",
+                _ap.bssid[0], _ap.bssid[1], _ap.bssid[2], _ap.bssid[3], _ap.bssid[4], _ap.bssid[5], _ap.channel);
+}
+
+void Connectivity::loop()
+{
+  if (_events == NULL || _credCount == 0)
+    return;
+  uint32_t now = millis();
+  portENTER_CRITICAL(&_mux);
+  bool disc = _discEvents != _seenDisc;
+  _seenDisc = _discEvents;
+  _seenIp = _ipEvents;
+  uint32_t downSince = _downSince;
+  portEXIT_CRITICAL(&_mux);
+
+  switch (_state)
+  {
+  case CONN_SUSPENDED:
+    if ((int32_t)(now - _suspendUntil) >= 0)
+    {
+      _recoverStart = now;
+      connect(true);
+    }
+    break;
+
+  case CONN_ONLINE:
+    if (!_online)
+    {
+      _drops++;
+      _recoverStart = now;
+      _roamScanning = false;
+      Serial.printf("WiFi断开，原因:%u，重新连接\n", _lastReason);
+      connect(true);
+      break;
+    }
+    sampleRssi(now);
+    if (_roamScanning)
+    {
+      int16_t n = WiFi.scanComplete();
+      if (n == WIFI_SCAN_RUNNING && now - _scanStart < ConnScanWait)
+        break;
+      _roamScanning = false;
+      if (n < 0 || collectScan() == 0)
+        break;
+      // 候选已按RSSI排序，第一个不是当前AP的就是最强的
+      const uint8_t *cur = WiFi.BSSID();
+      for (uint8_t i = 0; i < _candCount; i++)
+      {
+        Candidate &c = _cands[i];
+        if (cur != NULL && memcmp(c.bssid, cur, sizeof(c.bssid)) == 0)
+          continue;
+        if (c.rssi * 4 >= _rssiEma + ConnRoamMargin * 4)
+        {
+          Serial.printf("信号弱(平均%ddBm)，切换到%s %02X:%02X:%02X:%02X:%02X:%02X %ddBm\n", _rssiEma / 4, _creds[c.cred].ssid,
+                        c.bssid[0], c.bssid[1], c.bssid[2], c.bssid[3], c.bssid[4], c.bssid[5], c.rssi);
+          // 先断开，避免还没断开旧AP就判断为已连上
+          WiFi.disconnect();
+          portENTER_CRITICAL(&_mux);
+          _online = false;
+          portEXIT_CRITICAL(&_mux);
+          xEventGroupClearBits(_events, ConnOnlineBit);
+          connectTo(_creds[c.cred], c.bssid, c.channel, ConnCandTimeout);
+          _roaming = true;
+        }
+        break;
+      }
+    }
+    else if (_rssiEma != 0 && _rssiEma < ConnRoamRssi * 4 && now - _lastRoamScan >= ConnRoamInterval)
+      startScan(true);
+    break;
+
+  case CONN_SCANNING:
+  {
+    int16_t n = WiFi.scanComplete();
+    if (n == WIFI_SCAN_RUNNING && now - _scanStart < ConnScanWait)
+      break;
+    if (n > 0 && collectScan() > 0)
+    {
+      Candidate &c = _cands[0];
+      connectTo(_creds[c.cred], c.bssid, c.channel, ConnCandTimeout);
+    }
+    else
+    {
+      // 没扫到已保存的WiFi(可能是隐藏网络)，由驱动直接连接最近用过的
+      WiFi.scanDelete();
+      _candCount = 0;
+      _candIdx = 0;
+      connectTo(_creds[0], NULL, 0, ConnScanTimeout);
+    }
+    break;
+  }
+
+  case CONN_CONNECTING:
+    if (_online)
+    {
+      if (_fastAttempt)
+        _fastHits++;
+      if (_roaming)
+      {
+        // 主动切换AP不算断网
+        _roaming = false;
+        _roams++;
+        _lastRoamMs = now - _attemptStart;
+        portENTER_CRITICAL(&_mux);
+        _downSince = 0;
+        portEXIT_CRITICAL(&_mux);
+        Serial.printf("已切换AP，用时%ums\n", _lastRoamMs);
+      }
+      else if (downSince != 0)
+      {
+        // 断网后恢复
+        _lastReconnectMs = now - _recoverStart;
+        _lastDownMs = now - downSince;
+        _sumReconnectMs += _lastReconnectMs;
+        if (_lastReconnectMs > _maxReconnectMs)
+          _maxReconnectMs = _lastReconnectMs;
+        if (_lastDownMs > _maxDownMs)
+          _maxDownMs = _lastDownMs;
+        _recoveries++;
+        portENTER_CRITICAL(&_mux);
+        _downSince = 0;
+        portEXIT_CRITICAL(&_mux);
+        Serial.printf("WiFi已恢复，重连用时%ums，断网%ums\n", _lastReconnectMs, _lastDownMs);
+      }
+      onConnected(now);
+    }
+    else if ((disc && _lastReason != ConnReasonLeave) || now - _attemptStart > _attemptTimeout)
+    {
+      if (_fastAttempt)
+      {
+        // 缓存的AP不可用，扫描后重连
+        _fastMisses++;
+        startScan(false);
+        break;
+      }
+      if (_roaming)
+      {
+        // 新AP连不上，回到缓存的AP
+        _roaming = false;
+        _roamFailures++;
+        _recoverStart = now;
+        portENTER_CRITICAL(&_mux);
+        if (_downSince == 0)
+          _downSince = _attemptStart;
+        portEXIT_CRITICAL(&_mux);
+        connect(true);
+        break;
+      }
+      if (_candIdx + 1 < _candCount)
+      {
+        Candidate &c = _cands[++_candIdx];
+        connectTo(_creds[c.cred], c.bssid, c.channel, ConnCandTimeout);
+        break;
+      }
+      WiFi.disconnect();
+      _retryAt = now + _backoff;
+      _backoff = _backoff * 2 > ConnBackoffMax ? ConnBackoffMax : _backoff * 2;
+      _state = CONN_WAIT_RETRY;
+    }
+    break;
+
+  case CONN_WAIT_RETRY:
+    if ((int32_t)(now - _retryAt) >= 0)
+    {
+      _retries++;
+      connect(false);
+    }
+    break;
+
+  default:
+    if (_online)
+      onConnected(now); // 由配网工具连上的
+    else
+      connect(true);
+    break;
+  }
+}
+
+// 断开指定时间后再重连，用来测量重连时间和数据过期时间
+void Connectivity::simulateOutage(uint32_t ms)
+{
+  if (_state == CONN_ONLINE)
+    _drops++;
+  portENTER_CRITICAL(&_mux);
+  if (_downSince == 0)
+    _downSince = millis();
+  portEXIT_CRITICAL(&_mux);
+  _suspendUntil = millis() + ms;
+  _roaming = false;
+  _roamScanning = false;
+  _state = CONN_SUSPENDED;
+  WiFi.disconnect();
+}
+
+void Connectivity::queueFetch(FetchSource src)
+{
+  _queued |= 1 << src;
+}
+
+// 联网后取出排队的数据源，记下来用于统计恢复后取到新数据的时间
+uint8_t Connectivity::takeQueued()
+{
+  if (!_online)
+    return 0;
+  uint8_t queued = _queued;
+  _queued = 0;
+  _outageQueued |= queued;
+  return queued;
+}
+
+// bytes为0(304未改变)时不更新吞吐量
+void Connectivity::onFetched(FetchSource src, uint32_t prevSuccess, uint32_t bytes, uint32_t ms)
+{
+  if (bytes > 0)
+  {
+    _lastFetchSrc = src;
+    _lastFetchBytes = bytes;
+    _lastFetchMs = ms;
+  }
+  uint8_t bit = 1 << src;
+  if (!(_outageQueued & bit))
+    return;
+  _outageQueued &= ~bit;
+  uint32_t now = millis();
+  _lastRefreshMs[src] = now - _onlineSince;
+  uint32_t stale = prevSuccess ? now - prevSuccess : 0;
+  if (stale > _maxStaleMs[src])
+    _maxStaleMs[src] = stale;
+}
+
+void Connectivity::print(Print &out)
+{
+  out.printf("网络 状态:%s 断线:%u 恢复:%u 缓存AP重连:成功%u/失败%u 最后断开原因:%u\n",
+             stateNames[_state], _drops, _recoveries, _fastHits, _fastMisses, _lastReason);
+  out.printf("  重连用时:最近%ums 平均%ums 最大%ums 断网时长:最近%ums 最大%ums\n",
+             _lastReconnectMs, _recoveries ? _sumReconnectMs / _recoveries : 0, _maxReconnectMs, _lastDownMs, _maxDownMs);
+  out.printf("  AP %s %02X:%02X:%02X:%02X:%02X:%02X 信道%u RSSI:当前%d 平均%d 最低%ddBm\n",
+             _credCount ? _creds[0].ssid : "-", _ap.bssid[0], _ap.bssid[1], _ap.bssid[2], _ap.bssid[3], _ap.bssid[4], _ap.bssid[5],
+             _ap.channel, _rssi, _rssiEma / 4, _rssiMin);
+  out.printf("  连接尝试:%u 退避重试:%u 扫描:%u 漫游:成功%u/失败%u 最近切换用时%ums\n",
+             _attempts, _retries, _scans, _roams, _roamFailures, _lastRoamMs);
+  out.printf("  已保存WiFi(%u):", _credCount);
+  for (uint8_t i = 0; i < _credCount; i++)
+    out.printf(" %s", _creds[i].ssid);
+  out.printf("\n");
+  if (_lastFetchMs > 0)
+    out.printf("  最近下载(%s):%u字节 %ums %.1fKB/s\n", sourceNames[_lastFetchSrc], _lastFetchBytes, _lastFetchMs,
+               _lastFetchBytes / 1.024f / _lastFetchMs);
+  for (int i = 0; i < FETCH_SOURCE_COUNT; i++)
+  {
+    out.printf("  %s 恢复后取到新数据:%ums 被替换时旧数据最大年龄:%us%s\n", sourceNames[i],
+               _lastRefreshMs[i], _maxStaleMs[i] / 1000, (_queued & (1 << i)) ? " (排队中)" : "");
+  }
+}
@@ -0,0 +1,160 @@
+#ifndef _CONNECTIVITY_H_
+#define _CONNECTIVITY_H_
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Preferences.h>
+#include "FetchScheduler.h"
+
+/* *****************************************************************
+ * 网络连接管理：WiFi事件回调只记录状态，重连由任务A周期调用loop()完成。
+ * 连接成功后把AP的BSSID和信道存入NVS，重连时先按缓存的BSSID/信道直接连接，
+ * 跳过全信道扫描，失败再扫描，按RSSI从强到弱依次连接已保存的WiFi，
+ * 都失败后按1s、2s……30s退避重试。
+ * 已保存的WiFi最多ConnMaxCreds个，按最近使用排序，第一个就是缓存AP所属的WiFi。
+ * 在线时每10s采样RSSI，平均值低于ConnRoamRssi时后台扫描，有明显更强的AP就切换。
+ * 断网期间到期的取数排队，重新联网后立即执行。
+ * *****************************************************************/
+#define ConnNamespace "conn"
+#define ConnFastTimeout 3000     // 按缓存BSSID连接的超时
+#define ConnScanTimeout 15000    // 扫描后连接的超时
+#define ConnBackoffMin 1000
+#define ConnBackoffMax 30000
+#define ConnMaxCreds 4           // 最多保存的WiFi数
+#define ConnMaxCands 6           // 扫描结果中保留的候选AP数
+#define ConnCandTimeout 8000     // 按扫描结果连接的超时
+#define ConnScanWait 12000       // 等待扫描结果的超时
+#define ConnRssiPeriod 10000     // 在线时采样RSSI的周期
+#define ConnRoamRssi -75         // RSSI平均值低于它时后台扫描(dBm)
+#define ConnRoamMargin 8         // 新AP至少强这么多才切换(dB)
+#define ConnRoamInterval 60000   // 两次漫游扫描的最小间隔
+
+enum ConnState
+{
+  CONN_IDLE,       // 还没开始连接
+  CONN_SCANNING,   // 正在扫描
+  CONN_CONNECTING, // 正在连接
+  CONN_ONLINE,     // 已获取IP
+  CONN_WAIT_RETRY, // 等待重试
+  CONN_SUSPENDED   // 模拟断网
+};
+
+class Connectivity
+{
+public:
+  Connectivity();
+  bool begin(const char *ssid, const char *psk);
+  bool addCredential(const char *ssid, const char *psk); // 加到最前面，列表满时去掉最久未用的
+  bool removeCredential(const char *ssid);
+  void clearCredentials();
+  uint8_t credentialCount() const { return _credCount; }
+  const char *credentialSsid(uint8_t i) const { return i < _credCount ? _creds[i].ssid : ""; }
+  void loop(); // 在任务A中调用
+  bool isOnline() const { return _online; }
+  bool waitOnline(uint32_t ms); // 等待联网，联网后立即返回true
+
+  void queueFetch(FetchSource src);
+  uint8_t takeQueued(); // 取出排队的数据源，按位表示
+  void onFetched(FetchSource src, uint32_t prevSuccess, uint32_t bytes, uint32_t ms); // 取数成功后调用，统计数据过期时间和吞吐量
+  void simulateOutage(uint32_t ms);
+
+  void print(Print &out);
+
+private:
+  struct ApCache
+  {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t valid;
+  };
+  struct Credential
+  {
+    char ssid[32];
+    char psk[64];
+  };
+  struct Candidate
+  {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t cred; // _creds中的序号
+    int8_t rssi;
+  };
+
+  Preferences _prefs;
+  Credential _creds[ConnMaxCreds];
+  uint8_t _credCount;
+  ApCache _ap;
+  ApCache _seenAp;       // 事件回调中记录的当前AP
+  Candidate _cands[ConnMaxCands]; // 按RSSI从强到弱
+  uint8_t _candCount;
+  uint8_t _candIdx;      // 正在尝试的候选AP
+  EventGroupHandle_t _events;
+  portMUX_TYPE _mux;
+
+  volatile bool _online;
+  ConnState _state;
+  bool _fastAttempt;
+  bool _roaming;         // 正在切换到更强的AP
+  bool _roamScanning;    // 在线时的后台扫描
+  uint32_t _attemptStart;
+  uint32_t _attemptTimeout;
+  uint32_t _scanStart;
+  uint32_t _lastRoamScan;
+  uint32_t _retryAt;
+  uint32_t _backoff;
+  uint32_t _suspendUntil;
+
+  // 由事件回调修改，在_mux内访问
+  uint32_t _discEvents;
+  uint32_t _ipEvents;
+  uint32_t _seenDisc;
+  uint32_t _seenIp;
+  uint8_t _lastReason;
+
+  uint32_t _downSince;     // 断网时间
+  uint32_t _recoverStart;  // 断网后开始重连的时间
+  uint32_t _onlineSince;
+  uint8_t _queued;
+  uint8_t _outageQueued;   // 断网期间排队、恢复后还没取到新数据的数据源
+
+  // 统计
+  uint32_t _drops;
+  uint32_t _recoveries;
+  uint32_t _fastHits;
+  uint32_t _fastMisses;
+  uint32_t _lastReconnectMs;
+  uint32_t _maxReconnectMs;
+  uint32_t _sumReconnectMs;
+  uint32_t _lastDownMs;
+  uint32_t _maxDownMs;
+  uint32_t _maxStaleMs[FETCH_SOURCE_COUNT];   // 恢复后取到新数据时，旧数据的最大年龄
+  uint32_t _lastRefreshMs[FETCH_SOURCE_COUNT]; // 恢复联网到取到新数据的时间
+  uint32_t _attempts;      // 调用WiFi.begin的次数
+  uint32_t _retries;       // 退避后重试的次数
+  uint32_t _scans;
+  uint32_t _roams;
+  uint32_t _roamFailures;
+  uint32_t _lastRoamMs;
+  uint32_t _rssiAt;
+  int8_t _rssi;
+  int8_t _rssiMin;
+  int16_t _rssiEma;        // 乘以4保存，0表示还没有采样
+  uint8_t _lastFetchSrc;
+  uint32_t _lastFetchBytes;
+  uint32_t _lastFetchMs;
+
+  static void onEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+  void connect(bool fast);
+  void connectTo(const Credential &cred, const uint8_t *bssid, uint8_t channel, uint32_t timeout);
+  void startScan(bool roam);
+  uint8_t collectScan();
+  void onConnected(uint32_t now);
+  void sampleRssi(uint32_t now);
+  int findCredential(const char *ssid);
+  void saveCreds();
+  void saveAp();
+};
+
+extern Connectivity conn;
+
+#endif
@@ -0,0 +1,175 @@
+#include "CpuGovernor.h"
+#include "PowerManager.h"
+
+static const uint32_t levelFreq[CPU_LEVEL_COUNT] = {80, 160, 240};
+static const uint32_t policyFreq[CPU_POLICY_COUNT] = {0, 240, 160, 80};
+static const uint32_t freqList[CpuFreqCount] = {80, 160, 240};
+static const char *pathNames[CPU_PATH_COUNT] = {"时钟", "动画", "字幕", "天气", "预警", "取数", "刷新"};
+
+CpuGovernor::CpuGovernor()
+{
+  _lock = NULL;
+  _statsMux = portMUX_INITIALIZER_UNLOCKED;
+  _policy = CPU_POLICY_AUTO;
+  for (int i = 0; i < CPU_LEVEL_COUNT; i++)
+    _holds[i] = 0;
+  _freq = 240;
+  _pmHeld = false;
+  _pmMax = 240;
+  _since = 0;
+  for (int i = 0; i < CpuFreqCount; i++)
+    _stateMs[i] = 0;
+  _switches = 0;
+  memset(_paths, 0, sizeof(_paths));
+}
+
+int CpuGovernor::freqIndex(uint32_t freq)
+{
+  return freq >= 240 ? 2 : (freq >= 160 ? 1 : 0);
+}
+
+void CpuGovernor::begin(uint8_t policy)
+{
+  _lock = xSemaphoreCreateMutex();
+  _policy = policy < CPU_POLICY_COUNT ? policy : CPU_POLICY_AUTO;
+  _since = millis();
+  if (power.mode() != POWER_FULL)
+  {
+    // 电源管理已接管，没有持锁时运行在最低频率
+    _freq = 80;
+    _pmMax = getCpuFrequencyMhz() > 80 ? getCpuFrequencyMhz() : 240;
+  }
+  else
+  {
+    _freq = getCpuFrequencyMhz();
+  }
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  apply(targetFreq());
+  xSemaphoreGive(_lock);
+}
+
+void CpuGovernor::setPolicy(uint8_t policy)
+{
+  if (policy >= CPU_POLICY_COUNT || _lock == NULL)
+    return;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _policy = policy;
+  apply(targetFreq());
+  xSemaphoreGive(_lock);
+}
+
+// 固定频率时忽略等级，自动时取持有中的最高等级
+uint32_t CpuGovernor::targetFreq()
+{
+  if (_policy != CPU_POLICY_AUTO)
+    return policyFreq[_policy];
+  for (int i = CPU_LEVEL_COUNT - 1; i > 0; i--)
+  {
+    if (_holds[i] > 0)
+      return levelFreq[i];
+  }
+  return levelFreq[CPU_LEVEL_IDLE];
+}
+
+void CpuGovernor::request(CpuLevel level)
+{
+  if (_lock == NULL)
+    return;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _holds[level]++;
+  apply(targetFreq());
+  xSemaphoreGive(_lock);
+}
+
+void CpuGovernor::release(CpuLevel level)
+{
+  if (_lock == NULL)
+    return;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_holds[level] > 0)
+    _holds[level]--;
+  apply(targetFreq());
+  xSemaphoreGive(_lock);
+}
+
+// 在_lock内调用
+void CpuGovernor::apply(uint32_t freq)
+{
+  if (freq == _freq)
+    return;
+  uint32_t now = millis();
+  _stateMs[freqIndex(_freq)] += now - _since;
+  _since = now;
+  _switches++;
+
+  if (power.mode() != POWER_FULL)
+  {
+    if (freq > 80)
+    {
+      if (freq != _pmMax && power.setMaxFreq(freq))
+        _pmMax = freq;
+      if (!_pmHeld)
+      {
+        power.acquire();
+        _pmHeld = true;
+      }
+    }
+    else if (_pmHeld)
+    {
+      power.release();
+      _pmHeld = false;
+    }
+  }
+  else
+  {
+    setCpuFrequencyMhz(freq);
+  }
+  _freq = freq;
+}
+
+void CpuGovernor::observe(CpuPath path, uint32_t freq, uint32_t us)
+{
+  if (path >= CPU_PATH_COUNT)
+    return;
+  portENTER_CRITICAL(&_statsMux);
+  PathStats &s = _paths[path][freqIndex(freq)];
+  s.count++;
+  s.sumUs += us;
+  if (us > s.maxUs)
+    s.maxUs = us;
+  portEXIT_CRITICAL(&_statsMux);
+}
+
+void CpuGovernor::print(Print &out)
+{
+  static const char *policyNames[CPU_POLICY_COUNT] = {"自动", "固定240MHz", "固定160MHz", "固定80MHz"};
+  uint32_t stateMs[CpuFreqCount];
+  for (int i = 0; i < CpuFreqCount; i++)
+    stateMs[i] = _stateMs[i];
+  stateMs[freqIndex(_freq)] += millis() - _since;
+  uint32_t total = stateMs[0] + stateMs[1] + stateMs[2];
+  if (total == 0)
+    total = 1;
+  out.printf("CPU频率 策略:%s 切换:%u次 80MHz:%us(%.1f%%) 160MHz:%us(%.1f%%) 240MHz:%us(%.1f%%)\n",
+             policyNames[_policy], _switches,
+             stateMs[0] / 1000, stateMs[0] * 100.0f / total, stateMs[1] / 1000, stateMs[1] * 100.0f / total,
+             stateMs[2] / 1000, stateMs[2] * 100.0f / total);
+
+  PathStats paths[CPU_PATH_COUNT][CpuFreqCount];
+  portENTER_CRITICAL(&_statsMux);
+  memcpy(paths, _paths, sizeof(paths));
+  portEXIT_CRITICAL(&_statsMux);
+  for (int p = 0; p < CPU_PATH_COUNT; p++)
+  {
+    out.printf("  %s耗时(平均/最大us)", pathNames[p]);
+    for (int f = 0; f < CpuFreqCount; f++)
+    {
+      const PathStats &s = paths[p][f];
+      if (s.count > 0)
+        out.printf(" %uMHz:%u/%u(%u次)", freqList[f], (unsigned)(s.sumUs / s.count), s.maxUs, s.count);
+      else
+        out.printf(" %uMHz:-", freqList[f]);
+    }
+    out.println();
+  }
+}
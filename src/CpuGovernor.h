@@ -0,0 +1,110 @@
+#ifndef _CPU_GOVERNOR_H_
+#define _CPU_GOVERNOR_H_
+
+#include <Arduino.h>
+
+/* *****************************************************************
+ * CPU频率调节：各段代码用CpuScope声明需要的等级，取所有持有中的最高等级。
+ * 只走时为80MHz，普通绘图160MHz，TLS握手、JPEG连续解码、预警动画240MHz。
+ * 开启esp_pm时通过修改最高频率和频率锁实现，否则直接setCpuFrequencyMhz，
+ * 80/160/240MHz下APB都是80MHz，SPI、串口和定时器不受影响。
+ * 同时统计每个频率的停留时间和各热点路径在不同频率下的耗时。
+ * *****************************************************************/
+enum CpuLevel
+{
+  CPU_LEVEL_IDLE,   // 只走时
+  CPU_LEVEL_NORMAL, // 普通绘图
+  CPU_LEVEL_BOOST,  // TLS、JPEG连续解码、预警动画
+  CPU_LEVEL_COUNT
+};
+
+enum CpuPolicy
+{
+  CPU_POLICY_AUTO, // 按负载调节
+  CPU_POLICY_240,  // 固定频率
+  CPU_POLICY_160,
+  CPU_POLICY_80,
+  CPU_POLICY_COUNT
+};
+
+enum CpuPath
+{
+  CPU_PATH_CLOCK,   // 时钟数字
+  CPU_PATH_ANIM,    // 太空人动画
+  CPU_PATH_SCROLL,  // 滚动字幕
+  CPU_PATH_WEATHER, // 天气图标和数据
+  CPU_PATH_WARN,    // 预警画面
+  CPU_PATH_FETCH,   // 联网取数
+  CPU_PATH_REFRESH, // 整屏刷新时钟
+  CPU_PATH_COUNT
+};
+
+#define CpuFreqCount 3 // 80/160/240MHz
+
+class CpuGovernor
+{
+public:
+  CpuGovernor();
+  void begin(uint8_t policy); // 在电源管理初始化之后调用
+  void setPolicy(uint8_t policy);
+  uint8_t policy() const { return _policy; }
+  uint32_t freqMhz() const { return _freq; }
+
+  void request(CpuLevel level);
+  void release(CpuLevel level);
+  void observe(CpuPath path, uint32_t freq, uint32_t us);
+
+  void print(Print &out);
+
+private:
+  struct PathStats
+  {
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t sumUs;
+  };
+
+  SemaphoreHandle_t _lock;
+  portMUX_TYPE _statsMux;
+  uint8_t _policy;
+  uint16_t _holds[CPU_LEVEL_COUNT];
+  uint32_t _freq;
+  bool _pmHeld;     // 是否持有esp_pm最高频率锁
+  uint32_t _pmMax;  // esp_pm当前最高频率
+  uint32_t _since;  // 进入当前频率的时间(ms)
+  uint32_t _stateMs[CpuFreqCount];
+  uint32_t _switches;
+  PathStats _paths[CPU_PATH_COUNT][CpuFreqCount];
+
+  uint32_t targetFreq();
+  void apply(uint32_t freq);
+  static int freqIndex(uint32_t freq);
+};
+
+extern CpuGovernor governor;
+
+// 作用域内至少以指定等级运行，结束时按实际频率记录耗时
+class CpuScope
+{
+public:
+  CpuScope(CpuLevel level, CpuPath path) : _level(level), _path(path)
+  {
+    governor.request(level);
+    _freq = governor.freqMhz();
+    _start = micros();
+  }
+  ~CpuScope()
+  {
+    uint32_t us = micros() - _start;
+    governor.release(_level);
+    governor.observe(_path, _freq, us);
+  }
+
+private:
+  CpuLevel _level;
+  CpuPath _path;
+  uint32_t _freq;
+  uint32_t _start;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "DataCache.h"
+#include <FS.h>
+#include <LittleFS.h>
+#include <rom/crc.h>
+
+// 保存一条记录，先写.tmp再改名覆盖原文件(LittleFS的改名是原子的，目标存在时直接替换)，
+// 任何时候断电都至少留下新旧两份中的一份；改名失败时保留原来的缓存
+bool DataCache::save(const char *path, const void *data, uint16_t len, uint32_t timestamp)
+{
+  CacheHeader header;
+  header.magic = CacheMagic;
+  header.version = CacheVersion;
+  header.len = len;
+  header.timestamp = timestamp;
+  header.crc = crc32_le(0, (const uint8_t *)data, len);
+
+  String tmpPath = String(path) + ".tmp";
+  File file = LittleFS.open(tmpPath, FILE_WRITE);
+  if (!file)
+  {
+    Serial.printf("缓存写入失败:%s\n", path);
+    return false;
+  }
+  bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            file.write((const uint8_t *)data, len) == len;
+  file.close();
+
+  if (ok)
+    ok = LittleFS.rename(tmpPath, path);
+  if (!ok)
+  {
+    LittleFS.remove(tmpPath);
+    Serial.printf("缓存写入失败:%s\n", path);
+  }
+  return ok;
+}
+
+// 读取一条记录，文件不存在、版本或长度不符、CRC错误都返回false
+bool DataCache::load(const char *path, void *data, uint16_t len, uint32_t *timestamp)
+{
+  if (!LittleFS.exists(path))
+    return false;
+
+  File file = LittleFS.open(path, FILE_READ);
+  if (!file)
+    return false;
+
+  CacheHeader header;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == CacheMagic && header.version == CacheVersion && header.len == len &&
+            file.read((uint8_t *)data, len) == len &&
+            crc32_le(0, (const uint8_t *)data, len) == header.crc;
+  file.close();
+
+  if (!ok)
+  {
+    Serial.printf("缓存无效:%s\n", path);
+    return false;
+  }
+  if (timestamp != NULL)
+    *timestamp = header.timestamp;
+  return true;
+}
+
+// 复制字符串到定长数组，超长时在UTF-8字符边界截断
+void DataCache::copyText(char *dst, size_t size, const String &src)
+{
+  size_t n = src.length();
+  if (n >= size)
+  {
+    n = size - 1;
+    while (n > 0 && (src[n] & 0xC0) == 0x80) // 不能从多字节字符中间截断
+      n--;
+  }
+  memcpy(dst, src.c_str(), n);
+  memset(dst + n, 0, size - n);
+}
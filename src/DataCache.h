@@ -0,0 +1,75 @@
+#ifndef _DATA_CACHE_H_
+#define _DATA_CACHE_H_
+
+#include <Arduino.h>
+
+/* *****************************************************************
+ * 最后一次取到的有效数据保存在LittleFS中，开机时先用缓存显示，再在后台更新。
+ * 文件格式：CacheHeader + 定长记录，记录用CRC32校验，写入时先写临时文件再改名。
+ * *****************************************************************/
+#define CacheMagic 0x43444453UL // "SDDC"
+#define CacheVersion 1
+#define CacheTextLen 48         // 每行文字最大字节数(UTF-8，约16个汉字)
+#define CacheCalLines 16        // 农历滚动信息最多行数
+
+#define WeatherCacheFile "/cache_weather.bin"
+#define NongliCacheFile "/cache_nongli.bin"
+#define WarnCacheFile "/cache_warn.bin"
+#define AlmanacCacheFile "/cache_almanac.bin"
+
+struct CacheHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t len;       // 记录长度
+  uint32_t timestamp; // 保存时的时间(epoch)
+  uint32_t crc;       // 记录的CRC32
+};
+
+// 天气实况
+struct WeatherRecord
+{
+  int16_t temp;                     // 温度
+  int16_t humi;                     // 湿度
+  int16_t aqi;                      // 空气质量指数
+  int16_t icon;                     // 天气图标代码
+  char city[CacheTextLen];          // 城市名称
+  char scroll[6][CacheTextLen];     // 滚动字幕
+};
+
+// 农历、宜忌滚动信息
+struct CalendarRecord
+{
+  uint8_t count;
+  uint8_t color[CacheCalLines];
+  char title[CacheCalLines][CacheTextLen];
+};
+
+// 当天的宜忌和假日，农历在本地计算
+struct AlmanacRecord
+{
+  int32_t date;                 // 对应的日期，如20240210
+  char typeDes[CacheTextLen];   // 工作日、休息日或节日名称
+  char suit[384];               // 宜，各项以"."分隔
+  char avoid[384];              // 忌
+};
+
+// 天气预警
+struct WarnRecord
+{
+  int16_t type;
+  char status[12];
+  char color[12];
+  char title[128];
+  char text[768];
+};
+
+class DataCache
+{
+public:
+  static bool save(const char *path, const void *data, uint16_t len, uint32_t timestamp);
+  static bool load(const char *path, void *data, uint16_t len, uint32_t *timestamp = NULL);
+  static void copyText(char *dst, size_t size, const String &src);
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "DhtReader.h"
+
+void DhtFilter::reset()
+{
+  memset(_win, 0, sizeof(_win));
+  _count = 0;
+  _pos = 0;
+  _ema = 0;
+}
+
+int16_t DhtFilter::add(int16_t value)
+{
+  _win[_pos] = value;
+  _pos = (_pos + 1) % 3;
+  if (_count < 3)
+    _count++;
+
+  int16_t median = value;
+  if (_count == 3)
+  {
+    int16_t a = _win[0], b = _win[1], c = _win[2];
+    median = max(min(a, b), min(max(a, b), c));
+  }
+  if (_count == 1)
+    _ema = (int32_t)median << 4; // 第一个值直接作为初值
+  else
+    _ema += (((int32_t)median << 4) - _ema) >> DhtEmaShift;
+  return this->value();
+}
+
+DhtReader::DhtReader(uint8_t pin, uint8_t type)
+{
+  _pin = pin;
+  _type = type;
+  _rb = NULL;
+  _ready = false;
+  _valid = false;
+  _rawTemp = 0;
+  _rawHumi = 0;
+  _reads = 0;
+  _timeouts = 0;
+  _badFrames = 0;
+  _checksumErrors = 0;
+  _busyUs = 0;
+  _busyUsMax = 0;
+  _readMs = 0;
+}
+
+// RMT按1us计时接收，电平DhtIdleUs不变时结束一帧
+bool DhtReader::begin()
+{
+  rmt_config_t cfg = RMT_DEFAULT_CONFIG_RX((gpio_num_t)_pin, DhtRmtChannel);
+  cfg.clk_div = 80;
+  cfg.rx_config.filter_en = true;
+  cfg.rx_config.filter_ticks_thresh = 100; // 按APB时钟计，滤掉1.25us以下的毛刺
+  cfg.rx_config.idle_threshold = DhtIdleUs;
+  if (rmt_config(&cfg) != ESP_OK || rmt_driver_install(DhtRmtChannel, 512, 0) != ESP_OK)
+  {
+    Serial.println("DHT RMT初始化失败");
+    return false;
+  }
+  rmt_get_ringbuf_handle(DhtRmtChannel, &_rb);
+  gpio_set_pull_mode((gpio_num_t)_pin, GPIO_PULLUP_ONLY);
+  _ready = _rb != NULL;
+  return _ready;
+}
+
+bool DhtReader::read()
+{
+  if (!_ready)
+    return false;
+  gpio_num_t pin = (gpio_num_t)_pin;
+  uint32_t start = millis();
+
+  // 起始信号：开漏输出拉低，等待时让出CPU
+  uint32_t t0 = micros();
+  gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+  gpio_set_level(pin, 0);
+  uint32_t busy = micros() - t0;
+  vTaskDelay(pdMS_TO_TICKS(DhtStartMs));
+
+  // 先开始接收再释放总线，传感器20-40us后应答
+  t0 = micros();
+  size_t size = 0;
+  void *old;
+  while ((old = xRingbufferReceive(_rb, &size, 0)) != NULL)
+    vRingbufferReturnItem(_rb, old);
+  rmt_rx_start(DhtRmtChannel, true);
+  gpio_set_level(pin, 1);
+  busy += micros() - t0;
+
+  rmt_item32_t *items = (rmt_item32_t *)xRingbufferReceive(_rb, &size, pdMS_TO_TICKS(DhtTimeoutMs));
+  t0 = micros();
+  rmt_rx_stop(DhtRmtChannel);
+  gpio_set_direction(pin, GPIO_MODE_INPUT);
+  _reads++;
+
+  bool ok = false;
+  uint8_t data[5];
+  if (items == NULL)
+    _timeouts++;
+  else
+  {
+    ok = decode(items, size / sizeof(rmt_item32_t), data);
+    vRingbufferReturnItem(_rb, items);
+  }
+  if (ok && (uint8_t)(data[0] + data[1] + data[2] + data[3]) != data[4])
+  {
+    _checksumErrors++;
+    ok = false;
+  }
+  if (ok)
+  {
+    int16_t t10, h10;
+    if (_type == 11)
+    {
+      h10 = data[0] * 10 + data[1];
+      t10 = data[2] * 10 + (data[3] & 0x7F);
+      if (data[3] & 0x80)
+        t10 = -t10;
+    }
+    else
+    {
+      h10 = (data[0] << 8) | data[1];
+      t10 = ((data[2] & 0x7F) << 8) | data[3];
+      if (data[2] & 0x80)
+        t10 = -t10;
+    }
+    addSample(t10, h10);
+  }
+  busy += micros() - t0;
+  _busyUs = busy;
+  if (busy > _busyUsMax)
+    _busyUsMax = busy;
+  _readMs = millis() - start;
+  return ok;
+}
+
+void DhtReader::addSample(int16_t temp10, int16_t humi10)
+{
+  _rawTemp = temp10;
+  _rawHumi = humi10;
+  _temp.add(temp10);
+  _humi.add(humi10);
+  _valid = true;
+}
+
+// 只看高电平：最后40个高电平是数据位，之前的是释放总线和应答
+bool DhtReader::decode(const rmt_item32_t *items, size_t count, uint8_t *data)
+{
+  uint16_t highs[48];
+  uint8_t n = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    uint16_t durations[2] = {(uint16_t)items[i].duration0, (uint16_t)items[i].duration1};
+    uint8_t levels[2] = {(uint8_t)items[i].level0, (uint8_t)items[i].level1};
+    for (int k = 0; k < 2; k++)
+    {
+      if (durations[k] == 0)
+        break; // 帧结束
+      if (levels[k] == 1)
+      {
+        if (n == sizeof(highs) / sizeof(highs[0]))
+        {
+          _badFrames++;
+          return false;
+        }
+        highs[n++] = durations[k];
+      }
+    }
+  }
+  if (n < 40)
+  {
+    _badFrames++;
+    return false;
+  }
+  memset(data, 0, 5);
+  const uint16_t *bits = highs + n - 40;
+  for (uint8_t i = 0; i < 40; i++)
+  {
+    if (bits[i] > DhtBitOneUs)
+      data[i / 8] |= 0x80 >> (i % 8);
+  }
+  return true;
+}
+
+void DhtReader::print(Print &out)
+{
+  out.printf("DHT(RMT) 读取:%u次 超时:%u 帧错误:%u 校验错误:%u 上次用时:%ums CPU占用:%uus(最大%uus)\n",
+             _reads, _timeouts, _badFrames, _checksumErrors, _readMs, _busyUs, _busyUsMax);
+  if (_valid)
+    out.printf("  原始:%.1f℃ %.1f%% 滤波后:%.1f℃ %.1f%%\n", _rawTemp / 10.0f, _rawHumi / 10.0f, temperature(), humidity());
+}
@@ -0,0 +1,75 @@
+#ifndef _DHT_READER_H_
+#define _DHT_READER_H_
+
+#include <Arduino.h>
+#include <driver/rmt.h>
+#include <freertos/ringbuf.h>
+
+/* *****************************************************************
+ * DHT11/DHT22读取：起始信号用GPIO拉低后vTaskDelay等待，
+ * 应答和40位数据由RMT接收并记录每段电平的时长，CPU只在收完后解码，
+ * 全程不关中断，不影响同一个核上的SPI和时钟。
+ * 一次读取同时得到温度和湿度，经过3点中值和EMA滤波。
+ * *****************************************************************/
+#define DhtRmtChannel RMT_CHANNEL_4
+#define DhtStartMs 20     // 起始信号拉低时间，DHT11至少18ms
+#define DhtIdleUs 150     // 电平超过这个时间不变就是一帧结束，帧内最长80us
+#define DhtTimeoutMs 10   // 一帧约4-5ms
+#define DhtBitOneUs 40    // 数据位高电平长于这个时间为1(0约27us，1约70us)
+#define DhtEmaShift 2     // EMA系数1/4
+
+// 3点中值去掉单次跳变，再做EMA，数值为0.1单位
+class DhtFilter
+{
+public:
+  DhtFilter() { reset(); }
+  void reset();
+  int16_t add(int16_t value);
+  int16_t value() const { return (int16_t)((_ema + 8) >> 4); }
+
+private:
+  int16_t _win[3];
+  uint8_t _count;
+  uint8_t _pos;
+  int32_t _ema; // 放大16倍
+};
+
+class DhtReader
+{
+public:
+  DhtReader(uint8_t pin, uint8_t type);
+  bool begin();
+  bool read(); // 读一次，成功时更新滤波后的温湿度
+  void addSample(int16_t temp10, int16_t humi10);
+  bool valid() const { return _valid; }
+  float temperature() const { return _temp.value() / 10.0f; }
+  float humidity() const { return _humi.value() / 10.0f; }
+  int16_t rawTemp() const { return _rawTemp; }
+  int16_t rawHumi() const { return _rawHumi; }
+
+  void print(Print &out);
+
+private:
+  uint8_t _pin;
+  uint8_t _type;
+  RingbufHandle_t _rb;
+  bool _ready;
+  bool _valid;
+  DhtFilter _temp;
+  DhtFilter _humi;
+  int16_t _rawTemp;
+  int16_t _rawHumi;
+
+  // 统计
+  uint32_t _reads;
+  uint32_t _timeouts;
+  uint32_t _badFrames;   // 边沿数不对
+  uint32_t _checksumErrors;
+  uint32_t _busyUs;      // 上次读取CPU实际工作的时间(不含等待)
+  uint32_t _busyUsMax;
+  uint32_t _readMs;      // 上次读取总时间
+
+  bool decode(const rmt_item32_t *items, size_t count, uint8_t *data);
+};
+
+#endif
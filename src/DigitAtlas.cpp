@@ -0,0 +1,155 @@
+#include "DigitAtlas.h"
+
+int DigitAtlas::index(char c)
+{
+  const char *p = strchr(DigitAtlasChars, c);
+  return (p && c) ? p - DigitAtlasChars : -1;
+}
+
+uint8_t DigitAtlas::width(char c) const
+{
+  int i = index(c);
+  return i < 0 ? 0 : _w[i];
+}
+
+// 先量出每个字形的宽度，再按宽度依次排开画进一个sprite
+bool DigitAtlas::build(const uint8_t *font, uint16_t fg, uint16_t bg, uint8_t height, int16_t midY, const char *unit, uint8_t unitFont)
+{
+  if (_h)
+    _spr.deleteSprite();
+  _h = 0;
+  _width = 0;
+  _spr.setColorDepth(8);
+  _unitW = unitFont ? _spr.textWidth(unit, unitFont) : 0; // 加载平滑字库后只能量它的宽度
+  _spr.loadFont(font);
+  uint16_t x = 0;
+  for (int i = 0; i < DigitAtlasCount; i++)
+  {
+    char s[2] = {DigitAtlasChars[i], 0};
+    _x[i] = x;
+    _w[i] = _spr.textWidth(s);
+    x += _w[i];
+  }
+  _unitX = x;
+  if (!unitFont)
+    _unitW = _spr.textWidth(unit);
+  x += _unitW;
+
+  if (!_spr.createSprite(x, height))
+  {
+    _spr.unloadFont();
+    return false;
+  }
+  _spr.fillSprite(bg);
+  _spr.setTextDatum(ML_DATUM);
+  _spr.setTextColor(fg, bg);
+  for (int i = 0; i < DigitAtlasCount; i++)
+  {
+    char s[2] = {DigitAtlasChars[i], 0};
+    _spr.drawString(s, _x[i], midY);
+  }
+  if (unitFont)
+  {
+    _spr.unloadFont();
+    _spr.drawString(unit, _unitX, midY, unitFont);
+  }
+  else
+  {
+    _spr.drawString(unit, _unitX, midY);
+    _spr.unloadFont();
+  }
+  _fg = fg;
+  _bg = bg;
+  _h = height;
+  _width = x;
+  _builds++;
+  return true;
+}
+
+// 到屏幕时推送窗口，到sprite时逐点画
+void DigitAtlas::copy(TFT_eSPI &dst, int32_t x, int32_t y, uint16_t sx, uint8_t w)
+{
+  if (&dst == _tft)
+  {
+    _spr.pushSprite(x, y, sx, 0, w, _h);
+    return;
+  }
+  for (uint8_t j = 0; j < _h; j++)
+    for (uint8_t i = 0; i < w; i++)
+      dst.drawPixel(x + i, y + j, _spr.readPixel(sx + i, j));
+}
+
+uint32_t DigitAtlas::push(TFT_eSPI &dst, char c, int32_t x, int32_t y)
+{
+  return push(dst, c, x, y, INT32_MIN, INT32_MAX);
+}
+
+uint32_t DigitAtlas::push(TFT_eSPI &dst, char c, int32_t x, int32_t y, int32_t clipLeft, int32_t clipRight)
+{
+  int i = index(c);
+  if (i < 0 || !_h || !_w[i])
+    return 0;
+  int32_t left = x < clipLeft ? clipLeft : x;
+  int32_t right = x + _w[i] > clipRight ? clipRight : x + _w[i];
+  if (right <= left)
+    return 0;
+  copy(dst, left, y, _x[i] + (left - x), right - left);
+  return (uint32_t)(right - left) * _h;
+}
+
+uint32_t DigitAtlas::pushUnit(TFT_eSPI &dst, int32_t x, int32_t y)
+{
+  if (!_h || !_unitW)
+    return 0;
+  copy(dst, x, y, _unitX, _unitW);
+  return (uint32_t)_unitW * _h;
+}
+
+void DigitField::invalidate()
+{
+  _atlas = NULL;
+  _atlasBuild = 0;
+  _text[0] = 0;
+  _drawnLeft = _left; // 不知道屏幕上原来有什么，整个字段都算画过
+}
+
+// 右对齐排好新字符串；同一位置上字符和颜色都没变的不推送
+uint32_t DigitField::draw(TFT_eSPI &tft, DigitAtlas &atlas, const char *text)
+{
+  if (!atlas.ready())
+    return 0;
+  bool same = _atlas == &atlas && _atlasBuild == atlas.builds();
+  uint8_t len = strnlen(text, DigitFieldMax);
+  uint8_t oldLen = strlen(_text);
+  int16_t pos[DigitFieldMax];
+  int16_t x = _right;
+  for (int i = len - 1; i >= 0; i--)
+  {
+    x -= atlas.width(text[i]);
+    pos[i] = x;
+  }
+  int16_t left = x < _left ? _left : x;
+
+  uint32_t pixels = 0;
+  if (_drawnLeft < left)
+  {
+    tft.fillRect(_drawnLeft, _y, left - _drawnLeft, atlas.height(), atlas.bg());
+    pixels += (uint32_t)(left - _drawnLeft) * atlas.height();
+  }
+  for (uint8_t i = 0; i < len; i++)
+  {
+    int k = (int)i - len + oldLen; // 右对齐，从右边数同一位
+    if (same && k >= 0 && _text[k] == text[i] && _pos[k] == pos[i])
+      continue;
+    pixels += atlas.push(tft, text[i], pos[i], _y, _left, _right);
+    _glyphs++;
+  }
+
+  memcpy(_text, text, len);
+  _text[len] = 0;
+  memcpy(_pos, pos, sizeof(pos[0]) * len);
+  _drawnLeft = left;
+  _atlas = &atlas;
+  _atlasBuild = atlas.builds();
+  return pixels;
+}
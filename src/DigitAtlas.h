@@ -0,0 +1,70 @@
+#ifndef _DIGIT_ATLAS_H_
+#define _DIGIT_ATLAS_H_
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+/* *****************************************************************
+ * 数字字形缓存：加载一次平滑字库，把"0123456789.-"和单位画进常驻sprite，
+ * 之后显示数值只从里面按字符推送窗口，不再加载字库、不再画字。
+ * DigitField记住上次显示的字符和位置(右对齐)，只重推变化的字符，超出字段的部分裁掉。
+ * 目标不是屏幕而是sprite(整帧离屏绘制)时逐点复制。
+ * *****************************************************************/
+#define DigitAtlasChars "0123456789.-"
+#define DigitAtlasCount 12
+#define DigitFieldMax 6 // 一个字段最多的字符数
+
+class DigitAtlas
+{
+public:
+  DigitAtlas(TFT_eSPI *tft) : _tft(tft), _spr(tft), _fg(0), _bg(0), _h(0), _width(0), _unitX(0), _unitW(0), _builds(0) { memset(_w, 0, sizeof(_w)); }
+  // 数字用平滑字库画，单位unitFont为0时也用它，否则用内置字体；字形垂直居中于midY
+  bool build(const uint8_t *font, uint16_t fg, uint16_t bg, uint8_t height, int16_t midY, const char *unit, uint8_t unitFont = 0);
+  bool ready() const { return _h != 0; }
+  uint16_t fg() const { return _fg; }
+  uint16_t bg() const { return _bg; }
+  uint8_t height() const { return _h; }
+  uint8_t width(char c) const;
+  uint8_t unitWidth() const { return _unitW; }
+  uint32_t builds() const { return _builds; }
+  uint32_t bytes() const { return (uint32_t)_width * _h; }
+  uint32_t push(TFT_eSPI &dst, char c, int32_t x, int32_t y); // 返回推送的像素数
+  uint32_t push(TFT_eSPI &dst, char c, int32_t x, int32_t y, int32_t clipLeft, int32_t clipRight); // 只推[clipLeft,clipRight)
+  uint32_t pushUnit(TFT_eSPI &dst, int32_t x, int32_t y);
+
+private:
+  TFT_eSPI *_tft;
+  TFT_eSprite _spr;
+  uint16_t _fg, _bg;
+  uint8_t _h;
+  uint16_t _width;
+  uint16_t _x[DigitAtlasCount];
+  uint8_t _w[DigitAtlasCount];
+  uint16_t _unitX;
+  uint8_t _unitW;
+  uint32_t _builds;
+
+  static int index(char c);
+  void copy(TFT_eSPI &dst, int32_t x, int32_t y, uint16_t sx, uint8_t w);
+};
+
+class DigitField
+{
+public:
+  DigitField(int16_t left, int16_t right, int16_t y) : _left(left), _right(right), _y(y), _glyphs(0) { invalidate(); }
+  void place(int16_t left, int16_t right, int16_t y) { _left = left; _right = right; _y = y; invalidate(); }
+  void invalidate(); // 屏幕清过或换了颜色，下次全部重推
+  uint32_t draw(TFT_eSPI &tft, DigitAtlas &atlas, const char *text); // 返回推送的像素数
+  uint32_t glyphs() const { return _glyphs; }
+
+private:
+  int16_t _left, _right, _y;
+  const DigitAtlas *_atlas;
+  uint32_t _atlasBuild;
+  char _text[DigitFieldMax + 1];
+  int16_t _pos[DigitFieldMax];
+  int16_t _drawnLeft; // 上次画到的最左边，变窄时清掉多出来的部分
+  uint32_t _glyphs;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "FetchScheduler.h"
+
+FetchScheduler::FetchScheduler()
+{
+  for (int i = 0; i < FETCH_SOURCE_COUNT; i++)
+  {
+    _slots[i].interval = 20 * 60 * 1000;
+    _slots[i].nextDue = 0;
+    _slots[i].lastSuccess = 0;
+    _slots[i].failStreak = 0;
+  }
+  _slots[FETCH_CALENDAR].interval = 24 * 60 * 60 * 1000; // 农历在本地计算，宜忌每天取一次，日期变化时另行安排
+}
+
+// 设置正常更新间隔，间隔缩短时立即按新间隔重新排期
+void FetchScheduler::setInterval(FetchSource src, uint32_t intervalMs)
+{
+  Slot &s = _slots[src];
+  if (s.interval == intervalMs)
+    return;
+  s.interval = intervalMs;
+  uint32_t now = millis();
+  if (s.failStreak == 0 && (int32_t)(s.nextDue - (now + intervalMs)) > 0)
+    s.nextDue = now + intervalMs;
+}
+
+// 预警生效期间预警源使用更短的间隔
+void FetchScheduler::setWarningActive(bool active)
+{
+  if (active && !_warnActive)
+  {
+    uint32_t now = millis();
+    if ((int32_t)(_slots[FETCH_WARNING].nextDue - (now + WarnActiveInterval)) > 0)
+      _slots[FETCH_WARNING].nextDue = now + WarnActiveInterval;
+  }
+  _warnActive = active;
+}
+
+// 立即安排一次取数，例如修改城市代码后
+void FetchScheduler::markDue(FetchSource src)
+{
+  _slots[src].nextDue = millis();
+}
+
+bool FetchScheduler::isDue(FetchSource src, uint32_t now)
+{
+  return (int32_t)(now - _slots[src].nextDue) >= 0;
+}
+
+void FetchScheduler::onSuccess(FetchSource src, uint32_t now)
+{
+  Slot &s = _slots[src];
+  s.failStreak = 0;
+  s.lastSuccess = now;
+  // 加少量抖动，避免多台设备同时请求服务器
+  s.nextDue = now + jitter(effectiveInterval(src), 5);
+}
+
+// 失败后退避：30s、60s、120s……最长不超过正常间隔
+void FetchScheduler::onFailure(FetchSource src, uint32_t now)
+{
+  Slot &s = _slots[src];
+  if (s.failStreak < 255)
+    s.failStreak++;
+  uint8_t shift = s.failStreak > 16 ? 16 : s.failStreak - 1;
+  uint32_t backoff = BaseBackoff << shift;
+  uint32_t interval = effectiveInterval(src);
+  if (backoff > interval)
+    backoff = interval;
+  s.nextDue = now + jitter(backoff, 20);
+}
+
+// 距下次到期还有多少毫秒，已到期返回0
+uint32_t FetchScheduler::nextDueIn(FetchSource src, uint32_t now)
+{
+  int32_t left = (int32_t)(_slots[src].nextDue - now);
+  return left > 0 ? left : 0;
+}
+
+uint8_t FetchScheduler::failStreak(FetchSource src)
+{
+  return _slots[src].failStreak;
+}
+
+uint32_t FetchScheduler::lastSuccess(FetchSource src)
+{
+  return _slots[src].lastSuccess;
+}
+
+const char *FetchScheduler::name(FetchSource src)
+{
+  switch (src)
+  {
+  case FETCH_WEATHER:
+    return "天气";
+  case FETCH_WARNING:
+    return "预警";
+  case FETCH_CALENDAR:
+    return "农历";
+  default:
+    return "未知";
+  }
+}
+
+uint32_t FetchScheduler::effectiveInterval(FetchSource src)
+{
+  uint32_t interval = _slots[src].interval;
+  if (src == FETCH_WARNING && _warnActive && interval > WarnActiveInterval)
+    interval = WarnActiveInterval;
+  return interval;
+}
+
+// 在base基础上加减percent%的随机抖动
+uint32_t FetchScheduler::jitter(uint32_t base, uint8_t percent)
+{
+  uint32_t span = base / 100 * percent;
+  if (span == 0)
+    return base;
+  return base - span + esp_random() % (2 * span + 1);
+}
@@ -0,0 +1,53 @@
+#ifndef _FETCH_SCHEDULER_H_
+#define _FETCH_SCHEDULER_H_
+
+#include <Arduino.h>
+
+// 需要定时从网络获取的数据源
+enum FetchSource
+{
+  FETCH_WEATHER = 0, // 天气
+  FETCH_WARNING,     // 预警
+  FETCH_CALENDAR,    // 农历
+  FETCH_SOURCE_COUNT
+};
+
+/* *****************************************************************
+ * 取数调度器：每个数据源独立的更新间隔，失败后按指数退避并加随机抖动重试，
+ * 预警生效期间加快预警的轮询。所有时间都是millis()毫秒值。
+ * *****************************************************************/
+class FetchScheduler
+{
+public:
+  FetchScheduler();
+  void setInterval(FetchSource src, uint32_t intervalMs);
+  void setWarningActive(bool active);
+  void markDue(FetchSource src);
+  bool isDue(FetchSource src, uint32_t now);
+  void onSuccess(FetchSource src, uint32_t now);
+  void onFailure(FetchSource src, uint32_t now);
+  uint32_t nextDueIn(FetchSource src, uint32_t now);
+  uint8_t failStreak(FetchSource src);
+  uint32_t lastSuccess(FetchSource src);
+  const char *name(FetchSource src);
+
+  static const uint8_t MaxRetry = 3;                 // 单次取数内的最多重试次数
+  static const uint32_t BaseBackoff = 30 * 1000;     // 首次失败后的退避时间
+  static const uint32_t WarnActiveInterval = 5 * 60 * 1000; // 预警期间预警的轮询间隔
+
+private:
+  struct Slot
+  {
+    uint32_t interval;    // 正常更新间隔
+    uint32_t nextDue;     // 下次到期时间
+    uint32_t lastSuccess; // 最近一次成功时间
+    uint8_t failStreak;   // 连续失败次数
+  };
+  Slot _slots[FETCH_SOURCE_COUNT];
+  bool _warnActive = false;
+
+  uint32_t effectiveInterval(FetchSource src);
+  static uint32_t jitter(uint32_t base, uint8_t percent);
+};
+
+#endif
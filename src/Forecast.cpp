@@ -0,0 +1,225 @@
+#include "Forecast.h"
+#include <string.h>
+#include <stdlib.h>
+
+// 要查找的"f":[，KMP失配时退回的位置
+static const char forecastKey[] = "\"f\":[";
+static const uint8_t forecastFail[] = {0, 0, 0, 1, 0};
+
+ForecastParser::ForecastParser(ForecastData &out) : _out(out)
+{
+  reset();
+}
+
+void ForecastParser::reset()
+{
+  memset(&_out, 0, sizeof(_out));
+  _state = SEEK;
+  _match = 0;
+  _depth = 0;
+  _escape = false;
+  _inString = false;
+  _keyLen = 0;
+  _valLen = 0;
+  _bytes = 0;
+}
+
+void ForecastParser::feed(const char *data, size_t len)
+{
+  for (size_t i = 0; i < len && _state != DONE; i++)
+  {
+    _bytes++;
+    step(data[i]);
+  }
+}
+
+static int8_t parseTemp(const char *s)
+{
+  if (*s == '\0')
+    return ForecastNoTemp;
+  int v = atoi(s);
+  return v < -127 ? -127 : (v > 127 ? 127 : v);
+}
+
+void ForecastParser::endValue()
+{
+  _val[_valLen] = '\0';
+  if (_out.count < ForecastMaxDays && _keyLen == 2 && _key[0] == 'f')
+  {
+    ForecastDay &d = _out.days[_out.count];
+    switch (_key[1])
+    {
+    case 'a':
+      d.dayCode = atoi(_val);
+      break;
+    case 'b':
+      d.nightCode = atoi(_val);
+      break;
+    case 'c':
+      d.high = parseTemp(_val);
+      break;
+    case 'd':
+      d.low = parseTemp(_val);
+      break;
+    case 'i':
+    {
+      d.month = atoi(_val);
+      const char *p = strchr(_val, '/');
+      d.mday = p ? atoi(p + 1) : 0;
+      break;
+    }
+    case 'j':
+    {
+      // 太长时在UTF-8字符边界截断
+      uint8_t n = _valLen < ForecastWeekLen - 1 ? _valLen : ForecastWeekLen - 1;
+      while (n < _valLen && n > 0 && (_val[n] & 0xC0) == 0x80)
+        n--;
+      memcpy(d.week, _val, n);
+      d.week[n] = '\0';
+      break;
+    }
+    }
+  }
+  _state = OBJECT;
+}
+
+void ForecastParser::step(char c)
+{
+  switch (_state)
+  {
+  case SEEK:
+    while (_match > 0 && c != forecastKey[_match])
+      _match = forecastFail[_match];
+    if (c == forecastKey[_match])
+      _match++;
+    if (_match == sizeof(forecastKey) - 1)
+      _state = ARRAY;
+    break;
+
+  case ARRAY:
+    if (c == '{')
+    {
+      if (_out.count < ForecastMaxDays)
+      {
+        ForecastDay &d = _out.days[_out.count];
+        memset(&d, 0, sizeof(d));
+        d.high = ForecastNoTemp;
+        d.low = ForecastNoTemp;
+      }
+      _state = OBJECT;
+    }
+    else if (c == ']')
+      _state = DONE;
+    break;
+
+  case OBJECT:
+    if (c == '"')
+    {
+      _keyLen = 0;
+      _state = KEY;
+    }
+    else if (c == '}')
+    {
+      if (_out.count < ForecastMaxDays)
+        _out.count++;
+      _state = ARRAY;
+    }
+    break;
+
+  case KEY:
+    if (c == '"')
+      _state = COLON;
+    else if (_keyLen < sizeof(_key) - 1)
+      _key[_keyLen++] = c;
+    else
+      _keyLen = sizeof(_key); // 太长，不是要的键
+    break;
+
+  case COLON:
+    if (c == ':')
+      _state = VALUE;
+    break;
+
+  case VALUE:
+    _valLen = 0;
+    _escape = false;
+    if (c == '"')
+      _state = STRING;
+    else if (c == '{' || c == '[')
+    {
+      _depth = 1;
+      _inString = false;
+      _state = SKIP;
+    }
+    else if (c != ' ')
+    {
+      _val[_valLen++] = c;
+      _state = BARE;
+    }
+    break;
+
+  case STRING:
+    if (_escape)
+      _escape = false; // \/只保留/
+    else if (c == '\\')
+    {
+      _escape = true;
+      break;
+    }
+    else if (c == '"')
+    {
+      endValue();
+      break;
+    }
+    if (_valLen < sizeof(_val) - 1)
+      _val[_valLen++] = c;
+    break;
+
+  case BARE:
+    if (c == ',' || c == '}')
+    {
+      endValue();
+      if (c == '}')
+        step(c);
+    }
+    else if (_valLen < sizeof(_val) - 1)
+      _val[_valLen++] = c;
+    break;
+
+  case SKIP:
+    if (_escape)
+      _escape = false;
+    else if (_inString)
+    {
+      if (c == '\\')
+        _escape = true;
+      else if (c == '"')
+        _inString = false;
+    }
+    else if (c == '"')
+      _inString = true;
+    else if (c == '{' || c == '[')
+      _depth++;
+    else if ((c == '}' || c == ']') && --_depth == 0)
+      _state = OBJECT;
+    break;
+
+  case DONE:
+    break;
+  }
+}
+
+// 中国气象局天气现象代码
+const char *ForecastParser::weatherText(uint8_t code)
+{
+  static const char *const texts[] = {
+      "晴", "多云", "阴", "阵雨", "雷阵雨", "冰雹", "雨夹雪", "小雨", "中雨", "大雨",
+      "暴雨", "大暴雨", "特大暴雨", "阵雪", "小雪", "中雪", "大雪", "暴雪", "雾", "冻雨",
+      "沙尘暴", "小到中雨", "中到大雨", "大到暴雨", "暴雨", "大暴雨", "小到中雪", "中到大雪", "大到暴雪", "浮尘",
+      "扬沙", "强沙尘暴"};
+  if (code < sizeof(texts) / sizeof(texts[0]))
+    return texts[code];
+  if (code == 53)
+    return "霾";
+  return "";
+}
@@ -0,0 +1,75 @@
+#ifndef _FORECAST_H_
+#define _FORECAST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* *****************************************************************
+ * 多日天气预报：weather_index页面中的"f":[{...},{...}]数组，
+ * 逐字节扫描一遍直接填入定长的ForecastDay数组，不建JSON文档，不分配内存。
+ * 可以分段输入，不依赖Arduino，可以在PC上编译(tools/forecast_bench.cpp)。
+ * *****************************************************************/
+#define ForecastMaxDays 7
+#define ForecastWeekLen 10       // "星期二"的UTF-8加结尾
+#define ForecastNoTemp INT8_MIN  // 没有温度(晚上的当天最高温度为空)
+
+struct ForecastDay
+{
+  int8_t high;      // 最高温度 fc
+  int8_t low;       // 最低温度 fd
+  uint8_t dayCode;  // 白天天气代码 fa
+  uint8_t nightCode; // 夜间天气代码 fb
+  uint8_t month;    // 日期 fi，如"10/20"
+  uint8_t mday;
+  char week[ForecastWeekLen]; // fj，如"今天"、"星期二"
+};
+
+struct ForecastData
+{
+  uint8_t count;
+  ForecastDay days[ForecastMaxDays];
+};
+
+class ForecastParser
+{
+public:
+  ForecastParser(ForecastData &out);
+  void reset();
+  void feed(const char *data, size_t len);
+  bool done() const { return _state == DONE; }
+  uint32_t bytesScanned() const { return _bytes; }
+
+  static const char *weatherText(uint8_t code); // 天气代码对应的文字
+
+private:
+  enum State : uint8_t
+  {
+    SEEK,      // 查找"f":[
+    ARRAY,     // 数组中，等待{或]
+    OBJECT,    // 对象中，等待键
+    KEY,
+    COLON,
+    VALUE,     // 等待值
+    STRING,    // 字符串值
+    BARE,      // 数字等不带引号的值
+    SKIP,      // 跳过嵌套的对象或数组
+    DONE
+  };
+
+  ForecastData &_out;
+  State _state;
+  uint8_t _match;   // SEEK时已匹配的字符数
+  uint8_t _depth;   // SKIP时的嵌套层数
+  bool _escape;
+  bool _inString;   // SKIP时是否在字符串中
+  uint8_t _keyLen;
+  uint8_t _valLen;
+  char _key[4];
+  char _val[16];
+  uint32_t _bytes;
+
+  void endValue();
+  void step(char c);
+};
+
+#endif
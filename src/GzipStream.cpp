@@ -0,0 +1,107 @@
+#include "GzipStream.h"
+
+GzipStream::GzipStream(Stream &src, uint16_t window, uint32_t timeoutMs)
+    : _src(src), _window(window), _timeoutMs(timeoutMs), _s(NULL), _pos(0), _len(0), _error(TINF_DATA_ERROR), _timedOut(false), _in(0), _out(0)
+{
+}
+
+bool GzipStream::begin(Format format)
+{
+  end();
+  _s = (State *)malloc(sizeof(State) + _window); // 字典紧跟在State后面
+  if (_s == NULL)
+    return false;
+  _s->self = this;
+  _pos = _len = 0;
+  _timedOut = false;
+  _in = _out = 0;
+  uzlib_init();
+  uzlib_uncompress_init(&_s->d, (uint8_t *)(_s + 1), _window);
+  _s->d.source = _s->d.source_limit = _s->in;
+  _s->d.source_read_cb = readSource;
+  int res = format == Gzip ? uzlib_gzip_parse_header(&_s->d) : uzlib_zlib_parse_header(&_s->d);
+  _error = res < 0 || _timedOut ? TINF_DATA_ERROR : TINF_OK; // zlib头返回窗口位数
+  return _error == TINF_OK;
+}
+
+void GzipStream::end()
+{
+  free(_s);
+  _s = NULL;
+  _pos = _len = 0;
+}
+
+int GzipStream::readSource(TINF_DATA *d)
+{
+  return ((State *)d)->self->nextSourceByte();
+}
+
+// uzlib读完上一块时调用：等到有数据后取一块，返回第一个字节
+int GzipStream::nextSourceByte()
+{
+  uint32_t start = millis();
+  int n;
+  while ((n = _src.available()) <= 0)
+  {
+    if (millis() - start >= _timeoutMs)
+    {
+      _timedOut = true;
+      return -1;
+    }
+    delay(1);
+  }
+  n = _src.readBytes(_s->in, n < GzipInChunk ? n : GzipInChunk);
+  if (n <= 0)
+  {
+    _timedOut = true;
+    return -1;
+  }
+  _in += n;
+  _s->d.source = _s->in + 1;
+  _s->d.source_limit = _s->in + n;
+  return _s->in[0];
+}
+
+// 解压下一块到out，块边界上可能一次没有输出
+bool GzipStream::fill()
+{
+  _pos = _len = 0;
+  while (_s != NULL && _error == TINF_OK && _len == 0)
+  {
+    _s->d.dest = _s->out;
+    _s->d.dest_limit = _s->out + GzipOutChunk;
+    int res = uzlib_uncompress_chksum(&_s->d);
+    _len = _s->d.dest - _s->out;
+    if (_timedOut && res != TINF_DONE)
+      res = TINF_DATA_ERROR; // 连接断了，uzlib只会读到0
+    if (res != TINF_OK)
+    {
+      _error = res;
+      if (res != TINF_DONE)
+        _len = 0; // 出错的这一块不交出去
+    }
+    _out += _len;
+  }
+  return _len > 0;
+}
+
+int GzipStream::available()
+{
+  if (_pos >= _len && !fill())
+    return 0;
+  return _len - _pos;
+}
+
+int GzipStream::read()
+{
+  if (_pos >= _len && !fill())
+    return -1;
+  return _s->out[_pos++];
+}
+
+int GzipStream::peek()
+{
+  if (_pos >= _len && !fill())
+    return -1;
+  return _s->out[_pos];
+}
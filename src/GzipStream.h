@@ -0,0 +1,61 @@
+#ifndef _GZIP_STREAM_H_
+#define _GZIP_STREAM_H_
+
+#include <Arduino.h>
+#include "ArduinoUZlib.h" // 用其中的uzlib
+
+/* *****************************************************************
+ * gzip/zlib响应边收边解压，作为Stream直接交给JSON解析，不写文件、不整体缓存。
+ * uzlib的环形字典就是窗口：回溯距离超过窗口时报TINF_DICT_ERROR而不会解错，
+ * 解压后不超过窗口的响应总能解出。状态和字典在begin时一次分配，end时释放。
+ * *****************************************************************/
+#define GzipInChunk 128 // 每次从网络取的最大字节数
+#define GzipOutChunk 64 // 每次解压的最大字节数
+
+class GzipStream : public Stream
+{
+public:
+  enum Format
+  {
+    Gzip,
+    Zlib // HTTP的deflate编码
+  };
+  GzipStream(Stream &src, uint16_t window, uint32_t timeoutMs = 5000);
+  ~GzipStream() { end(); }
+  bool begin(Format format); // 分配内存并解析头部
+  void end();
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t) override { return 0; }
+  void flush() override {}
+  bool ok() const { return _error == TINF_OK || _error == TINF_DONE; }
+  bool done() const { return _error == TINF_DONE; } // 已读到结尾并校验过CRC
+  int error() const { return _error; }              // uzlib的返回值，网络超时为TINF_DATA_ERROR
+  uint32_t inBytes() const { return _in; }
+  uint32_t outBytes() const { return _out; }
+  uint32_t bytes() const { return sizeof(State) + _window; } // 解压占用的内存
+
+private:
+  struct State
+  {
+    TINF_DATA d; // 必须在最前，读数据回调从它找到State
+    GzipStream *self;
+    uint8_t in[GzipInChunk];
+    uint8_t out[GzipOutChunk];
+  };
+  Stream &_src;
+  uint16_t _window;
+  uint32_t _timeoutMs;
+  State *_s;
+  uint8_t _pos, _len; // out中未读的部分
+  int _error;
+  bool _timedOut;
+  uint32_t _in, _out;
+
+  static int readSource(TINF_DATA *d);
+  int nextSourceByte();
+  bool fill();
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "History.h"
+
+History::History()
+{
+  _mux = portMUX_INITIALIZER_UNLOCKED;
+  _seq = 0;
+  _savedAt = 0;
+  _saves = 0;
+  _gaps = 0;
+  clear(HistoryMinMinutes);
+}
+
+void History::clear(uint8_t minutes)
+{
+  memset(&_rec, 0, sizeof(_rec));
+  memset(_last, 0, sizeof(_last));
+  _rec.minutes = minutes;
+}
+
+// 读取后重新累加出最新值，内容不对时从头开始
+void History::begin()
+{
+  uint32_t timestamp = 0;
+  if (!DataCache::load(HistoryCacheFile, &_rec, sizeof(_rec), &timestamp) ||
+      _rec.minutes < HistoryMinMinutes || _rec.minutes > HistoryMaxMinutes ||
+      _rec.count > HistoryMaxPoints || _rec.head >= HistoryMaxPoints)
+  {
+    clear(HistoryMinMinutes);
+    return;
+  }
+  memcpy(_last, _rec.base, sizeof(_last));
+  for (uint16_t k = 0; k < _rec.count; k++)
+  {
+    const int16_t *p = _rec.delta[(_rec.head + k) % HistoryMaxPoints];
+    for (uint8_t c = 0; c < HistoryChannels; c++)
+      if (p[c] != HistoryGap)
+        _last[c] += p[c];
+  }
+  _savedAt = timestamp;
+  Serial.printf("读取温湿度历史%u个点，间隔%u分钟\n", _rec.count, _rec.minutes);
+}
+
+bool History::setMinutes(int minutes)
+{
+  if (minutes < HistoryMinMinutes || minutes > HistoryMaxMinutes)
+    return false;
+  if (minutes == _rec.minutes)
+    return true;
+  portENTER_CRITICAL(&_mux);
+  clear(minutes);
+  _seq++; // 图表整个重画
+  portEXIT_CRITICAL(&_mux);
+  _savedAt = 0;
+  return true;
+}
+
+// 满了丢掉最旧的点，它的差值并入base
+void History::push(const int16_t *values)
+{
+  if (_rec.count == HistoryMaxPoints)
+  {
+    const int16_t *old = _rec.delta[_rec.head];
+    for (uint8_t c = 0; c < HistoryChannels; c++)
+      if (old[c] != HistoryGap)
+        _rec.base[c] += old[c];
+    _rec.head = (_rec.head + 1) % HistoryMaxPoints;
+    _rec.count--;
+  }
+  int16_t *p = _rec.delta[(_rec.head + _rec.count) % HistoryMaxPoints];
+  for (uint8_t c = 0; c < HistoryChannels; c++)
+  {
+    if (values[c] == HistoryGap)
+      p[c] = HistoryGap;
+    else
+    {
+      p[c] = values[c] - _last[c];
+      _last[c] = values[c];
+    }
+  }
+  _rec.count++;
+}
+
+// 同一个时间槽只采一次，中间缺的时间槽补空点
+bool History::add(uint32_t epoch, const int16_t *values)
+{
+  uint32_t slot = epoch / (_rec.minutes * 60UL);
+  if (_rec.count > 0 && slot <= _rec.lastSlot)
+    return false;
+  static const int16_t gap[HistoryChannels] = {HistoryGap, HistoryGap, HistoryGap, HistoryGap};
+  portENTER_CRITICAL(&_mux);
+  if (_rec.count > 0)
+  {
+    uint32_t missed = slot - _rec.lastSlot - 1;
+    if (missed > HistoryMaxPoints)
+      missed = HistoryMaxPoints;
+    for (uint32_t i = 0; i < missed; i++)
+      push(gap);
+    _gaps += missed;
+  }
+  push(values);
+  _rec.lastSlot = slot;
+  _seq++;
+  portEXIT_CRITICAL(&_mux);
+  return true;
+}
+
+// 只有任务A修改_rec，这里不用加锁
+bool History::save(uint32_t epoch)
+{
+  _savedAt = epoch;
+  if (!DataCache::save(HistoryCacheFile, &_rec, sizeof(_rec), epoch))
+    return false;
+  _saves++;
+  return true;
+}
+
+// 从最旧的点累加，按点所在的整点小时分组求平均
+uint32_t History::hourly(uint8_t ch, int16_t *out, uint8_t n)
+{
+  for (uint8_t i = 0; i < n; i++)
+    out[i] = HistoryGap;
+  portENTER_CRITICAL(&_mux);
+  uint32_t secs = _rec.minutes * 60UL;
+  uint32_t lastHour = _rec.lastSlot * secs / 3600;
+  int32_t value = _rec.base[ch];
+  int32_t sum = 0;
+  uint16_t cnt = 0;
+  int32_t bucket = -1;
+  for (uint16_t k = 0; k <= _rec.count; k++)
+  {
+    int32_t b = n; // 结束时把最后一组写出
+    int16_t d = HistoryGap;
+    if (k < _rec.count)
+    {
+      d = _rec.delta[(_rec.head + k) % HistoryMaxPoints][ch];
+      if (d != HistoryGap)
+        value += d;
+      uint32_t hour = (_rec.lastSlot - (_rec.count - 1 - k)) * secs / 3600;
+      b = (int32_t)n - 1 - (int32_t)(lastHour - hour);
+    }
+    if (b != bucket)
+    {
+      if (bucket >= 0 && bucket < n && cnt > 0)
+        out[bucket] = (sum + (sum >= 0 ? cnt / 2 : -(int32_t)(cnt / 2))) / (int32_t)cnt;
+      bucket = b;
+      sum = 0;
+      cnt = 0;
+    }
+    if (d != HistoryGap)
+    {
+      sum += value;
+      cnt++;
+    }
+  }
+  portEXIT_CRITICAL(&_mux);
+  return lastHour;
+}
+
+void History::print(Print &out)
+{
+  out.printf("温湿度历史 %u/%u个点 间隔%u分钟(%u小时) 补空点:%u 保存:%u次 内存:%u字节\n", _rec.count, HistoryMaxPoints,
+             _rec.minutes, hours(), _gaps, _saves, (unsigned)sizeof(_rec));
+}
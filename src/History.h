@@ -0,0 +1,78 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <Arduino.h>
+#include "DataCache.h"
+
+/* *****************************************************************
+ * 温湿度历史：室外(天气实况)和室内(DHT)的温湿度按固定间隔采样，
+ * 存在定长环形缓冲区中，每个点存和前一个有效点的差(0.1单位，int16)。
+ * 间隔5-15分钟可调，对应24-72小时；每小时保存一次到LittleFS，
+ * 断电期间缺的点开机后补成空点，时间轴不会错位。
+ * 任务A采样和保存，任务C读取画图，读写在_mux内。
+ * *****************************************************************/
+#define HistoryCacheFile "/cache_history.bin"
+#define HistoryChannels 4
+#define HistoryMaxPoints 288     // 5分钟一个点24小时，15分钟一个点72小时
+#define HistoryMinMinutes 5
+#define HistoryMaxMinutes 15
+#define HistorySaveMinutes 60    // 写LittleFS的间隔
+#define HistoryGap INT16_MIN     // 没有数据的点
+
+enum HistoryChannel
+{
+  HIST_OUT_TEMP, // 室外温度
+  HIST_OUT_HUMI, // 室外湿度
+  HIST_IN_TEMP,  // 室内温度
+  HIST_IN_HUMI   // 室内湿度
+};
+
+// 保存到LittleFS的内容，base加上到某个点为止的全部差值就是这个点的值
+struct HistoryRecord
+{
+  uint16_t minutes;                // 采样间隔
+  uint16_t count;                  // 点数
+  uint16_t head;                   // 最旧的点
+  uint16_t reserved;
+  uint32_t lastSlot;               // 最新点的时间槽(epoch/间隔)
+  int16_t base[HistoryChannels];   // 最旧点之前的值
+  int16_t delta[HistoryMaxPoints][HistoryChannels];
+};
+
+class History
+{
+public:
+  History();
+  void begin();                       // 读取保存的历史
+  bool setMinutes(int minutes);       // 修改间隔会清空历史
+  uint8_t minutes() const { return _rec.minutes; }
+  uint16_t hours() const { return HistoryMaxPoints * _rec.minutes / 60; }
+  uint16_t count() const { return _rec.count; }
+  uint32_t seq() const { return _seq; } // 累计加入的点数
+
+  // 任务A中调用
+  bool add(uint32_t epoch, const int16_t *values); // 进入新的时间槽时加一个点
+  bool saveDue(uint32_t epoch) const { return epoch - _savedAt >= HistorySaveMinutes * 60UL; }
+  bool save(uint32_t epoch);
+
+  // 最近n个整点小时的平均值，out[n-1]是最新点所在的小时，没有数据为HistoryGap；返回最新点的小时数(epoch/3600)
+  uint32_t hourly(uint8_t ch, int16_t *out, uint8_t n);
+
+  void print(Print &out);
+
+private:
+  HistoryRecord _rec;
+  int16_t _last[HistoryChannels];     // 最新的有效值，即base加上全部差值
+  uint32_t _seq;
+  uint32_t _savedAt;
+  uint32_t _saves;
+  uint32_t _gaps;                     // 补的空点
+  portMUX_TYPE _mux;
+
+  void clear(uint8_t minutes);
+  void push(const int16_t *values);
+};
+
+extern History history;
+
+#endif
@@ -4,14 +4,16 @@
 uint8_t HttpsGetUtils::_buffer[1024 * 3];
 const char *HttpsGetUtils::host = "https://devapi.qweather.com"; // 服务器地址，这是免费用户的地址，如果非免费用户，改为：https://api.qweather.com
 size_t HttpsGetUtils::_bufferSize = 0;
+const char *HttpsGetUtils::validatorHeaders[] = {"ETag", "Last-Modified"};
+uint32_t HttpsGetUtils::rxBytes = 0;
 
 HttpsGetUtils::HttpsGetUtils()
 {
 }
 
-bool HttpsGetUtils::getString(const char *url, uint8_t *&outbuf, size_t &outlen)
+bool HttpsGetUtils::getString(const char *url, uint8_t *&outbuf, size_t &outlen, HttpValidator *validator)
 {
-    fetchBuffer(url); // HTTPS获取数据流
+    fetchBuffer(url, validator); // HTTPS获取数据流
     if (_bufferSize)
     {
         Serial.print("buffersize:");
@@ -23,9 +25,50 @@ bool HttpsGetUtils::getString(const char *url, uint8_t *&outbuf, size_t &outlen)
     return false;
 }
 
-bool HttpsGetUtils::fetchBuffer(const char *url)
+// 请求头中加入上次的校验信息
+void HttpsGetUtils::addValidatorHeaders(HTTPClient &http, const HttpValidator *validator)
+{
+    http.collectHeaders(validatorHeaders, 2);
+    if (validator == NULL)
+        return;
+    if (!validator->etag.isEmpty())
+        http.addHeader("If-None-Match", validator->etag);
+    if (!validator->lastModified.isEmpty())
+        http.addHeader("If-Modified-Since", validator->lastModified);
+}
+
+// 记录本次响应的校验信息，304时保留原有的值
+// 响应为200时同时累计下载的字节数
+void HttpsGetUtils::saveValidator(HTTPClient &http, HttpValidator *validator, int httpCode, size_t size)
+{
+    if (httpCode == HTTP_CODE_OK)
+        rxBytes += size;
+    if (validator == NULL)
+        return;
+    validator->lastCode = httpCode;
+    if (httpCode != HTTP_CODE_OK)
+        return;
+    validator->etag = http.header("ETag");
+    validator->lastModified = http.header("Last-Modified");
+    validator->lastSize = size;
+}
+
+// FNV-1a哈希，用来判断内容是否有变化
+uint32_t HttpsGetUtils::contentHash(const uint8_t *data, size_t len, uint32_t hash)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+bool HttpsGetUtils::fetchBuffer(const char *url, HttpValidator *validator)
 {
     _bufferSize = 0;
+    if (validator != NULL)
+        validator->lastCode = 0; // 连接失败时不能留着上次的304
     std::unique_ptr<WiFiClientSecure> client(new WiFiClientSecure);
     client->setInsecure();
     HTTPClient https;
@@ -33,6 +76,7 @@ bool HttpsGetUtils::fetchBuffer(const char *url)
     {
         https.addHeader("Accept-Encoding", "gzip");
         https.setUserAgent("Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:109.0) Gecko/20100101 Firefox/115.0");
+        addValidatorHeaders(https, validator);
         int httpCode = https.GET();
         if (httpCode > 0)
         {
@@ -58,6 +102,7 @@ bool HttpsGetUtils::fetchBuffer(const char *url)
                 }
                 _bufferSize = offset;
             }
+            saveValidator(https, validator, httpCode, _bufferSize);
         }
         else
         {
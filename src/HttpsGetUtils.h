@@ -6,14 +6,27 @@
 #include <WiFiMulti.h>
 #include <HTTPClient.h>
 #include <WiFiClientSecure.h>
+
+// 条件请求的校验信息，服务器支持时用If-None-Match/If-Modified-Since避免重复下载
+struct HttpValidator {
+  String etag;          // 上次响应的ETag
+  String lastModified;  // 上次响应的Last-Modified
+  int lastCode = 0;     // 最近一次HTTP状态码，304表示内容未改变
+  size_t lastSize = 0;  // 最近一次完整响应的字节数，用于统计节省的流量
+};
  
 class HttpsGetUtils {  
   public:
     HttpsGetUtils();
-    static bool getString(const char* url, uint8_t*& outbuf, size_t &len);
+    static bool getString(const char* url, uint8_t*& outbuf, size_t &len, HttpValidator *validator = NULL);
+    static void addValidatorHeaders(HTTPClient &http, const HttpValidator *validator);
+    static void saveValidator(HTTPClient &http, HttpValidator *validator, int httpCode, size_t size);
+    static uint32_t contentHash(const uint8_t *data, size_t len, uint32_t hash = 2166136261UL);
     static const char  *host;		// 服务器地址
+    static const char *validatorHeaders[];
+    static uint32_t rxBytes;    // 累计下载的响应体字节数，用于统计吞吐量
   private:
-    static bool fetchBuffer(const char* url);
+    static bool fetchBuffer(const char* url, HttpValidator *validator);
     static uint8_t _buffer[1024 * 3]; //gzip流最大缓冲区
     static size_t _bufferSize;
  
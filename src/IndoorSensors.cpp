@@ -0,0 +1,419 @@
+#include "IndoorSensors.h"
+#include <string.h>
+
+bool I2cBus::write(uint8_t addr, const uint8_t *data, size_t len)
+{
+  _transfers++;
+  if (rawWrite(addr, data, len, true))
+    return true;
+  _errors++;
+  return false;
+}
+
+bool I2cBus::read(uint8_t addr, uint8_t *data, size_t len)
+{
+  _transfers++;
+  if (rawRead(addr, data, len))
+    return true;
+  _errors++;
+  return false;
+}
+
+bool I2cBus::writeRead(uint8_t addr, const uint8_t *out, size_t outLen, uint8_t *in, size_t inLen)
+{
+  _transfers++;
+  if (rawWrite(addr, out, outLen, false) && rawRead(addr, in, inLen))
+    return true;
+  _errors++;
+  return false;
+}
+
+// 多项式0x31，初值0xFF
+uint8_t sensirionCrc(const uint8_t *data, size_t len)
+{
+  uint8_t crc = 0xFF;
+  for (size_t i = 0; i < len; i++)
+  {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+// 每个字后跟一个CRC，全部正确时返回true
+static bool checkWords(const uint8_t *buf, uint16_t *words, uint8_t count)
+{
+  for (uint8_t i = 0; i < count; i++)
+  {
+    const uint8_t *p = buf + i * 3;
+    if (sensirionCrc(p, 2) != p[2])
+      return false;
+    words[i] = (p[0] << 8) | p[1];
+  }
+  return true;
+}
+
+// 温度-45+175*x/65535，湿度100*x/65535，SHT3x和SCD4x相同
+static int16_t sensirionTemp10(uint16_t raw)
+{
+  return (int16_t)(-450 + (int32_t)((1750UL * raw + 32767) / 65535));
+}
+
+static int16_t sensirionHumi10(uint16_t raw)
+{
+  return (int16_t)((1000UL * raw + 32767) / 65535);
+}
+
+/* ---------------- SHT3x ---------------- */
+
+// 读状态寄存器确认存在
+bool Sht3xSensor::begin()
+{
+  static const uint8_t cmd[] = {0xF3, 0x2D};
+  uint8_t buf[3];
+  uint16_t status;
+  return _bus.write(_addr, cmd, sizeof(cmd)) && _bus.read(_addr, buf, sizeof(buf)) && checkWords(buf, &status, 1);
+}
+
+uint16_t Sht3xSensor::trigger()
+{
+  static const uint8_t cmd[] = {0x24, 0x00}; // 单次测量，高重复性，不拉低时钟
+  return _bus.write(_addr, cmd, sizeof(cmd)) ? 16 : 0;
+}
+
+bool Sht3xSensor::collect(IndoorReading &r)
+{
+  uint8_t buf[6];
+  uint16_t words[2];
+  if (!_bus.read(_addr, buf, sizeof(buf)) || !checkWords(buf, words, 2))
+    return false;
+  r.temp10 = sensirionTemp10(words[0]);
+  r.humi10 = sensirionHumi10(words[1]);
+  r.fields |= INDOOR_TEMP | INDOOR_HUMI;
+  return true;
+}
+
+/* ---------------- BME280 ---------------- */
+
+bool Bme280Sensor::writeReg(uint8_t reg, uint8_t value)
+{
+  uint8_t buf[2] = {reg, value};
+  return _bus.write(_addr, buf, sizeof(buf));
+}
+
+// 芯片ID为0x60是BME280，0x58是BMP280；然后读出校准参数
+bool Bme280Sensor::begin()
+{
+  uint8_t reg = 0xD0;
+  uint8_t id;
+  if (!_bus.writeRead(_addr, &reg, 1, &id, 1) || (id != 0x60 && id != 0x58))
+    return false;
+  _hasHumi = id == 0x60;
+
+  uint8_t c[26];
+  reg = 0x88;
+  if (!_bus.writeRead(_addr, &reg, 1, c, sizeof(c)))
+    return false;
+  _t1 = c[0] | (c[1] << 8);
+  _t2 = c[2] | (c[3] << 8);
+  _t3 = c[4] | (c[5] << 8);
+  _p1 = c[6] | (c[7] << 8);
+  _p2 = c[8] | (c[9] << 8);
+  _p3 = c[10] | (c[11] << 8);
+  _p4 = c[12] | (c[13] << 8);
+  _p5 = c[14] | (c[15] << 8);
+  _p6 = c[16] | (c[17] << 8);
+  _p7 = c[18] | (c[19] << 8);
+  _p8 = c[20] | (c[21] << 8);
+  _p9 = c[22] | (c[23] << 8);
+  _h1 = c[25];
+
+  if (_hasHumi)
+  {
+    uint8_t h[7];
+    reg = 0xE1;
+    if (!_bus.writeRead(_addr, &reg, 1, h, sizeof(h)))
+      return false;
+    _h2 = h[0] | (h[1] << 8);
+    _h3 = h[2];
+    _h4 = (int16_t)((int8_t)h[3] * 16) | (h[4] & 0x0F);
+    _h5 = (int16_t)((int8_t)h[5] * 16) | (h[4] >> 4);
+    _h6 = (int8_t)h[6];
+  }
+  // 湿度过采样要在写ctrl_meas之前设置；不滤波，待机由强制模式决定
+  return (!_hasHumi || writeReg(0xF2, 0x01)) && writeReg(0xF5, 0x00);
+}
+
+uint16_t Bme280Sensor::trigger()
+{
+  return writeReg(0xF4, (1 << 5) | (1 << 2) | 0x01) ? 10 : 0; // 温度、气压1倍过采样，强制模式
+}
+
+// 补偿公式来自数据手册
+bool Bme280Sensor::collect(IndoorReading &r)
+{
+  uint8_t reg = 0xF7;
+  uint8_t d[8];
+  if (!_bus.writeRead(_addr, &reg, 1, d, sizeof(d)))
+    return false;
+  int32_t adcP = ((int32_t)d[0] << 12) | (d[1] << 4) | (d[2] >> 4);
+  int32_t adcT = ((int32_t)d[3] << 12) | (d[4] << 4) | (d[5] >> 4);
+  int32_t adcH = (d[6] << 8) | d[7];
+  if (adcT == 0x80000)
+    return false; // 还没有测量结果
+
+  int32_t var1 = ((((adcT >> 3) - ((int32_t)_t1 << 1))) * _t2) >> 11;
+  int32_t var2 = (((((adcT >> 4) - (int32_t)_t1) * ((adcT >> 4) - (int32_t)_t1)) >> 12) * _t3) >> 14;
+  int32_t tFine = var1 + var2;
+  int32_t t100 = (tFine * 5 + 128) >> 8;
+  r.temp10 = (int16_t)((t100 + (t100 >= 0 ? 5 : -5)) / 10);
+  r.fields |= INDOOR_TEMP;
+
+  int64_t p1 = (int64_t)tFine - 128000;
+  int64_t p2 = p1 * p1 * _p6;
+  p2 += (p1 * _p5) << 17;
+  p2 += (int64_t)_p4 << 35;
+  p1 = ((p1 * p1 * _p3) >> 8) + ((p1 * _p2) << 12);
+  p1 = ((((int64_t)1) << 47) + p1) * _p1 >> 33;
+  if (p1 != 0 && adcP != 0x80000)
+  {
+    int64_t p = 1048576 - adcP;
+    p = (((p << 31) - p2) * 3125) / p1;
+    p1 = ((int64_t)_p9 * (p >> 13) * (p >> 13)) >> 25;
+    p2 = ((int64_t)_p8 * p) >> 19;
+    p = ((p + p1 + p2) >> 8) + ((int64_t)_p7 << 4); // Pa的256倍
+    r.press10 = (uint16_t)((p + 1280) / 2560);
+    r.fields |= INDOOR_PRESS;
+  }
+
+  if (_hasHumi && adcH != 0x8000)
+  {
+    int32_t v = tFine - 76800;
+    v = (((((adcH << 14) - ((int32_t)_h4 << 20) - ((int32_t)_h5 * v)) + 16384) >> 15) *
+         (((((((v * _h6) >> 10) * (((v * (int32_t)_h3) >> 11) + 32768)) >> 10) + 2097152) * _h2 + 8192) >> 14));
+    v = v - (((((v >> 15) * (v >> 15)) >> 7) * (int32_t)_h1) >> 4);
+    v = v < 0 ? 0 : (v > 419430400 ? 419430400 : v);
+    r.humi10 = (int16_t)(((v >> 12) * 10 + 512) >> 10); // %的1024倍
+    r.fields |= INDOOR_HUMI;
+  }
+  return true;
+}
+
+/* ---------------- SCD4x ---------------- */
+
+bool Scd4xSensor::command(uint16_t cmd)
+{
+  uint8_t buf[2] = {(uint8_t)(cmd >> 8), (uint8_t)cmd};
+  return _bus.write(_addr, buf, sizeof(buf));
+}
+
+bool Scd4xSensor::readWords(uint16_t *words, uint8_t count)
+{
+  uint8_t buf[9];
+  return count <= 3 && _bus.read(_addr, buf, count * 3) && checkWords(buf, words, count);
+}
+
+// 先停止可能在运行的周期测量，读序列号确认存在，再开始周期测量
+bool Scd4xSensor::begin()
+{
+  if (!command(0x3F86))
+    return false;
+  _bus.delayMs(500);
+  uint16_t serial[3];
+  if (!command(0x3682))
+    return false;
+  _bus.delayMs(1);
+  return readWords(serial, 3) && command(0x21B1);
+}
+
+uint16_t Scd4xSensor::trigger()
+{
+  return command(0xE4B8) ? 1 : 0; // 查询数据是否就绪
+}
+
+bool Scd4xSensor::collect(IndoorReading &r)
+{
+  uint16_t status;
+  if (!readWords(&status, 1))
+    return false;
+  if ((status & 0x07FF) == 0)
+  {
+    _notReady++;
+    return true;
+  }
+  uint16_t w[3];
+  if (!command(0xEC05))
+    return false;
+  _bus.delayMs(1);
+  if (!readWords(w, 3))
+    return false;
+  r.co2 = w[0];
+  r.temp10 = sensirionTemp10(w[1]);
+  r.humi10 = sensirionHumi10(w[2]);
+  r.fields |= INDOOR_CO2 | INDOOR_TEMP | INDOOR_HUMI;
+  return true;
+}
+
+/* ---------------- IndoorSensors ---------------- */
+
+IndoorSensors::IndoorSensors(I2cBus &bus) : _bus(bus)
+{
+  memset(_sensors, 0, sizeof(_sensors));
+  memset(_present, 0, sizeof(_present));
+  memset(_healthy, 0, sizeof(_healthy));
+  memset(_failures, 0, sizeof(_failures));
+  memset(&_snap, 0, sizeof(_snap));
+  _count = 0;
+  _seq = 0;
+  _batches = 0;
+  _lastWaitMs = 0;
+  _lastBatchUs = 0;
+#ifdef ARDUINO
+  _mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+}
+
+bool IndoorSensors::add(IndoorSensor *sensor)
+{
+  if (_count >= IndoorMaxSensors)
+    return false;
+  _sensors[_count++] = sensor;
+  return true;
+}
+
+uint8_t IndoorSensors::begin()
+{
+  uint8_t found = 0;
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    _present[i] = _sensors[i]->begin();
+    _healthy[i] = _present[i];
+    if (_present[i])
+      found++;
+  }
+  return found;
+}
+
+// 前面健康的传感器已经提供的字段，后面的传感器不再触发
+bool IndoorSensors::sample()
+{
+#ifdef ARDUINO
+  uint32_t start = micros();
+#endif
+  bool active[IndoorMaxSensors] = {false};
+  uint8_t covered = 0;
+  uint16_t wait = 0;
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    IndoorSensor *s = _sensors[i];
+    if (!_present[i] || (s->provides() & ~covered) == 0)
+      continue;
+    active[i] = true;
+    uint16_t ms = s->trigger();
+    if (ms > wait)
+      wait = ms;
+    if (_healthy[i])
+      covered |= s->provides();
+  }
+  if (wait > 0)
+    _bus.delayMs(wait);
+  _lastWaitMs = wait;
+
+  IndoorReading merged;
+  memset(&merged, 0, sizeof(merged));
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    if (!active[i])
+      continue;
+    IndoorReading r;
+    memset(&r, 0, sizeof(r));
+    _healthy[i] = _sensors[i]->collect(r);
+    if (!_healthy[i])
+    {
+      _failures[i]++;
+      continue;
+    }
+    uint8_t add = r.fields & ~merged.fields;
+    if (add & INDOOR_TEMP)
+      merged.temp10 = r.temp10;
+    if (add & INDOOR_HUMI)
+      merged.humi10 = r.humi10;
+    if (add & INDOOR_CO2)
+      merged.co2 = r.co2;
+    if (add & INDOOR_PRESS)
+      merged.press10 = r.press10;
+    merged.fields |= add;
+  }
+  _batches++;
+#ifdef ARDUINO
+  _lastBatchUs = micros() - start;
+#endif
+  if (merged.fields == 0)
+    return false;
+
+#ifdef ARDUINO
+  portENTER_CRITICAL(&_mux);
+#endif
+  _snap = merged;
+  _seq++;
+#ifdef ARDUINO
+  portEXIT_CRITICAL(&_mux);
+#endif
+  return true;
+}
+
+uint32_t IndoorSensors::get(IndoorReading &r)
+{
+#ifdef ARDUINO
+  portENTER_CRITICAL(&_mux);
+#endif
+  r = _snap;
+  uint32_t seq = _seq;
+#ifdef ARDUINO
+  portEXIT_CRITICAL(&_mux);
+#endif
+  return seq;
+}
+
+#ifdef ARDUINO
+void IndoorSensors::print(Print &out)
+{
+  out.printf("室内传感器 采样:%u批 上次用时:%ums(等待%ums) I2C收发:%u次 错误:%u\n", _batches, _lastBatchUs / 1000, _lastWaitMs,
+             _bus.transfers(), _bus.errors());
+  for (uint8_t i = 0; i < _count; i++)
+    out.printf("  %s %s 失败:%u\n", _sensors[i]->name(), _present[i] ? (_healthy[i] ? "正常" : "出错") : "未找到", _failures[i]);
+  IndoorReading r;
+  get(r);
+  if (r.fields & INDOOR_TEMP)
+    out.printf("  温度:%.1f℃", r.temp10 / 10.0f);
+  if (r.fields & INDOOR_HUMI)
+    out.printf(" 湿度:%.1f%%", r.humi10 / 10.0f);
+  if (r.fields & INDOOR_CO2)
+    out.printf(" CO2:%uppm", r.co2);
+  if (r.fields & INDOOR_PRESS)
+    out.printf(" 气压:%.1fhPa", r.press10 / 10.0f);
+  out.printf("\n");
+}
+
+void WireBus::begin(int sda, int scl, uint32_t freq)
+{
+  Wire.begin(sda, scl, freq);
+}
+
+bool WireBus::rawWrite(uint8_t addr, const uint8_t *data, size_t len, bool stop)
+{
+  Wire.beginTransmission(addr);
+  Wire.write(data, len);
+  return Wire.endTransmission(stop) == 0;
+}
+
+bool WireBus::rawRead(uint8_t addr, uint8_t *data, size_t len)
+{
+  if (Wire.requestFrom(addr, (uint8_t)len) != len)
+    return false;
+  for (size_t i = 0; i < len; i++)
+    data[i] = Wire.read();
+  return true;
+}
+#endif
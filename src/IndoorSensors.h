@@ -0,0 +1,185 @@
+#ifndef _INDOOR_SENSORS_H_
+#define _INDOOR_SENSORS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+/* *****************************************************************
+ * 室内传感器：DHT11/22和I2C上的SHT3x、BME280、SCD4x(CO2)统一成IndoorSensor。
+ * 每批先给所有传感器发测量命令，只等一次最长的转换时间，再依次读结果，
+ * 同一个字段按加入顺序取第一个读到的值，合成一份快照给界面显示。
+ * 传感器只通过I2cBus收发，不依赖Arduino，PC上可以接假总线(tools/sensor_fakebus.cpp)。
+ * *****************************************************************/
+#define IndoorMaxSensors 4
+
+enum IndoorField
+{
+  INDOOR_TEMP = 1,  // 温度
+  INDOOR_HUMI = 2,  // 湿度
+  INDOOR_CO2 = 4,   // 二氧化碳
+  INDOOR_PRESS = 8  // 气压
+};
+
+struct IndoorReading
+{
+  uint8_t fields;   // 有效字段IndoorField
+  int16_t temp10;   // 0.1℃
+  int16_t humi10;   // 0.1%
+  uint16_t co2;     // ppm
+  uint16_t press10; // 0.1hPa
+};
+
+// I2C总线，统计收发次数和错误
+class I2cBus
+{
+public:
+  I2cBus() : _transfers(0), _errors(0) {}
+  virtual ~I2cBus() {}
+  bool write(uint8_t addr, const uint8_t *data, size_t len);
+  bool read(uint8_t addr, uint8_t *data, size_t len);
+  bool writeRead(uint8_t addr, const uint8_t *out, size_t outLen, uint8_t *in, size_t inLen); // 重复起始读寄存器
+  virtual void delayMs(uint16_t ms) = 0;
+  uint32_t transfers() const { return _transfers; }
+  uint32_t errors() const { return _errors; }
+
+protected:
+  virtual bool rawWrite(uint8_t addr, const uint8_t *data, size_t len, bool stop) = 0;
+  virtual bool rawRead(uint8_t addr, uint8_t *data, size_t len) = 0;
+
+private:
+  uint32_t _transfers;
+  uint32_t _errors;
+};
+
+class IndoorSensor
+{
+public:
+  virtual ~IndoorSensor() {}
+  virtual const char *name() const = 0;
+  virtual uint8_t provides() const = 0; // 能提供的字段
+  virtual bool begin() = 0;             // 探测和初始化，不存在时返回false
+  virtual uint16_t trigger() = 0;       // 开始一次测量，返回要等待的毫秒数
+  virtual bool collect(IndoorReading &r) = 0; // 读取结果填入r，还没有新数据时返回true但不填字段
+};
+
+// SHT3x 单次测量，高重复性
+class Sht3xSensor : public IndoorSensor
+{
+public:
+  Sht3xSensor(I2cBus &bus, uint8_t addr = 0x44) : _bus(bus), _addr(addr) {}
+  const char *name() const override { return "SHT3x"; }
+  uint8_t provides() const override { return INDOOR_TEMP | INDOOR_HUMI; }
+  bool begin() override;
+  uint16_t trigger() override;
+  bool collect(IndoorReading &r) override;
+
+private:
+  I2cBus &_bus;
+  uint8_t _addr;
+};
+
+// BME280 强制模式，各项1倍过采样；BMP280没有湿度
+class Bme280Sensor : public IndoorSensor
+{
+public:
+  Bme280Sensor(I2cBus &bus, uint8_t addr = 0x76) : _bus(bus), _addr(addr), _hasHumi(false) {}
+  const char *name() const override { return _hasHumi ? "BME280" : "BMP280"; }
+  uint8_t provides() const override { return INDOOR_TEMP | INDOOR_PRESS | (_hasHumi ? INDOOR_HUMI : 0); }
+  bool begin() override;
+  uint16_t trigger() override;
+  bool collect(IndoorReading &r) override;
+
+private:
+  I2cBus &_bus;
+  uint8_t _addr;
+  bool _hasHumi;
+  // 出厂校准参数
+  uint16_t _t1;
+  int16_t _t2, _t3;
+  uint16_t _p1;
+  int16_t _p2, _p3, _p4, _p5, _p6, _p7, _p8, _p9;
+  uint8_t _h1, _h3;
+  int16_t _h2, _h4, _h5;
+  int8_t _h6;
+
+  bool writeReg(uint8_t reg, uint8_t value);
+};
+
+// SCD4x 周期测量(5秒一次)，每批先查数据是否就绪
+class Scd4xSensor : public IndoorSensor
+{
+public:
+  Scd4xSensor(I2cBus &bus, uint8_t addr = 0x62) : _bus(bus), _addr(addr), _notReady(0) {}
+  const char *name() const override { return "SCD4x"; }
+  uint8_t provides() const override { return INDOOR_CO2 | INDOOR_TEMP | INDOOR_HUMI; }
+  bool begin() override;
+  uint16_t trigger() override;
+  bool collect(IndoorReading &r) override;
+  uint32_t notReady() const { return _notReady; }
+
+private:
+  I2cBus &_bus;
+  uint8_t _addr;
+  uint32_t _notReady;
+
+  bool command(uint16_t cmd);
+  bool readWords(uint16_t *words, uint8_t count);
+};
+
+class IndoorSensors
+{
+public:
+  IndoorSensors(I2cBus &bus);
+  bool add(IndoorSensor *sensor); // 先加入的优先
+  uint8_t begin();                // 探测全部传感器，返回找到的个数
+  bool sample();                  // 采样一批，有数据时更新快照
+  uint32_t get(IndoorReading &r); // 复制快照，返回序号(每更新一次加1)
+  uint32_t seq() const { return _seq; }
+  uint8_t count() const { return _count; }
+  IndoorSensor *sensor(uint8_t i) { return _sensors[i]; }
+  bool present(uint8_t i) const { return _present[i]; }
+  uint32_t failures(uint8_t i) const { return _failures[i]; }
+  uint32_t batches() const { return _batches; }
+  uint32_t lastWaitMs() const { return _lastWaitMs; }
+#ifdef ARDUINO
+  void print(Print &out);
+#endif
+
+private:
+  I2cBus &_bus;
+  IndoorSensor *_sensors[IndoorMaxSensors];
+  bool _present[IndoorMaxSensors];
+  bool _healthy[IndoorMaxSensors]; // 上次读取成功，失败时由后面的传感器补上
+  uint32_t _failures[IndoorMaxSensors];
+  uint8_t _count;
+  IndoorReading _snap;
+  volatile uint32_t _seq;
+  uint32_t _batches;
+  uint32_t _lastWaitMs;
+  uint32_t _lastBatchUs;
+#ifdef ARDUINO
+  portMUX_TYPE _mux;
+#endif
+};
+
+uint8_t sensirionCrc(const uint8_t *data, size_t len); // SHT3x和SCD4x共用的CRC-8
+
+#ifdef ARDUINO
+#include <Wire.h>
+// 板上用Wire实现的I2C总线，等待时让出CPU
+class WireBus : public I2cBus
+{
+public:
+  void begin(int sda, int scl, uint32_t freq);
+  void delayMs(uint16_t ms) override { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+protected:
+  bool rawWrite(uint8_t addr, const uint8_t *data, size_t len, bool stop) override;
+  bool rawRead(uint8_t addr, uint8_t *data, size_t len) override;
+};
+#endif
+
+#endif
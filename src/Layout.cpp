@@ -0,0 +1,198 @@
+#include "Layout.h"
+
+Layout::Layout()
+{
+  _mux = portMUX_INITIALIZER_UNLOCKED;
+  _table = NULL;
+  _touched = 0;
+  _full = 0;
+  _switches = 0;
+  memset(_period, 0, sizeof(_period));
+  memset(_last, 0, sizeof(_last));
+  memset(_renders, 0, sizeof(_renders));
+  memset(_fullRenders, 0, sizeof(_fullRenders));
+  memset(_usSum, 0, sizeof(_usSum));
+  memset(_usMax, 0, sizeof(_usMax));
+}
+
+// 部件不多，插入排序；z相同时按编号。
+// 几套表的编号和z相同，正在run的任务最多按旧表的位置画完这一轮
+void Layout::use(const LayoutTable *table)
+{
+  if (table == NULL || table->count > LayoutMaxWidgets)
+    return;
+  uint8_t order[LayoutMaxWidgets];
+  for (uint8_t i = 0; i < table->count; i++)
+  {
+    uint8_t j = i;
+    while (j > 0 && table->widgets[order[j - 1]].z > table->widgets[i].z)
+    {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+  portENTER_CRITICAL(&_mux);
+  if (_table != NULL && _table != table)
+    _switches++;
+  _table = table;
+  memcpy(_order, order, sizeof(order));
+  for (uint8_t i = 0; i < table->count; i++)
+    _period[i] = table->widgets[i].periodMs;
+  _full = (1UL << table->count) - 1;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void Layout::invalidate()
+{
+  portENTER_CRITICAL(&_mux);
+  if (_table != NULL)
+    _full = (1UL << _table->count) - 1;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void Layout::invalidate(uint8_t id)
+{
+  portENTER_CRITICAL(&_mux);
+  _full |= 1UL << id;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void Layout::touch(uint8_t id)
+{
+  portENTER_CRITICAL(&_mux);
+  _touched |= 1UL << id;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void Layout::setPeriod(uint8_t id, uint16_t ms)
+{
+  if (id < LayoutMaxWidgets)
+    _period[id] = ms;
+}
+
+void Layout::draw(uint8_t id, bool full)
+{
+  const WidgetDef &w = _table->widgets[id];
+  uint32_t start = micros();
+  w.render(w.rect, full);
+  uint32_t us = micros() - start;
+  _renders[id]++;
+  if (full)
+    _fullRenders[id]++;
+  _usSum[id] += us;
+  if (us > _usMax[id])
+    _usMax[id] = us;
+}
+
+void Layout::render(uint8_t id, bool full)
+{
+  if (!visible(id) || _table->widgets[id].render == NULL)
+    return;
+  uint32_t bit = 1UL << id;
+  portENTER_CRITICAL(&_mux);
+  if (full)
+    _full &= ~bit;
+  _touched &= ~bit;
+  portEXIT_CRITICAL(&_mux);
+  _last[id] = millis();
+  draw(id, full);
+}
+
+// 先取走这个任务的标记再画，画的过程中新的标记留到下一轮
+uint8_t Layout::run(uint8_t task, uint32_t now)
+{
+  const LayoutTable *table = _table;
+  if (table == NULL)
+    return 0;
+  uint32_t mask = 0;
+  for (uint8_t i = 0; i < table->count; i++)
+    if (table->widgets[i].task == task)
+      mask |= 1UL << i;
+  portENTER_CRITICAL(&_mux);
+  uint32_t full = _full & mask;
+  uint32_t touched = _touched & mask;
+  _full &= ~mask;
+  _touched &= ~mask;
+  portEXIT_CRITICAL(&_mux);
+
+  uint8_t drawn = 0;
+  for (uint8_t k = 0; k < table->count; k++)
+  {
+    uint8_t id = _order[k];
+    const WidgetDef &w = table->widgets[id];
+    uint32_t bit = 1UL << id;
+    if (!(mask & bit) || w.render == NULL || w.rect.w <= 0)
+      continue;
+    bool due = _period[id] != 0 && now - _last[id] >= _period[id];
+    if (!due && !((full | touched) & bit))
+      continue;
+    if (due)
+      _last[id] = (now - _last[id] >= 2u * _period[id]) ? now : _last[id] + _period[id]; // 落后太多时不补
+    draw(id, full & bit);
+    drawn++;
+  }
+  return drawn;
+}
+
+// 旋转屏幕时在离屏帧里画出整个界面，标记全部清掉
+uint8_t Layout::renderAll()
+{
+  const LayoutTable *table = _table;
+  if (table == NULL)
+    return 0;
+  portENTER_CRITICAL(&_mux);
+  _full = 0;
+  _touched = 0;
+  portEXIT_CRITICAL(&_mux);
+
+  uint32_t now = millis();
+  uint8_t drawn = 0;
+  for (uint8_t k = 0; k < table->count; k++)
+  {
+    uint8_t id = _order[k];
+    const WidgetDef &w = table->widgets[id];
+    if (w.render == NULL || w.rect.w <= 0)
+      continue;
+    _last[id] = now;
+    draw(id, true);
+    drawn++;
+  }
+  return drawn;
+}
+
+uint32_t Layout::nextDue(uint8_t task, uint32_t now)
+{
+  const LayoutTable *table = _table;
+  uint32_t next = UINT32_MAX;
+  if (table == NULL)
+    return next;
+  for (uint8_t i = 0; i < table->count; i++)
+  {
+    const WidgetDef &w = table->widgets[i];
+    if (w.task != task || w.render == NULL || w.rect.w <= 0 || _period[i] == 0)
+      continue;
+    uint32_t passed = now - _last[i];
+    uint32_t left = passed >= _period[i] ? 0 : _period[i] - passed;
+    if (left < next)
+      next = left;
+  }
+  return next;
+}
+
+void Layout::print(Print &out)
+{
+  if (_table == NULL)
+    return;
+  out.printf("布局 %s 切换:%u次\n", _table->name, _switches);
+  for (uint8_t k = 0; k < _table->count; k++)
+  {
+    uint8_t i = _order[k];
+    const WidgetDef &w = _table->widgets[i];
+    if (w.render == NULL || w.rect.w <= 0)
+      continue;
+    out.printf("  %-8s (%d,%d %dx%d) z%u 任务%c 周期:%ums 绘制:%u次 全画:%u 平均:%uus 最大:%uus\n", w.name, w.rect.x, w.rect.y,
+               w.rect.w, w.rect.h, w.z, 'A' + w.task, _period[i], _renders[i], _fullRenders[i],
+               _renders[i] ? (unsigned)(_usSum[i] / _renders[i]) : 0, _usMax[i]);
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef _LAYOUT_H_
+#define _LAYOUT_H_
+
+#include <Arduino.h>
+
+/* *****************************************************************
+ * 界面布局：每个部件在表中登记位置、先后(z)、由哪个任务画、刷新周期和绘制函数。
+ * 部件编号就是在表中的下标，几套布局的编号必须一致，不显示的部件宽度为0。
+ * 数据变化时touch，清屏或被盖住后invalidate，各任务调用run只画到期或标记过的部件，
+ * 并统计每个部件的绘制次数和耗时。标记可以在任何任务中做，在_mux内。
+ * *****************************************************************/
+#define LayoutMaxWidgets 16
+
+struct LayoutRect
+{
+  int16_t x, y, w, h;
+};
+
+typedef void (*WidgetRender)(const LayoutRect &r, bool full); // full为真时连不变的部分也要画
+
+struct WidgetDef
+{
+  const char *name;
+  LayoutRect rect;
+  uint8_t z;           // 小的先画
+  uint8_t task;        // 由哪个任务画
+  uint16_t periodMs;   // 0表示只在标记后画
+  WidgetRender render; // NULL表示只提供位置，由别的部件一起画
+};
+
+struct LayoutTable
+{
+  const char *name;
+  const WidgetDef *widgets;
+  uint8_t count;
+};
+
+class Layout
+{
+public:
+  Layout();
+  void use(const LayoutTable *table); // 切换布局，之后全部重画
+  const LayoutTable *table() const { return _table; }
+  const LayoutRect &rect(uint8_t id) const { return _table->widgets[id].rect; }
+  bool visible(uint8_t id) const { return _table != NULL && id < _table->count && _table->widgets[id].rect.w > 0; }
+  void invalidate();           // 清屏后全部重画
+  void invalidate(uint8_t id); // 这个部件被盖住，下次全部重画
+  void touch(uint8_t id);      // 数据变了，下次更新
+  void setPeriod(uint8_t id, uint16_t ms); // 运行时改变周期，如夜间停动画
+  void render(uint8_t id, bool full);      // 立即画，开机时在任务外调用
+  uint8_t run(uint8_t task, uint32_t now); // 画这个任务到期和标记过的部件，返回画的个数
+  uint8_t renderAll(); // 不分任务按z全部重画，调用者要保证其他任务此时不画
+  uint32_t nextDue(uint8_t task, uint32_t now); // 离下一个周期部件到期的毫秒数，没有时为UINT32_MAX
+  void print(Print &out);
+
+private:
+  portMUX_TYPE _mux;
+  const LayoutTable *_table;
+  uint8_t _order[LayoutMaxWidgets]; // 按z排好的编号
+  uint32_t _touched;                // 按编号的位
+  uint32_t _full;
+  uint16_t _period[LayoutMaxWidgets];
+  uint32_t _last[LayoutMaxWidgets];
+
+  // 统计
+  uint32_t _renders[LayoutMaxWidgets];
+  uint32_t _fullRenders[LayoutMaxWidgets];
+  uint64_t _usSum[LayoutMaxWidgets];
+  uint32_t _usMax[LayoutMaxWidgets];
+  uint32_t _switches;
+
+  void draw(uint8_t id, bool full);
+};
+
+#endif
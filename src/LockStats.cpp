@@ -0,0 +1,82 @@
+#include "LockStats.h"
+
+static LockStats lockStats[LockStatsMax];
+static int lockStatsCount = 0;
+static portMUX_TYPE lockStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void copyTaskName(char *dst, const char *src)
+{
+  strncpy(dst, src ? src : "?", LockTaskLen - 1);
+  dst[LockTaskLen - 1] = '\0';
+}
+
+// 在创建互斥量后、创建任务前登记
+void LockStats::add(SemaphoreHandle_t *mutex, const char *name)
+{
+  if (lockStatsCount >= LockStatsMax)
+    return;
+  LockStats &s = lockStats[lockStatsCount];
+  memset(&s, 0, sizeof(s));
+  s.mutex = mutex;
+  s.name = name;
+  lockStatsCount++;
+}
+
+LockStats *LockStats::find(SemaphoreHandle_t *mutex)
+{
+  for (int i = 0; i < lockStatsCount; i++)
+  {
+    if (lockStats[i].mutex == mutex)
+      return &lockStats[i];
+  }
+  return NULL;
+}
+
+void LockStats::onAcquire(bool locked, uint32_t waitTime, const char *blocker)
+{
+  const char *task = pcTaskGetName(NULL);
+  portENTER_CRITICAL(&lockStatsMux);
+  if (locked)
+  {
+    acquires++;
+    copyTaskName(holder, task);
+  }
+  else
+  {
+    timeouts++;
+  }
+  waitUs += waitTime;
+  if (waitTime > maxWaitUs)
+  {
+    maxWaitUs = waitTime;
+    copyTaskName(maxWaiter, task);
+    copyTaskName(maxBlocker, blocker);
+  }
+  portEXIT_CRITICAL(&lockStatsMux);
+}
+
+void LockStats::onRelease(uint32_t holdTime)
+{
+  portENTER_CRITICAL(&lockStatsMux);
+  holdUs += holdTime;
+  if (holdTime > maxHoldUs)
+  {
+    maxHoldUs = holdTime;
+    memcpy(maxHolder, holder, LockTaskLen);
+  }
+  portEXIT_CRITICAL(&lockStatsMux);
+}
+
+void LockStats::print(Print &out)
+{
+  for (int i = 0; i < lockStatsCount; i++)
+  {
+    portENTER_CRITICAL(&lockStatsMux);
+    LockStats s = lockStats[i];
+    portEXIT_CRITICAL(&lockStatsMux);
+    out.printf("互斥量%s 获取:%u 超时:%u 等待:总%ums/最长%ums(%s等%s) 持有:总%ums/最长%ums(%s)\n",
+               s.name, s.acquires, s.timeouts,
+               (unsigned)(s.waitUs / 1000), s.maxWaitUs / 1000, s.maxWaiter, s.maxBlocker,
+               (unsigned)(s.holdUs / 1000), s.maxHoldUs / 1000, s.maxHolder);
+  }
+}
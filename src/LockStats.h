@@ -0,0 +1,36 @@
+#ifndef _LOCK_STATS_H_
+#define _LOCK_STATS_H_
+
+#include <Arduino.h>
+
+/* *****************************************************************
+ * 互斥量统计：按名字登记互斥量，SmartLocker每次获取、释放时累计等待和持有时间，
+ * 并记录最长一次等待时是哪个任务在等、哪个任务持有，用来查看任务之间的阻塞。
+ * *****************************************************************/
+#define LockStatsMax 4
+#define LockTaskLen 8
+
+struct LockStats
+{
+  SemaphoreHandle_t *mutex;
+  const char *name;
+  uint32_t acquires;     // 成功获取次数
+  uint32_t timeouts;     // 等待超时次数
+  uint64_t waitUs;       // 累计等待时间
+  uint32_t maxWaitUs;    // 最长等待时间
+  uint64_t holdUs;       // 累计持有时间
+  uint32_t maxHoldUs;    // 最长持有时间
+  char holder[LockTaskLen];     // 当前(或最后)持有者
+  char maxWaiter[LockTaskLen];  // 最长等待的任务
+  char maxBlocker[LockTaskLen]; // 最长等待时的持有者
+  char maxHolder[LockTaskLen];  // 持有最久的任务
+
+  static void add(SemaphoreHandle_t *mutex, const char *name);
+  static LockStats *find(SemaphoreHandle_t *mutex);
+  static void print(Print &out);
+
+  void onAcquire(bool locked, uint32_t waitTime, const char *blocker);
+  void onRelease(uint32_t holdTime);
+};
+
+#endif
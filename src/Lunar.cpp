@@ -0,0 +1,238 @@
+#include "Lunar.h"
+#include <stdio.h>
+#include <string.h>
+
+// 以下由tools/lunar_tables.py生成，不要手改。
+// LunarYearInfo：0x8000>>(月-1)为1时该月30天，低4位为闰月(0为没有)，0x10000为1时闰月30天。
+// LunarNewYear：正月初一距公历1月1日的天数。
+// LunarTermBits：每个节气2位，加LunarTermBase为当月日期，第k个节气在[k/4]的第k%4*2位。
+static const uint32_t LunarYearInfo[LunarLastYear - LunarFirstYear + 1] = {
+    0x04bd8, 0x04ae0, 0x0a570, 0x054d5, 0x0d260, 0x0d950, 0x16554, 0x056a0, 0x09ad0, 0x055d2,
+    0x04ae0, 0x0a5b6, 0x0a4d0, 0x0d250, 0x1d295, 0x0b550, 0x056a0, 0x0ada2, 0x095b0, 0x14977,
+    0x049b0, 0x0a4b0, 0x0b4b5, 0x06a50, 0x06d40, 0x1ab54, 0x02b60, 0x09570, 0x052f2, 0x04970,
+    0x06566, 0x0d4a0, 0x0ea50, 0x16a95, 0x05ad0, 0x02b60, 0x186e3, 0x092e0, 0x1c8d7, 0x0c950,
+    0x0d4a0, 0x1d8a6, 0x0b550, 0x056a0, 0x1a5b4, 0x025d0, 0x092d0, 0x0d2b2, 0x0a950, 0x0b557,
+    0x06ca0, 0x0b550, 0x15355, 0x04da0, 0x0a5b0, 0x14573, 0x052b0, 0x0a9a8, 0x0e950, 0x06aa0,
+    0x0aea6, 0x0ab50, 0x04b60, 0x0aae4, 0x0a570, 0x05260, 0x0f263, 0x0d950, 0x05b57, 0x056a0,
+    0x096d0, 0x04dd5, 0x04ad0, 0x0a4d0, 0x0d4d4, 0x0d250, 0x0d558, 0x0b540, 0x0b6a0, 0x195a6,
+    0x095b0, 0x049b0, 0x0a974, 0x0a4b0, 0x0b27a, 0x06a50, 0x06d40, 0x0af46, 0x0ab60, 0x09570,
+    0x04af5, 0x04970, 0x064b0, 0x074a3, 0x0ea50, 0x06b58, 0x05ac0, 0x0ab60, 0x096d5, 0x092e0,
+    0x0c960, 0x0d954, 0x0d4a0, 0x0da50, 0x07552, 0x056a0, 0x0abb7, 0x025d0, 0x092d0, 0x0cab5,
+    0x0a950, 0x0b4a0, 0x0baa4, 0x0ad50, 0x055d9, 0x04ba0, 0x0a5b0, 0x15176, 0x052b0, 0x0a930,
+    0x07954, 0x06aa0, 0x0ad50, 0x05b52, 0x04b60, 0x0a6e6, 0x0a4e0, 0x0d260, 0x0ea65, 0x0d530,
+    0x05aa0, 0x076a3, 0x096d0, 0x04afb, 0x04ad0, 0x0a4d0, 0x1d0b6, 0x0d250, 0x0d520, 0x0dd45,
+    0x0b5a0, 0x056d0, 0x055b2, 0x049b0, 0x0a577, 0x0a4b0, 0x0aa50, 0x1b255, 0x06d20, 0x0ada0,
+    0x14b63, 0x09370, 0x049f8, 0x04970, 0x064b0, 0x168a6, 0x0ea50, 0x06aa0, 0x1a6c4, 0x0aae0,
+    0x092e0, 0x0d2e3, 0x0c960, 0x0d557, 0x0d4a0, 0x0da50, 0x05d55, 0x056a0, 0x0a6d0, 0x055d4,
+    0x052d0, 0x0a9b8, 0x0a950, 0x0b4a0, 0x0b6a6, 0x0ad50, 0x055a0, 0x0aba4, 0x0a5b0, 0x052b0,
+    0x0b273, 0x06930, 0x07337, 0x06aa0, 0x0ad50, 0x14b55, 0x04b60, 0x0a570, 0x054e4, 0x0d160,
+    0x0e968, 0x0d520, 0x0daa0, 0x16aa6, 0x056d0, 0x04ae0, 0x0a9d4, 0x0a2d0, 0x0d150, 0x0f252,
+    0x0d520,
+};
+static const uint8_t LunarNewYear[LunarLastYear - LunarFirstYear + 1] = {
+    30, 49, 38, 28, 46, 34, 24, 43, 32, 21, 40, 29, 48, 36, 25, 44, 34, 22, 41, 31,
+    50, 38, 27, 46, 35, 23, 43, 32, 22, 40, 29, 47, 36, 25, 44, 34, 23, 41, 30, 49,
+    38, 26, 45, 35, 24, 43, 32, 21, 40, 28, 47, 36, 26, 44, 33, 23, 42, 30, 48, 38,
+    27, 45, 35, 24, 43, 32, 20, 39, 29, 47, 36, 26, 45, 33, 22, 41, 30, 48, 37, 27,
+    46, 35, 24, 43, 32, 50, 39, 28, 47, 36, 26, 45, 34, 22, 40, 30, 49, 37, 27, 46,
+    35, 23, 42, 31, 21, 39, 28, 48, 37, 25, 44, 33, 22, 40, 30, 49, 38, 27, 46, 35,
+    24, 42, 31, 21, 40, 28, 47, 36, 25, 43, 33, 22, 41, 30, 49, 38, 27, 45, 34, 23,
+    42, 31, 21, 40, 29, 47, 36, 25, 44, 32, 22, 41, 31, 49, 38, 27, 45, 34, 23, 42,
+    32, 20, 39, 28, 47, 35, 25, 44, 33, 22, 41, 30, 49, 37, 26, 45, 35, 23, 42, 32,
+    21, 39, 28, 47, 36, 25, 44, 33, 23, 40, 29, 48, 37, 26, 45, 35, 24, 42, 31, 20,
+    39,
+};
+static const uint8_t LunarTermBase[24] = {4, 19, 3, 18, 4, 19, 4, 19, 4, 20, 4, 20, 6, 22, 6, 22, 6, 22, 7, 22, 6, 21, 6, 21};
+static const uint8_t LunarTermBits[LunarLastYear - LunarFirstYear + 1][6] = {
+    {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a}, {0x6a, 0xaa, 0xba, 0xaa, 0xaa, 0xaa}, {0xaa, 0xaf, 0xbb, 0xba, 0xab, 0xaa},
+    {0xab, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a}, {0x6a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa}, {0xaa, 0xaf, 0xbb, 0xba, 0xab, 0xaa},
+    {0xab, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a}, {0x6a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa}, {0xaa, 0xaf, 0xbb, 0xba, 0xab, 0xaa},
+    {0xab, 0x5a, 0xa6, 0x65, 0xa6, 0x56}, {0x56, 0x9a, 0xaa, 0xa6, 0xa6, 0x6a}, {0x5a, 0x9a, 0xaa, 0xaa, 0xaa, 0xaa}, {0xaa, 0xae, 0xba, 0xaa, 0xab, 0xaa},
+    {0xaa, 0x5a, 0xa6, 0x65, 0x96, 0x56}, {0x56, 0x9a, 0xa6, 0xa6, 0xa6, 0x6a}, {0x5a, 0x9a, 0xaa, 0xaa, 0xaa, 0x6a}, {0xaa, 0xae, 0xba, 0xaa, 0xab, 0xaa},
+    {0xaa, 0x5a, 0xa6, 0x65, 0x96, 0x56}, {0x56, 0x5a, 0xa6, 0xa6, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xaa, 0xaa, 0x6a}, {0x6a, 0xaa, 0xba, 0xaa, 0xab, 0xaa},
+    {0xaa, 0x5a, 0xa6, 0x65, 0x96, 0x56}, {0x56, 0x5a, 0xa6, 0xa6, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a}, {0x6a, 0xaa, 0xba, 0xaa, 0xab, 0xaa},
+    {0xaa, 0x5a, 0xa6, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a}, {0x6a, 0xaa, 0xba, 0xaa, 0xaa, 0xaa},
+    {0xaa, 0x5a, 0x66, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a}, {0x6a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa},
+    {0xaa, 0x5a, 0x66, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a}, {0x6a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa},
+    {0xaa, 0x5a, 0x66, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a}, {0x6a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa},
+    {0xaa, 0x5a, 0x65, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0x96, 0x56}, {0x56, 0x9a, 0xaa, 0xa6, 0xa6, 0x6a}, {0x5a, 0x9a, 0xaa, 0xaa, 0xaa, 0xaa},
+    {0xaa, 0x59, 0x65, 0x55, 0x56, 0x55}, {0x55, 0x5a, 0xa6, 0x65, 0x96, 0x56}, {0x56, 0x5a, 0xa6, 0xa6, 0xa6, 0x6a}, {0x5a, 0x9a, 0xaa, 0xaa, 0xaa, 0xaa},
+    {0xaa, 0x59, 0x65, 0x55, 0x56, 0x55}, {0x55, 0x5a, 0xa6, 0x65, 0x96, 0x56}, {0x56, 0x5a, 0xa6, 0xa6, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a},
+    {0xaa, 0x55, 0x65, 0x55, 0x56, 0x55}, {0x55, 0x5a, 0xa6, 0x65, 0x96, 0x56}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a},
+    {0x6a, 0x55, 0x65, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a},
+    {0x6a, 0x55, 0x65, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a},
+    {0x6a, 0x55, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xaa, 0x6a},
+    {0x6a, 0x55, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a}, {0x5a, 0x9a, 0xaa, 0xa6, 0xa6, 0x6a},
+    {0x6a, 0x45, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x55, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0x96, 0x5a}, {0x5a, 0x9a, 0xa6, 0xa6, 0xa6, 0x6a},
+    {0x6a, 0x45, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x55, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0x96, 0x56}, {0x56, 0x5a, 0xa6, 0xa6, 0xa6, 0x6a},
+    {0x5a, 0x45, 0x55, 0x51, 0x55, 0x55}, {0x55, 0x59, 0x65, 0x55, 0x56, 0x55}, {0x55, 0x5a, 0xa6, 0x65, 0x96, 0x56}, {0x56, 0x5a, 0xa6, 0xa5, 0xa6, 0x5a},
+    {0x5a, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x55, 0x55, 0x65, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x96, 0x56}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a},
+    {0x5a, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x65, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a},
+    {0x5a, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a},
+    {0x5a, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a},
+    {0x5a, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x55, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0xa6, 0x5a},
+    {0x5a, 0x45, 0x55, 0x51, 0x51, 0x15}, {0x15, 0x45, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x55, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0x96, 0x5a},
+    {0x5a, 0x45, 0x51, 0x51, 0x51, 0x15}, {0x15, 0x45, 0x55, 0x51, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x55, 0x56, 0x55}, {0x56, 0x5a, 0xa6, 0x65, 0x96, 0x56},
+    {0x56, 0x05, 0x51, 0x51, 0x51, 0x15}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x55}, {0x55, 0x59, 0x65, 0x55, 0x56, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x96, 0x56},
+    {0x56, 0x05, 0x51, 0x10, 0x51, 0x15}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x55, 0x55, 0x65, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x96, 0x56},
+    {0x56, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x56, 0x55},
+    {0x56, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x66, 0x65, 0x56, 0x55},
+    {0x56, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x55, 0x56, 0x55},
+    {0x56, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x55, 0x56, 0x55},
+    {0x56, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x51, 0x51, 0x51, 0x15}, {0x15, 0x45, 0x55, 0x55, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x55, 0x56, 0x55},
+    {0x56, 0x05, 0x51, 0x10, 0x41, 0x05}, {0x05, 0x05, 0x51, 0x51, 0x51, 0x15}, {0x15, 0x45, 0x55, 0x51, 0x55, 0x55}, {0x55, 0x5a, 0x65, 0x55, 0x56, 0x55},
+    {0x56, 0x05, 0x11, 0x10, 0x41, 0x01}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x15}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x55}, {0x55, 0x55, 0x65, 0x55, 0x55, 0x55},
+    {0x55, 0x05, 0x11, 0x10, 0x41, 0x01}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x15}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x55}, {0x55, 0x55, 0x55, 0x55, 0x55, 0x55},
+    {0x55, 0x05, 0x11, 0x10, 0x41, 0x01}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x55, 0x55, 0x55, 0x55, 0x55, 0x55},
+    {0x55, 0x05, 0x11, 0x10, 0x01, 0x00}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55},
+    {0x55, 0x05, 0x11, 0x10, 0x01, 0x00}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55},
+    {0x55, 0x05, 0x10, 0x00, 0x01, 0x00}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x51, 0x51, 0x51, 0x15}, {0x15, 0x55, 0x55, 0x55, 0x55, 0x55},
+    {0x55, 0x05, 0x10, 0x00, 0x01, 0x00}, {0x01, 0x05, 0x51, 0x10, 0x41, 0x05}, {0x05, 0x45, 0x51, 0x51, 0x51, 0x15}, {0x15, 0x45, 0x55, 0x51, 0x55, 0x55},
+    {0x55, 0x05, 0x10, 0x00, 0x01, 0x00}, {0x01, 0x05, 0x51, 0x10, 0x41, 0x05}, {0x05, 0x05, 0x51, 0x50, 0x51, 0x15}, {0x15, 0x45, 0x55, 0x51, 0x55, 0x55},
+    {0x55, 0x05, 0x10, 0x00, 0x01, 0x00}, {0x01, 0x05, 0x11, 0x10, 0x41, 0x01}, {0x05, 0x05, 0x51, 0x10, 0x51, 0x15}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x55},
+    {0x55, 0x00, 0x10, 0x00, 0x00, 0x00}, {0x00, 0x05, 0x11, 0x10, 0x41, 0x01}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x15}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x55},
+    {0x55, 0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x05, 0x11, 0x10, 0x41, 0x01}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15},
+    {0x55, 0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x05, 0x11, 0x10, 0x01, 0x00}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15},
+    {0x15, 0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x05, 0x11, 0x00, 0x01, 0x00}, {0x01, 0x05, 0x51, 0x10, 0x51, 0x05}, {0x05, 0x45, 0x55, 0x51, 0x55, 0x15},
+    {0x15, 0x55, 0x55, 0x55, 0x55, 0x55},
+};
+
+static const char *const termNames[24] = {"小寒", "大寒", "立春", "雨水", "惊蛰", "春分", "清明", "谷雨",
+                                          "立夏", "小满", "芒种", "夏至", "小暑", "大暑", "立秋", "处暑",
+                                          "白露", "秋分", "寒露", "霜降", "立冬", "小雪", "大雪", "冬至"};
+static const char *const zodiacNames[12] = {"鼠", "牛", "虎", "兔", "龙", "蛇", "马", "羊", "猴", "鸡", "狗", "猪"};
+static const char *const stems[10] = {"甲", "乙", "丙", "丁", "戊", "己", "庚", "辛", "壬", "癸"};
+static const char *const branches[12] = {"子", "丑", "寅", "卯", "辰", "巳", "午", "未", "申", "酉", "戌", "亥"};
+static const char *const monthNames[12] = {"正", "二", "三", "四", "五", "六", "七", "八", "九", "十", "冬", "腊"};
+static const char *const dayTens[3] = {"初", "十", "廿"};
+static const char *const digits[10] = {"十", "一", "二", "三", "四", "五", "六", "七", "八", "九"};
+
+// 公历日期转天数(1970年1月1日为0)
+int32_t Lunar::dayNumber(int year, int month, int day)
+{
+  if (month <= 2)
+    year--;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  int32_t yoe = year - era * 400;
+  int32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+uint8_t Lunar::leapMonth(int lunarYear)
+{
+  return LunarYearInfo[lunarYear - LunarFirstYear] & 0xf;
+}
+
+uint8_t Lunar::leapDays(int lunarYear)
+{
+  if (!leapMonth(lunarYear))
+    return 0;
+  return (LunarYearInfo[lunarYear - LunarFirstYear] & 0x10000) ? 30 : 29;
+}
+
+uint8_t Lunar::monthDays(int lunarYear, uint8_t month)
+{
+  return (LunarYearInfo[lunarYear - LunarFirstYear] & (0x8000 >> (month - 1))) ? 30 : 29;
+}
+
+uint8_t Lunar::termDay(int year, uint8_t term)
+{
+  if (year < LunarFirstYear || year > LunarLastYear || term >= 24)
+    return 0;
+  return LunarTermBase[term] + ((LunarTermBits[year - LunarFirstYear][term / 4] >> (term % 4 * 2)) & 3);
+}
+
+// 星期四所在的年就是这一周所属的年
+uint8_t Lunar::isoWeek(int year, int month, int day)
+{
+  int32_t n = dayNumber(year, month, day);
+  int weekday = ((n % 7) + 10) % 7 + 1; // 1为星期一，1970年1月1日是星期四
+  int32_t thursday = n - weekday + 4;
+  int32_t first = dayNumber(year, 1, 1);
+  if (thursday < first)
+    first = dayNumber(year - 1, 1, 1);
+  else if (thursday >= dayNumber(year + 1, 1, 1))
+    first = dayNumber(year + 1, 1, 1);
+  return (thursday - first) / 7 + 1;
+}
+
+// 先按春节表定出农历年，再在这一年里按月减去天数
+bool Lunar::convert(int year, int month, int day, LunarDay &out)
+{
+  if (year < LunarFirstYear || year > LunarLastYear || month < 1 || month > 12 || day < 1 || day > 31)
+    return false;
+  int32_t n = dayNumber(year, month, day);
+  int lunarYear = year;
+  int32_t offset = n - dayNumber(year, 1, 1) - LunarNewYear[year - LunarFirstYear];
+  if (offset < 0)
+  {
+    if (--lunarYear < LunarFirstYear)
+      return false;
+    offset = n - dayNumber(lunarYear, 1, 1) - LunarNewYear[lunarYear - LunarFirstYear];
+  }
+  uint8_t leap = leapMonth(lunarYear);
+  uint8_t m = 1;
+  bool isLeap = false;
+  for (;;)
+  {
+    uint8_t days = isLeap ? leapDays(lunarYear) : monthDays(lunarYear, m);
+    if (offset < days)
+      break;
+    offset -= days;
+    if (m == leap && !isLeap)
+      isLeap = true;
+    else
+    {
+      isLeap = false;
+      m++;
+    }
+  }
+  out.year = lunarYear;
+  out.month = m;
+  out.day = offset + 1;
+  out.leap = isLeap;
+
+  // 每个公历月有两个节气，月初到第一个节气之间算上月的第二个节气之后
+  uint8_t first = (month - 1) * 2;
+  uint8_t firstDay = termDay(year, first);
+  uint8_t secondDay = termDay(year, first + 1);
+  out.term = day == firstDay ? first : day == secondDay ? first + 1 : LunarNoTerm;
+  out.lastTerm = day >= secondDay ? first + 1 : day >= firstDay ? first : (first + 23) % 24;
+  out.week = isoWeek(year, month, day);
+  return true;
+}
+
+const char *Lunar::termName(uint8_t term)
+{
+  return term < 24 ? termNames[term] : "";
+}
+
+// 公元4年为甲子鼠年
+const char *Lunar::zodiac(int lunarYear)
+{
+  return zodiacNames[((lunarYear - 4) % 12 + 12) % 12];
+}
+
+void Lunar::ganZhi(int lunarYear, char *out, size_t size)
+{
+  snprintf(out, size, "%s%s", stems[((lunarYear - 4) % 10 + 10) % 10], branches[((lunarYear - 4) % 12 + 12) % 12]);
+}
+
+void Lunar::dateText(const LunarDay &d, char *out, size_t size)
+{
+  char dayText[8];
+  if (d.day == 20 || d.day == 30)
+    snprintf(dayText, sizeof(dayText), "%s十", digits[d.day / 10]);
+  else
+    snprintf(dayText, sizeof(dayText), "%s%s", dayTens[(d.day - 1) / 10], digits[d.day % 10]);
+  snprintf(out, size, "%s%s月%s", d.leap ? "闰" : "", monthNames[d.month - 1], dayText);
+}
+
+void Lunar::termText(const LunarDay &d, char *out, size_t size)
+{
+  if (d.term != LunarNoTerm)
+    snprintf(out, size, "%s", termNames[d.term]);
+  else
+    snprintf(out, size, "%s后", termNames[d.lastTerm]);
+}
@@ -0,0 +1,49 @@
+#ifndef _LUNAR_H_
+#define _LUNAR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* *****************************************************************
+ * 本地农历：按表把公历日期换算成农历日期、节气、干支、生肖和周数，
+ * 不用联网。表由tools/lunar_tables.py按天文算法生成，每年一个数记月大小和闰月、
+ * 1字节春节日期、6字节24节气日期，换算不用从1900年逐年累加。
+ * 不依赖Arduino，可以在PC上编译(tools/lunar_check.cpp)。
+ * *****************************************************************/
+#define LunarFirstYear 1900
+#define LunarLastYear 2100 // 公历支持到2100年12月31日
+#define LunarTextLen 20    // "闰十二月廿九"的UTF-8加结尾
+#define LunarNoTerm -1
+
+struct LunarDay
+{
+  int16_t year;     // 农历年(正月初一开始)
+  uint8_t month;    // 1-12，11为冬月，12为腊月
+  uint8_t day;      // 1-30
+  bool leap;        // 闰月
+  int8_t term;      // 当天的节气，0为小寒，23为冬至，不是节气为LunarNoTerm
+  uint8_t lastTerm; // 当天或之前最近的节气
+  uint8_t week;     // ISO 8601周数
+};
+
+class Lunar
+{
+public:
+  // 公历1900年1月31日(农历正月初一)到2100年12月31日，超出范围返回false
+  static bool convert(int year, int month, int day, LunarDay &out);
+  static uint8_t termDay(int year, uint8_t term); // 节气在当月的日期，term为0-23，第term/2+1月
+  static uint8_t isoWeek(int year, int month, int day);
+  static const char *termName(uint8_t term);
+  static const char *zodiac(int lunarYear);                       // 生肖
+  static void ganZhi(int lunarYear, char *out, size_t size);      // 干支纪年，如"甲辰"
+  static void dateText(const LunarDay &d, char *out, size_t size); // 如"闰四月初一"、"腊月廿三"
+  static void termText(const LunarDay &d, char *out, size_t size); // 节气当天为"清明"，之后为"清明后"
+
+private:
+  static int32_t dayNumber(int year, int month, int day); // 1970年1月1日起的天数
+  static uint8_t monthDays(int lunarYear, uint8_t month);
+  static uint8_t leapMonth(int lunarYear);
+  static uint8_t leapDays(int lunarYear);
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "Metrics.h"
+#include <WiFi.h>
+#include <esp_heap_caps.h>
+
+// 取数耗时直方图的上界(毫秒)，超过最后一个的计入+Inf
+static const uint32_t latencyBounds[MetricsLatencyBuckets - 1] = {100, 250, 500, 1000, 2500, 5000, 10000};
+static const char *sourceLabels[FETCH_SOURCE_COUNT] = {"weather", "warning", "calendar"};
+
+Metrics::Metrics()
+{
+  for (int i = 0; i < MetricsTaskCount; i++)
+  {
+    _tasks[i].name = NULL;
+    _tasks[i].handle = NULL;
+    _tasks[i].busyUs = 0;
+    _tasks[i].busyMs = 0;
+  }
+  for (int i = 0; i < FETCH_SOURCE_COUNT; i++)
+  {
+    for (int b = 0; b < MetricsLatencyBuckets; b++)
+      _fetch[i].bucket[b] = 0;
+    _fetch[i].sumMs = 0;
+    _fetch[i].failures = 0;
+  }
+  _spiBytes = 0;
+  _jpegDecodes = 0;
+  _warnActivations = 0;
+  _wifiConnects = 0;
+  _wifiDisconnects = 0;
+}
+
+static void onWiFiEvent(WiFiEvent_t event)
+{
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+    metrics.countWifiConnect();
+  else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED)
+    metrics.countWifiDisconnect();
+}
+
+void Metrics::begin()
+{
+  WiFi.onEvent(onWiFiEvent);
+}
+
+void Metrics::registerTask(uint8_t idx, const char *name, TaskHandle_t handle)
+{
+  if (idx >= MetricsTaskCount)
+    return;
+  _tasks[idx].name = name;
+  _tasks[idx].handle = handle;
+}
+
+// 只由任务自己调用，不足1ms的部分留在busyUs中
+void Metrics::addTaskBusy(uint8_t idx, uint32_t us)
+{
+  if (idx >= MetricsTaskCount)
+    return;
+  TaskInfo &task = _tasks[idx];
+  task.busyUs += us;
+  if (task.busyUs >= 1000)
+  {
+    task.busyMs.fetch_add(task.busyUs / 1000, std::memory_order_relaxed);
+    task.busyUs %= 1000;
+  }
+}
+
+void Metrics::observeFetch(FetchSource src, uint32_t ms, bool ok)
+{
+  if (src >= FETCH_SOURCE_COUNT)
+    return;
+  Histogram &h = _fetch[src];
+  int b = 0;
+  while (b < MetricsLatencyBuckets - 1 && ms > latencyBounds[b])
+    b++;
+  h.bucket[b].fetch_add(1, std::memory_order_relaxed);
+  h.sumMs.fetch_add(ms, std::memory_order_relaxed);
+  if (!ok)
+    h.failures.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t Metrics::busyMs()
+{
+  uint32_t total = 0;
+  for (int i = 0; i < MetricsTaskCount; i++)
+    total += _tasks[i].busyMs.load(std::memory_order_relaxed);
+  return total;
+}
+
+static void printHeader(Print &out, const char *name, const char *type, const char *help)
+{
+  out.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Prometheus文本格式
+void Metrics::print(Print &out)
+{
+  printHeader(out, "sdd_uptime_seconds", "gauge", "Seconds since boot");
+  out.printf("sdd_uptime_seconds %u\n", (unsigned)(millis() / 1000));
+
+  printHeader(out, "sdd_heap_free_bytes", "gauge", "Free heap");
+  out.printf("sdd_heap_free_bytes %u\n", ESP.getFreeHeap());
+  printHeader(out, "sdd_heap_min_free_bytes", "gauge", "Minimum free heap since boot");
+  out.printf("sdd_heap_min_free_bytes %u\n", ESP.getMinFreeHeap());
+  printHeader(out, "sdd_heap_largest_free_block_bytes", "gauge", "Largest allocatable block");
+  out.printf("sdd_heap_largest_free_block_bytes %u\n", (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+  printHeader(out, "sdd_task_stack_free_min_bytes", "gauge", "Task stack high-water mark (unused bytes)");
+  for (int i = 0; i < MetricsTaskCount; i++)
+    if (_tasks[i].handle != NULL)
+      out.printf("sdd_task_stack_free_min_bytes{task=\"%s\"} %u\n", _tasks[i].name, (unsigned)uxTaskGetStackHighWaterMark(_tasks[i].handle));
+  printHeader(out, "sdd_task_busy_seconds_total", "counter", "Wall-clock time in the task loop body, including blocking and preemption (not CPU time)");
+  for (int i = 0; i < MetricsTaskCount; i++)
+    if (_tasks[i].handle != NULL)
+      out.printf("sdd_task_busy_seconds_total{task=\"%s\"} %.3f\n", _tasks[i].name, _tasks[i].busyMs.load(std::memory_order_relaxed) / 1000.0);
+
+  printHeader(out, "sdd_fetch_duration_seconds", "histogram", "HTTP fetch duration including retries");
+  for (int i = 0; i < FETCH_SOURCE_COUNT; i++)
+  {
+    Histogram &h = _fetch[i];
+    uint32_t cumulative = 0;
+    for (int b = 0; b < MetricsLatencyBuckets; b++)
+    {
+      cumulative += h.bucket[b].load(std::memory_order_relaxed);
+      if (b < MetricsLatencyBuckets - 1)
+        out.printf("sdd_fetch_duration_seconds_bucket{source=\"%s\",le=\"%g\"} %u\n", sourceLabels[i], latencyBounds[b] / 1000.0, cumulative);
+      else
+        out.printf("sdd_fetch_duration_seconds_bucket{source=\"%s\",le=\"+Inf\"} %u\n", sourceLabels[i], cumulative);
+    }
+    out.printf("sdd_fetch_duration_seconds_sum{source=\"%s\"} %.3f\n", sourceLabels[i], h.sumMs.load(std::memory_order_relaxed) / 1000.0);
+    out.printf("sdd_fetch_duration_seconds_count{source=\"%s\"} %u\n", sourceLabels[i], cumulative); // 和+Inf桶相同
+  }
+  printHeader(out, "sdd_fetch_failures_total", "counter", "Failed fetches");
+  for (int i = 0; i < FETCH_SOURCE_COUNT; i++)
+    out.printf("sdd_fetch_failures_total{source=\"%s\"} %u\n", sourceLabels[i], _fetch[i].failures.load(std::memory_order_relaxed));
+
+  printHeader(out, "sdd_jpeg_decodes_total", "counter", "JPEG images decoded");
+  out.printf("sdd_jpeg_decodes_total %u\n", _jpegDecodes.load(std::memory_order_relaxed));
+  printHeader(out, "sdd_spi_bytes_total", "counter", "Pixel bytes pushed to the display");
+  out.printf("sdd_spi_bytes_total %u\n", _spiBytes.load(std::memory_order_relaxed));
+  printHeader(out, "sdd_warning_activations_total", "counter", "Warning screen activations");
+  out.printf("sdd_warning_activations_total %u\n", _warnActivations.load(std::memory_order_relaxed));
+
+  printHeader(out, "sdd_wifi_rssi_dbm", "gauge", "WiFi signal strength");
+  if (WiFi.status() == WL_CONNECTED)
+    out.printf("sdd_wifi_rssi_dbm %d\n", WiFi.RSSI());
+  uint32_t connects = _wifiConnects.load(std::memory_order_relaxed);
+  printHeader(out, "sdd_wifi_reconnects_total", "counter", "WiFi reconnects after the first connection");
+  out.printf("sdd_wifi_reconnects_total %u\n", connects > 0 ? connects - 1 : 0);
+  printHeader(out, "sdd_wifi_disconnects_total", "counter", "WiFi disconnect events");
+  out.printf("sdd_wifi_disconnects_total %u\n", _wifiDisconnects.load(std::memory_order_relaxed));
+}
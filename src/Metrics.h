@@ -0,0 +1,73 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include "FetchScheduler.h"
+
+/* *****************************************************************
+ * 运行指标：计数器都是32位原子变量，用relaxed方式累加，可以在绘图回调等热点路径调用。
+ * 32位计数溢出后从0重新开始，Prometheus的rate()会按计数器重置处理。
+ * print()按Prometheus文本格式输出，供/metrics接口使用。
+ * *****************************************************************/
+#define MetricsTaskCount 4      // 任务A-D
+#define MetricsLatencyBuckets 8 // 取数耗时直方图的桶数(最后一个为+Inf)
+
+class Metrics
+{
+public:
+  Metrics();
+  void begin(); // 注册WiFi事件
+  void registerTask(uint8_t idx, const char *name, TaskHandle_t handle);
+
+  void addSpiBytes(uint32_t bytes) { _spiBytes.fetch_add(bytes, std::memory_order_relaxed); }
+  void countJpeg(uint32_t n = 1) { _jpegDecodes.fetch_add(n, std::memory_order_relaxed); }
+  void countWarnActivation() { _warnActivations.fetch_add(1, std::memory_order_relaxed); }
+  void countWifiConnect() { _wifiConnects.fetch_add(1, std::memory_order_relaxed); }
+  void countWifiDisconnect() { _wifiDisconnects.fetch_add(1, std::memory_order_relaxed); }
+  void addTaskBusy(uint8_t idx, uint32_t us);
+  void observeFetch(FetchSource src, uint32_t ms, bool ok);
+  uint32_t busyMs(); // 所有任务循环体累计用时
+
+  void print(Print &out);
+
+private:
+  struct TaskInfo
+  {
+    const char *name;
+    TaskHandle_t handle;
+    uint32_t busyUs;                // 不足1ms的部分，只由任务自己修改
+    std::atomic<uint32_t> busyMs;   // 累计循环体用时(墙钟时间)
+  };
+  struct Histogram
+  {
+    std::atomic<uint32_t> bucket[MetricsLatencyBuckets];
+    std::atomic<uint32_t> sumMs;
+    std::atomic<uint32_t> failures;
+  };
+
+  TaskInfo _tasks[MetricsTaskCount];
+  Histogram _fetch[FETCH_SOURCE_COUNT];
+  std::atomic<uint32_t> _spiBytes;
+  std::atomic<uint32_t> _jpegDecodes;
+  std::atomic<uint32_t> _warnActivations;
+  std::atomic<uint32_t> _wifiConnects;
+  std::atomic<uint32_t> _wifiDisconnects;
+};
+
+extern Metrics metrics;
+
+// 统计任务一次循环体的墙钟时间，放在任务循环体开头。
+// 包括循环体内等锁、等网络和被高优先级任务抢占的时间，不是CPU占用；等下一轮的延时和通知不在其中
+class TaskBusyScope
+{
+public:
+  TaskBusyScope(uint8_t idx) : _idx(idx), _start(micros()) {}
+  ~TaskBusyScope() { metrics.addTaskBusy(_idx, micros() - _start); }
+
+private:
+  uint8_t _idx;
+  uint32_t _start;
+};
+
+#endif
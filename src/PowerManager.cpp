@@ -0,0 +1,158 @@
+#include "PowerManager.h"
+#include <WiFi.h>
+#include "Metrics.h"
+
+// 电流估算用的典型值(mA)，来自ESP32数据手册和常见240x240屏模组，只用于粗略比较
+#define CurrentActiveMa 68.0f     // 240MHz运行
+#define CurrentIdleMaxMa 30.0f    // 240MHz空闲(WAITI)
+#define CurrentIdleMinMa 20.0f    // 80MHz空闲
+#define CurrentLightSleepMa 0.8f  // 浅睡眠
+#define CurrentWifiMa 10.0f       // modem sleep下WiFi平均(DTIM1)
+#define CurrentBacklightMa 30.0f  // 背光满亮度
+
+static const char *modeNames[] = {"全速", "降频", "浅睡眠"};
+
+PowerManager::PowerManager()
+{
+  _mode = POWER_FULL;
+  _night = false;
+  _backlight = 0;
+  _cpuLock = NULL;
+  _noSleepLock = NULL;
+  _noSleepHeld = false;
+  _lightSleep = false;
+  _noSleepSince = 0;
+  _noSleepMs = 0;
+  _nightSince = 0;
+  _nightMs = 0;
+}
+
+// 在任务创建之后调用，之后没有持锁的代码都会在80MHz下运行，频率由CpuGovernor调节
+void PowerManager::begin(bool enable)
+{
+  if (!enable)
+  {
+    Serial.println("省电模式未开启");
+    return;
+  }
+  if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "frame", &_cpuLock) != ESP_OK ||
+      esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "backlight", &_noSleepLock) != ESP_OK)
+  {
+    Serial.println("固件未开启电源管理，全速运行");
+    _cpuLock = NULL;
+    _noSleepLock = NULL;
+    return;
+  }
+  updateSleepLock();
+
+  esp_pm_config_esp32_t cfg = {};
+  cfg.max_freq_mhz = getCpuFrequencyMhz();
+  cfg.min_freq_mhz = 80; // 不低于80MHz，APB时钟不变，SPI和定时器不受影响
+  cfg.light_sleep_enable = true;
+  esp_err_t err = esp_pm_configure(&cfg);
+  if (err == ESP_ERR_NOT_SUPPORTED)
+  {
+    // 没有开启tickless idle，只降频
+    cfg.light_sleep_enable = false;
+    err = esp_pm_configure(&cfg);
+  }
+  if (err != ESP_OK)
+  {
+    Serial.printf("电源管理配置失败：%d，全速运行\n", err);
+    return;
+  }
+  _lightSleep = cfg.light_sleep_enable;
+  _mode = _lightSleep ? POWER_LIGHT_SLEEP : POWER_DFS;
+  WiFi.setSleep(WIFI_PS_MIN_MODEM);
+  Serial.printf("省电模式：%s，%d-%dMHz\n", modeNames[_mode], cfg.min_freq_mhz, cfg.max_freq_mhz);
+}
+
+void PowerManager::acquire()
+{
+  if (_cpuLock != NULL)
+    esp_pm_lock_acquire(_cpuLock);
+}
+
+void PowerManager::release()
+{
+  if (_cpuLock != NULL)
+    esp_pm_lock_release(_cpuLock);
+}
+
+bool PowerManager::setMaxFreq(uint32_t mhz)
+{
+  if (_mode == POWER_FULL)
+    return false;
+  esp_pm_config_esp32_t cfg = {};
+  cfg.max_freq_mhz = mhz;
+  cfg.min_freq_mhz = 80;
+  cfg.light_sleep_enable = _lightSleep;
+  return esp_pm_configure(&cfg) == ESP_OK;
+}
+
+void PowerManager::setBacklight(uint32_t level)
+{
+  _backlight = level;
+  updateSleepLock();
+}
+
+// 背光点亮时不允许浅睡眠，夜间最低亮度也一样，否则PWM在睡眠期间停止，背光闪烁
+void PowerManager::updateSleepLock()
+{
+  if (_noSleepLock == NULL)
+    return;
+  bool need = _backlight > 0;
+  if (need == _noSleepHeld)
+    return;
+  if (need)
+  {
+    esp_pm_lock_acquire(_noSleepLock);
+    _noSleepSince = millis();
+  }
+  else
+  {
+    esp_pm_lock_release(_noSleepLock);
+    _noSleepMs += millis() - _noSleepSince;
+  }
+  _noSleepHeld = need;
+}
+
+void PowerManager::setNight(bool night)
+{
+  if (night == _night)
+    return;
+  if (night)
+    _nightSince = millis();
+  else
+    _nightMs += millis() - _nightSince;
+  _night = night;
+}
+
+// 忙时按240MHz运行计算，空闲时按模式计算，两个核按一个计算，结果偏大
+float PowerManager::estimateCurrent(float busyRatio)
+{
+  if (busyRatio > 1.0f)
+    busyRatio = 1.0f;
+  float idleMa = CurrentIdleMaxMa;
+  if (_mode == POWER_DFS)
+  {
+    idleMa = CurrentIdleMinMa;
+  }
+  else if (_mode == POWER_LIGHT_SLEEP)
+  {
+    uint32_t now = millis();
+    uint32_t noSleep = _noSleepMs + (_noSleepHeld ? now - _noSleepSince : 0);
+    float awake = now ? (float)noSleep / now : 1.0f;
+    idleMa = awake * CurrentIdleMinMa + (1.0f - awake) * CurrentLightSleepMa;
+  }
+  return busyRatio * CurrentActiveMa + (1.0f - busyRatio) * idleMa + CurrentWifiMa + CurrentBacklightMa * _backlight / 255;
+}
+
+void PowerManager::print(Print &out)
+{
+  uint32_t now = millis();
+  uint32_t nightMs = _nightMs + (_night ? now - _nightSince : 0);
+  float busy = now ? (float)metrics.busyMs() / now : 0.0f;
+  out.printf("电源 模式:%s 夜间:%s(累计%us) 任务忙:%.1f%% 估算平均电流:%.1fmA\n",
+             modeNames[_mode], _night ? "是" : "否", nightMs / 1000, busy * 100, estimateCurrent(busy));
+}
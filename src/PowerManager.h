@@ -0,0 +1,57 @@
+#ifndef _POWER_MANAGER_H_
+#define _POWER_MANAGER_H_
+
+#include <Arduino.h>
+#include <esp_pm.h>
+
+/* *****************************************************************
+ * 省电模式：用esp_pm在空闲时自动降到80MHz(DFS)，固件支持时允许自动浅睡眠，
+ * WiFi用modem sleep，每个DTIM信标醒一次，web服务仍可访问，只是响应多一点延迟。
+ * 运行时的频率由CpuGovernor通过最高频率锁和setMaxFreq()调节。
+ * LEDC背光使用APB时钟，浅睡眠时会停止输出造成闪烁，所以背光点亮时(包括夜间最低亮度)
+ * 持有禁止浅睡眠锁，只有背光关闭时才浅睡眠；夜间靠降低刷新频率和降频省电。
+ * 固件没有开启CONFIG_PM_ENABLE时全速运行；没有开启tickless idle时只降频。
+ * *****************************************************************/
+enum PowerMode
+{
+  POWER_FULL,       // 全速运行
+  POWER_DFS,        // 空闲降频
+  POWER_LIGHT_SLEEP // 空闲降频+自动浅睡眠
+};
+
+class PowerManager
+{
+public:
+  PowerManager();
+  void begin(bool enable);
+  void setBacklight(uint32_t level); // 背光亮度改变时调用
+  void setNight(bool night);         // 夜间降低刷新频率
+  bool isNight() const { return _night; }
+  PowerMode mode() const { return _mode; }
+
+  void acquire();                  // 持有最高频率锁
+  void release();
+  bool setMaxFreq(uint32_t mhz);   // 修改持锁时的频率
+
+  float estimateCurrent(float busyRatio); // 平均电流估算(mA)
+  void print(Print &out);
+
+private:
+  PowerMode _mode;
+  bool _night;
+  uint32_t _backlight;
+  esp_pm_lock_handle_t _cpuLock;
+  esp_pm_lock_handle_t _noSleepLock;
+  bool _noSleepHeld;
+  bool _lightSleep;
+  uint32_t _noSleepSince; // 背光点亮(禁止浅睡眠)的开始时间
+  uint32_t _noSleepMs;
+  uint32_t _nightSince;
+  uint32_t _nightMs;
+
+  void updateSleepLock();
+};
+
+extern PowerManager power;
+
+#endif
@@ -0,0 +1,240 @@
+#include "Settings.h"
+#include <EEPROM.h>
+#include <rom/crc.h>
+#include "CpuGovernor.h"
+
+// 旧版本EEPROM参数地址，只在迁移时使用
+#define LegacyBL_addr 1     // 亮度
+#define LegacyRo_addr 2     // 旋转方向
+#define LegacyDHT_addr 3    // DHT使能标志位
+#define LegacyUpWeT_addr 4  // 更新时间
+#define LegacyCC_addr 10    // 城市代码，5个字节，每字节存两位十进制
+#define LegacyWifi_addr 30  // wifi-ssid-psw
+
+static const char *slotKeys[2] = {"cfgA", "cfgB"};
+
+Settings::Settings()
+{
+  _dirty = false;
+  _migrated = false;
+  _commits = 0;
+  _skips = 0;
+  _bytesWritten = 0;
+  setDefaults();
+}
+
+void Settings::setDefaults()
+{
+  memset(&_data, 0, sizeof(_data));
+  _data.magic = SettingsMagic;
+  _data.version = SettingsVersion;
+  _data.backlight = 250;
+  _data.updateMinutes = 20;
+}
+
+uint32_t Settings::calcCrc(const SettingsData *data)
+{
+  return crc32_le(0, (const uint8_t *)data, offsetof(SettingsData, crc));
+}
+
+bool Settings::loadSlot(const char *key, SettingsData *out)
+{
+  if (_prefs.getBytesLength(key) != sizeof(SettingsData))
+    return false;
+  if (_prefs.getBytes(key, out, sizeof(SettingsData)) != sizeof(SettingsData))
+    return false;
+  return out->magic == SettingsMagic && out->version == SettingsVersion && out->crc == calcCrc(out);
+}
+
+// 读取A/B两份设置，取序号较新的一份；都无效时从EEPROM迁移
+bool Settings::begin()
+{
+  if (!_prefs.begin(SettingsNamespace, false))
+  {
+    Serial.println("设置存储打开失败，使用默认值");
+    return false;
+  }
+
+  SettingsData slot[2];
+  bool valid[2];
+  for (int i = 0; i < 2; i++)
+    valid[i] = loadSlot(slotKeys[i], &slot[i]);
+
+  if (valid[0] && valid[1])
+    _data = (slot[1].seq > slot[0].seq) ? slot[1] : slot[0];
+  else if (valid[0])
+    _data = slot[0];
+  else if (valid[1])
+    _data = slot[1];
+  else
+  {
+    migrateLegacy();
+    commit();
+    return true;
+  }
+  Serial.printf("读取设置，序号：%u\n", _data.seq);
+  return true;
+}
+
+// 从旧的按字节存放的EEPROM读取设置，范围不对的用默认值
+void Settings::migrateLegacy()
+{
+  setDefaults();
+  EEPROM.begin(1024);
+
+  uint32_t code = 0;
+  for (int cnum = 5; cnum > 0; cnum--)
+  {
+    code = code * 100;
+    code += EEPROM.read(LegacyCC_addr + cnum - 1);
+  }
+  if (isValidCityCode(code))
+    _data.cityCode = code;
+
+  uint8_t v = EEPROM.read(LegacyBL_addr);
+  if (v > 0 && v < 255)
+    _data.backlight = v;
+  v = EEPROM.read(LegacyRo_addr);
+  if (v <= 3)
+    _data.rotation = v;
+  _data.dhtEnable = EEPROM.read(LegacyDHT_addr) == 1;
+  v = EEPROM.read(LegacyUpWeT_addr);
+  if (v > 0 && v < 60)
+    _data.updateMinutes = v;
+
+  char ssid[sizeof(_data.ssid)];
+  char psk[sizeof(_data.psk)];
+  for (int i = 0; i < (int)sizeof(ssid); i++)
+    ssid[i] = EEPROM.read(LegacyWifi_addr + i);
+  for (int i = 0; i < (int)sizeof(psk); i++)
+    psk[i] = EEPROM.read(LegacyWifi_addr + sizeof(ssid) + i);
+  ssid[sizeof(ssid) - 1] = '\0';
+  psk[sizeof(psk) - 1] = '\0';
+  setWifi(ssid, psk); // 有不可显示字符时不迁移
+
+  _migrated = true;
+  _dirty = true;
+  Serial.println("设置已从EEPROM迁移");
+}
+
+// 写入另一份槽位，一次写入整个结构体
+bool Settings::commit()
+{
+  if (!_dirty)
+  {
+    _skips++;
+    return true;
+  }
+  _data.seq++;
+  _data.magic = SettingsMagic;
+  _data.version = SettingsVersion;
+  _data.crc = calcCrc(&_data);
+
+  size_t len = _prefs.putBytes(slotKeys[_data.seq & 1], &_data, sizeof(_data));
+  if (len != sizeof(_data))
+  {
+    Serial.println("设置保存失败");
+    return false;
+  }
+  _dirty = false;
+  _commits++;
+  _bytesWritten += len;
+  Serial.printf("设置已保存，序号：%u，写入%u字节\n", _data.seq, (unsigned)len);
+  return true;
+}
+
+bool Settings::setCityCode(uint32_t code)
+{
+  if (!isValidCityCode(code))
+    return false;
+  if (_data.cityCode != code)
+  {
+    _data.cityCode = code;
+    _dirty = true;
+  }
+  return true;
+}
+
+bool Settings::setBacklight(int value)
+{
+  if (value < 0 || value > 255)
+    return false;
+  if (_data.backlight != value)
+  {
+    _data.backlight = value;
+    _dirty = true;
+  }
+  return true;
+}
+
+bool Settings::setRotation(int value)
+{
+  if (value < 0 || value > 3)
+    return false;
+  if (_data.rotation != value)
+  {
+    _data.rotation = value;
+    _dirty = true;
+  }
+  return true;
+}
+
+void Settings::setDhtEnable(bool en)
+{
+  if (_data.dhtEnable != (uint8_t)en)
+  {
+    _data.dhtEnable = en;
+    _dirty = true;
+  }
+}
+
+bool Settings::setUpdateMinutes(int minutes)
+{
+  if (minutes < 1 || minutes > 60)
+    return false;
+  if (_data.updateMinutes != minutes)
+  {
+    _data.updateMinutes = minutes;
+    _dirty = true;
+  }
+  return true;
+}
+
+bool Settings::setCpuPolicy(int policy)
+{
+  if (policy < 0 || policy >= CPU_POLICY_COUNT)
+    return false;
+  if (_data.cpuPolicy != policy)
+  {
+    _data.cpuPolicy = policy;
+    _dirty = true;
+  }
+  return true;
+}
+
+// 保存WiFi信息，名称或密码过长、含不可显示字符时返回false
+bool Settings::setWifi(const char *ssid, const char *psk)
+{
+  if (strlen(ssid) >= sizeof(_data.ssid) || strlen(psk) >= sizeof(_data.psk))
+    return false;
+  for (const char *p = ssid; *p; p++)
+    if (!isPrintable(*p))
+      return false;
+  for (const char *p = psk; *p; p++)
+    if (!isPrintable(*p))
+      return false;
+  if (strcmp(_data.ssid, ssid) != 0 || strcmp(_data.psk, psk) != 0)
+  {
+    memset(_data.ssid, 0, sizeof(_data.ssid));
+    memset(_data.psk, 0, sizeof(_data.psk));
+    strcpy(_data.ssid, ssid);
+    strcpy(_data.psk, psk);
+    _dirty = true;
+  }
+  return true;
+}
+
+void Settings::clearWifi()
+{
+  setWifi("", "");
+}
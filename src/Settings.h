@@ -0,0 +1,81 @@
+#ifndef _SETTINGS_H_
+#define _SETTINGS_H_
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+/* *****************************************************************
+ * 参数存储：所有设置放在一个带版本号和CRC的结构体里，一次写入NVS。
+ * NVS本身有磨损均衡，另外用A/B两个键轮流写，读取时取序号较新且校验正确的一份，
+ * 写到一半断电也能用上一份。串口、WiFiManager、web配置都通过这里读写。
+ * *****************************************************************/
+#define SettingsMagic 0x5344U // "SD"
+#define SettingsVersion 1
+#define SettingsNamespace "settings"
+
+struct SettingsData
+{
+  uint16_t magic;
+  uint8_t version;
+  uint8_t cpuPolicy;      // CPU频率策略，0自动(原保留字节，旧数据为0)
+  uint32_t seq;           // 写入序号，每次保存加1
+  uint32_t cityCode;      // 城市代码，0为自动获取
+  uint8_t backlight;      // 屏幕亮度0-255
+  uint8_t rotation;       // 屏幕方向0-3
+  uint8_t dhtEnable;      // DHT传感器使能
+  uint8_t updateMinutes;  // 天气更新时间(分钟)
+  char ssid[32];          // WIFI名
+  char psk[64];           // WIFI密码
+  uint32_t crc;           // 以上内容的CRC32
+};
+
+class Settings
+{
+public:
+  Settings();
+  bool begin(); // 读取设置，NVS中没有时从旧的EEPROM迁移
+  bool commit(); // 有修改时写入一次
+
+  uint32_t cityCode() { return _data.cityCode; }
+  uint8_t backlight() { return _data.backlight; }
+  uint8_t rotation() { return _data.rotation; }
+  bool dhtEnable() { return _data.dhtEnable != 0; }
+  uint8_t updateMinutes() { return _data.updateMinutes; }
+  uint8_t cpuPolicy() { return _data.cpuPolicy; }
+  const char *ssid() { return _data.ssid; }
+  const char *psk() { return _data.psk; }
+
+  // 参数超出范围时返回false，不修改
+  bool setCityCode(uint32_t code);
+  bool setBacklight(int value);
+  bool setRotation(int value);
+  void setDhtEnable(bool en);
+  bool setUpdateMinutes(int minutes);
+  bool setCpuPolicy(int policy);
+  bool setWifi(const char *ssid, const char *psk);
+  void clearWifi();
+
+  static bool isValidCityCode(uint32_t code) { return code == 0 || (code >= 101000000 && code <= 102000000); }
+
+  uint32_t getSeq() { return _data.seq; }               // 累计写入次数
+  uint32_t getCommitCount() { return _commits; }        // 本次开机写入次数
+  uint32_t getSkipCount() { return _skips; }            // 内容没变跳过的次数
+  uint32_t getBytesWritten() { return _bytesWritten; }  // 本次开机写入字节数
+  bool isMigrated() { return _migrated; }
+
+private:
+  Preferences _prefs;
+  SettingsData _data;
+  bool _dirty;
+  bool _migrated;
+  uint32_t _commits;
+  uint32_t _skips;
+  uint32_t _bytesWritten;
+
+  void setDefaults();
+  bool loadSlot(const char *key, SettingsData *out);
+  void migrateLegacy();
+  static uint32_t calcCrc(const SettingsData *data);
+};
+
+#endif
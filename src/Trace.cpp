@@ -0,0 +1,180 @@
+#include "Trace.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+Trace::Ring Trace::_rings[TraceCores];
+
+uint32_t Trace::now()
+{
+#ifdef ARDUINO
+  return micros();
+#else
+  static const auto t0 = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+#endif
+}
+
+// 占位后写入事件，最后写seq表示事件完整
+void Trace::record(const char *name, uint32_t start, uint32_t dur)
+{
+#ifdef ARDUINO
+  uint8_t core = xPortGetCoreID() % TraceCores;
+  const char *task = pcTaskGetName(NULL);
+#else
+  uint8_t core = 0;
+  const char *task = "host";
+#endif
+  Ring &ring = _rings[core];
+  uint32_t idx = ring.head.fetch_add(1, std::memory_order_relaxed);
+  TraceEvent &e = ring.events[idx % TraceCapacity];
+
+  e.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  e.name = name;
+  e.start = start;
+  e.dur = dur;
+  strncpy(e.task, task ? task : "?", TraceTaskLen - 1);
+  e.task[TraceTaskLen - 1] = '\0';
+  e.seq.store(idx + 1, std::memory_order_release);
+}
+
+void Trace::clear()
+{
+  for (int c = 0; c < TraceCores; c++)
+  {
+    for (int i = 0; i < TraceCapacity; i++)
+      _rings[c].events[i].seq.store(0, std::memory_order_relaxed);
+    _rings[c].head.store(0, std::memory_order_relaxed);
+  }
+}
+
+TraceDump::TraceDump()
+{
+  for (int c = 0; c < TraceCores; c++)
+  {
+    _end[c] = Trace::_rings[c].head.load(std::memory_order_acquire);
+    _begin[c] = _end[c] > TraceCapacity ? _end[c] - TraceCapacity : 0;
+  }
+  _core = 0;
+  _pos = _begin[0];
+  _state = 0;
+  _meta = 0;
+  _first = true;
+  _taskCount = 0;
+  _lineLen = 0;
+  _lineOff = 0;
+}
+
+// 任务名转成tid，最多16个任务，超出的合用最后一个
+int TraceDump::taskId(const char *task)
+{
+  for (int i = 0; i < _taskCount; i++)
+  {
+    if (strncmp(_tasks[i], task, TraceTaskLen) == 0)
+      return i + 1;
+  }
+  if (_taskCount >= TraceMaxTasks)
+    return TraceMaxTasks;
+  strncpy(_tasks[_taskCount], task, TraceTaskLen);
+  return ++_taskCount;
+}
+
+// 生成下一行JSON，输出完成返回false
+bool TraceDump::nextLine()
+{
+  const char *sep = _first ? "" : ",\n";
+  switch (_state)
+  {
+  case 0:
+    _lineLen = snprintf(_line, sizeof(_line), "{\"traceEvents\":[\n");
+    _state = 1;
+    return true;
+  case 1:
+    while (_core < TraceCores)
+    {
+      while (_pos < _end[_core])
+      {
+        uint32_t idx = _pos++;
+        const TraceEvent &e = Trace::_rings[_core].events[idx % TraceCapacity];
+        if (e.seq.load(std::memory_order_acquire) != idx + 1)
+          continue;
+        const char *name = e.name;
+        uint32_t start = e.start;
+        uint32_t dur = e.dur;
+        char task[TraceTaskLen];
+        memcpy(task, e.task, TraceTaskLen);
+        task[TraceTaskLen - 1] = '\0';
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (e.seq.load(std::memory_order_relaxed) != idx + 1)
+          continue; // 读取过程中被覆盖
+        _lineLen = snprintf(_line, sizeof(_line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%u,\"dur\":%u,\"pid\":%u,\"tid\":%d}",
+                            sep, name, (unsigned)start, (unsigned)dur, (unsigned)_core, taskId(task));
+        _first = false;
+        return true;
+      }
+      _core++;
+      if (_core < TraceCores)
+        _pos = _begin[_core];
+    }
+    _state = 2;
+    return nextLine();
+  case 2:
+    // 先输出每个核的进程名，再输出每个核下的线程名
+    if (_meta < TraceCores)
+    {
+      _lineLen = snprintf(_line, sizeof(_line), "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"core%u\"}}",
+                          sep, (unsigned)_meta, (unsigned)_meta);
+      _meta++;
+      _first = false;
+      return true;
+    }
+    if (_meta < TraceCores + TraceCores * _taskCount)
+    {
+      int i = _meta - TraceCores;
+      _lineLen = snprintf(_line, sizeof(_line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                          sep, i % TraceCores, i / TraceCores + 1, _tasks[i / TraceCores]);
+      _meta++;
+      _first = false;
+      return true;
+    }
+    _state = 3;
+    return nextLine();
+  case 3:
+    _lineLen = snprintf(_line, sizeof(_line), "\n]}\n");
+    _state = 4;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// 填满buf，一行放不下时留到下次继续输出
+size_t TraceDump::read(char *buf, size_t len)
+{
+  size_t used = 0;
+  while (used < len)
+  {
+    if (_lineOff >= _lineLen)
+    {
+      _lineOff = 0;
+      _lineLen = 0;
+      if (!nextLine())
+        break;
+      if (_lineLen >= sizeof(_line))
+        _lineLen = sizeof(_line) - 1; // snprintf截断
+    }
+    size_t n = _lineLen - _lineOff;
+    if (n > len - used)
+      n = len - used;
+    memcpy(buf + used, _line + _lineOff, n);
+    used += n;
+    _lineOff += n;
+  }
+  return used;
+}
@@ -0,0 +1,93 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/* *****************************************************************
+ * 热点路径耗时跟踪：TRACE_SCOPE在作用域结束时写入一条定长事件，
+ * 每个核一个环形缓冲区，用原子自增占位，不加锁，写满后覆盖最旧的事件。
+ * TraceDump分段输出Chrome trace JSON(chrome://tracing或Perfetto打开)。
+ * 不定义ARDUINO时用std::chrono计时，可以在PC上编译运行。
+ * *****************************************************************/
+#ifndef TRACE_EN
+#define TRACE_EN 1
+#endif
+
+#define TraceCores 2
+#define TraceCapacity 256 // 每个核保存的事件数
+#define TraceTaskLen 8
+#define TraceMaxTasks 16
+
+struct TraceEvent
+{
+  const char *name;        // 只保存指针，必须是字符串常量
+  uint32_t start;          // 开始时间(us)
+  uint32_t dur;            // 持续时间(us)
+  std::atomic<uint32_t> seq; // 写入完成后才更新为序号+1，读取时用来判断事件是否完整
+  char task[TraceTaskLen]; // 任务名
+};
+
+class Trace
+{
+public:
+  static uint32_t now();
+  static void record(const char *name, uint32_t start, uint32_t dur);
+  static void clear();
+
+private:
+  friend class TraceDump;
+  struct Ring
+  {
+    std::atomic<uint32_t> head;
+    TraceEvent events[TraceCapacity];
+  };
+  static Ring _rings[TraceCores];
+};
+
+class TraceScope
+{
+public:
+  TraceScope(const char *name) : _name(name), _start(Trace::now()) {}
+  ~TraceScope() { Trace::record(_name, _start, Trace::now() - _start); }
+
+private:
+  const char *_name;
+  uint32_t _start;
+};
+
+// 分段输出JSON，每次read()尽量填满缓冲区，返回0表示结束
+class TraceDump
+{
+public:
+  TraceDump();
+  size_t read(char *buf, size_t len);
+
+private:
+  uint8_t _core;
+  uint32_t _pos;
+  uint32_t _begin[TraceCores];
+  uint32_t _end[TraceCores];
+  uint8_t _state; // 0开头 1事件 2进程名和线程名 3结尾 4结束
+  int _meta;
+  bool _first;
+  uint8_t _taskCount;
+  char _tasks[TraceMaxTasks][TraceTaskLen];
+  char _line[160];
+  size_t _lineLen;
+  size_t _lineOff;
+
+  int taskId(const char *task);
+  bool nextLine();
+};
+
+#if TRACE_EN
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(_traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+#endif
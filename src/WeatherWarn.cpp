@@ -5,21 +5,49 @@ WeatherWarn::WeatherWarn() {
  
 //例如 location="101010100"，城市相关ID从https://github.com/qwd/LocationList下载。
 void WeatherWarn::config(String userKey, String location) {
-    _url =  String(HttpsGetUtils::host) +  "/v7/warning/now?location=" + location + "&key=" + userKey + "&lang=zh";
+    _setUrl(String(HttpsGetUtils::host) +  "/v7/warning/now?location=" + location + "&key=" + userKey + "&lang=zh");
 }
  
 //以英文逗号分隔的经度,纬度坐标（十进制，支持小数点后两位）例如Grid_location="116.41,39.92"
 void WeatherWarn::config_Grid(String userKey, String Grid_location) {
-    _url =  String(HttpsGetUtils::host) +  "/v7/warning/now?location=" + Grid_location +"&key=" + userKey + "&lang=zh";
+    _setUrl(String(HttpsGetUtils::host) +  "/v7/warning/now?location=" + Grid_location +"&key=" + userKey + "&lang=zh");
+}
+
+// 换了地点时丢掉上次的校验信息和哈希，304或内容相同不能沿用别的地点的预警
+void WeatherWarn::_setUrl(const String &url) {
+    if(url != _url) {
+        _validator = HttpValidator();
+        _hash = 0;
+    }
+    _url = url;
 }
  
 bool WeatherWarn::get() {
    uint8_t *outbuf=NULL;
   size_t len=0;
   Serial.println("Get WeatherWarning..");
-  bool result = HttpsGetUtils::getString(_url.c_str(), outbuf, len);
-  if(outbuf && len){
-      _parseNowJson((char*)outbuf,len);
+  _changed = false;
+  bool result = HttpsGetUtils::getString(_url.c_str(), outbuf, len, &_validator);
+  if(_validator.lastCode == HTTP_CODE_NOT_MODIFIED) {
+    // 预警内容未改变，沿用上次的解析结果
+    _notModified++;
+    _bytesSaved += _validator.lastSize;
+    result = true;
+  } else if(outbuf && len){
+      // 只对预警数组做哈希，updateTime每次都会变化
+      uint8_t *start = (uint8_t*)memmem(outbuf, len, "\"warning\"", 9);
+      uint8_t *end = start ? (uint8_t*)memmem(start, len - (start - outbuf), "\"refer\"", 7) : NULL;
+      uint32_t hash = 0;
+      if(start) {
+        hash = HttpsGetUtils::contentHash(start, end ? end - start : len - (start - outbuf));
+      }
+      if(hash != 0 && hash == _hash) {
+        _unchanged++;
+      } else {
+        _parseNowJson((char*)outbuf,len);
+        _hash = hash;
+        _changed = true;
+      }
   } else {
     Serial.println("Get WeatherWarning failed");
   }
@@ -105,3 +133,41 @@ String WeatherWarn::getTypeName() {
 String WeatherWarn::getStatus() {
   return _warn_status_str;
 }
+
+// 最近一次get()预警内容是否有变化
+bool WeatherWarn::isChanged() {
+  return _changed;
+}
+
+// 服务器返回304的次数
+uint32_t WeatherWarn::getNotModifiedCount() {
+  return _notModified;
+}
+
+// 内容未变、跳过解析的次数
+uint32_t WeatherWarn::getUnchangedCount() {
+  return _unchanged;
+}
+
+// 因304节省的下载字节数
+uint32_t WeatherWarn::getBytesSaved() {
+  return _bytesSaved;
+}
+
+// 当前预警保存到缓存记录
+void WeatherWarn::toRecord(WarnRecord &rec) {
+  rec.type = _warn_type_int;
+  DataCache::copyText(rec.status, sizeof(rec.status), _warn_status_str);
+  DataCache::copyText(rec.color, sizeof(rec.color), _warn_severityColor_str);
+  DataCache::copyText(rec.title, sizeof(rec.title), _warn_title_str);
+  DataCache::copyText(rec.text, sizeof(rec.text), _warn_text_str);
+}
+
+// 开机时从缓存记录恢复上次的预警
+void WeatherWarn::fromRecord(const WarnRecord &rec) {
+  _warn_type_int = rec.type;
+  _warn_status_str = rec.status;
+  _warn_severityColor_str = rec.color;
+  _warn_title_str = rec.title;
+  _warn_text_str = rec.text;
+}
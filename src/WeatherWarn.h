@@ -3,6 +3,8 @@
  
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include "HttpsGetUtils.h"
+#include "DataCache.h"
  
 class WeatherWarn {
   public:
@@ -20,8 +22,15 @@ class WeatherWarn {
     String getColor();
     String getTypeName();
     String getStatus();
+    bool isChanged();                  // 最近一次get()预警内容是否有变化
+    uint32_t getNotModifiedCount();    // 服务器返回304的次数
+    uint32_t getUnchangedCount();      // 内容哈希未变、跳过解析的次数
+    uint32_t getBytesSaved();          // 因304节省的下载字节数
+    void toRecord(WarnRecord &rec);    // 保存到缓存记录
+    void fromRecord(const WarnRecord &rec); // 从缓存记录恢复
  
   private:
+    void _setUrl(const String &url);
     void _parseNowJson(char* input, size_t inputLength);  // 解析json信息
     String _url;
     String _response_code =  "no_init";            // API状态码
@@ -34,6 +43,12 @@ class WeatherWarn {
     String _warn_severityColor_str = "no_init";    // 预警严重等级颜色
     String _warn_typeName_str = "no_init";         // 预警类型名称
     String _warn_status_str = "no_init";           // 预警信息的发布状态
+    HttpValidator _validator;                      // 条件请求校验信息
+    uint32_t _hash = 0;                            // 上次预警内容的哈希
+    bool _changed = false;
+    uint32_t _notModified = 0;
+    uint32_t _unchanged = 0;
+    uint32_t _bytesSaved = 0;
 };
  
 #endif
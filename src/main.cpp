@@ -25,6 +25,7 @@
  *              CS    GPIO5
  *
  *             增加DHT11温湿度传感器，传感器接口为 GPIO 13
+ *             I2C室内传感器(SHT3x/BME280/SCD4x)  SDA GPIO21  SCL GPIO25
  *
  *    感谢群友 @你别失望  提醒发现WiFi保存后无法重置的问题，目前已解决。详情查看更改说明！
 
@@ -59,18 +60,35 @@
 #include <TFT_eSPI.h>
 #include <SPI.h>
 #include <TJpg_Decoder.h>
-#include <EEPROM.h>
 #include "qr.h"
 #include "number.h"
 #include "weathernum.h"
 #include <NTPClient.h>
 #include <ESP32Time.h>
-#include <ESP32-targz.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <sys/time.h>
+#include "GzipStream.h"
 #include "esp32-hal-cpu.h"
 #include <DigitalRainAnimation.hpp>
 
 #include "WeatherWarn.h"
 #include "HttpsGetUtils.h"
+#include "FetchScheduler.h"
+#include "DataCache.h"
+#include "Settings.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "PowerManager.h"
+#include "CpuGovernor.h"
+#include "Connectivity.h"
+#include "CityRotation.h"
+#include "Forecast.h"
+#include "History.h"
+#include "IndoorSensors.h"
+#include "DigitAtlas.h"
+#include "Layout.h"
+#include "Lunar.h"
 #include <Ticker.h> // 使用Ticker库，需要包含头文件
 
 // Font files are stored in Flash FS
@@ -88,6 +106,7 @@
 SemaphoreHandle_t shared_var_mutex_pushImage = NULL;
 SemaphoreHandle_t shared_var_mutex_pushSprite = NULL;
 SemaphoreHandle_t shared_var_mutex_loop = NULL;
+SemaphoreHandle_t shared_var_mutex_render = NULL; // 任务B、任务C画部件的整个过程持有，旋转屏幕时借用
 
 static TaskHandle_t TaskA_Handle = NULL; /* 创建A任务句柄 */
 static TaskHandle_t TaskB_Handle = NULL; /* B任务句柄 */
@@ -113,10 +132,14 @@ String mx_secret = "";
  * *****************************************************************/
 // WEB配网使能标志位----WEB配网打开后会默认关闭smartconfig功能
 #define WM_EN 1
-// Web服务器使能标志位----打开后将无法使用wifi休眠功能。
+// Web服务器使能标志位----异步服务器在WiFi modem sleep下仍可访问
 #define WebSever_EN 1
+// 省电模式使能标志位----空闲降频/浅睡眠，夜间不显示秒和太空人动画
+#define PowerSave_EN 1
 // 设定DHT11温湿度传感器使能标志
 #define DHT_EN 1
+// DHT用RMT接收，不关中断；设为0时用原来的Adafruit库，用来对比关中断造成的抖动
+#define DHT_RMT 1
 // 设置太空人图片是否使用
 #define imgAst_EN 1
 
@@ -127,26 +150,55 @@ WiFiManager wm; // global wm instance
 #endif
 
 #if WebSever_EN
-// #include "ESPAsyncWebServer.h"
-// #include <DNSServer.h>
 #include <WiFi.h>
 #include <WiFiClient.h>
 #include <ESPmDNS.h>
-#include <WiFiClient.h>
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
+#include <AsyncJson.h>
+#include "webpage.h"
+
+// 设置ESP32服务器运行于80端口，请求在AsyncTCP任务中处理，不占用任务A
+AsyncWebServer server(80);
 
-// 设置ESP32服务器运行于80端口
-// AsyncWebServer server(80);
-WebServer server(80); // 建立esp8266网站服务器对象
+// web页面提交的设置，回调中只做记录，由任务A应用(涉及屏幕操作)
+struct WebConfig
+{
+  bool pending;
+  int cc, setro, lcdbl, upt, dhten, cpu; // -1表示没有提交该项
+};
+#define WebCityAuto -2 // 接口提交的城市代码0：自动定位。表单的空城市代码也是0，不当作自动
+WebConfig webConfig = {false, -1, -1, -1, -1, -1, -1};
+portMUX_TYPE webConfigMux = portMUX_INITIALIZER_UNLOCKED;
 #endif
 
 // 设定DHT11温湿度传感器引脚
 #if DHT_EN
 #include "DHT.h"
+#include "DhtReader.h"
 #define DHTPIN 13
 #define DHTTYPE DHT11
+#if !DHT_RMT
 DHT dht(DHTPIN, DHTTYPE);
 #endif
+DhtReader dhtReader(DHTPIN, DHTTYPE); // 读数滤波，RMT读取时也负责接收
+float DHT11_T = 0;
+float DHT11_H = 0;
+
+// 室内I2C传感器，和DHT按这个顺序合成一份室内快照
+#define I2C_SDA 21
+#define I2C_SCL 25 // GPIO22是背光
+WireBus i2cBus;
+Sht3xSensor sht3x(i2cBus);
+Bme280Sensor bme280(i2cBus);
+Scd4xSensor scd4x(i2cBus);
+IndoorSensors indoor(i2cBus);
+#endif
+
+// 0.1秒定时器中断的延迟，关中断的时间会直接反映在这里
+volatile int64_t tickLastUs = 0;
+volatile uint32_t tickJitterMaxUs = 0;    // 全部
+volatile uint32_t tickJitterDhtMaxUs = 0; // 读DHT期间
+volatile bool dhtReading = false;
 
 /* *****************************************************************
  *  字库、图片库
@@ -177,21 +229,26 @@ unsigned long AprevTime = 0; // 太空人更新时间记录
  *  参数设置
  * *****************************************************************/
 
-struct config_type
-{
-  char stassid[32]; // 定义配网得到的WIFI名长度(最大32字节)
-  char stapsw[64];  // 定义配网得到的WIFI密码长度(最大64字节)
-};
-
-//---------------修改此处""内的信息--------------------
-// 如开启WEB配网则可不用设置这里的参数，前一个为wifi ssid，后一个为密码
-config_type wificonf = {{""}, {""}};
+// 参数存储(城市代码、亮度、方向、DHT、更新时间、WiFi信息)
+Settings settings;
+// 运行指标，/metrics接口输出
+Metrics metrics;
+PowerManager power;
+CpuGovernor governor;
+Connectivity conn;
+CityRotation cities;
+History history;
 
 //----------------------------------------------------
 // LCD屏幕相关设置
 TFT_eSPI tft = TFT_eSPI(); // 引脚请自行配置tft_espi库中的 User_Setup.h文件
 TFT_eSprite clk = TFT_eSprite(&tft);
 TFT_eSprite clkJpeg = TFT_eSprite(&tft);
+TFT_eSprite chartSpr = TFT_eSprite(&tft); // 温度曲线，常驻内存，只在任务C中使用
+Layout layout;                            // 仪表盘各部件的位置和刷新，见setup前的布局表
+TFT_eSprite frameSpr = TFT_eSprite(&tft); // 整屏离屏帧，只在旋转屏幕时临时分配
+TFT_eSprite *lcdFrame = NULL;             // 不为NULL时各部件画到这一帧而不是屏幕
+int cityPending = -1;                     // 轮播到的下一个城市，由天气部件显示
 
 // 黑客帝国数字雨效果
 DigitalRainAnimation<TFT_eSPI> matrix_effect = DigitalRainAnimation<TFT_eSPI>();
@@ -216,13 +273,111 @@ bool isNewWarn = false;      // 预警更新标志
 int prevTime = 1;            // 滚动显示更新标志位
 int DHT_img_flag = 0;        // DHT传感器使用标志位
 bool UpdateScreen = 0;       // 全部重画屏幕
-bool finishNL = false;       // 农历取数完毕
+int nongliDay = -1;          // 农历信息对应的日期
 
 int prevDisplay = 0;          // 显示时间显示记录
-unsigned long weaterTime = 0; // 天气更新时间记录
+FetchScheduler fetcher;       // 天气、预警、农历的取数调度
+unsigned long warnShowTime = 0; // 上次显示预警画面的时间
+
+// 供web接口读取的数据快照，取数时更新，AsyncTCP任务中复制后再输出
+WeatherRecord weatherSnap;
+CalendarRecord calendarSnap;
+WarnRecord warnSnap;
+uint32_t weatherSnapTime = 0, calendarSnapTime = 0, warnSnapTime = 0;
+portMUX_TYPE snapMux = portMUX_INITIALIZER_UNLOCKED;
+
+// 开机计时
+bool fastBoot = false;          // 使用缓存快速开机
+bool webStarted = false;        // web服务是否已启动
+uint32_t bootFirstPixelMs = 0;  // 开机到显示仪表盘的时间
+uint32_t bootFreshDataMs = 0;   // 开机到取得最新天气的时间
+
+// 时钟由整秒定时器驱动，定时器比整秒稍晚触发，避免抖动提前唤醒时读到上一秒
+#define ClockEdgeLagUs 2000
+esp_timer_handle_t secondTimer = NULL;
+struct ClockStats
+{
+  uint32_t wakeups;     // 任务B唤醒次数
+  uint32_t ticks;       // 整秒通知次数
+  uint32_t digitsDrawn; // 重画的数字个数
+  uint32_t phaseCount;  // 秒数字变化次数
+  uint64_t phaseSumUs;  // 整秒到秒数字推送完成的累计延迟(按NTP校准的系统时间)
+  uint32_t phaseMaxUs;
+} clockStats = {};
+
+// 旋转屏幕的统计，时间都是最近一次
+struct RotateStats
+{
+  uint32_t count;
+  uint32_t fallbacks; // 整屏帧分配失败，退回清屏后各部件重画
+  uint32_t renderMs;  // 离屏画完整个界面
+  uint32_t pushUs;    // 整帧推到屏幕
+  uint32_t stableMs;  // 从开始旋转到屏幕上是完整的新画面
+  uint32_t stableMaxMs;
+} rotateStats = {};
+int8_t rotatePending = -1; // 推送锁超时没能旋转的方向，任务A下一轮重试
 
 String scrollText[7] = {""}; // 天气情况滚动显示数组
 
+// 天气条件请求及内容变化检测
+HttpValidator weatherValidator;      // 天气请求的ETag/Last-Modified
+uint32_t weatherHash = 0;            // 上次天气数据的哈希
+uint32_t weatherNotModified = 0;     // 服务器返回304的次数
+uint32_t weatherRedrawSkipped = 0;   // 数据未变跳过的重画次数
+uint32_t weatherBytesSaved = 0;      // 因304节省的下载字节数
+
+// 宜忌响应边收边解压，窗口不小于解压后的JSON长度(约1KB)
+#define NongliWindow 2048
+struct NongliStats
+{
+  uint32_t builds;     // 本地计算农历的次数
+  uint32_t buildUs;    // 计算并排好滚动信息的耗时
+  uint32_t buildMaxUs;
+  uint32_t fetches;
+  uint32_t gzip;      // 压缩的响应
+  uint32_t failures;  // 解压或解析失败
+  uint32_t lastMs;    // 从收到响应头到解析完
+  uint32_t maxMs;
+  uint32_t inBytes;   // 最近一次收到的字节数
+  uint32_t outBytes;  // 解压后的字节数
+  uint32_t heapBytes; // 最近一次解码的内存峰值：解压状态和窗口(begin时一次分配)，或整个响应的String，不含JSON文档
+} nongliStats = {};
+AlmanacRecord almanac = {}; // 当天的宜忌和假日
+
+// 轮播城市共用的请求对象，保持连接，错开几秒取数的城市复用同一个连接
+HTTPClient cityHttp;
+WeatherWarn cityWarn;
+
+// 主城市多日预报，任务A解析后写入，任务C画成字幕页面缓存起来
+#define ForecastPages 3    // 字幕中显示的预报天数(不含今天)
+#define ForecastPageW 150  // 和天气字幕一样大
+#define ForecastPageH 30
+#define ForecastPageBytes (ForecastPageW * ForecastPageH)
+ForecastData forecast = {};
+portMUX_TYPE forecastMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool forecastDirty = false; // 预报变化，页面需要重画
+uint8_t *forecastPixels = NULL;      // 画好的预报页面(8位色)，只在任务C中分配
+uint8_t forecastPageCount = 0;
+uint32_t forecastParseUs = 0;        // 上次解析耗时
+uint32_t forecastParseMaxUs = 0;
+uint32_t forecastScanned = 0;        // 上次扫描的字节数
+uint32_t forecastRenders = 0;
+uint32_t forecastAllocFailures = 0;
+
+// 温度曲线：最近24小时每小时的平均温度，室外和室内两条线，显示在日期字幕的位置
+#define ChartW 162
+#define ChartH 30
+#define ChartHours 24
+#define ChartDx 6                          // 每小时的宽度
+#define ChartPlotW (ChartHours * ChartDx)  // 右边写纵轴范围
+uint32_t chartSeq = 0;    // 已画到的历史点数
+uint32_t chartHour = 0;   // 最右一列的小时(epoch/3600)
+int16_t chartLo = 0;      // 纵轴范围(0.1℃)
+int16_t chartHi = 0;
+bool chartReady = false;
+uint32_t chartFullDraws = 0;
+uint32_t chartPartDraws = 0;
+
 /*** Component objects ***/
 Number dig;
 WeatherNum wrat;
@@ -232,28 +387,17 @@ uint32_t targetTime = 0;
 String cityCode = "101281006"; // 天气城市代码 湛江： 101281001 长沙: 101250101 株洲: 101250301 衡阳: 101250401 赤坎： 101281006  霞山 101281009
 int tempnum = 0;               // 温度百分比
 int huminum = 0;               // 湿度百分比
-int tempcol = 0xffff;          // 温度显示颜色
-int humicol = 0xffff;          // 湿度显示颜色
 int pm25V = 0;                 // PM2.5
 int Iconsname;                 // 天气图标名称
 String cityname = "";          // 城市名称
 // 天气更新时间  默认20分钟
 int updateweater_time = 20;
 
-// EEPROM参数存储地址位
-int BL_addr = 1;    // 被写入数据的EEPROM地址编号  1亮度
-int Ro_addr = 2;    // 被写入数据的EEPROM地址编号  2 旋转方向
-int DHT_addr = 3;   // 被写入数据的EEPROM地址编号  3 DHT使能标志位
-int UpWeT_addr = 4; // 更新时间记录
-int CC_addr = 10;   // 被写入数据的EEPROM地址编号  10城市
-int wifi_addr = 30; // 被写入数据的EEPROM地址编号  20wifi-ssid-psw
-
 // wifi连接UDP设置参数
 WiFiUDP Udp;
 WiFiClient wificlient;
 unsigned int localPort = 8321;
 float duty = 0;
-bool LostWiFi = false;
 
 // NTP服务器参数
 const int timeZone = 8; // 东八区
@@ -287,13 +431,7 @@ typedef struct
 #define LENGTH(array) (sizeof(array) / sizeof(array[0]))
 
 Display *scrollNongLi = NULL;
-Display *scrolHEAD = NULL;
-Display *scrollYI = NULL;
-Display *scrollJI = NULL;
 int TotalDis = 0;
-int TotalHEAD = 0;
-int TotalYI = 0;
-int TotalJI = 0;
 int CurrentDisDate = 0;
 
 // 绘制预警画面有关变量定义
@@ -311,16 +449,40 @@ byte state = 0;
 /* *********************************************************/
 /*  ***************函数定义**********************************/
 /* *********************************************************/
-void getCityCode();
-void getCityWeater();
+bool getCityCode();
+bool getCityWeater();
+bool parseWeatherPage(const String &str, uint32_t &hash, WeatherRecord &rec, ForecastData &fc, bool primary);
+String forecastTemp(int8_t temp);
+void setForecast(const ForecastData &fc);
+void renderForecast();
+void sampleHistory();
+void updateChart();
+void drawChartColumns(const int16_t *outdoor, const int16_t *indoor, int from);
+void showChart(const LayoutRect &r);
+void drawForecastPage(const ForecastDay &day);
+void showForecastPage(const LayoutRect &r, uint8_t page);
+uint8_t forecastPagesShown();
+void applyWeatherRecord(const WeatherRecord &rec);
+void weatherPlaceholder();
+void currentWeather(WeatherRecord &rec);
+String warnShortTitle(const String &title);
+void fetchCity(uint8_t idx);
 void saveParamCallback();
-void scrollBanner();
-void scrollDate();
-void imgAnim();
+void scrollBanner(const LayoutRect &r);
+void scrollDate(const LayoutRect &r);
+void imgAnim(int x, int y);
 void weaterData();
+const char *aqiLevel(int aqi, uint16_t *color);
+void drawWeather(uint8_t idx);
+void drawWeatherWidgets(const WeatherRecord &rec, uint8_t *pixels);
+void renderCities();
+void showCity(uint8_t idx);
+void bannerLine(int idx, String &out);
 String monthDay();
 String week();
-void getNongli();
+int32_t dateStamp();
+bool getNongli();
+void buildCalendar();
 /* *********************************************************/
 /*  ********************************************************/
 /* *********************************************************/
@@ -331,10 +493,7 @@ void printDigits(int digits);
 String num2str(int digits);
 void sendNTPpacket(IPAddress &address);
 void LCD_reflash(bool en);
-void savewificonfig();
-void readwificonfig();
-void deletewificonfig();
-int StrSplit(String str, String fen, String *result);
+void applyCityCode(unsigned int code);
 void IRAM_ATTR onTimer();
 void IRAM_ATTR onTimer_dht();
 void ledcAnalogWrite(uint8_t channel, uint32_t value);
@@ -345,18 +504,17 @@ bool tft_output_Anim2(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bi
 void Web_win();
 void Webconfig();
 void loading(byte delayTime); // 绘制进度条
-void IndoorTem();
+void IndoorTem(const LayoutRect &box, bool full);
 void Serial_set();
 void sleepTimeLoop(uint8_t Maxlight, uint8_t Minlight);
 void taskA(void *ptParam);
 void taskB(void *ptParam);
 void taskC(void *ptParam);
 void taskD(void *ptParam);
-void getDHT11();
-void myTarProgressCallback(uint8_t progress);
-void my_strcat_arrcy(Display *arr, int lena, Display *brr, int lenb, Display *crr, int lenc, Display *str);
+bool getDHT11();
+void beginIndoorSensors();
 String HTTPS_request(String host, String url, String parameter);
-void getWarning();
+bool getWarning();
 void DispWarn();
 void Wait_win(String showStr);
 
@@ -365,25 +523,117 @@ unsigned int brightness(unsigned int colour, int brightness);
 unsigned int rainbow(byte value);
 void SaveConfigCallback();
 void dispScrolls();
-void drawTemIcons();
+void applyLayout();
+void renderClock(const LayoutRect &r, bool full);
+void renderAnim(const LayoutRect &r, bool full);
+void renderWeather(const LayoutRect &r, bool full);
+void renderTempIcon(const LayoutRect &r, bool full);
+void renderHumiIcon(const LayoutRect &r, bool full);
+void renderBanner(const LayoutRect &r, bool full);
+void renderDate(const LayoutRect &r, bool full);
 
 #if WebSever_EN
 void Web_Sever_Init();
-void Web_Sever();
+void applyWebConfig();
 void Web_sever_Win();
-void saveCityCodetoEEP(int *citycode);
-void readCityCodefromEEP(int *citycode);
-void handleconfig();
 #endif
+void printRunStats(Print &out);
+void saveWeatherCache();
+bool loadWeatherCache();
+void saveNongliCache();
+bool loadNongliCache();
+bool loadAlmanacCache();
+void copyWords(char *dst, size_t size, const String &src);
+void saveWarnCache();
+bool loadWarnCache();
+bool runFetch(FetchSource src);
+void startSecondTimer();
+void armSecondTimer();
+void startTasks();
+void lcdPush(TFT_eSprite &spr, int32_t x, int32_t y);
+TFT_eSPI &lcdTarget();
+void rotateScreen(uint8_t rot);
+void setSnapshot(void *snap, uint32_t *snapTime, const void *rec, size_t len, uint32_t timestamp);
+void getSnapshot(void *rec, uint32_t *timestamp, const void *snap, const uint32_t *snapTime, size_t len);
 /* *********************************************************/
 
+// 仪表盘部件，编号是布局表中的下标
+enum WidgetId
+{
+  W_CLOCK,     // 时分
+  W_SECONDS,   // 秒，和时分一起画
+  W_ANIM,      // 右下角动画
+  W_INDOOR,    // 室内温湿度框
+  W_WEATHER,   // 天气图标，和后面6个天气小部件一起画
+  W_CITY,      // 城市名，天气小部件按这个顺序保存像素
+  W_AQI,       // 空气质量
+  W_TEMP,      // 温度
+  W_TEMP_BAR,  // 温度条
+  W_HUMI,      // 湿度
+  W_HUMI_BAR,  // 湿度条
+  W_TEMP_ICON, // 温度图标
+  W_HUMI_ICON, // 湿度图标
+  W_BANNER,    // 上面的滚动字幕和预报页面
+  W_DATE,      // 下面的农历和温度曲线
+  W_COUNT
+};
+#define WTaskB 1   // 时钟、动画、室内温湿度
+#define WTaskC 2   // 天气、图标、字幕
+#define AnimMs 150 // 动画帧间隔
+#if DHT_EN
+#define IndoorRender IndoorTem
+#else
+#define IndoorRender NULL
+#endif
+
+// 显示室内温湿度时秒在右上角，下面是室内温湿度框
+const WidgetDef layoutIndoorWidgets[W_COUNT] = {
+    {"时分", {10, 82, 161, 60}, 1, WTaskB, 0, renderClock},
+    {"秒", {172, 82, 40, 30}, 1, WTaskB, 0, NULL},
+    {"动画", {160, 160, 70, 70}, 1, WTaskB, AnimMs, renderAnim},
+    {"室内", {170, 112, 66, 48}, 1, WTaskB, 1000, IndoorRender},
+    {"天气", {160, 15, 60, 60}, 1, WTaskC, 0, renderWeather},
+    {"城市", {26, 15, 94, 30}, 1, WTaskC, 0, NULL},
+    {"空气", {104, 18, 56, 24}, 1, WTaskC, 0, NULL},
+    {"温度", {110, 184, 58, 24}, 1, WTaskC, 0, NULL},
+    {"温度条", {50, 192, 66, 6}, 1, WTaskC, 0, NULL},
+    {"湿度", {110, 214, 58, 24}, 1, WTaskC, 0, NULL},
+    {"湿度条", {72, 222, 44, 6}, 1, WTaskC, 0, NULL},
+    {"温度图标", {31, 183, 24, 24}, 0, WTaskC, 0, renderTempIcon},
+    {"湿度图标", {50, 200, 24, 24}, 0, WTaskC, 0, renderHumiIcon},
+    {"字幕", {10, 45, 150, 30}, 1, WTaskC, 0, renderBanner},
+    {"农历", {10, 150, 162, 30}, 1, WTaskC, 0, renderDate},
+};
+
+// 不显示室内温湿度时秒移到时分右下方
+const WidgetDef layoutPlainWidgets[W_COUNT] = {
+    {"时分", {10, 82, 161, 60}, 1, WTaskB, 0, renderClock},
+    {"秒", {172, 112, 40, 30}, 1, WTaskB, 0, NULL},
+    {"动画", {160, 160, 70, 70}, 1, WTaskB, AnimMs, renderAnim},
+    {"室内", {0, 0, 0, 0}, 1, WTaskB, 0, NULL},
+    {"天气", {160, 15, 60, 60}, 1, WTaskC, 0, renderWeather},
+    {"城市", {26, 15, 94, 30}, 1, WTaskC, 0, NULL},
+    {"空气", {104, 18, 56, 24}, 1, WTaskC, 0, NULL},
+    {"温度", {110, 184, 58, 24}, 1, WTaskC, 0, NULL},
+    {"温度条", {50, 192, 66, 6}, 1, WTaskC, 0, NULL},
+    {"湿度", {110, 214, 58, 24}, 1, WTaskC, 0, NULL},
+    {"湿度条", {72, 222, 44, 6}, 1, WTaskC, 0, NULL},
+    {"温度图标", {31, 183, 24, 24}, 0, WTaskC, 0, renderTempIcon},
+    {"湿度图标", {50, 200, 24, 24}, 0, WTaskC, 0, renderHumiIcon},
+    {"字幕", {10, 45, 150, 30}, 1, WTaskC, 0, renderBanner},
+    {"农历", {10, 150, 162, 30}, 1, WTaskC, 0, renderDate},
+};
+
+const LayoutTable layoutIndoor = {"室内温湿度", layoutIndoorWidgets, W_COUNT};
+const LayoutTable layoutPlain = {"无室内温湿度", layoutPlainWidgets, W_COUNT};
+
 void setup()
 {
   Serial.begin(115200);
 
   WiFi.enableSTA(true);
 
-  setCpuFrequencyMhz(240);
+  setCpuFrequencyMhz(240); // 开机全速，任务启动后由CpuGovernor调节
   Serial.print("CPU频率是： ");
   Serial.println(getCpuFrequencyMhz());
 
@@ -398,6 +648,11 @@ void setup()
   shared_var_mutex_pushImage = xSemaphoreCreateMutex();  // Create the mutex
   shared_var_mutex_pushSprite = xSemaphoreCreateMutex(); // Create the mutex
   shared_var_mutex_loop = xSemaphoreCreateMutex();       // Create the mutex
+  shared_var_mutex_render = xSemaphoreCreateMutex();     // Create the mutex
+  LockStats::add(&shared_var_mutex_pushImage, "pushImage");
+  LockStats::add(&shared_var_mutex_pushSprite, "pushSprite");
+  LockStats::add(&shared_var_mutex_loop, "loop");
+  LockStats::add(&shared_var_mutex_render, "render");
 
   TJpgDec.setJpgScale(1);
   TJpgDec.setSwapBytes(true);
@@ -411,11 +666,29 @@ void setup()
   {
     Serial.println("Flash FS available!");
   }
-  // 显示开机LOGO
-  TJpgDec.drawFsJpg(0, 0, "/logo.jpg", FlashFS);
-  delay(3000); // 花一些时间打开串行监视器
 
-  EEPROM.begin(1024);
+  settings.begin(); // 读取存储的设置和wifi信息
+  cities.begin();   // 读取轮播城市
+  history.begin();  // 读取温湿度历史
+
+  // 获取城市代码
+  bool validCity = settings.cityCode() != 0;
+  if (validCity)
+    cityCode = settings.cityCode();
+
+  // 读取上次保存的天气、农历和预警，有缓存就先显示，联网取数放到后台
+  fastBoot = loadWeatherCache() && validCity && strlen(settings.ssid()) > 0;
+  loadNongliCache();
+  loadAlmanacCache();
+  loadWarnCache();
+
+  if (!fastBoot)
+  {
+    // 显示开机LOGO
+    TJpgDec.drawFsJpg(0, 0, "/logo.jpg", FlashFS);
+    metrics.countJpeg();
+    delay(3000); // 花一些时间打开串行监视器
+  }
 
   // 屏幕亮度控制初始化
   //  initialize digital pin LED_BUILTIN as an output.
@@ -432,19 +705,25 @@ void setup()
   timerDHT.attach(10, onTimer_dht); // 设置定时器，每隔 10 秒钟调用一次 DHT 函数 恢复DTH11读取任务
 
 #if DHT_EN
+#if DHT_RMT
+  dhtReader.begin();
+#else
   dht.begin();
-  // 从eeprom读取DHT传感器使能标志
-  DHT_img_flag = EEPROM.read(DHT_addr);
 #endif
-  // 从eeprom读取天气更新时间间隔设置
-  if (EEPROM.read(UpWeT_addr) > 0 && EEPROM.read(UpWeT_addr) < 60)
-    updateweater_time = EEPROM.read(UpWeT_addr);
-  // 从eeprom读取背光亮度设置
-  if (EEPROM.read(BL_addr) > 0 && EEPROM.read(BL_addr) < 255)
-    LCD_BL_PWM = EEPROM.read(BL_addr);
-  // 从eeprom读取屏幕方向设置
-  if (EEPROM.read(Ro_addr) >= 0 && EEPROM.read(Ro_addr) <= 3)
-    LCD_Rotation = EEPROM.read(Ro_addr);
+  beginIndoorSensors();
+  // 读取DHT传感器使能标志
+  DHT_img_flag = settings.dhtEnable();
+#endif
+  applyLayout();
+  // 天气小部件的像素按布局中的大小分配，两套布局大小相同
+  uint32_t widgetBytes = 0;
+  for (int i = 0; i < CityWidgetCount; i++)
+    widgetBytes += layout.rect(W_CITY + i).w * layout.rect(W_CITY + i).h;
+  cities.setWidgetBytes(widgetBytes);
+  // 读取天气更新时间间隔、背光亮度、屏幕方向设置
+  updateweater_time = settings.updateMinutes();
+  LCD_BL_PWM = settings.backlight();
+  LCD_Rotation = settings.rotation();
   // 设置背光
   ledcAnalogWrite(pwm_channel0, LCD_BL_PWM);
 
@@ -457,24 +736,51 @@ void setup()
       25, /* Speed Max */
       50 /* Screen Update Interval */);
 
-  readwificonfig(); // 读取存储的wifi信息
   Serial.print("正在连接WIFI ");
-  Serial.println(String(wificonf.stassid));
+  Serial.println(String(settings.ssid()));
 
-  if (WiFi.mode(WIFI_STA))
+  metrics.begin();
+  if (!conn.begin(settings.ssid(), settings.psk()))
   {
-    WiFi.begin(wificonf.stassid, wificonf.stapsw);
-    WiFi.setAutoReconnect(true);
+    esp_restart(); // 重启
   }
-  else
+
+  weatherWarn.config(HeUserKey, cityCode); // 配置请求信息
+  fetcher.setInterval(FETCH_WEATHER, 60000UL * updateweater_time);
+  fetcher.setInterval(FETCH_WARNING, 60000UL * updateweater_time);
+
+  if (fastBoot)
   {
-    esp_restart(); // 重启
+    // 用缓存直接画出仪表盘，校时、取数和web服务由任务A在联网后完成
+    tft.fillScreen(bgColor);
+    layout.render(W_TEMP_ICON, true);
+    layout.render(W_HUMI_ICON, true);
+    layout.render(W_WEATHER, true);
+    bootFirstPixelMs = millis();
+    Serial.printf("缓存开机，显示用时：%ums\n", bootFirstPixelMs);
+
+    timeClient.begin();
+    setSyncProvider(getNtpTime);
+    setSyncInterval(60 * 60);
+
+#if DHT_EN
+    if (DHT_img_flag != 0)
+    {
+      indoor.sample();
+      layout.render(W_INDOOR, true);
+    }
+#endif
+
+    startTasks();
+    return;
   }
 
   tft.fillScreen(bgColor);
-  while (WiFi.status() != WL_CONNECTED)
+  // 等待联网事件，联网后立即结束，超时后进入配网
+  while (!conn.waitOnline(30))
   {
-    loading(30);
+    conn.loop();
+    loading(0);
     if (loadNum >= 197)
     {
 // 使能web配网后自动将smartconfig配网失效
@@ -491,10 +797,8 @@ void setup()
     }
   }
 
-  while (loadNum < 194) // 让动画走完
-  {
-    loading(1);
-  }
+  loadNum = 194; // 进度条直接走完
+  loading(0);
 
   Wait_win("WIFI已连接......"); // 显示连接成功后界面
 
@@ -543,58 +847,66 @@ void setup()
   setSyncInterval(60 * 60); // 每60分钟同步一次时间
 
   Wait_win("正在城市信息..."); // 显示连接成功后界面
-  // 获取城市代码
-  int CityCODE = 0;
-  for (int cnum = 5; cnum > 0; cnum--)
-  {
-    CityCODE = CityCODE * 100;
-    CityCODE += EEPROM.read(CC_addr + cnum - 1);
-    delay(5);
-  }
-  if (CityCODE >= 101000000 && CityCODE <= 102000000)
-    cityCode = CityCODE;
-  else
+  if (!validCity)
     getCityCode();                    // 获取城市代码
   Wait_win("正在获取农历信息......"); // 显示连接成功后界面
-  getNongli();                        // 农历信息
+  buildCalendar();          // 农历本地计算
+  runFetch(FETCH_CALENDAR); // 宜忌和假日
+  nongliDay = rtc.getDay();
   Wait_win("正在获取天气情况......"); // 显示连接成功后界面
-  getCityWeater();                    // 取天气情况
+  if (runFetch(FETCH_WEATHER)) // 取天气情况
+    bootFreshDataMs = millis();
+  else if (weatherSnapTime == 0) // 没有缓存也没取到，先显示等待更新
+    weatherPlaceholder();
   Wait_win("正在获取预警信息......"); // 显示连接成功后界面
   // 使用城市ID取当前预警
   weatherWarn.config(HeUserKey, cityCode); // 配置请求信息  101230201厦门 101230201 厦门  101281006 湛江 101281009 霞山
-  getWarning();                            // 取当前预警
+  runFetch(FETCH_WARNING); // 取当前预警
+  fetcher.setWarningActive(!scrollText[6].isEmpty());
   Wait_win("等待启动WEB服务...");          // 显示连接成功后界面
 
 #if WebSever_EN
   // 开启web服务器初始化
   Web_Sever_Init();
+  webStarted = true;
   Web_sever_Win();
   delay(6000);
 #endif
 
 #if DHT_EN
   if (DHT_img_flag != 0)
-  {
-    getDHT11();
-    IndoorTem();
-  }
+    indoor.sample();
 #endif
-  drawTemIcons();
 
-  // 任务A          任务B          tskNO_AFFINITY 表示不指定核心
-  xTaskCreatePinnedToCore(taskA, "Task A", 1024 * 8, NULL, 1, (TaskHandle_t *)&TaskA_Handle, 0);
-  xTaskCreatePinnedToCore(taskB, "Task B", 1024 * 5, NULL, 3, (TaskHandle_t *)&TaskB_Handle, 1); // configMAX_PRIORITIES - 1
-  xTaskCreatePinnedToCore(taskC, "Task C", 1024 * 4, NULL, 2, (TaskHandle_t *)&TaskC_Handle, 1);
-  xTaskCreatePinnedToCore(taskD, "Task D", 1024 * 3, NULL, 4, (TaskHandle_t *)&TaskD_Handle, 1);
+  startTasks();
 
   tft.fillScreen(TFT_BLACK); // 清屏
-  weaterTime = millis();
+  layout.invalidate();       // 任务已在运行，清屏后全部重画
+  bootFirstPixelMs = millis();
+  Serial.printf("开机显示用时：%ums，取得天气用时：%ums\n", bootFirstPixelMs, bootFreshDataMs);
 }
 
 void loop()
 {
   vTaskDelete(NULL);
 }
+
+// 创建任务并登记到运行指标
+void startTasks()
+{
+  // 任务A          任务B          tskNO_AFFINITY 表示不指定核心
+  xTaskCreatePinnedToCore(taskA, "Task A", 1024 * 8, NULL, 1, (TaskHandle_t *)&TaskA_Handle, 0);
+  xTaskCreatePinnedToCore(taskB, "Task B", 1024 * 5, NULL, 3, (TaskHandle_t *)&TaskB_Handle, 1); // configMAX_PRIORITIES - 1
+  xTaskCreatePinnedToCore(taskC, "Task C", 1024 * 4, NULL, 2, (TaskHandle_t *)&TaskC_Handle, 1);
+  xTaskCreatePinnedToCore(taskD, "Task D", 1024 * 3, NULL, 4, (TaskHandle_t *)&TaskD_Handle, 1);
+  metrics.registerTask(0, "taskA", TaskA_Handle);
+  metrics.registerTask(1, "taskB", TaskB_Handle);
+  metrics.registerTask(2, "taskC", TaskC_Handle);
+  metrics.registerTask(3, "taskD", TaskD_Handle);
+  startSecondTimer();
+  power.begin(PowerSave_EN);
+  governor.begin(settings.cpuPolicy());
+}
 // Serial.println("check 1:");
 // Serial.printf("FreeHeap:%d\r\n", ESP.getFreeHeap());
 
@@ -607,62 +919,73 @@ void taskA(void *ptParam)
 {
   while (1)
   {
-#ifdef UseMutex
-    SmartLocker smartLocker(&shared_var_mutex_loop, portMAX_DELAY);
-    if (smartLocker.IsLocked())
     {
-#endif
-      if (!isNewWarn)
+#ifdef UseMutex
+      SmartLocker smartLocker(&shared_var_mutex_loop, LockTimeout);
+      if (smartLocker.IsLocked())
       {
+#endif
+        TaskBusyScope busy(0);
+        if (!isNewWarn)
+        {
 #if WebSever_EN
-        Web_Sever();
+          applyWebConfig();
 #endif
-        Serial_set();
-        LCD_reflash(UpdateScreen);
-      }
-      // printf("TaskA剩余栈%d\r\n", uxTaskGetStackHighWaterMark(NULL)); // uxTaskGetStackHighWaterMark以word为单位
-      //     Serial.print("taskA: priority = ");
-      //     Serial.println(uxTaskPriorityGet(NULL));
+          Serial_set();
+          conn.loop();
+          if (rotatePending >= 0)
+            rotateScreen(rotatePending);
+          LCD_reflash(UpdateScreen);
+          sampleHistory();
+        }
+        // printf("TaskA剩余栈%d\r\n", uxTaskGetStackHighWaterMark(NULL)); // uxTaskGetStackHighWaterMark以word为单位
+        //     Serial.print("taskA: priority = ");
+        //     Serial.println(uxTaskPriorityGet(NULL));
 #ifdef UseMutex
-    }
+      }
 #endif
+    }
+    // 释放互斥量后让出CPU，空闲任务才能降频或睡眠
+    vTaskDelay(power.isNight() ? pdMS_TO_TICKS(100) : pdMS_TO_TICKS(20));
   }
 }
 
 // 任务B用来*********
+// 画布局中属于任务B的部件：时钟在整秒通知时刷新，动画和室内温湿度按各自的周期
+// 夜间整分才通知，不播放动画
 void taskB(void *ptParam)
 {
-  TickType_t xLastWakeTime;
-  const TickType_t xDelayms = pdMS_TO_TICKS(150); // 1000ms
-  xLastWakeTime = xTaskGetTickCount();
   while (1)
   {
-    vTaskDelayUntil(&xLastWakeTime, xDelayms);
-    // 绘制时分秒
-    if ((!isNewWarn) && (isNewWeather == 0) && (UpdateWeater_en == 0) && (UpdateNL_en == 0))
+    // 等整秒通知，最多等到下一个部件到期；夜间最多等1秒，及时响应UpdateScreen
+    bool night = power.isNight();
+    layout.setPeriod(W_ANIM, night ? 0 : AnimMs);
+    uint32_t due = layout.nextDue(WTaskB, millis());
+    TickType_t wait = pdMS_TO_TICKS(min(due, (uint32_t)1000));
+    bool secondEdge = ulTaskNotifyTake(pdTRUE, wait) > 0;
+    clockStats.wakeups++;
+
+    TaskBusyScope busy(1);
+    if (secondEdge)
+      layout.touch(W_CLOCK);
     {
-
-
-      if (UpdateScreen == 1)
-      {
-        digitalClockDisplay(1);
-        UpdateScreen = 0;
-      }
-      else
+      // 一轮部件画完才放开，旋转屏幕和任务C不会在JPG解码到一半时接手
+      SmartLocker smartLocker(&shared_var_mutex_render, LockTimeout);
+      if (smartLocker.IsLocked())
       {
-        digitalClockDisplay(0);
+        if (UpdateScreen == 1)
+        {
+          // 清过屏，全部部件重画；任务C等这里清掉标志后再画天气
+          layout.invalidate();
+          UpdateScreen = 0;
+        }
+        if ((!isNewWarn) && (isNewWeather == 0) && (UpdateWeater_en == 0) && (UpdateNL_en == 0))
+          layout.run(WTaskB, millis());
       }
-
-      imgAnim();
-
-      // 绘制室内温度
-#if DHT_EN
-      if (DHT_img_flag != 0)
-        IndoorTem();
-#endif
     }
 
-    sleepTimeLoop(LCD_BL_PWM, MINLIGHT); // 定时开关显示屏背光 参数是打开后最大亮度
+    if (secondEdge)
+      sleepTimeLoop(LCD_BL_PWM, MINLIGHT); // 定时开关显示屏背光 参数是打开后最大亮度
     //printf("TaskB剩余栈%d\r\n", uxTaskGetStackHighWaterMark(NULL)); // uxTaskGetStackHighWaterMark以word为单位
     //     printf("xPortGetFreeHeapSize = %d\r\n", xPortGetFreeHeapSize());
     //     printf("xPortGetMinimumEverFreeHeapSize = %d\r\n", xPortGetMinimumEverFreeHeapSize());
@@ -679,41 +1002,63 @@ void taskC(void *ptParam)
   xLastWakeTime = xTaskGetTickCount();
   while (1)
   {
-    vTaskDelayUntil(&xLastWakeTime, xDelayms);
+    vTaskDelayUntil(&xLastWakeTime, power.isNight() ? pdMS_TO_TICKS(500) : xDelayms); // 夜间字幕切换不需要100ms精度
 
 #ifdef UseMutex
-    SmartLocker smartLocker(&shared_var_mutex_loop, portMAX_DELAY);
+    SmartLocker smartLocker(&shared_var_mutex_loop, LockTimeout);
     if (smartLocker.IsLocked())
     {
 #endif
-      if (isNewWarn)
+      TaskBusyScope busy(2);
       {
-        vTaskSuspend(TaskB_Handle);
-        DispWarn();
-        isNewWarn = false;
+        // 天气图标、温湿度图标、城市轮播和预警都用TJpgDec，和任务B的动画共用一个解码器，
+        // 整段持有绘制锁，任务B画完手上这一轮后等在这里，不挂起任务B
+        SmartLocker renderLocker(&shared_var_mutex_render, LockTimeout);
+        if (renderLocker.IsLocked())
+        {
+          if (isNewWarn)
+          {
+            CpuScope cpu(CPU_LEVEL_BOOST, CPU_PATH_WARN);
+            DispWarn();
+            isNewWarn = false;
+            layout.invalidate(); // 预警盖住了整个屏幕
+          }
 
-        imgAnim();        
-        digitalClockDisplay(1);      
-        drawTemIcons();
-        wrat.printfweather(160, 15, Iconsname);
-        weaterData();
+          if (isNewWeather == 1 && isNewWarn == 0 && UpdateNL_en == 0 && UpdateScreen == 0)
+          {
+            // 天气图标和温湿度等，轮播时显示当前城市
+            layout.touch(W_WEATHER);
+            isNewWeather = 0;
+          }
 
-        vTaskResume(TaskB_Handle);
-      }
+          if (forecastDirty && isNewWeather == 0 && !isNewWarn && UpdateScreen == 0)
+          {
+            // 预报变化时画好字幕页面，轮到时直接推送
+            CpuScope cpu(CPU_LEVEL_NORMAL, CPU_PATH_SCROLL);
+            renderForecast();
+          }
 
-      if (isNewWeather == 1 && isNewWarn == 0 && UpdateNL_en == 0 && UpdateScreen == 0)
-      {
-        drawTemIcons();
-        // 天气图标  170,15
-        wrat.printfweather(160, 15, Iconsname);
-        weaterData();
-        isNewWeather = 0;
-      }
+          if (isNewWeather == 0 && !isNewWarn && UpdateScreen == 0)
+          {
+            // 轮播到下一个城市，只推送画好的小部件
+            int next = cities.rotateDue(millis());
+            if (next >= 0)
+            {
+              cityPending = next;
+              layout.touch(W_WEATHER);
+            }
+          }
 
-      if (!isNewWarn && UpdateScreen == 0)
-      {
-        // 显示上下两个滚动字幕
-        dispScrolls();
+          if (!isNewWarn && UpdateScreen == 0)
+          {
+            {
+              CpuScope cpu(CPU_LEVEL_NORMAL, CPU_PATH_SCROLL);
+              updateChart();
+            }
+            dispScrolls(); // 轮到的字幕标记为要画
+            layout.run(WTaskC, millis());
+          }
+        }
       }
 
       if (TaskD_Handle != NULL && updateDHT == 1)
@@ -739,12 +1084,11 @@ void taskD(void *ptParam)
 
   while (1)
   {
-    if (!isNewWarn)
     {
-
-      if (DHT_img_flag != 0)
+      TaskBusyScope busy(3);
+      if (!isNewWarn && DHT_img_flag != 0)
       {
-        getDHT11(); // 采集DHT11温湿度传感器
+        indoor.sample(); // 一批采集全部室内传感器
       }
     }
     vTaskSuspend(NULL); // 这里是把自己挂起，挂起后该任务被暂停，不恢复是不运行的
@@ -760,6 +1104,18 @@ void taskD(void *ptParam)
 void IRAM_ATTR onTimer()
 {               // 定时器中断函数
   updateTime++; // 加0.1秒
+  int64_t now = esp_timer_get_time();
+  if (tickLastUs != 0)
+  {
+    int32_t jitter = (int32_t)(now - tickLastUs) - 100000;
+    if (jitter < 0)
+      jitter = -jitter;
+    if ((uint32_t)jitter > tickJitterMaxUs)
+      tickJitterMaxUs = jitter;
+    if (dhtReading && (uint32_t)jitter > tickJitterDhtMaxUs)
+      tickJitterDhtMaxUs = jitter;
+  }
+  tickLastUs = now;
 }
 
 void IRAM_ATTR onTimer_dht()
@@ -770,64 +1126,16 @@ void IRAM_ATTR onTimer_dht()
 /* *****************************************************************
  *  函数
  * *****************************************************************/
-// wifi ssid，psw保存到eeprom
-void savewificonfig()
-{
-  // 开始写入
-  uint8_t *p = (uint8_t *)(&wificonf);
-  for (int i = 0; i < sizeof(wificonf); i++)
-  {
-    EEPROM.write(i + wifi_addr, *(p + i)); // 在闪存内模拟写入
-  }
-  delay(10);
-  EEPROM.commit(); // 执行写入ROM
-  delay(10);
-}
-// 删除原有eeprom中的信息
-void deletewificonfig()
-{
-  config_type deletewifi = {{""}, {""}};
-  uint8_t *p = (uint8_t *)(&deletewifi);
-  for (int i = 0; i < sizeof(deletewifi); i++)
-  {
-    EEPROM.write(i + wifi_addr, *(p + i)); // 在闪存内模拟写入
-  }
-  delay(10);
-  EEPROM.commit(); // 执行写入ROM
-  delay(10);
-}
-
-// 从eeprom读取WiFi信息ssid，psw
-void readwificonfig()
+// 保存城市代码并更新天气和预警请求，0为自动获取
+void applyCityCode(unsigned int code)
 {
-  uint8_t *p = (uint8_t *)(&wificonf);
-  for (int i = 0; i < sizeof(wificonf); i++)
-  {
-    *(p + i) = EEPROM.read(i + wifi_addr);
-  }
-  for (int i = 0; i < 32; i++)
-  {
-    if (wificonf.stassid[i] == '\0')
-      break;
-    if (!isPrintable(wificonf.stassid[1]))
-    {
-      deletewificonfig();
-      esp_restart(); // 重启
-      break;
-    }
-  }
-  for (int i = 0; i < 64; i++)
-  {
-    if (wificonf.stapsw[i] == '\0')
-      break;
-    if (!isPrintable(wificonf.stapsw[i]))
-    {
-      deletewificonfig();
-      esp_restart(); // 重启
-      break;
-    }
-  }
-
+  settings.setCityCode(code);
+  settings.commit();
+  cityCode = code;
+  if (code == 0)
+    getCityCode(); // 获取城市代码
+  weatherWarn.config(HeUserKey, cityCode); // 配置请求信息
+  UpdateWeater_en = 1;
 }
 
 // portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
@@ -841,16 +1149,16 @@ bool tft_output(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap)
   clkJpeg.createSprite(w, h);
   clkJpeg.fillSprite(TFT_BLACK);
 
-  SmartLocker smartLocker(&shared_var_mutex_pushImage, portMAX_DELAY);
+  SmartLocker smartLocker(&shared_var_mutex_pushImage, LockTimeout);
   if (smartLocker.IsLocked())
   {
     clkJpeg.pushImage(0, 0, w, h, bitmap);
   }
 
-  SmartLocker smartLocker2(&shared_var_mutex_pushSprite, portMAX_DELAY);
+  SmartLocker smartLocker2(&shared_var_mutex_pushSprite, LockTimeout);
   if (smartLocker2.IsLocked())
   {
-    clkJpeg.pushSprite(x, y);
+    lcdPush(clkJpeg, x, y);
   }
   clkJpeg.deleteSprite();
   // Return 1 to decode next block
@@ -868,7 +1176,7 @@ bool tft_output_Anim(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bit
   clkJpeg.createSprite(w, h);
   clkJpeg.fillSprite(TFT_BLACK);
 
-  SmartLocker smartLocker(&shared_var_mutex_pushImage, portMAX_DELAY);
+  SmartLocker smartLocker(&shared_var_mutex_pushImage, LockTimeout);
   if (smartLocker.IsLocked())
   {
     clkJpeg.pushImage(0, 0, w, h, bitmap);
@@ -890,10 +1198,10 @@ bool tft_output_Anim(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bit
     }
   }
 
-  SmartLocker smartLocker2(&shared_var_mutex_pushSprite, portMAX_DELAY);
+  SmartLocker smartLocker2(&shared_var_mutex_pushSprite, LockTimeout);
   if (smartLocker2.IsLocked())
   {
-    clkJpeg.pushSprite(x, y);
+    lcdPush(clkJpeg, x, y);
   }
 
   clkJpeg.deleteSprite();
@@ -913,7 +1221,7 @@ bool tft_output_Anim2(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bi
   clkJpeg.createSprite(w, h);
   clkJpeg.fillSprite(TFT_BLACK);
 
-  SmartLocker smartLocker(&shared_var_mutex_pushImage, portMAX_DELAY);
+  SmartLocker smartLocker(&shared_var_mutex_pushImage, LockTimeout);
   if (smartLocker.IsLocked())
   {
     clkJpeg.pushImage(0, 0, w, h, bitmap);
@@ -935,10 +1243,10 @@ bool tft_output_Anim2(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bi
     }
   }
 
-  SmartLocker smartLocker2(&shared_var_mutex_pushSprite, portMAX_DELAY);
+  SmartLocker smartLocker2(&shared_var_mutex_pushSprite, LockTimeout);
   if (smartLocker2.IsLocked())
   {
-    clkJpeg.pushSprite(x, y);
+    lcdPush(clkJpeg, x, y);
   }
 
   clkJpeg.deleteSprite();
@@ -991,7 +1299,7 @@ bool tft_output_Warn(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bit
     }
   }
 
-  clk.pushSprite(x, y);
+  lcdPush(clk, x, y);
   clk.deleteSprite();
 
   // Return 1 to decode next block
@@ -1012,93 +1320,204 @@ void loading(byte delayTime) // 绘制进度条
   clk.drawString("Connecting to WiFi......", 100, 40, 2);
   clk.setTextColor(TFT_WHITE, 0x0000);
   clk.drawRightString(Version, 180, 60, 2);
-  clk.pushSprite(20, 120); // 窗口位置
+  lcdPush(clk, 20, 120); // 窗口位置
   clk.deleteSprite();
   loadNum += 1;
   delay(delayTime);
 }
 
-// 湿度图标显示函数
-void humidityWin()
-{
-  clk.setColorDepth(8);
-  huminum = huminum * (44 - 1) / 100;
-  clk.createSprite(44, 6);                         // 创建窗口
-  clk.fillSprite(0x0000);                          // 填充率
-  clk.drawRoundRect(0, 0, 44, 6, 3, 0xFFFF);       // 空心圆角矩形  起始位x,y,长度，宽度，圆弧半径，颜色
-  clk.fillRoundRect(1, 1, huminum, 4, 2, humicol); // 实心圆角矩形
-  clk.pushSprite(72, 222);                         // 窗口位置
-  clk.deleteSprite();
-}
+#if DHT_EN
 
-// 温度图标显示函数
-void tempWin()
+// 取数，在多任务调用。温度和湿度一次读出，失败时保留上次的值
+uint32_t dhtLegacyUs = 0;    // Adafruit库读取一次的时间(关中断约为其中去掉20ms起始信号的部分)
+uint32_t dhtLegacyMaxUs = 0;
+bool getDHT11()
 {
-  clk.setColorDepth(8);
-  tempnum = tempnum + 10;
-  clk.createSprite(66, 6);                         // 创建窗口
-  clk.fillSprite(0x0000);                          // 填充率
-  clk.drawRoundRect(0, 0, 66, 6, 3, 0xFFFF);       // 空心圆角矩形  起始位x,y,长度，宽度，圆弧半径，颜色
-  clk.fillRoundRect(1, 1, tempnum, 4, 2, tempcol); // 实心圆角矩形
-  clk.pushSprite(50, 192);                         // 窗口位置
-  clk.deleteSprite();
+  dhtReading = true;
+#if DHT_RMT
+  bool ok = dhtReader.read();
+#else
+  uint32_t start = micros();
+  bool ok = dht.read();
+  dhtLegacyUs = micros() - start;
+  if (dhtLegacyUs > dhtLegacyMaxUs)
+    dhtLegacyMaxUs = dhtLegacyUs;
+  if (ok)
+    dhtReader.addSample(lroundf(dht.readTemperature() * 10), lroundf(dht.readHumidity() * 10)); // 2秒内不会重新读取
+#endif
+  dhtReading = false;
+  if (!ok || !dhtReader.valid())
+    return false;
+  DHT11_T = dhtReader.temperature();
+  DHT11_H = dhtReader.humidity();
+  return true;
 }
 
-#if DHT_EN
+// DHT接到室内传感器层，读取由getDHT11完成
+class DhtSensor : public IndoorSensor
+{
+public:
+  const char *name() const override { return "DHT"; }
+  uint8_t provides() const override { return INDOOR_TEMP | INDOOR_HUMI; }
+  bool begin() override { return true; }    // 单总线无法探测，读不到时计为失败
+  uint16_t trigger() override { return 0; } // 起始信号在读取时发
+  bool collect(IndoorReading &r) override
+  {
+    if (!getDHT11())
+      return false;
+    r.temp10 = lroundf(DHT11_T * 10);
+    r.humi10 = lroundf(DHT11_H * 10);
+    r.fields |= INDOOR_TEMP | INDOOR_HUMI;
+    return true;
+  }
+};
+DhtSensor dhtSensor;
 
-float DHT11_T = 0;
-float DHT11_H = 0;
+// I2C传感器精度高，排在DHT前面；DHT只在它们不能提供温湿度时才读
+void beginIndoorSensors()
+{
+  i2cBus.begin(I2C_SDA, I2C_SCL, 100000);
+  indoor.add(&sht3x);
+  indoor.add(&bme280);
+  indoor.add(&scd4x);
+  indoor.add(&dhtSensor);
+  uint8_t found = indoor.begin();
+  Serial.printf("室内传感器：找到%u个I2C传感器\n", found - 1);
+}
 
-// 取数，在多任务调用。
-bool NewDht = 0;
-void getDHT11()
+// 室内温湿度框，有CO2时第二行和湿度交替显示。
+// 数字从字形缓存推送，只重推变化的字符；字库只在建缓存(开机、CO2换颜色)时加载
+// 框内的位置相对于布局中的框：每行24像素，数字右对齐到左起42像素，单位中心在53像素。
+// CO2到4位数时数字占满第二行，不画单位，颜色表示浓度
+DigitAtlas indoorTempAtlas(&tft);
+DigitAtlas indoorHumiAtlas(&tft);
+DigitAtlas indoorCo2Atlas(&tft);
+DigitField indoorTempField(0, 0, 0);
+DigitField indoorLine2Field(0, 0, 0);
+uint32_t indoorShownSeq = 0;
+bool indoorReflash = true; // 屏幕清过，下次画边框、单位和全部数字
+DigitAtlas *indoorLine2 = NULL; // 第二行当前用的缓存，换了就重画单位
+bool indoorLine2Wide = false;    // 第二行占满整行
+struct IndoorDrawStats
 {
-  DHT11_T = dht.readTemperature();
-  DHT11_H = dht.readHumidity();
-  NewDht = 1;
+  uint32_t updates;   // 有新数据的次数
+  uint32_t unchanged; // 数据变了但显示的数字没变
+  uint32_t fullDraws;
+  uint64_t pixels;
+} indoorStats = {};
+
+// 0.1单位的数值显示一位小数，超过4个字符时只显示整数
+void formatTenths(char *buf, size_t size, int16_t v10)
+{
+  int a = abs(v10);
+  snprintf(buf, size, "%s%d.%d", v10 < 0 ? "-" : "", a / 10, a % 10);
+  if (strlen(buf) > 4)
+    snprintf(buf, size, "%d", (v10 + (v10 < 0 ? -5 : 5)) / 10);
 }
 
-// 外接DHT11传感器，显示数据
-void IndoorTem()
+void IndoorTem(const LayoutRect &box, bool full)
 {
-  if (!NewDht)
+  IndoorReading r;
+  uint32_t seq = indoor.get(r);
+  if (full)
+    indoorReflash = true; // 还没有数据时留到有数据再画
+  if ((seq == indoorShownSeq && !indoorReflash) || !(r.fields & INDOOR_TEMP))
     return;
-  NewDht = 0;
-  float t = DHT11_T;
-  float h = DHT11_H;
-  // /***绘制相关文字***/
-  clk.setColorDepth(8);
-  clk.loadFont(ZdyLwFont_20);
-  tft.drawRoundRect(170, 112, 66, 48, 5, TFT_YELLOW); // 室内温湿度框
-  // //位置
-  // 温度
-  clk.createSprite(60, 24);
-  clk.fillSprite(bgColor);
-  clk.setTextDatum(CC_DATUM);
-  clk.setTextColor(TFT_CYAN, bgColor);
-  clk.drawFloat(t, 1, 20, 13);
-  clk.drawString("℃", 50, 13);
-  clk.pushSprite(173, 112); // 184
-  clk.deleteSprite();
+  indoorShownSeq = seq;
+  indoorStats.updates++;
+  uint32_t pixels = 0;
+  SmartLocker smartLocker(&shared_var_mutex_pushSprite, LockTimeout);
+  if (!smartLocker.IsLocked())
+  {
+    indoorShownSeq = 0; // 下次再画
+    return;
+  }
+  if (!indoorTempAtlas.ready())
+  {
+    indoorTempAtlas.build(ZdyLwFont_20, TFT_CYAN, bgColor, 24, 13, "℃");
+    indoorHumiAtlas.build(ZdyLwFont_20, TFT_GREENYELLOW, bgColor, 24, 13, "%");
+  }
+  if (indoorReflash)
+  {
+    indoorReflash = false;
+    lcdTarget().drawRoundRect(box.x, box.y, box.w, box.h, 5, TFT_YELLOW); // 室内温湿度框
+    pixels += indoorTempAtlas.pushUnit(lcdTarget(), box.x + 53 - indoorTempAtlas.unitWidth() / 2, box.y);
+    indoorTempField.place(box.x + 2, box.x + 42, box.y);
+    indoorLine2Field.place(box.x + 2, box.x + 43, box.y + 24);
+    indoorLine2 = NULL;
+    indoorStats.fullDraws++;
+  }
 
-  // 湿度
-  clk.createSprite(60, 24);
-  clk.fillSprite(bgColor);
-  clk.setTextDatum(CC_DATUM);
-  clk.setTextColor(TFT_GREENYELLOW, bgColor);
-  clk.drawFloat(h, 1, 20, 13);
-  clk.drawString("%", 50, 13);
-  clk.pushSprite(173, 136); // 214
-  clk.deleteSprite();
+  char buf[8];
+  formatTenths(buf, sizeof(buf), r.temp10);
+  pixels += indoorTempField.draw(lcdTarget(), indoorTempAtlas, buf);
+
+  // 湿度或CO2
+  DigitAtlas *line2 = &indoorHumiAtlas;
+  if ((r.fields & INDOOR_CO2) && (!(r.fields & INDOOR_HUMI) || (seq & 1)))
+  {
+    uint16_t color = r.co2 < 1000 ? TFT_GREEN : (r.co2 < 1500 ? TFT_YELLOW : TFT_RED);
+    if (!indoorCo2Atlas.ready() || indoorCo2Atlas.fg() != color)
+      indoorCo2Atlas.build(ZdyLwFont_20, color, bgColor, 24, 13, "ppm", 1); // 字库里没有字母，单位用内置字体
+    line2 = &indoorCo2Atlas;
+    snprintf(buf, sizeof(buf), "%u", r.co2 > 9999 ? 9999 : r.co2);
+  }
+  else if (r.fields & INDOOR_HUMI)
+    formatTenths(buf, sizeof(buf), r.humi10);
+  else
+    strcpy(buf, "--"); // BMP280没有湿度
+  bool wide = line2 == &indoorCo2Atlas && strlen(buf) > 3;
+  if (line2 != indoorLine2 || wide != indoorLine2Wide)
+  {
+    lcdTarget().fillRect(box.x + 43, box.y + 24, 22, 24, bgColor);
+    pixels += 22 * 24;
+    if (!wide)
+      pixels += line2->pushUnit(lcdTarget(), box.x + 53 - line2->unitWidth() / 2, box.y + 24);
+    indoorLine2Field.place(box.x + 2, wide ? box.x + box.w - 3 : box.x + 43, box.y + 24);
+    indoorLine2 = line2;
+    indoorLine2Wide = wide;
+  }
+  pixels += indoorLine2Field.draw(lcdTarget(), *line2, buf);
+
+  if (pixels == 0)
+    indoorStats.unchanged++;
+  indoorStats.pixels += pixels;
+  if (lcdFrame == NULL)
+    metrics.addSpiBytes(pixels * 2);
 }
 #endif
 
+// 到采样时间记录室外和室内温湿度，每小时保存一次
+void sampleHistory()
+{
+  if (rtc.getYear() == 1970)
+    return;
+  int16_t values[HistoryChannels];
+  bool weather = !cityname.isEmpty();
+  values[HIST_OUT_TEMP] = weather ? tempnum * 10 : HistoryGap;
+  values[HIST_OUT_HUMI] = weather ? huminum * 10 : HistoryGap;
+#if DHT_EN
+  IndoorReading r;
+  indoor.get(r);
+  bool show = DHT_img_flag != 0;
+  values[HIST_IN_TEMP] = show && (r.fields & INDOOR_TEMP) ? r.temp10 : HistoryGap;
+  values[HIST_IN_HUMI] = show && (r.fields & INDOOR_HUMI) ? r.humi10 : HistoryGap;
+#else
+  values[HIST_IN_TEMP] = HistoryGap;
+  values[HIST_IN_HUMI] = HistoryGap;
+#endif
+  uint32_t now = rtc.getEpoch();
+  if (history.add(now, values) && history.saveDue(now))
+    history.save(now);
+}
+
 #if !WM_EN
 // 微信配网函数
 void SmartConfig(void)
 {
   WiFi.mode(WIFI_STA); // 设置STA模式
   tft.pushImage(0, 0, 240, 240, qr);
+  metrics.addSpiBytes(240 * 240 * 2);
   Serial.println("\r\nWait for Smartconfig..."); // 打印log信息
   WiFi.beginSmartConfig();                       // 开始SmartConfig，等待手机端发出用户名和密码
   while (1)
@@ -1129,6 +1548,7 @@ void ledcAnalogWrite(uint8_t channel, uint32_t value)
   // calculate duty, 8191 from 2 ^ 13 - 1
 
   uint32_t duty = (8191 / valueMax) * min(value, valueMax);
+  power.setBacklight(value);
 
   // write duty to LEDC
 
@@ -1162,13 +1582,10 @@ void Serial_set()
     if (SMOD == "0x01") // 设置1亮度设置
     {
       int LCDBL = atoi(incomingByte.c_str()); // int n = atoi(xxx.c_str());//String转int
-      if (LCDBL >= 0 && LCDBL <= 255)
+      if (settings.setBacklight(LCDBL))
       {
-        EEPROM.write(BL_addr, LCDBL); // 亮度地址写入亮度值
-        EEPROM.commit();              // 保存更改的数据
-        delay(5);
-        LCD_BL_PWM = EEPROM.read(BL_addr);
-        delay(5);
+        settings.commit(); // 保存更改的数据
+        LCD_BL_PWM = settings.backlight();
         SMOD = "";
         Serial.print("亮度调整为：");
         // analogWrite(LCD_BL_PIN, 1023 - (LCD_BL_PWM*10));
@@ -1181,39 +1598,15 @@ void Serial_set()
     }
     if (SMOD == "0x02") // 设置2地址设置
     {
-      unsigned int CityCODE = 0;
       unsigned int CityC = atoi(incomingByte.c_str());  // int n = atoi(xxx.c_str());//String转int
       CityC = (CityC == 101281001) ? 101281009 : CityC; // 湛江的代码改为霞山代码，解决湛江的代码取不到其他区的预警信号
-      if (CityC >= 101000000 && CityC <= 102000000 || CityC == 0)
+      if (Settings::isValidCityCode(CityC))
       {
-        for (int cnum = 0; cnum < 5; cnum++)
-        {
-          EEPROM.write(CC_addr + cnum, CityC % 100); // 城市地址写入城市代码
-          EEPROM.commit();                           // 保存更改的数据
-          CityC = CityC / 100;
-          delay(5);
-        }
-        for (int cnum = 5; cnum > 0; cnum--)
-        {
-          CityCODE = CityCODE * 100;
-          CityCODE += EEPROM.read(CC_addr + cnum - 1);
-          delay(5);
-        }
-
-        cityCode = CityCODE;
-
-        if (cityCode == "0")
-        {
+        if (CityC == 0)
           Serial.println("城市代码调整为：自动");
-          getCityCode(); // 获取城市代码
-        }
-        else
-        {
-          Serial.print("城市代码调整为：");
-          Serial.println(cityCode);
-        }
-        UpdateWeater_en = 1;
-        weatherWarn.config(HeUserKey, cityCode); // 配置请求信息  101230201厦门 101230201 厦门  101281006 湛江 101281009 霞山
+        applyCityCode(CityC);
+        Serial.print("城市代码调整为：");
+        Serial.println(cityCode);
         UpdateScreen = 1;
         // LCD_reflash(1); // 屏幕刷新程序
         SMOD = "";
@@ -1224,16 +1617,12 @@ void Serial_set()
     if (SMOD == "0x03") // 设置3屏幕显示方向
     {
       int RoSet = atoi(incomingByte.c_str());
-      if (RoSet >= 0 && RoSet <= 3)
+      if (settings.setRotation(RoSet))
       {
-        EEPROM.write(Ro_addr, RoSet); // 屏幕方向地址写入方向值
-        EEPROM.commit();              // 保存更改的数据
+        settings.commit(); // 保存更改的数据
+        LCD_Rotation = RoSet;
         SMOD = "";
-        // 设置屏幕方向后重新刷屏并显示
-        tft.setRotation(RoSet);
-        tft.fillScreen(0x0000);
-        isNewWeather = 1;
-        UpdateScreen = 1;
+        rotateScreen(RoSet); // 按新方向离屏重画后一次推送
 
         Serial.print("屏幕方向设置为：");
         Serial.println(RoSet);
@@ -1246,14 +1635,10 @@ void Serial_set()
     if (SMOD == "0x04") // 设置天气更新时间
     {
       int wtup = atoi(incomingByte.c_str()); // int n = atoi(xxx.c_str());//String转int
-      if (wtup >= 1 && wtup <= 60)
+      if (settings.setUpdateMinutes(wtup))
       {
-        EEPROM.write(UpWeT_addr, wtup); // 更新时间地址写入更新时间值
-        EEPROM.commit();                // 保存更改的数据
-        delay(5);
-        updateweater_time = EEPROM.read(UpWeT_addr);
-        delay(5);
-        // updateweater_time = wtup;
+        settings.commit(); // 保存更改的数据
+        updateweater_time = settings.updateMinutes();
         SMOD = "";
         Serial.print("天气更新时间更改为：");
         Serial.print(updateweater_time);
@@ -1262,6 +1647,78 @@ void Serial_set()
       else
         Serial.println("更新时间太长，请重新设置（1-60）");
     }
+    else if (SMOD == "0x09") // 模拟断网
+    {
+      int sec = atoi(incomingByte.c_str());
+      if (sec > 0 && sec <= 3600)
+      {
+        SMOD = "";
+        Serial.printf("模拟断网%d秒\n", sec);
+        conn.simulateOutage(sec * 1000UL);
+      }
+      else
+        Serial.println("断网时间错误，请输入1-3600秒");
+    }
+    else if (SMOD == "0x0A") // 添加或删除WiFi
+    {
+      int comma = incomingByte.indexOf(',');
+      String ssid = comma < 0 ? incomingByte : incomingByte.substring(0, comma);
+      bool ok = comma < 0 ? conn.removeCredential(ssid.c_str())
+                          : conn.addCredential(ssid.c_str(), incomingByte.substring(comma + 1).c_str());
+      SMOD = "";
+      Serial.printf("%s WiFi %s%s，共%u个\n", comma < 0 ? "删除" : "添加", ssid.c_str(), ok ? "" : "失败", conn.credentialCount());
+    }
+    else if (SMOD == "0x0B") // 设置轮播城市
+    {
+      uint32_t codes[CityMax - 1];
+      uint8_t n = 0;
+      bool ok = true;
+      int from = 0;
+      while (ok && incomingByte != "0" && from < (int)incomingByte.length())
+      {
+        int comma = incomingByte.indexOf(',', from);
+        if (comma < 0)
+          comma = incomingByte.length();
+        uint32_t code = incomingByte.substring(from, comma).toInt();
+        ok = n < CityMax - 1 && code != 0 && Settings::isValidCityCode(code);
+        if (ok)
+          codes[n++] = code;
+        from = comma + 1;
+      }
+      if (ok && cities.setCities(codes, n))
+      {
+        SMOD = "";
+        isNewWeather = 1; // 重画当前城市
+        Serial.printf("轮播城市：%u个\n", cities.count());
+      }
+      else
+        Serial.printf("城市代码错误，最多%d个，用逗号分隔，输入0关闭轮播\n", CityMax - 1);
+    }
+    else if (SMOD == "0x0C") // 温湿度历史采样间隔
+    {
+      int minutes = atoi(incomingByte.c_str());
+      if (history.setMinutes(minutes))
+      {
+        SMOD = "";
+        Serial.printf("采样间隔%d分钟，保存%u小时\n", minutes, history.hours());
+      }
+      else
+        Serial.printf("采样间隔错误，请输入%d-%d分钟\n", HistoryMinMinutes, HistoryMaxMinutes);
+    }
+    else if (SMOD == "0x08") // 设置CPU频率策略
+    {
+      int policy = atoi(incomingByte.c_str());
+      if (settings.setCpuPolicy(policy))
+      {
+        settings.commit(); // 保存更改的数据
+        governor.setPolicy(policy);
+        SMOD = "";
+        Serial.print("CPU频率策略更改为：");
+        Serial.println(policy);
+      }
+      else
+        Serial.println("CPU频率策略错误，请输入0-3");
+    }
     else
     {
       SMOD = incomingByte;
@@ -1290,12 +1747,61 @@ void Serial_set()
         Serial.println("重置WiFi设置中......");
         delay(10);
         wm.resetSettings();
-        deletewificonfig();
+        settings.clearWifi();
+        settings.commit();
+        conn.clearCredentials();
         delay(10);
         Serial.println("重置WiFi成功");
         SMOD = "";
         ESP.restart();
       }
+      else if (SMOD == "0x06")
+      {
+        // 输出Chrome trace JSON，保存为.json后用chrome://tracing打开
+        char buf[256];
+        size_t n;
+        TraceDump dump;
+        while ((n = dump.read(buf, sizeof(buf))) > 0)
+          Serial.write((const uint8_t *)buf, n);
+        SMOD = "";
+      }
+      else if (SMOD == "0x07")
+      {
+        printRunStats(Serial);
+        SMOD = "";
+      }
+      else if (SMOD == "0x08")
+      {
+        Serial.print("当前CPU频率策略：");
+        Serial.println(governor.policy());
+        Serial.println("0-自动(只走时80MHz，绘图160MHz，联网和图片解码240MHz)");
+        Serial.println("1-固定240MHz");
+        Serial.println("2-固定160MHz");
+        Serial.println("3-固定80MHz");
+      }
+      else if (SMOD == "0x09")
+        Serial.println("请输入模拟断网的秒数（1-3600），恢复后用0x07查看重连统计");
+      else if (SMOD == "0x0B")
+      {
+        Serial.print("当前轮播城市：");
+        for (uint8_t i = 1; i < cities.count(); i++)
+          Serial.printf(" %u", cities.code(i));
+        Serial.println("");
+        Serial.printf("请输入主城市以外的城市代码，最多%d个，用逗号分隔，输入0关闭轮播\n", CityMax - 1);
+      }
+      else if (SMOD == "0x0C")
+      {
+        Serial.printf("当前采样间隔%u分钟，保存%u小时，已有%u个点\n", history.minutes(), history.hours(), history.count());
+        Serial.printf("请输入采样间隔（%d-%d分钟），修改后清空历史\n", HistoryMinMinutes, HistoryMaxMinutes);
+      }
+      else if (SMOD == "0x0A")
+      {
+        Serial.print("已保存的WiFi：");
+        for (uint8_t i = 0; i < conn.credentialCount(); i++)
+          Serial.printf(" %s", conn.credentialSsid(i));
+        Serial.println("");
+        Serial.println("添加请输入 名称,密码 ；删除请输入名称");
+      }
       else
       {
         Serial.println("");
@@ -1305,6 +1811,13 @@ void Serial_set()
         Serial.println("屏幕方向设置输入    0x03");
         Serial.println("更改天气更新时间    0x04");
         Serial.println("重置WiFi(会重启)    0x05");
+        Serial.println("输出耗时跟踪        0x06");
+        Serial.println("输出运行统计        0x07");
+        Serial.println("CPU频率策略         0x08");
+        Serial.println("模拟断网            0x09");
+        Serial.println("添加/删除WiFi       0x0A");
+        Serial.println("多城市轮播          0x0B");
+        Serial.println("温湿度历史间隔      0x0C");
         Serial.println("");
       }
     }
@@ -1325,7 +1838,7 @@ void Wait_win(String showStr)
   clk.drawString("WiFi连接成功!!!", 100, 40, 2);
   clk.setTextColor(TFT_WHITE, 0x0000);
   clk.drawRightString("初始化...", 180, 60, 2);
-  clk.pushSprite(20, 120); // 窗口位置
+  lcdPush(clk, 20, 120); // 窗口位置
   clk.deleteSprite();
 
   clk.createSprite(200, 20);
@@ -1333,7 +1846,7 @@ void Wait_win(String showStr)
   clk.setTextDatum(CC_DATUM);
   clk.setTextColor(TFT_WHITE, 0x0000);
   clk.drawCentreString(showStr, 120, 0, 2);
-  clk.pushSprite(20, 100);
+  lcdPush(clk, 20, 100);
   clk.deleteSprite();
   clk.unloadFont();
   loadNum += 1;
@@ -1356,7 +1869,7 @@ void Web_win()
   clk.drawString("SSID:", 45, 40, 2);
   clk.setTextColor(TFT_WHITE, 0x0000);
   clk.drawString("WeatherAP_XXXX", 125, 40, 2);
-  clk.pushSprite(20, 50); // 窗口位置
+  lcdPush(clk, 20, 50); // 窗口位置
 
   clk.deleteSprite();
 }
@@ -1471,13 +1984,14 @@ String getParam(String name)
 
 void saveParamCallback()
 {
-  int CCODE = 0, cc;
+  int cc;
 
   Serial.println("[CALLBACK] saveParamCallback fired");
 
 // 将从页面中获取的数据保存
 #if DHT_EN
   DHT_img_flag = getParam("DHT11EN").toInt();
+  applyLayout();
 #endif
   updateweater_time = getParam("WeaterUpdateTime").toInt();
   cc = getParam("CityCode").toInt();
@@ -1489,49 +2003,26 @@ void saveParamCallback()
   Serial.print("CityCode = ");
   Serial.println(cc);
   cc = (cc == 101281001) ? 101281009 : cc; // 湛江的代码改为霞山代码，解决湛江的代码取不到其他区的预警信号
-  if (cc >= 101000000 && cc <= 102000000 || cc == 0)
-  {
-    for (int cnum = 0; cnum < 5; cnum++)
-    {
-      EEPROM.write(CC_addr + cnum, cc % 100); // 城市地址写入城市代码
-      EEPROM.commit();                        // 保存更改的数据
-      cc = cc / 100;
-      delay(5);
-    }
-    for (int cnum = 5; cnum > 0; cnum--)
-    {
-      CCODE = CCODE * 100;
-      CCODE += EEPROM.read(CC_addr + cnum - 1);
-      delay(5);
-    }
-    cityCode = CCODE;
-  }
+  if (settings.setCityCode(cc))
+    cityCode = cc;
   // 屏幕方向
   Serial.print("LCD_Rotation = ");
   Serial.println(LCD_Rotation);
-  if (EEPROM.read(Ro_addr) != LCD_Rotation)
-  {
-    EEPROM.write(Ro_addr, LCD_Rotation);
-    EEPROM.commit();
-    delay(5);
-  }
+  if (!settings.setRotation(LCD_Rotation))
+    LCD_Rotation = settings.rotation();
   tft.setRotation(LCD_Rotation);
   tft.fillScreen(0x0000);
   Web_win();
   loadNum--;
   loading(1);
-  if (EEPROM.read(BL_addr) != LCD_BL_PWM)
-  {
-    EEPROM.write(BL_addr, LCD_BL_PWM);
-    EEPROM.commit();
-    delay(5);
-  }
-  if (EEPROM.read(UpWeT_addr) != updateweater_time)
-  {
-    EEPROM.write(UpWeT_addr, updateweater_time);
-    EEPROM.commit();
-    delay(5);
-  }
+  if (!settings.setBacklight(LCD_BL_PWM))
+    LCD_BL_PWM = settings.backlight();
+  if (!settings.setUpdateMinutes(updateweater_time))
+    updateweater_time = settings.updateMinutes();
+#if DHT_EN
+  settings.setDhtEnable(DHT_img_flag);
+#endif
+  settings.commit(); // 所有参数一次保存
   // 屏幕亮度
   Serial.print("亮度调整为：");
   ledcAnalogWrite(pwm_channel0, LCD_BL_PWM);
@@ -1543,8 +2034,6 @@ void saveParamCallback()
 #if DHT_EN
   // 是否使用DHT11传感器
   Serial.print("DHT11传感器：");
-  EEPROM.write(DHT_addr, DHT_img_flag);
-  EEPROM.commit(); // 保存更改的数据
   Serial.println((DHT_img_flag ? "已启用" : "未启用"));
 #endif
 }
@@ -1557,77 +2046,110 @@ void SaveConfigCallback()
     Serial.println(WiFi.SSID().c_str());
     Serial.print("PSW:");
     Serial.println("************");
-    strcpy(wificonf.stassid, WiFi.SSID().c_str()); // 名称复制
-    strcpy(wificonf.stapsw, WiFi.psk().c_str());   // 密码复制
-    savewificonfig();
-    readwificonfig();
+    settings.setWifi(WiFi.SSID().c_str(), WiFi.psk().c_str());
+    settings.commit();
+    conn.addCredential(WiFi.SSID().c_str(), WiFi.psk().c_str());
   }
 }
 #endif
 
 void LCD_reflash(bool en)
 {
-  // 更新天气情况和预警情况
+  // 修改城市等设置后立即更新天气和预警
   if (UpdateWeater_en == 1)
   {
-    if (WiFi.status() == WL_CONNECTED)
-    {
-      Serial.println("开始更新天气...");
+    fetcher.markDue(FETCH_WEATHER);
+    fetcher.markDue(FETCH_WARNING);
+  }
 
-      getCityWeater();
-      getWarning(); // 取当前预警
+  // 日期变化后农历在本地重算，当天的宜忌还没取过再联网
+  if (rtc.getYear() != 1970 && rtc.getDay() != nongliDay)
+  {
+    nongliDay = rtc.getDay();
+    buildCalendar();
+    if (almanac.date != dateStamp())
+      fetcher.markDue(FETCH_CALENDAR);
+  }
 
-      if (UpdateWeater_en == 1)
-        UpdateWeater_en = 0;
-    }
+  fetcher.setInterval(FETCH_WEATHER, 60000UL * updateweater_time);
+  fetcher.setInterval(FETCH_WARNING, 60000UL * updateweater_time);
+
+  if (!conn.isOnline())
+  {
+    // 断网期间到期的取数排队，联网后立即执行
+    for (int i = 0; i < FETCH_SOURCE_COUNT; i++)
+      if (fetcher.isDue((FetchSource)i, millis()))
+        conn.queueFetch((FetchSource)i);
+    return;
+  }
+  uint8_t queued = conn.takeQueued();
+  for (int i = 0; i < FETCH_SOURCE_COUNT; i++)
+    if (queued & (1 << i))
+      fetcher.markDue((FetchSource)i);
+
+  // 缓存开机时，联网后再校时和启动web服务
+  if (rtc.getYear() == 1970)
+    getNtpTime();
+#if WebSever_EN
+  if (!webStarted)
+  {
+    Web_Sever_Init();
+    webStarted = true;
   }
+#endif
 
-  // 更新农历情况
-  if (UpdateNL_en == 1)
+  // 更新天气情况
+  if (fetcher.isDue(FETCH_WEATHER, millis()))
   {
-    if (WiFi.status() == WL_CONNECTED)
+    UpdateWeater_en = 1;
+    Serial.println("开始更新天气...");
+    if (runFetch(FETCH_WEATHER) && bootFreshDataMs == 0)
     {
-      Serial.println("开始更新万年历...");
-      getNongli();
-      if (UpdateNL_en == 1)
-        UpdateNL_en = 0;
+      bootFreshDataMs = millis();
+      Serial.printf("开机到取得最新天气用时：%ums\n", bootFreshDataMs);
     }
   }
 
-  // 20分钟更新一次天气
-  if (millis() - weaterTime > (60000 * updateweater_time))
+  // 更新预警情况，预警生效期间加快轮询
+  if (fetcher.isDue(FETCH_WARNING, millis()))
   {
     UpdateWeater_en = 1;
-    weaterTime = millis();
+    runFetch(FETCH_WARNING);
+    fetcher.setWarningActive(!scrollText[6].isEmpty());
   }
+  UpdateWeater_en = 0;
 
-  // 每3小时更新一下农历信息
-  if (rtc.getHour(true) % 3 == 0)
-  {
-    if (!finishNL)
-    {
-      UpdateNL_en = 1;
-    }
-    else
-    {
-      UpdateNL_en = 0;
-    }
-  }
-  else
+  // 更新农历情况
+  if (fetcher.isDue(FETCH_CALENDAR, millis()))
   {
+    UpdateNL_en = 1;
+    Serial.println("开始更新宜忌...");
+    runFetch(FETCH_CALENDAR);
     UpdateNL_en = 0;
   }
+
+  // 轮播城市错开取数，每次最多一个
+  int city = cities.nextDue(millis());
+  if (city > 0)
+    fetchCity(city);
   // UpdateScreen = 2;
 }
 
-void drawTemIcons()
+void renderTempIcon(const LayoutRect &r, bool full)
+{
+  TJpgDec.drawJpg(r.x, r.y, temperature, sizeof(temperature));
+  metrics.countJpeg();
+}
+
+void renderHumiIcon(const LayoutRect &r, bool full)
 {
-  TJpgDec.drawJpg(31, 183, temperature, sizeof(temperature)); // 温度图标
-  TJpgDec.drawJpg(50, 200, humidity, sizeof(humidity));       // 湿度图标
+  TJpgDec.drawJpg(r.x, r.y, humidity, sizeof(humidity));
+  metrics.countJpeg();
 }
 // 滚动显示两个字幕
 void dispScrolls()
 {
+  TRACE_SCOPE("dispScrolls");
   /***********************************************************************************************************
    * 做一个双状态切换  1 -> 3
    *                    X
@@ -1639,11 +2161,11 @@ void dispScrolls()
   switch (prevTime)
   {
   case 1:
-    scrollDate();
+    layout.touch(W_DATE);
     prevTime = 3;
     break;
   case 2:
-    scrollBanner();
+    layout.touch(W_BANNER);
     prevTime = 4;
     break;
   default:
@@ -1671,18 +2193,12 @@ void dispScrolls()
 }
 
 // 取得和风天气的预警信息
-void getWarning()
+bool getWarning()
 {
-  if (WiFi.status() != WL_CONNECTED)
+  if (!conn.isOnline())
   {
     Serial.println("getWarning Error:WiFi is not Connected.");
-    LostWiFi = true;
-    // WiFi.reconnect();
-    return;
-  }
-  else
-  {
-    LostWiFi = false;
+    return false;
   }
   isNewWarn = false;
   scrollText[6] = "";
@@ -1691,16 +2207,23 @@ void getWarning()
   {
     if (weatherWarn.getStatus().equals("update") || weatherWarn.getStatus().equals("active"))
     {
-      String T = weatherWarn.getTitle();
-      int StrIndex = T.indexOf("布");
-      int StrEnd = T.indexOf("信号");
-      scrollText[6] = T.substring(StrIndex + 3, StrEnd);
-      isNewWarn = true;
+      scrollText[6] = warnShortTitle(weatherWarn.getTitle());
+      if (weatherWarn.isChanged())
+        saveWarnCache();
+      // 预警期间轮询加快，内容没变时按原来的天气更新间隔重播预警画面
+      if (weatherWarn.isChanged() || warnShowTime == 0 || millis() - warnShowTime >= 60000UL * updateweater_time)
+      {
+        isNewWarn = true;
+        warnShowTime = millis();
+        metrics.countWarnActivation();
+      }
     }
     else
     {
       isNewWarn = false;
       scrollText[6] = "";
+      if (weatherWarn.isChanged())
+        saveWarnCache();
     }
   }
   else
@@ -1710,12 +2233,23 @@ void getWarning()
     Serial.println(weatherWarn.getServerCode());
     scrollText[6] = "";
     isNewWarn = false;
+    return false;
   }
+  return true;
+}
+
+// 从预警标题中取出预警名称，如"暴雨蓝色预警"
+String warnShortTitle(const String &title)
+{
+  int StrIndex = title.indexOf("布");
+  int StrEnd = title.indexOf("信号");
+  return title.substring(StrIndex + 3, StrEnd);
 }
 
 // 显示天气预警界面
 void DispWarn()
 {
+  TRACE_SCOPE("DispWarn");
   String T = weatherWarn.getTitle();
   String X = weatherWarn.getWeatherText();
 
@@ -1758,6 +2292,7 @@ void DispWarn()
   TJpgDec.setCallback(tft_output_Warn);
   TJpgDec.drawFsJpg(80, 10, typeFile, FlashFS);
   TJpgDec.setCallback(tft_output);
+  metrics.countJpeg();
   tft.drawRoundRect(80, 10, 80, 80, 5, TFT_BLACK);
   tft.drawRoundRect(80 + 1, 10 + 1, 80 - 2, 80 - 2, 5, TFT_BLACK);
   tft.drawRoundRect(80 + 2, 10 + 2, 80 - 4, 80 - 4, 5, TFT_BLACK);
@@ -1773,7 +2308,7 @@ void DispWarn()
   clk.drawCentreString(temp2, 110, 3, 2);
   clk.drawCentreString(temp1, 110, 30, 2);
 
-  clk.pushSprite(10, 162);
+  lcdPush(clk, 10, 162);
   clk.deleteSprite();
 
   clk.createSprite(230, 22 * 3);
@@ -1788,7 +2323,7 @@ void DispWarn()
   {
     clk.fillSprite(TFT_WHITE);
     clk.drawString(X, 2, 60 - i * 2);
-    clk.pushSprite(5, 90);
+    lcdPush(clk, 5, 90);
 
     // Continuous elliptical arc drawing
     fillArc(120, 120, inc * 6, 1, 120, 120, 5, rainbow(col));
@@ -1820,18 +2355,13 @@ void DispWarn()
 }
 
 // 发送HTTP请求并且将服务器响应通过串口输出
-void getCityCode()
+bool getCityCode()
 {
-  if (WiFi.status() != WL_CONNECTED)
+  bool ok = false;
+  if (!conn.isOnline())
   {
     Serial.println("getCitycode Error:WiFi is not Connected.");
-    LostWiFi = true;
-    // WiFi.reconnect();
-    return;
-  }
-  else
-  {
-    LostWiFi = false;
+    return false;
   }
 
   String URL = "http://wgeo.weather.com.cn/ip/?_=" + String(rtc.getEpoch());
@@ -1849,9 +2379,10 @@ void getCityCode()
   int httpCode = httpClient.GET();
   Serial.print("Send GET request to URL: ");
 
-  // 重试
-  while (httpCode == -1 || httpCode == -11)
+  // 重试，次数有限，失败交给调用者处理
+  for (int iRetry = 0; iRetry < FetchScheduler::MaxRetry && (httpCode == -1 || httpCode == -11); iRetry++)
   {
+    delay(500 << iRetry);
     httpCode = httpClient.GET();
   }
 
@@ -1863,28 +2394,15 @@ void getCityCode()
     int aa = str.indexOf("id=");
     if (aa > -1)
     {
-      unsigned int CityCODE = 0;
       // cityCode = str.substring(aa+4,aa+4+9).toInt();
       unsigned int CityC = str.substring(aa + 4, aa + 4 + 9).toInt();
       Serial.println("CityCode:" + cityCode);
 
-      if (CityC >= 101000000 && CityC <= 102000000 || CityC == 0)
+      if (CityC != 0 && settings.setCityCode(CityC))
       {
-        for (int cnum = 0; cnum < 5; cnum++)
-        {
-          EEPROM.write(CC_addr + cnum, CityC % 100); // 城市地址写入城市代码
-          EEPROM.commit();                           // 保存更改的数据
-          CityC = CityC / 100;
-          delay(5);
-        }
-        for (int cnum = 5; cnum > 0; cnum--)
-        {
-          CityCODE = CityCODE * 100;
-          CityCODE += EEPROM.read(CC_addr + cnum - 1);
-          delay(5);
-        }
-
-        cityCode = CityCODE;
+        settings.commit(); // 保存更改的数据
+        cityCode = CityC;
+        ok = true;
       }
       else
       {
@@ -1903,27 +2421,19 @@ void getCityCode()
 
   // 关闭ESP8266与服务器连接
   httpClient.end();
+  return ok;
 }
 
 // 获取城市天气
-void getCityWeater()
+bool getCityWeater()
 {
-  if (WiFi.status() != WL_CONNECTED)
+  TRACE_SCOPE("getCityWeater");
+  if (!conn.isOnline())
   {
     Serial.println("getCitycode Error:WiFi is not Connected.");
-    LostWiFi = true;
-    // WiFi.reconnect();
-    return;
-  }
-  else
-  {
-    LostWiFi = false;
+    return false;
   }
 
-  String jsonCityDZ = "";
-  String jsonDataSK = "";
-  String jsonFC = "";
-
   String URL = "http://d1.weather.com.cn/weather_index/" + cityCode + ".html?_=" + String(rtc.getEpoch());
 
   // 创建 HTTPClient 对象
@@ -1934,130 +2444,281 @@ void getCityWeater()
   // 设置请求头中的User-Agent
   httpClient.setUserAgent("Mozilla/5.0 (iPhone; CPU iPhone OS 11_0 like Mac OS X) AppleWebKit/604.1.38 (KHTML, like Gecko) Version/11.0 Mobile/15A372 Safari/604.1");
   httpClient.addHeader("Referer", "http://www.weather.com.cn/");
+  HttpsGetUtils::addValidatorHeaders(httpClient, &weatherValidator);
 
   // 启动连接并发送HTTP请求
   int httpCode = httpClient.GET();
   Serial.println("正在获取天气数据");
 
-  // 重试
-  while (httpCode == -1 || httpCode == -11)
+  // 重试，次数有限，失败后由调度器退避
+  for (int iRetry = 0; iRetry < FetchScheduler::MaxRetry && (httpCode == -1 || httpCode == -11); iRetry++)
   {
+    delay(500 << iRetry);
     httpCode = httpClient.GET();
-    delay(1000);
   }
 
+  if (httpCode == HTTP_CODE_NOT_MODIFIED)
+  {
+    // 服务器确认内容未改变，不用下载、解析和重画
+    weatherNotModified++;
+    weatherBytesSaved += weatherValidator.lastSize;
+    weatherRedrawSkipped++;
+    Serial.println("天气数据未改变(304)");
+  }
   // 如果服务器响应OK则从服务器获取响应体信息并通过串口输出
-  if (httpCode == HTTP_CODE_OK)
+  else if (httpCode == HTTP_CODE_OK)
   {
 
     String str = httpClient.getString();
-    int indexStart = str.indexOf("weatherinfo\":");
-    int indexEnd = str.indexOf("};var alarmDZ");
-
-    jsonCityDZ = str.substring(indexStart + 13, indexEnd);
-
-    indexStart = str.indexOf("dataSK =");
-    indexEnd = str.indexOf(";var dataZS");
-    jsonDataSK = str.substring(indexStart + 8, indexEnd);
-
-    indexStart = str.indexOf("\"f\":[");
-    indexEnd = str.indexOf(",{\"fa");
-    jsonFC = str.substring(indexStart + 5, indexEnd);
+    HttpsGetUtils::saveValidator(httpClient, &weatherValidator, httpCode, str.length());
+    WeatherRecord rec;
+    ForecastData fc;
+    if (!parseWeatherPage(str, weatherHash, rec, fc, true))
+    {
+      weatherRedrawSkipped++;
+      Serial.println("天气数据未改变");
+      httpClient.end();
+      return true;
+    }
 
-    isNewWeather = 1;
     Serial.println("获取成功");
-
-    // 解析第一段JSON
-    DynamicJsonDocument doc(1024);
-    deserializeJson(doc, jsonDataSK);
-    JsonObject sk = doc.as<JsonObject>();
-
-    tempnum = sk["temp"].as<int>();                                  // 温度
-    huminum = atoi((sk["SD"].as<String>()).substring(0, 2).c_str()); // 湿度
-    // 霞山的霞字在字库里面没有，所以调整为湛江 ：）
-    cityname = sk["cityname"].as<String>();
-    cityname = cityname.equals("霞山") ? "湛江" : cityname;
-
-    pm25V = sk["aqi"];
-
-    scrollText[0] = "实时天气 " + sk["weather"].as<String>();
-    // scrollText[1] = "空气质量 " + aqiTxt;
-    scrollText[2] = "风向 " + sk["WD"].as<String>() + sk["WS"].as<String>();
-    Iconsname = atoi((sk["weathercode"].as<String>()).substring(1, 3).c_str());
-
-    // 左上角滚动字幕
-    // 解析第二段JSON
-    deserializeJson(doc, jsonCityDZ);
-    JsonObject dz = doc.as<JsonObject>();
-
-    scrollText[3] = "今日" + dz["weather"].as<String>();
-
-    deserializeJson(doc, jsonFC);
-    JsonObject fc = doc.as<JsonObject>();
-
-    scrollText[4] = "最低温度" + fc["fd"].as<String>() + "℃";
-    scrollText[5] = "最高温度" + fc["fc"].as<String>() + "℃";
+    applyWeatherRecord(rec);
+    setForecast(fc);
+    saveWeatherCache();
+    isNewWeather = 1;
   }
   else
   {
+    // 取数失败时继续显示上次的数据(开机时来自缓存)，不用重画
     Serial.print("请求城市天气错误：");
-    isNewWeather = 1;
-    jsonCityDZ = "{\"city\":\"湛江\",\"cityname\":\"zhanjiang\",\"temp\":\"999\",\"tempn\":\"29\",\"weather\":\"等待更新\",\"wd\":\"等待更新\",\"ws\":\"等待更新\",\"weathercode\":\"d1\",\"weathercoden\":\"n3\",\"fctime\":\"202306220800\"}";
-    jsonDataSK = "{\"nameen\":\"zhanjiang\",\"cityname\":\"湛江\",\"city\":\"101281001\",\"temp\":\"00\",\"tempf\":\"00\",\"WD\":\"等待更新\",\"wde\":\"NW\",\"WS\":\"等待更新\",\"wse\":\"4km/h\",\"SD\":\"00%\",\"sd\":\"00%\",\"qy\":\"997\",\"njd\":\"13km\",\"time\":\"18:55\",\"rain\":\"0\",\"rain24h\":\"0\",\"aqi\":\"38\",\"aqi_pm25\":\"38\",\"weather\":\"等待更新\",\"weathere\":\"Cloudy\",\"weathercode\":\"d01\",\"limitnumber\":\"\",\"date\":\"等待更新\"}";
-    jsonFC = "{\"fa\":\"01\",\"fb\":\"03\",\"fc\":\"34\",\"fd\":\"27\",\"fe\":\"等待更新\",\"ff\":\"等待更新\",\"fg\":\"等待更新\",\"fh\":\"等待更新\",\"fk\":\"5\",\"fl\":\"0\",\"fm\":\"999.9\",\"fn\":\"88.9\",\"fi\":\"6/22\",\"fj\":\"今天\"}";
+    Serial.println(httpCode);
   }
   // 关闭ESP8266与服务器连接
   httpClient.end();
+  return httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_NOT_MODIFIED;
 }
 
-//  获取农历信息
-void getNongli()
+// 从天气页面取出实况、今日两段JSON解析到rec，多日预报解析到fc，内容的哈希和hash相同时不解析，返回false
+// 预报解析的耗时统计只记主城市(primary)，轮播城市不计入
+bool parseWeatherPage(const String &str, uint32_t &hash, WeatherRecord &rec, ForecastData &fc, bool primary)
 {
-  if (WiFi.status() != WL_CONNECTED)
+  int indexStart = str.indexOf("weatherinfo\":");
+  int indexEnd = str.indexOf("};var alarmDZ");
+  String jsonCityDZ = str.substring(indexStart + 13, indexEnd);
+
+  indexStart = str.indexOf("dataSK =");
+  indexEnd = str.indexOf(";var dataZS");
+  String jsonDataSK = str.substring(indexStart + 8, indexEnd);
+
+  // 多日预报扫描一遍直接填入fc，不再截取第一天的JSON
+  uint32_t start = micros();
+  ForecastParser parser(fc);
+  parser.feed(str.c_str(), str.length());
+  if (primary)
   {
-    Serial.println("getCitycode Error:WiFi is not Connected.");
-    LostWiFi = true;
-    // WiFi.reconnect();
-    return;
+    forecastParseUs = micros() - start;
+    if (forecastParseUs > forecastParseMaxUs)
+      forecastParseMaxUs = forecastParseUs;
+    forecastScanned = parser.bytesScanned();
+  }
+
+  uint32_t h = HttpsGetUtils::contentHash((const uint8_t *)jsonCityDZ.c_str(), jsonCityDZ.length());
+  h = HttpsGetUtils::contentHash((const uint8_t *)jsonDataSK.c_str(), jsonDataSK.length(), h);
+  h = HttpsGetUtils::contentHash((const uint8_t *)fc.days, fc.count * sizeof(ForecastDay), h);
+  if (h == hash)
+    return false;
+  hash = h;
+
+  memset(&rec, 0, sizeof(rec));
+  // 解析第一段JSON
+  DynamicJsonDocument doc(1024);
+  deserializeJson(doc, jsonDataSK);
+  JsonObject sk = doc.as<JsonObject>();
+
+  rec.temp = sk["temp"].as<int>();                                  // 温度
+  rec.humi = atoi((sk["SD"].as<String>()).substring(0, 2).c_str()); // 湿度
+  // 霞山的霞字在字库里面没有，所以调整为湛江 ：）
+  String city = sk["cityname"].as<String>();
+  DataCache::copyText(rec.city, sizeof(rec.city), city.equals("霞山") ? String("湛江") : city);
+  rec.aqi = sk["aqi"];
+  rec.icon = atoi((sk["weathercode"].as<String>()).substring(1, 3).c_str());
+
+  uint16_t aqiColor;
+  DataCache::copyText(rec.scroll[0], sizeof(rec.scroll[0]), "实时天气 " + sk["weather"].as<String>());
+  DataCache::copyText(rec.scroll[1], sizeof(rec.scroll[1]), String("空气质量 ") + aqiLevel(rec.aqi, &aqiColor));
+  DataCache::copyText(rec.scroll[2], sizeof(rec.scroll[2]), "风向 " + sk["WD"].as<String>() + sk["WS"].as<String>());
+
+  // 左上角滚动字幕
+  // 解析第二段JSON
+  deserializeJson(doc, jsonCityDZ);
+  JsonObject dz = doc.as<JsonObject>();
+  DataCache::copyText(rec.scroll[3], sizeof(rec.scroll[3]), "今日" + dz["weather"].as<String>());
+
+  String low = fc.count > 0 ? forecastTemp(fc.days[0].low) : String("");
+  String high = fc.count > 0 ? forecastTemp(fc.days[0].high) : String("");
+  DataCache::copyText(rec.scroll[4], sizeof(rec.scroll[4]), "最低温度" + low + "℃");
+  DataCache::copyText(rec.scroll[5], sizeof(rec.scroll[5]), "最高温度" + high + "℃");
+  return true;
+}
+
+// 没有温度时为空，和原来页面中的空字符串一样
+String forecastTemp(int8_t temp)
+{
+  return temp == ForecastNoTemp ? String("") : String(temp, DEC);
+}
+
+// 主城市预报有变化时由任务C重画预报页面
+void setForecast(const ForecastData &fc)
+{
+  portENTER_CRITICAL(&forecastMux);
+  forecast = fc;
+  forecastDirty = true;
+  portEXIT_CRITICAL(&forecastMux);
+}
+
+// 取轮播城市的天气和预警，天气请求共用cityHttp保持的连接
+void fetchCity(uint8_t idx)
+{
+  TRACE_SCOPE("fetchCity");
+  CpuScope cpu(CPU_LEVEL_BOOST, CPU_PATH_FETCH);
+  uint32_t start = millis();
+  String code = String(cities.code(idx));
+  String URL = "http://d1.weather.com.cn/weather_index/" + code + ".html?_=" + String(rtc.getEpoch());
+
+  cityHttp.setReuse(true);
+  cityHttp.begin(URL);
+  cityHttp.setUserAgent("Mozilla/5.0 (iPhone; CPU iPhone OS 11_0 like Mac OS X) AppleWebKit/604.1.38 (KHTML, like Gecko) Version/11.0 Mobile/15A372 Safari/604.1");
+  cityHttp.addHeader("Referer", "http://www.weather.com.cn/");
+  int httpCode = cityHttp.GET();
+  bool ok = httpCode == HTTP_CODE_OK;
+  if (ok)
+  {
+    String str = cityHttp.getString();
+    HttpsGetUtils::rxBytes += str.length();
+    WeatherRecord rec;
+    ForecastData fc; // 轮播城市只显示实况
+    uint32_t hash = cities.weatherHash(idx);
+    if (parseWeatherPage(str, hash, rec, fc, false))
+      cities.setWeather(idx, rec, hash);
   }
   else
   {
-    LostWiFi = false;
+    Serial.printf("请求轮播城市%s天气错误：%d\n", code.c_str(), httpCode);
   }
+  cityHttp.end(); // 设置了复用，服务器允许时保持连接
 
-  Serial.println("获取农历信息．．．");
-  DynamicJsonDocument doc(1024);
-
-  TotalHEAD = 4;
-  scrolHEAD = new Display[TotalHEAD];
+  // 预警共用一个WeatherWarn，每次按城市重新配置
+  cityWarn.config(HeUserKey, code);
+  if (cityWarn.get())
+  {
+    String status = cityWarn.getStatus();
+    cities.setWarn(idx, status.equals("update") || status.equals("active") ? warnShortTitle(cityWarn.getTitle()) : String(""));
+  }
+  cities.onFetched(idx, ok, millis() - start, 60000UL * updateweater_time);
+}
 
-  if (scrolHEAD == NULL)
+// 宜忌按"."分成若干项，每行两项，返回行数
+int almanacLines(const char *prefix, const char *words, int color, Display *out, int max)
+{
+  int n = 0, items = 0;
+  const char *p = words;
+  while (*p && n < max)
+  {
+    const char *end = strchr(p, '.');
+    size_t len = end ? end - p : strlen(p);
+    if (len > 0)
+    {
+      char item[CacheTextLen];
+      snprintf(item, sizeof(item), "%.*s", (int)len, p);
+      if (items % 2 == 0)
+      {
+        out[n].title = prefix;
+        out[n].color = color;
+      }
+      else
+      {
+        out[n].title += " ";
+      }
+      out[n].title += item;
+      if (items++ % 2 == 1)
+        n++;
+    }
+    p = end ? end + 1 : p + len;
+  }
+  if (items % 2 == 1)
+    n++;
+  if (n == 0 && max > 0)
   {
-    Serial.println("new scrolHEAD fail!!");
+    out[0].title = prefix;
+    out[0].color = color;
+    n = 1;
+  }
+  return n;
+}
+
+// 农历、节气、干支和周数在本地计算，宜忌和假日用当天取到的，没取到时按星期估计
+void buildCalendar()
+{
+  if (rtc.getYear() == 1970)
+    return; // 还没有校时
+  uint32_t start = micros();
+  LunarDay day;
+  if (!Lunar::convert(rtc.getYear(), rtc.getMonth() + 1, rtc.getDay(), day))
     return;
+  char lunar[LunarTextLen], term[LunarTextLen], gz[8];
+  Lunar::dateText(day, lunar, sizeof(lunar));
+  Lunar::termText(day, term, sizeof(term));
+  Lunar::ganZhi(day.year, gz, sizeof(gz));
+  bool today = almanac.date == dateStamp();
+  const char *typeDes = today ? almanac.typeDes : (rtc.getDayofWeek() % 6 == 0 ? "休息日" : "工作日");
+
+  Display *lines = new Display[MaxScroll];
+  int n = 0;
+  lines[n].title = monthDay() + " " + week();
+  lines[n++].color = cWHITE;
+  lines[n].title = String(gz) + "年 " + lunar;
+  lines[n++].color = cWHITE;
+  lines[n].title = String(Lunar::zodiac(day.year)) + "年" + day.week + "周 " + typeDes;
+  lines[n++].color = cWHITE;
+  lines[n].title = String("今日") + term;
+  lines[n++].color = cWHITE;
+  if (today)
+  {
+    n += almanacLines("宜:", almanac.suit, cGREEN, lines + n, (MaxScroll - n) / 2);
+    n += almanacLines("忌:", almanac.avoid, cRED, lines + n, MaxScroll - n);
   }
 
   if (scrollNongLi != NULL)
     delete[] scrollNongLi;
-  scrollNongLi = new Display[1];
-  if (scrollNongLi == NULL)
+  scrollNongLi = lines;
+  TotalDis = n;
+  nongliStats.builds++;
+  nongliStats.buildUs = micros() - start;
+  if (nongliStats.buildUs > nongliStats.buildMaxUs)
+    nongliStats.buildMaxUs = nongliStats.buildUs;
+  saveNongliCache();
+}
+
+// 当天的宜忌和假日，每天取一次，取到后重排农历滚动信息
+bool getNongli()
+{
+  int32_t today = dateStamp();
+  if (almanac.date == today)
   {
-    Serial.println("new scrollNongLi fail!!");
-    return;
+    buildCalendar(); // 今天已经取过
+    return true;
+  }
+  if (!conn.isOnline())
+  {
+    Serial.println("getCitycode Error:WiFi is not Connected.");
+    return false;
   }
-  memset(scrollNongLi, '\0', 1);
-
-  String Y = String(rtc.getYear());
-  String M = rtc.getMonth() + 1 < 10 ? "0" + String(rtc.getMonth() + 1) : String(rtc.getMonth() + 1);
-  String D = rtc.getDay() < 10 ? "0" + String(rtc.getDay()) : String(rtc.getDay());
-
-  memset(scrolHEAD, '\0', TotalHEAD);
 
-  scrollNongLi[0].title = scrolHEAD[0].title = monthDay() + " " + week();
-  scrollNongLi[0].color = scrolHEAD[0].color = cWHITE;
+  Serial.println("获取宜忌信息．．．");
+  DynamicJsonDocument doc(1024);
 
   // https://www.mxnzp.com/api/holiday/single/20181121?ignoreHoliday=false&app_id=不再提供请自主申请&app_secret=不再提供请自主申请
-  String URL = "https://www.mxnzp.com/api/holiday/single/" + Y + M + D + "?ignoreHoliday=false&app_id=" + mx_id + "&app_secret=" + mx_secret;
+  String URL = "https://www.mxnzp.com/api/holiday/single/" + String(today) + "?ignoreHoliday=false&app_id=" + mx_id + "&app_secret=" + mx_secret;
 
   // 创建 HTTPClient 对象
   HTTPClient httpClient; // 定义http客户端
@@ -2067,11 +2728,7 @@ void getNongli()
   if (!client)
   {
     Serial.println("Unable to create client");
-    if (scrollNongLi != NULL)
-      delete[] scrollNongLi;
-    if (scrolHEAD != NULL)
-      delete[] scrolHEAD;
-    return;
+    return false;
   }
 
   client->setInsecure();
@@ -2083,7 +2740,8 @@ void getNongli()
   // 设置请求头中的User-Agent
   httpClient.setUserAgent("Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:109.0) Gecko/20100101 Firefox/114.0");
   httpClient.addHeader("Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8");
-  httpClient.addHeader("Accept-Encoding", "gzip, deflate, br");
+  httpClient.addHeader("Accept-Encoding", "gzip, deflate"); // 不支持br
+  httpClient.useHTTP10(true);                              // 不用分块传输，响应体可以直接当流解压
   httpClient.addHeader("Accept-Language", "zh-CN,zh;q=0.8,zh-TW;q=0.7,zh-HK;q=0.5,en-US;q=0.3,en;q=0.2");
   httpClient.addHeader("Host", "https://www.mxnzp.com/");
   httpClient.addHeader("Connection", "keep-alive");
@@ -2106,260 +2764,98 @@ void getNongli()
     {
       break;
     }
-    else
+    else if (iRetry < FetchScheduler::MaxRetry)
     {
-      delay(3000);
+      delay(500 << iRetry);
     }
     iRetry++;
-  } while (!(httpCode == HTTP_CODE_OK) && iRetry < 10);
+  } while (!(httpCode == HTTP_CODE_OK) && iRetry <= FetchScheduler::MaxRetry); // 重试次数有限，失败后由调度器退避
 
   // 如果服务器响应OK则从服务器获取响应体信息并通过串口输出
+  bool ok = false;
   if (httpCode == HTTP_CODE_OK)
   {
-    String response = "";
+    uint32_t decodeStart = millis();
     int content_len = httpClient.getSize(); // get length of document (is -1 when Server sends no Content-Length header)
-    if ((httpClient.hasHeader("Content-Encoding")) && (httpClient.header("Content-Encoding").equals("gzip")))
+    String encoding = httpClient.header("Content-Encoding");
+    bool gzip = encoding.equals("gzip");
+    WiFiClient *streamptr = httpClient.getStreamPtr();
+    DeserializationError error = DeserializationError::Ok;
+    if ((gzip || encoding.equals("deflate")) && streamptr != nullptr)
     {
-      Serial.println("httpget() ok");
-      WiFiClient *streamptr = httpClient.getStreamPtr();
-      Serial.println("getStreamPtr() ok");
-      // Gzip解压
-      if (streamptr != nullptr)
+      // 边收边解压，直接交给JSON解析
+      GzipStream gz(*streamptr, NongliWindow);
+      nongliStats.gzip++;
+      if (!gz.begin(gzip ? GzipStream::Gzip : GzipStream::Zlib))
       {
-        Serial.println("streamptr ok");
-        TarGzUnpacker *TARGZUnpacker = new TarGzUnpacker();
-        Serial.println("TARGZUnpacker ok");
-
-        TARGZUnpacker->haltOnError(true);                                                            // stop on fail (manual restart/reset required)
-        TARGZUnpacker->setTarVerify(true);                                                           // true = enables health checks but slows down the overall process
-        TARGZUnpacker->setupFSCallbacks(targzTotalBytesFn, targzFreeBytesFn);                        // prevent the partition from exploding, recommended
-        TARGZUnpacker->setGzProgressCallback(BaseUnpacker::defaultProgressCallback);                 // targzNullProgressCallback or defaultProgressCallback
-        TARGZUnpacker->setLoggerCallback(BaseUnpacker::targzPrintLoggerCallback);                    // gz log verbosity
-        TARGZUnpacker->setTarProgressCallback(BaseUnpacker::defaultProgressCallback);                // prints the untarring progress for each individual file
-        TARGZUnpacker->setTarStatusProgressCallback(BaseUnpacker::defaultTarStatusProgressCallback); // print the filenames as they're expanded
-        TARGZUnpacker->setTarMessageCallback(BaseUnpacker::targzPrintLoggerCallback);                // tar log verbosity
-
-        Serial.println("settings ok");
-
-        if (!TARGZUnpacker->tarGzStreamExpander(streamptr, tarGzFS))
-        {
-          Serial.printf("tarGzStreamExpander failed with return code #%d\n", TARGZUnpacker->tarGzGetError());
-        }
-        else
-        {
-          // print leftover bytes if any (probably zero-fill from the server)
-          while (httpClient.connected())
-          {
-            size_t streamSize = streamptr->available();
-            if (streamSize)
-            {
-              response += streamptr->read();
-            }
-            else
-              break;
-          }
-        }
-        delete TARGZUnpacker;
+        Serial.printf("农历gzip头部错误 内存:%u字节\n", gz.bytes());
+        error = DeserializationError::InvalidInput;
       }
       else
       {
-        Serial.println("Failed to establish http connection");
+        nongliStats.heapBytes = gz.bytes(); // 解压过程中不再分配，这就是峰值
+        error = deserializeJson(doc, gz);
+        while (gz.read() >= 0) // 读完JSON后面剩下的部分，校验CRC
+          ;
+        if (!gz.done())
+        {
+          Serial.printf("农历gzip解压错误:%d\n", gz.error());
+          if (!error)
+            error = DeserializationError::InvalidInput;
+        }
       }
+      nongliStats.inBytes = gz.inBytes();
+      nongliStats.outBytes = gz.outBytes();
+      HttpsGetUtils::rxBytes += gz.inBytes();
     }
     else
     {
-      response = httpClient.getString();
+      String response = httpClient.getString();
+      nongliStats.inBytes = nongliStats.outBytes = response.length();
+      nongliStats.heapBytes = response.length() + 1;
+      HttpsGetUtils::rxBytes += content_len > 0 ? content_len : response.length();
+      error = deserializeJson(doc, response);
     }
     // http结束
+    nongliStats.fetches++;
+    nongliStats.lastMs = millis() - decodeStart;
+    if (nongliStats.lastMs > nongliStats.maxMs)
+      nongliStats.maxMs = nongliStats.lastMs;
 
-    // 开始JSON解析
-    //  反序列化JSON
-    DeserializationError error = deserializeJson(doc, response);
-
+    // JSON解析结果
     if (error)
     {
+      nongliStats.failures++;
       Serial.print(F("deserializeJson() failed: "));
       Serial.println(error.f_str());
-      if (scrollNongLi != NULL)
-        delete[] scrollNongLi;
-      if (scrolHEAD != NULL)
-        delete[] scrolHEAD;
-      return;
     }
-    JsonObject root = doc.as<JsonObject>();
-
-    if (doc["code"].as<int>() != 1)
+    else if (doc["code"].as<int>() != 1)
     {
       Serial.print(F("data is  wrong: "));
       Serial.println(doc["code"].as<int>());
-      if (scrollNongLi != NULL)
-        delete[] scrollNongLi;
-      if (scrolHEAD != NULL)
-        delete[] scrolHEAD;
-      return;
-    }
-
-    JsonObject data = root["data"];
-
-    const char *suit = data["suit"];   // 今日宜
-    const char *avoid = data["avoid"]; // 今日忌
-
-    scrolHEAD[1].title = data["yearTips"].as<String>() + "年 " + data["lunarCalendar"].as<String>();
-    scrolHEAD[1].color = cWHITE;
-    scrolHEAD[2].title = data["chineseZodiac"].as<String>() + "年" + data["weekOfYear"].as<String>() + "周" + " " + data["typeDes"].as<String>();
-    scrolHEAD[2].color = cWHITE;
-    scrolHEAD[3].title = "今日" + data["solarTerms"].as<String>();
-    scrolHEAD[3].color = cWHITE;
-
-    // 宜忌有时描述太长，分行显示
-    String *rword = NULL;
-    int needle = 0;
-
-    rword = new String[strlen(suit)];
-    if (rword == NULL)
-    {
-      Serial.println("new rword fail!!");
-      return;
-    }
-    memset(rword, '\0', sizeof(rword));
-
-    // temp = suit;
-    if (strlen(suit) > 0)
-    {
-      TotalYI = StrSplit(suit, ".", rword);
-
-      scrollYI = new Display[TotalYI];
-      if (scrollYI == NULL)
-      {
-        Serial.println("new scrollYI fail!!");
-        return;
-      }
-      memset(scrollYI, '\0', TotalYI);
-
-      if (TotalYI < MaxScroll)
-      {
-        for (int i = 0; i < TotalYI; i += 2)
-        {
-          scrollYI[needle].title = "宜:" + rword[i] + " " + rword[i + 1];
-          scrollYI[needle].color = cGREEN;
-          needle++;
-          if (needle > MaxScroll)
-            break;
-        }
-      }
-      else
-      {
-        Serial.println("suit字符串太大。");
-      }
-    }
-    else
-    {
-      scrollYI[needle].title = "宜:";
-      scrollYI[needle].color = cWHITE;
-      needle++;
-    }
-    TotalYI = needle;
-    needle = 0;
-
-    if (rword != NULL)
-      delete[] rword;
-
-    rword = new String[strlen(avoid)];
-    if (rword == NULL)
-    {
-      Serial.println("new rword fail!!");
-      return;
-    }
-    memset(rword, '\0', sizeof(rword));
-    if (strlen(avoid) > 0)
-    {
-      TotalJI = StrSplit(avoid, ".", rword);
-
-      scrollJI = new Display[TotalJI];
-      if (scrollJI == NULL)
-      {
-        Serial.println("new scrollJI fail!!");
-        return;
-      }
-      memset(scrollJI, '\0', TotalJI);
-
-      if (TotalJI < MaxScroll)
-      {
-        for (int i = 0; i < TotalJI; i += 2)
-        {
-          scrollJI[needle].title = "忌:" + rword[i] + " " + rword[i + 1];
-          scrollJI[needle].color = cRED;
-          needle++;
-          if (needle > MaxScroll)
-            break;
-        }
-      }
-      else
-      {
-        Serial.println("avoid字符串太大。");
-      }
     }
     else
     {
-      scrollJI[needle].title = "忌:";
-      scrollJI[needle].color = cRED;
-      needle++;
-    }
-    TotalJI = needle;
-    if (rword != NULL)
-      delete[] rword;
-
-    if (scrollNongLi != NULL)
-      delete[] scrollNongLi;
-
-    TotalDis = TotalHEAD + TotalYI + TotalJI;
-    scrollNongLi = new Display[TotalDis];
-    if (scrollNongLi == NULL)
-    {
-      Serial.println("new scrollNongLi fail!!");
-      return;
+      JsonObject data = doc["data"];
+      almanac.date = today;
+      DataCache::copyText(almanac.typeDes, sizeof(almanac.typeDes), data["typeDes"].as<String>());
+      copyWords(almanac.suit, sizeof(almanac.suit), data["suit"].as<String>());   // 今日宜
+      copyWords(almanac.avoid, sizeof(almanac.avoid), data["avoid"].as<String>()); // 今日忌
+      DataCache::save(AlmanacCacheFile, &almanac, sizeof(almanac), rtc.getEpoch());
+      buildCalendar();
+      ok = true;
     }
-    memset(scrollNongLi, '\0', TotalDis);
-
-    my_strcat_arrcy(scrolHEAD, TotalHEAD, scrollYI, TotalYI, scrollJI, TotalJI, scrollNongLi);
-
-    if (scrollJI != NULL)
-      delete[] scrollJI;
-    if (scrollYI != NULL)
-      delete[] scrollYI;
-
-    finishNL = true;
   }
   else
   {
-    if (scrollNongLi != NULL)
-      delete[] scrollNongLi;
-
-    TotalDis = TotalHEAD = 1;
-    scrollNongLi = new Display[TotalDis];
-    if (scrollNongLi == NULL)
-    {
-      Serial.println("new scrollNongLi fail!!");
-      return;
-    }
-    memset(scrollNongLi, '\0', TotalDis);
-
-    for (int i = 0; i < TotalDis; i++)
-    {
-      scrollNongLi[i] = scrolHEAD[i];
-    }
-
-    Serial.print("请求农历信息错误：");
-
-    finishNL = false;
+    Serial.print("请求宜忌信息错误：");
+    Serial.println(httpCode);
   }
 
-  if (scrolHEAD != NULL)
-    delete[] scrolHEAD;
-
   // 关闭ESP8266与服务器连接
   httpClient.end();
   delete client;
+  return ok;
 }
 
 /**
@@ -2459,206 +2955,350 @@ String HTTPS_request(String host, String url, String parameter)
   return line;
 }
 
-// 3个数组相加出来1个
-void my_strcat_arrcy(Display *arr, int lena, Display *brr, int lenb, Display *crr, int lenc, Display *str)
+// 天气信息写到屏幕上
+// 空气质量等级，color返回底色
+const char *aqiLevel(int aqi, uint16_t *color)
 {
-  int i = 0, j = 0;
-  for (i = 0; i < lena; i++)
+  if (aqi > 200)
   {
-    str[j] = arr[i];
-    j++;
+    *color = tft.color565(136, 11, 32); // 重度
+    return "重度";
   }
-  for (i = 0; i < lenb; i++)
+  if (aqi > 150)
   {
-    str[j] = brr[i];
-    j++;
+    *color = tft.color565(186, 55, 121); // 中度
+    return "中度";
   }
-  for (i = 0; i < lenc; i++)
+  if (aqi > 100)
   {
-    str[j] = crr[i];
-    j++;
+    *color = tft.color565(242, 159, 57); // 轻
+    return "轻度";
   }
-}
-// gzip解压进度
-void myTarProgressCallback(uint8_t progress)
-{
-  static int8_t myLastProgress = -1;
-  if (myLastProgress != progress)
+  if (aqi > 50)
   {
-    myLastProgress = progress;
-    if (progress == 0)
-    {
-      Serial.print("Progress: [0% ");
-    }
-    else if (progress == 100)
-    {
-      Serial.println(" 100%]\n");
-    }
-    else
-    {
-      switch (progress)
-      {
-      case 25:
-        Serial.print(" 25% ");
-        break;
-      case 50:
-        Serial.print(" 50% ");
-        break;
-      case 75:
-        Serial.print(" 75% ");
-        break;
-      default:
-        Serial.print("T");
-        break;
-      }
-    }
+    *color = tft.color565(247, 219, 100); // 良
+    return "良";
   }
+  *color = tft.color565(156, 202, 127); // 优
+  return "优";
 }
-// 天气信息写到屏幕上
-void weaterData()
-{
-
-  /***绘制相关文字***/
-  clk.setColorDepth(8);
-  clk.loadFont(ZdyLwFont_20); // ZdyLwFont_20
 
-  // 温度
-  clk.createSprite(58, 24);
+// 在clk中画第idx个天气小部件，clk已按布局中的大小创建并载入字体
+void drawWeatherWidget(int idx, const WeatherRecord &rec)
+{
   clk.fillSprite(bgColor);
   clk.setTextDatum(CC_DATUM);
   clk.setTextColor(TFT_WHITE, bgColor);
-  // clk.drawString(sk["temp"].as<String>() + "℃", 28, 13);
-  clk.drawString(String(tempnum, DEC) + "℃", 28, 13);
-  clk.pushSprite(110, 184);
-  clk.deleteSprite();
-  // tempnum = sk["temp"].as<int>();
-  tempnum = tempnum + 10;
-  if (tempnum < 10)
-    tempcol = 0x00FF;
-  else if (tempnum < 28)
-    tempcol = 0x0AFF;
-  else if (tempnum < 34)
-    tempcol = 0x0F0F;
-  else if (tempnum < 41)
-    tempcol = 0xFF0F;
-  else if (tempnum < 49)
-    tempcol = 0xF00F;
-  else
+  switch (idx)
   {
-    tempcol = 0xF00F;
-    tempnum = 50;
-  }
-  tempWin();
-
-  // 湿度
-  clk.createSprite(58, 24);
-  clk.fillSprite(bgColor);
-  clk.setTextDatum(CC_DATUM);
-  clk.setTextColor(TFT_WHITE, bgColor);
-  clk.drawString(String(huminum, DEC) + '%', 28, 13);
-  // clk.drawString("100%",28,13);
-  clk.pushSprite(110, 214);
-  clk.deleteSprite();
-
-  if (huminum > 90)
-    humicol = 0x00FF;
-  else if (huminum > 70)
-    humicol = 0x0AFF;
-  else if (huminum > 40)
-    humicol = 0x0F0F;
-  else if (huminum > 20)
-    humicol = 0xFF0F;
-  else
-    humicol = 0xF00F;
-  humidityWin();
-
-  // 城市名称
-  clk.createSprite(94, 30);
-  clk.fillSprite(bgColor);
-  clk.setTextDatum(CC_DATUM);
-  clk.setTextColor(TFT_WHITE, bgColor);
-
-  clk.drawString(cityname, 44, 16);
-  clk.pushSprite(26, 15); // 15,15
-  clk.deleteSprite();
-
-  // PM2.5空气指数
-  uint16_t pm25BgColor = tft.color565(156, 202, 127); // 优
-  String aqiTxt = "优";
-  // int pm25V = sk["aqi"];
-  if (pm25V > 200)
+  case 0: // 城市名称
+    clk.drawString(rec.city, 44, 16);
+    break;
+  case 1: // PM2.5空气指数
   {
-    pm25BgColor = tft.color565(136, 11, 32); // 重度
-    aqiTxt = "重度";
+    uint16_t color;
+    const char *txt = aqiLevel(rec.aqi, &color);
+    clk.fillRoundRect(0, 0, 50, 24, 4, color);
+    clk.setTextColor(0x0000);
+    clk.drawString(txt, 25, 13);
+    break;
   }
-  else if (pm25V > 150)
+  case 2: // 温度
+    clk.drawString(String(rec.temp, DEC) + "℃", 28, 13);
+    break;
+  case 3: // 温度条
   {
-    pm25BgColor = tft.color565(186, 55, 121); // 中度
-    aqiTxt = "中度";
+    int len = rec.temp + 10;
+    uint16_t color = 0xF00F;
+    if (len < 10)
+      color = 0x00FF;
+    else if (len < 28)
+      color = 0x0AFF;
+    else if (len < 34)
+      color = 0x0F0F;
+    else if (len < 41)
+      color = 0xFF0F;
+    else if (len >= 49)
+      len = 50;
+    clk.drawRoundRect(0, 0, 66, 6, 3, 0xFFFF);        // 空心圆角矩形  起始位x,y,长度，宽度，圆弧半径，颜色
+    clk.fillRoundRect(1, 1, len + 10, 4, 2, color); // 实心圆角矩形
+    break;
   }
-  else if (pm25V > 100)
+  case 4: // 湿度
+    clk.drawString(String(rec.humi, DEC) + '%', 28, 13);
+    break;
+  case 5: // 湿度条
   {
-    pm25BgColor = tft.color565(242, 159, 57); // 轻
-    aqiTxt = "轻度";
+    uint16_t color = 0xF00F;
+    if (rec.humi > 90)
+      color = 0x00FF;
+    else if (rec.humi > 70)
+      color = 0x0AFF;
+    else if (rec.humi > 40)
+      color = 0x0F0F;
+    else if (rec.humi > 20)
+      color = 0xFF0F;
+    clk.drawRoundRect(0, 0, 44, 6, 3, 0xFFFF);
+    clk.fillRoundRect(1, 1, rec.humi * (44 - 1) / 100, 4, 2, color);
+    break;
   }
-  else if (pm25V > 50)
-  {
-    pm25BgColor = tft.color565(247, 219, 100); // 良
-    aqiTxt = "良";
   }
-  clk.createSprite(56, 24);
-  clk.fillSprite(bgColor);
-  clk.fillRoundRect(0, 0, 50, 24, 4, pm25BgColor);
-  clk.setTextDatum(CC_DATUM);
-  clk.setTextColor(0x0000);
-  clk.drawString(aqiTxt, 25, 13);
-  clk.pushSprite(104, 18);
-  clk.deleteSprite();
-
-  scrollText[1] = "空气质量 " + aqiTxt;
-
-  clk.unloadFont();
 }
 
-// 滚动显示
-int currentIndex = 0;
-void scrollBanner()
+// 画出全部天气小部件，pixels不为NULL时依次复制保存(8位色)，否则直接推送到屏幕
+void drawWeatherWidgets(const WeatherRecord &rec, uint8_t *pixels)
 {
-  if (scrollText[currentIndex] != "")
+  clk.setColorDepth(8);
+  clk.loadFont(ZdyLwFont_20); // ZdyLwFont_20
+  for (int i = 0; i < CityWidgetCount; i++)
   {
-    clk.setColorDepth(8);
-    scrollText[6].isEmpty() ? clk.loadFont(ZdyLwFont_20) : clk.loadFont("msyhbd20", FlashFS);
+    const LayoutRect &r = layout.rect(W_CITY + i);
+    if (clk.createSprite(r.w, r.h) != NULL)
+    {
+      drawWeatherWidget(i, rec);
+      if (pixels != NULL)
+        memcpy(pixels, clk.getPointer(), r.w * r.h);
+      else
+        lcdPush(clk, r.x, r.y);
+      clk.deleteSprite();
+    }
+    if (pixels != NULL)
+      pixels += r.w * r.h;
+  }
+  clk.unloadFont();
+}
+
+void weaterData()
+{
+  TRACE_SCOPE("weaterData");
+  WeatherRecord rec;
+  currentWeather(rec);
+  drawWeatherWidgets(rec, NULL);
+}
+
+// 画天气图标和天气小部件，轮播时显示第idx个城市
+void drawWeather(uint8_t idx)
+{
+  if (!cities.enabled())
+  {
+    const LayoutRect &icon = layout.rect(W_WEATHER);
+    wrat.printfweather(icon.x, icon.y, Iconsname);
+    weaterData();
+    return;
+  }
+  renderCities();
+  showCity(idx);
+}
+
+void renderWeather(const LayoutRect &r, bool full)
+{
+  int next = cityPending;
+  cityPending = -1;
+  // 只是切换城市时推送画好的小部件，否则要连续解码多个JPEG
+  CpuScope cpu(next >= 0 && !full ? CPU_LEVEL_NORMAL : CPU_LEVEL_BOOST, CPU_PATH_WEATHER);
+  drawWeather(next >= 0 ? next : cities.current());
+}
+
+// 数据有变化的城市重新画小部件，只在任务C中调用
+void renderCities()
+{
+  TRACE_SCOPE("renderCities");
+  cities.releaseUnused();
+  WeatherRecord rec;
+  for (uint8_t i = 0; i < cities.count(); i++)
+  {
+    uint8_t *pixels = cities.beginRender(i, rec);
+    if (pixels != NULL)
+      drawWeatherWidgets(rec, pixels);
+  }
+}
+
+int currentIndex = 0; // 滚动字幕当前行
+
+// 切换城市时只推送画好的小部件，不重新排版文字
+// 图标缓存未命中时要用TJpgDec解码，只从持有绘制锁的任务C(或旋转屏幕)中调用
+void showCity(uint8_t idx)
+{
+  TRACE_SCOPE("showCity");
+  uint32_t start = micros();
+  WeatherRecord rec;
+  const LayoutRect &icon = layout.rect(W_WEATHER);
+  if (!cities.getWeather(idx, rec))
+  {
+    // 主城市还没有数据
+    wrat.printfweather(icon.x, icon.y, Iconsname);
+    weaterData();
+    return;
+  }
+  wrat.printfweather(icon.x, icon.y, rec.icon);
+  uint8_t *pixels = cities.rendered(idx);
+  if (pixels == NULL)
+    drawWeatherWidgets(rec, NULL); // 内存不够时直接画
+  else
+  {
+    clk.setColorDepth(8);
+    for (int i = 0; i < CityWidgetCount; i++)
+    {
+      const LayoutRect &r = layout.rect(W_CITY + i);
+      if (clk.createSprite(r.w, r.h) != NULL)
+      {
+        memcpy(clk.getPointer(), pixels, r.w * r.h);
+        lcdPush(clk, r.x, r.y);
+        clk.deleteSprite();
+      }
+      pixels += r.w * r.h;
+    }
+  }
+  if (idx != cities.current())
+    currentIndex = 0; // 字幕从新城市的第一行开始
+  cities.onShown(idx, micros() - start);
+}
+
+// 当前显示城市的滚动字幕，第6行是预警
+void bannerLine(int idx, String &out)
+{
+  if (cities.current() == 0)
+    out = scrollText[idx];
+  else
+    cities.getLine(cities.current(), idx, out);
+}
+
+// 在clk中画一天的预报，如"周二 多云 18~25℃"，放不下时省略天气
+void drawForecastPage(const ForecastDay &day)
+{
+  String name;
+  if (strncmp(day.week, "星期", 6) == 0)
+    name = String("周") + (day.week + 6);
+  else if (day.week[0] != '\0')
+    name = day.week;
+  else
+    name = String(day.mday, DEC) + "日";
+  String temp = forecastTemp(day.low) + "~" + forecastTemp(day.high) + "℃";
+  String text = name + " " + ForecastParser::weatherText(day.dayCode) + " " + temp;
+  if (clk.textWidth(text) > ForecastPageW - 4)
+    text = name + " " + temp;
+
+  clk.fillSprite(bgColor);
+  clk.setTextWrap(false);
+  clk.setTextDatum(CC_DATUM);
+  clk.setTextColor(TFT_CYAN, bgColor);
+  clk.drawString(text, 74, 16);
+}
+
+// 预报变化时重画全部页面，只在任务C中调用
+void renderForecast()
+{
+  TRACE_SCOPE("renderForecast");
+  ForecastData fc;
+  portENTER_CRITICAL(&forecastMux);
+  fc = forecast;
+  forecastDirty = false;
+  portEXIT_CRITICAL(&forecastMux);
+
+  // 第0天是今天，已在字幕中显示
+  uint8_t pages = fc.count > 1 ? min(fc.count - 1, ForecastPages) : 0;
+  if (pages > 0 && forecastPixels == NULL)
+  {
+    forecastPixels = (uint8_t *)malloc(ForecastPages * ForecastPageBytes);
+    if (forecastPixels == NULL)
+    {
+      forecastAllocFailures++;
+      forecastPageCount = 0;
+      return;
+    }
+  }
+
+  uint8_t done = 0;
+  clk.setColorDepth(8);
+  clk.loadFont("msyhbd20", FlashFS);
+  for (uint8_t i = 0; i < pages; i++)
+  {
+    if (clk.createSprite(ForecastPageW, ForecastPageH) == NULL)
+      break;
+    drawForecastPage(fc.days[i + 1]);
+    memcpy(forecastPixels + i * ForecastPageBytes, clk.getPointer(), ForecastPageBytes);
+    clk.deleteSprite();
+    done++;
+  }
+  clk.unloadFont();
+  forecastPageCount = done;
+  forecastRenders++;
+}
+
+// 预报页面只跟在主城市的字幕后面
+uint8_t forecastPagesShown()
+{
+  return cities.current() == 0 ? forecastPageCount : 0;
+}
 
-    clk.createSprite(150, 30);
+// 推送画好的预报页面，不载入字体
+void showForecastPage(const LayoutRect &r, uint8_t page)
+{
+  if (page >= forecastPageCount)
+    return;
+  clk.setColorDepth(8);
+  if (clk.createSprite(ForecastPageW, ForecastPageH) == NULL)
+    return;
+  memcpy(clk.getPointer(), forecastPixels + page * ForecastPageBytes, ForecastPageBytes);
+  SmartLocker smartLocker2(&shared_var_mutex_pushSprite, LockTimeout);
+  if (smartLocker2.IsLocked())
+  {
+    lcdPush(clk, r.x, r.y);
+  }
+  clk.deleteSprite();
+}
+
+// 滚动显示，第7行起是预报页面
+void scrollBanner(const LayoutRect &r)
+{
+  String text, warn;
+  if (currentIndex <= 6)
+    bannerLine(currentIndex, text);
+  else
+    showForecastPage(r, currentIndex - 7);
+  bannerLine(6, warn);
+  if (text != "")
+  {
+    clk.setColorDepth(8);
+    warn.isEmpty() ? clk.loadFont(ZdyLwFont_20) : clk.loadFont("msyhbd20", FlashFS);
+
+    clk.createSprite(r.w, r.h);
     clk.fillSprite(bgColor);
     clk.setTextWrap(false);
     clk.setTextDatum(CC_DATUM);
-    scrollText[6].isEmpty() ? clk.setTextColor(TFT_WHITE, bgColor) : clk.setTextColor(TFT_MAGENTA, bgColor);
+    warn.isEmpty() ? clk.setTextColor(TFT_WHITE, bgColor) : clk.setTextColor(TFT_MAGENTA, bgColor);
 
-    clk.drawString(scrollText[currentIndex], 74, 16);
+    clk.drawString(text, 74, 16);
 
-    SmartLocker smartLocker2(&shared_var_mutex_pushSprite, portMAX_DELAY);
+    SmartLocker smartLocker2(&shared_var_mutex_pushSprite, LockTimeout);
     if (smartLocker2.IsLocked())
     {
-      clk.pushSprite(10, 45);
+      lcdPush(clk, r.x, r.y);
     }
 
     clk.deleteSprite();
     clk.unloadFont();
   }
-  if (currentIndex >= 6)
+  if (currentIndex >= 6 + forecastPagesShown())
     currentIndex = 0; // 回第一个
   else
     currentIndex += 1; // 准备切换到下一个
 }
 
-void scrollDate()
+void scrollDate(const LayoutRect &r)
 {
   if (scrollNongLi == NULL)
   {
     Serial.println("scrollNongLi is NULL");
     return;
   }
+  // 农历后面显示温度曲线
+  if (CurrentDisDate >= TotalDis)
+  {
+    showChart(r);
+    CurrentDisDate = 0;
+    return;
+  }
   if (scrollNongLi[CurrentDisDate].title && CurrentDisDate < TotalDis)
   {
     if (scrollNongLi[CurrentDisDate].title != "")
@@ -2674,7 +3314,7 @@ void scrollDate()
       // 然后在这里调用
       clk.loadFont("msyhbd20", FlashFS);
       // 星期
-      clk.createSprite(162, 30);
+      clk.createSprite(r.w, r.h);
       clk.fillSprite(bgColor);
       clk.setTextDatum(CC_DATUM);
       switch (scrollNongLi[CurrentDisDate].color)
@@ -2697,10 +3337,10 @@ void scrollDate()
       }
       clk.drawString(scrollNongLi[CurrentDisDate].title, 75, 16);
 
-      SmartLocker smartLocker2(&shared_var_mutex_pushSprite, portMAX_DELAY);
+      SmartLocker smartLocker2(&shared_var_mutex_pushSprite, LockTimeout);
       if (smartLocker2.IsLocked())
       {
-        clk.pushSprite(10, 150);
+        lcdPush(clk, r.x, r.y);
       }
 
       clk.deleteSprite();
@@ -2714,7 +3354,7 @@ void scrollDate()
 
     if (CurrentDisDate >= TotalDis - 1)
     {
-      CurrentDisDate = 0; // 回第一个
+      CurrentDisDate = chartReady ? TotalDis : 0; // 回第一个，有温度曲线时先显示曲线
       return;
     }
     else
@@ -2730,15 +3370,134 @@ void scrollDate()
   }
 }
 
+static int chartX(int col)
+{
+  return col * ChartDx + 2;
+}
+
+static int chartY(int16_t value)
+{
+  return ChartH - 3 - (int32_t)(value - chartLo) * (ChartH - 6) / (chartHi - chartLo);
+}
+
+// 从第from列画到最右一列，空的小时断开
+void drawChartColumns(const int16_t *outdoor, const int16_t *indoor, int from)
+{
+  const int16_t *lines[2] = {outdoor, indoor};
+  const uint16_t colors[2] = {TFT_ORANGE, TFT_CYAN};
+  for (int l = 0; l < 2; l++)
+  {
+    const int16_t *v = lines[l];
+    for (int k = from; k < ChartHours; k++)
+    {
+      if (v[k] == HistoryGap)
+        continue;
+      if (k > 0 && v[k - 1] != HistoryGap)
+        chartSpr.drawLine(chartX(k - 1), chartY(v[k - 1]), chartX(k), chartY(v[k]), colors[l]);
+      else
+        chartSpr.drawPixel(chartX(k), chartY(v[k]), colors[l]);
+    }
+  }
+}
+
+// 有新的历史点时更新曲线：纵轴范围够用时整体左移，只重画最后两列
+void updateChart()
+{
+  if (history.seq() == chartSeq)
+    return;
+  TRACE_SCOPE("updateChart");
+  chartSeq = history.seq();
+  int16_t outdoor[ChartHours], indoor[ChartHours];
+  uint32_t hour = history.hourly(HIST_OUT_TEMP, outdoor, ChartHours);
+  history.hourly(HIST_IN_TEMP, indoor, ChartHours);
+
+  int16_t lo = INT16_MAX, hi = INT16_MIN;
+  for (int k = 0; k < ChartHours; k++)
+  {
+    if (outdoor[k] != HistoryGap)
+    {
+      lo = min(lo, outdoor[k]);
+      hi = max(hi, outdoor[k]);
+    }
+    if (indoor[k] != HistoryGap)
+    {
+      lo = min(lo, indoor[k]);
+      hi = max(hi, indoor[k]);
+    }
+  }
+  if (lo > hi)
+    return; // 还没有数据
+
+  if (!chartSpr.created())
+  {
+    chartSpr.setColorDepth(8);
+    if (chartSpr.createSprite(ChartW, ChartH) == NULL)
+      return;
+    chartSpr.setScrollRect(0, 0, ChartPlotW, ChartH, bgColor); // 纵轴范围不跟着移动
+  }
+
+  int32_t shift = (int32_t)(hour - chartHour);
+  if (!chartReady || shift < 0 || shift >= ChartHours - 1 || lo < chartLo || hi > chartHi)
+  {
+    // 上下各留1℃，温度变化不大时之后都只移动
+    chartLo = lo - 10;
+    chartHi = hi + 10;
+    chartSpr.fillSprite(bgColor);
+    drawChartColumns(outdoor, indoor, 0);
+    chartSpr.setTextColor(TFT_WHITE, bgColor);
+    chartSpr.setTextDatum(TR_DATUM);
+    chartSpr.drawString(String(chartHi / 10), ChartW - 1, 1, 1);
+    chartSpr.setTextDatum(BR_DATUM);
+    chartSpr.drawString(String(chartLo / 10), ChartW - 1, ChartH - 1, 1);
+    chartFullDraws++;
+  }
+  else
+  {
+    if (shift > 0)
+      chartSpr.scroll(-shift * ChartDx, 0);
+    int from = ChartHours - 2 - shift; // 上一个小时最后几个点画完后可能还有变化
+    int x = chartX(from - 1) + 1;
+    chartSpr.fillRect(x, 0, ChartPlotW - x, ChartH, bgColor);
+    drawChartColumns(outdoor, indoor, from);
+    chartPartDraws++;
+  }
+  chartHour = hour;
+  chartReady = true;
+}
+
+// 推送画好的温度曲线
+void showChart(const LayoutRect &r)
+{
+  if (!chartReady)
+    return;
+  SmartLocker smartLocker2(&shared_var_mutex_pushSprite, LockTimeout);
+  if (smartLocker2.IsLocked())
+  {
+    lcdPush(chartSpr, r.x, r.y);
+  }
+}
+
+void renderBanner(const LayoutRect &r, bool full)
+{
+  CpuScope cpu(CPU_LEVEL_NORMAL, CPU_PATH_SCROLL);
+  scrollBanner(r);
+}
+
+void renderDate(const LayoutRect &r, bool full)
+{
+  CpuScope cpu(CPU_LEVEL_NORMAL, CPU_PATH_SCROLL);
+  scrollDate(r);
+}
+
 #if imgAst_EN
-void imgAnim()
+void imgAnim(int x, int y)
 {
-  int x = 160, y = 160;
+  TRACE_SCOPE("imgAnim");
 
   Anim++;
   if (Anim == 10)
     Anim = 0;
-  if (LostWiFi)
+  if (!conn.isOnline())
     TJpgDec.setCallback(tft_output_Anim);
   if (! scrollText[6].isEmpty())
     TJpgDec.setCallback(tft_output_Anim2);
@@ -2779,47 +3538,140 @@ void imgAnim()
     Serial.println("显示Anim错误");
     break;
   }
-  if (LostWiFi || !scrollText[6].isEmpty())
+  metrics.countJpeg();
+  if (!conn.isOnline() || !scrollText[6].isEmpty())
     TJpgDec.setCallback(tft_output);
 }
 #endif
 
-unsigned char Hour_sign = 60;
-unsigned char Minute_sign = 60;
-unsigned char Second_sign = 60;
+// 每一位数字上次显示的值，依次为时十位、时个位、分十位、分个位、秒十位、秒个位
+#define ClockDigitBlank 11 // 夜间秒数字已清除
+unsigned char clockDigits[6] = {10, 10, 10, 10, 10, 10};
 void digitalClockDisplay(int reflash_Clock)
 {
-  // The decoder must be given the exact name of the rendering function above
-  int timey = 82;
-  if (rtc.getHour(true) != Hour_sign || reflash_Clock == 1) // 时钟刷新
+  TRACE_SCOPE("digitalClockDisplay");
+  // 只取一次系统时间，所有数字用同一个快照，只重画变化的数字
+  struct timeval tv;
+  struct tm ti;
+  gettimeofday(&tv, NULL);
+  localtime_r(&tv.tv_sec, &ti);
+  uint32_t start = micros();
+
+  // 时分和秒的位置由布局决定，显示室内温湿度时秒在右上角
+  const LayoutRect &hm = layout.rect(W_CLOCK);
+  const LayoutRect &sec = layout.rect(W_SECONDS);
+  int timey = hm.y;
+  int secy = sec.y;
+  const int digitX[6] = {hm.x, hm.x + 40, hm.x + 81, hm.x + 121, sec.x, sec.x + 20};
+  unsigned char digits[6] = {(unsigned char)(ti.tm_hour / 10), (unsigned char)(ti.tm_hour % 10),
+                             (unsigned char)(ti.tm_min / 10), (unsigned char)(ti.tm_min % 10),
+                             (unsigned char)(ti.tm_sec / 10), (unsigned char)(ti.tm_sec % 10)};
+  bool secondChanged = digits[5] != clockDigits[5];
+  int count = 6;
+  if (power.isNight())
   {
-    dig.printfW3660(20 - 10, timey, rtc.getHour(true) / 10);
-    dig.printfW3660(60 - 10, timey, rtc.getHour(true) % 10);
-    Hour_sign = rtc.getHour(true);
+    // 夜间不显示秒，清掉一次秒数字，白天时标记不同的值让秒数字重画
+    secondChanged = false;
+    count = 4;
+    if (clockDigits[4] != ClockDigitBlank || reflash_Clock == 1)
+    {
+      SmartLocker smartLocker(&shared_var_mutex_pushSprite, LockTimeout);
+      if (smartLocker.IsLocked())
+      {
+        lcdTarget().fillRect(sec.x, sec.y, sec.w, sec.h, TFT_BLACK);
+        clockDigits[4] = clockDigits[5] = ClockDigitBlank;
+      }
+    }
   }
-  if (rtc.getMinute() != Minute_sign || reflash_Clock == 1) // 分钟刷新
+  for (int i = 0; i < count; i++)
   {
-    dig.printfO3660(101 - 10, timey, rtc.getMinute() / 10);
-    dig.printfO3660(141 - 10, timey, rtc.getMinute() % 10);
-    Minute_sign = rtc.getMinute();
+    if (digits[i] == clockDigits[i] && reflash_Clock != 1)
+      continue;
+    if (i < 2)
+      dig.printfW3660(digitX[i], timey, digits[i]); // 时
+    else if (i < 4)
+      dig.printfO3660(digitX[i], timey, digits[i]); // 分
+    else
+      dig.printfW1830(digitX[i], secy, digits[i]); // 秒
+    clockDigits[i] = digits[i];
+    clockStats.digitsDrawn++;
   }
-  if (rtc.getSecond() != Second_sign || reflash_Clock == 1) // 秒钟刷新
+
+  // 整秒到秒数字显示出来的延迟
+  if (secondChanged && reflash_Clock != 1)
   {
-    if (DHT_img_flag == 1)
-    {
-      dig.printfW1830(182 - 10, timey, rtc.getSecond() / 10);
-      dig.printfW1830(202 - 10, timey, rtc.getSecond() % 10);
-    }
-    else
-    {
-      dig.printfW1830(182 - 10, timey + 30, rtc.getSecond() / 10);
-      dig.printfW1830(202 - 10, timey + 30, rtc.getSecond() % 10);
-    }
+    uint32_t phase = tv.tv_usec + (micros() - start);
+    clockStats.phaseCount++;
+    clockStats.phaseSumUs += phase;
+    if (phase > clockStats.phaseMaxUs)
+      clockStats.phaseMaxUs = phase;
+  }
+}
+
+// 全部重画时连没变的数字也画；还没校时先不显示，记下全部要重画
+void renderClock(const LayoutRect &r, bool full)
+{
+  if (rtc.getYear() == 1970)
+  {
+    if (full)
+      memset(clockDigits, 10, sizeof(clockDigits));
+    return;
+  }
+  if (full)
+  {
+    CpuScope cpu(CPU_LEVEL_BOOST, CPU_PATH_REFRESH);
+    digitalClockDisplay(1);
+  }
+  else
+  {
+    CpuScope cpu(CPU_LEVEL_IDLE, CPU_PATH_CLOCK); // 只走时，不升频
+    digitalClockDisplay(0);
+  }
+}
+
+void renderAnim(const LayoutRect &r, bool full)
+{
+  CpuScope cpu(CPU_LEVEL_NORMAL, CPU_PATH_ANIM);
+  imgAnim(r.x, r.y);
+}
+
+// 按是否显示室内温湿度选择布局，切换后全部重画
+void applyLayout()
+{
+  layout.use(DHT_img_flag != 0 ? &layoutIndoor : &layoutPlain);
+}
+
+// 把定时器设到下一个整秒，夜间设到下一个整分
+void armSecondTimer()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  uint64_t delayUs = 1000000 - tv.tv_usec + ClockEdgeLagUs;
+  if (power.isNight())
+    delayUs += (uint64_t)(59 - tv.tv_sec % 60) * 1000000;
+  esp_timer_stop(secondTimer); // 昼夜切换时定时器可能还在运行
+  esp_timer_start_once(secondTimer, delayUs);
+}
+
+// 在esp_timer任务中运行，每次重新对齐整秒，校时后自动跟上
+void onSecondEdge(void *arg)
+{
+  clockStats.ticks++;
+  xTaskNotifyGive(TaskB_Handle);
+  armSecondTimer();
+}
 
-    Second_sign = rtc.getSecond();
+void startSecondTimer()
+{
+  esp_timer_create_args_t args = {};
+  args.callback = onSecondEdge;
+  args.name = "clock";
+  if (esp_timer_create(&args, &secondTimer) != ESP_OK)
+  {
+    Serial.println("整秒定时器创建失败");
+    return;
   }
-  // if (reflash_Clock == 1)
-  //   reflash_Clock = 0;
+  armSecondTimer();
 }
 
 // 星期
@@ -2838,12 +3690,18 @@ String monthDay()
   return s;
 }
 
+// 日期数字，如20240210
+int32_t dateStamp()
+{
+  return rtc.getYear() * 10000L + (rtc.getMonth() + 1) * 100 + rtc.getDay();
+}
+
 /*-------- NTP code ----------*/
 
 time_t getNtpTime()
 {
-  unsigned long t;
-  if (WiFi.status() == WL_CONNECTED)
+  unsigned long t = 0;
+  if (conn.isOnline())
   {
     // timeClient.update();
     t = timeClient.getEpochTime();
@@ -2930,36 +3788,15 @@ void sleepTimeLoop(uint8_t Maxlight, uint8_t Minlight)
     }
   }
   ledcAnalogWrite(pwm_channel0, bLight); // 写入
-}
-
-// 创建一个函数，用来根据一个分割符来分割一个字符串
-// 入口参数（目标字符串，分割符，返回的结果字符串数组） 返回分割数量
-int StrSplit(String str, String fen, String *result)
-{
-  int index = 0, i = 0;
 
-  if (str.length() == 0)
-    return 0;
-  do
+#if PowerSave_EN
+  // 夜间降低刷新频率，切换后重新设定时钟定时器
+  if (isSleepMode != power.isNight())
   {
-    index = str.indexOf(fen);
-    if (index != -1)
-    {
-      result[i] = str.substring(0, index);
-      str = str.substring(index + fen.length(), str.length());
-      i++;
-    }
-    else
-    {
-      if (str.length() > 0)
-        result[i] = str;
-      i++;
-    }
-  } while (index >= 0);
-  // 保证为偶数，便于后面显示
-  if (i % 2 != 0)
-    result[i] = "";
-  return i;
+    power.setNight(isSleepMode);
+    armSecondTimer();
+  }
+#endif
 }
 
 // #########################################################################
@@ -3091,163 +3928,298 @@ unsigned int rainbow(byte value)
 }
 #if WebSever_EN
 // web网站相关函数
-// web设置页面
-void handleconfig()
-{
-  String msg = "Ready...";
-  int web_cc, web_setro, web_lcdbl, web_upt, web_dhten;
-
-  if (server.hasArg("web_ccode") || server.hasArg("web_bl") ||
-      server.hasArg("web_upwe_t") || server.hasArg("web_DHT11_en") || server.hasArg("web_set_rotation"))
-  {
-    web_cc = server.arg("web_ccode").toInt();
-    web_setro = server.arg("web_set_rotation").toInt();
-    web_lcdbl = server.arg("web_bl").toInt();
-    web_upt = server.arg("web_upwe_t").toInt();
-    web_dhten = server.arg("web_DHT11_en").toInt();
-    Serial.println("");
-    web_cc = (web_cc == 101281001) ? 101281009 : web_cc; // 湛江的代码改为霞山代码，解决湛江的代码取不到其他区的预警信号
-    if (web_cc >= 101000000 && web_cc <= 102000000)
-    {
-      saveCityCodetoEEP(&web_cc);
-      readCityCodefromEEP(&web_cc);
-      cityCode = web_cc;
-      Serial.print("城市代码:");
-      Serial.println(web_cc);
-      UpdateWeater_en = 1;
-      weatherWarn.config(HeUserKey, cityCode); // 配置请求信息  101230201厦门 101230201 厦门  101281006 湛江 101281009 霞山
-      UpdateScreen = 1;
-      msg = "Sent OK!!!";
-    }
-    if (web_lcdbl > 0 && web_lcdbl <= 255)
-    {
-      EEPROM.write(BL_addr, web_lcdbl); // 亮度地址写入亮度值
-      EEPROM.commit();                  // 保存更改的数据
-      delay(5);
-      LCD_BL_PWM = EEPROM.read(BL_addr);
-      delay(5);
-      Serial.print("亮度调整为：");
-      // analogWrite(LCD_BL_PIN, 1023 - (LCD_BL_PWM * 10));
-      ledcAnalogWrite(pwm_channel0, LCD_BL_PWM);
-      Serial.println(LCD_BL_PWM);
-      Serial.println("");
-      msg = "Sent OK!!!";
-    }
-    if (web_upt > 0 && web_upt <= 60)
-    {
-      EEPROM.write(UpWeT_addr, web_upt); // 时间间隔写入亮度值
-      EEPROM.commit();                   // 保存更改的数据
-      delay(5);
-      updateweater_time = EEPROM.read(UpWeT_addr);
-      delay(5);
-      // updateweater_time = web_upt;
-      Serial.print("天气更新时间（分钟）:");
-      Serial.println(web_upt);
-      msg = "Sent OK!!!";
-    }
-
-    EEPROM.write(DHT_addr, web_dhten);
-    EEPROM.commit(); // 保存更改的数据
-    delay(5);
-    if (web_dhten != DHT_img_flag)
-    {
-      DHT_img_flag = web_dhten;
-      tft.fillScreen(0x0000);
+// web设置页面，页面是压缩好的静态文件，当前设置和运行统计由页面脚本另外获取
+void handleconfig(AsyncWebServerRequest *request)
+{
+  AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", config_html_gz, config_html_gz_len);
+  response->addHeader("Content-Encoding", "gzip");
+  request->send(response);
+}
 
-      UpdateScreen = 1;
-      isNewWeather = 1;
-      msg = "Sent OK!!!";
-    }
-    Serial.print("DHT Sensor Enable： ");
-    Serial.println(DHT_img_flag);
+// 读取表单参数，没有该项时返回-1
+int webArg(AsyncWebServerRequest *request, const char *name)
+{
+  if (request->hasParam(name, true))
+    return request->getParam(name, true)->value().toInt();
+  if (request->hasParam(name))
+    return request->getParam(name)->value().toInt();
+  return -1;
+}
+
+// 保存设置，只记录提交的参数，由任务A应用
+void handleconfigPost(AsyncWebServerRequest *request)
+{
+  WebConfig cfg;
+  cfg.pending = true;
+  cfg.cc = webArg(request, "web_ccode");
+  cfg.setro = webArg(request, "web_set_rotation");
+  cfg.lcdbl = webArg(request, "web_bl");
+  cfg.upt = webArg(request, "web_upwe_t");
+  cfg.dhten = webArg(request, "web_DHT11_en");
+  cfg.cpu = webArg(request, "web_cpu");
+
+  portENTER_CRITICAL(&webConfigMux);
+  webConfig = cfg;
+  portEXIT_CRITICAL(&webConfigMux);
+  request->redirect("/?saved");
+}
+
+// 接口：读取设置，设置页面也用它填写表单
+void handleApiSettingsGet(AsyncWebServerRequest *request)
+{
+  StaticJsonDocument<384> doc;
+  doc["cityCode"] = settings.cityCode();
+  doc["backlight"] = settings.backlight();
+  doc["rotation"] = settings.rotation();
+  doc["updateMinutes"] = settings.updateMinutes();
+#if DHT_EN
+  doc["dhtEnable"] = settings.dhtEnable();
+#endif
+  doc["ssid"] = settings.ssid();
+  doc["cpuPolicy"] = settings.cpuPolicy();
+  JsonArray rotation = doc.createNestedArray("cities");
+  for (uint8_t i = 1; i < cities.count(); i++)
+    rotation.add(cities.code(i));
+  doc["seq"] = settings.getSeq();
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  serializeJson(doc, *response);
+  request->send(response);
+}
+
+// 接口：修改设置，只修改提交的项，和表单一样由任务A应用
+// 提交了但类型不对的字段名，都正确时返回NULL；数字字段必须是整数，dhtEnable必须是true/false
+const char *settingsTypeError(JsonObject obj)
+{
+  static const char *intKeys[] = {"cityCode", "rotation", "backlight", "updateMinutes", "cpuPolicy"};
+  for (const char *key : intKeys)
+    if (obj.containsKey(key) && !obj[key].is<int>())
+      return key;
+  if (obj.containsKey("dhtEnable") && !obj["dhtEnable"].is<bool>())
+    return "dhtEnable";
+  return NULL;
+}
+
+void handleApiSettingsPut(AsyncWebServerRequest *request, JsonVariant &json)
+{
+  JsonObject obj = json.as<JsonObject>();
+  if (obj.isNull())
+  {
+    request->send(400, "application/json", "{\"error\":\"json object required\"}");
+    return;
+  }
+  const char *badKey = settingsTypeError(obj);
+  if (badKey != NULL)
+  {
+    char body[64];
+    snprintf(body, sizeof(body), "{\"error\":\"wrong type\",\"field\":\"%s\"}", badKey);
+    request->send(400, "application/json", body);
+    return;
+  }
+  WebConfig cfg;
+  cfg.pending = true;
+  cfg.cc = obj["cityCode"] | -1;
+  cfg.setro = obj["rotation"] | -1;
+  cfg.lcdbl = obj["backlight"] | -1;
+  cfg.upt = obj["updateMinutes"] | -1;
+  cfg.dhten = obj.containsKey("dhtEnable") ? (obj["dhtEnable"].as<bool>() ? 1 : 0) : -1;
+  cfg.cpu = obj["cpuPolicy"] | -1;
+  if ((cfg.cc != -1 && !Settings::isValidCityCode(cfg.cc)) || (cfg.setro != -1 && (cfg.setro < 0 || cfg.setro > 3)) ||
+      (cfg.lcdbl != -1 && (cfg.lcdbl < 1 || cfg.lcdbl > 255)) || (cfg.upt != -1 && (cfg.upt < 1 || cfg.upt > 60)) ||
+      (cfg.cpu != -1 && (cfg.cpu < 0 || cfg.cpu >= CPU_POLICY_COUNT)))
+  {
+    request->send(400, "application/json", "{\"error\":\"value out of range\"}");
+    return;
+  }
+  if (cfg.cc == 0)
+    cfg.cc = WebCityAuto;
+
+  portENTER_CRITICAL(&webConfigMux);
+  webConfig = cfg;
+  portEXIT_CRITICAL(&webConfigMux);
+  request->send(202, "application/json", "{\"pending\":true}");
+}
+
+// 接口：天气实况
+void handleApiWeather(AsyncWebServerRequest *request)
+{
+  WeatherRecord rec;
+  uint32_t timestamp;
+  getSnapshot(&rec, &timestamp, &weatherSnap, &weatherSnapTime, sizeof(rec));
+
+  StaticJsonDocument<512> doc; // 字符串直接引用rec中的内容，不复制
+  doc["city"] = (const char *)rec.city;
+  doc["cityCode"] = settings.cityCode();
+  doc["temp"] = rec.temp;
+  doc["humidity"] = rec.humi;
+  doc["aqi"] = rec.aqi;
+  doc["icon"] = rec.icon;
+  doc["updated"] = timestamp;
+  JsonArray lines = doc.createNestedArray("scroll");
+  for (int i = 0; i < 6; i++)
+    lines.add((const char *)rec.scroll[i]);
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  serializeJson(doc, *response);
+  request->send(response);
+}
+
+// 接口：天气预警
+void handleApiWarning(AsyncWebServerRequest *request)
+{
+  WarnRecord rec;
+  uint32_t timestamp;
+  getSnapshot(&rec, &timestamp, &warnSnap, &warnSnapTime, sizeof(rec));
+
+  StaticJsonDocument<384> doc;
+  String status = rec.status;
+  doc["active"] = status.equals("update") || status.equals("active");
+  doc["status"] = (const char *)rec.status;
+  doc["type"] = rec.type;
+  doc["color"] = (const char *)rec.color;
+  doc["title"] = (const char *)rec.title;
+  doc["text"] = (const char *)rec.text;
+  doc["updated"] = timestamp;
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  serializeJson(doc, *response);
+  request->send(response);
+}
+
+// 接口：农历、宜忌
+void handleApiCalendar(AsyncWebServerRequest *request)
+{
+  CalendarRecord rec;
+  uint32_t timestamp;
+  getSnapshot(&rec, &timestamp, &calendarSnap, &calendarSnapTime, sizeof(rec));
+
+  StaticJsonDocument<1024> doc;
+  doc["updated"] = timestamp;
+  JsonArray lines = doc.createNestedArray("lines");
+  for (int i = 0; i < rec.count && i < CacheCalLines; i++)
+  {
+    JsonObject line = lines.createNestedObject();
+    line["color"] = rec.color[i];
+    line["text"] = (const char *)rec.title[i];
+  }
+
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  serializeJson(doc, *response);
+  request->send(response);
+}
+
+// 耗时跟踪，分段输出Chrome trace JSON，不需要一次生成整个响应
+void handleTrace(AsyncWebServerRequest *request)
+{
+  std::shared_ptr<TraceDump> dump = std::make_shared<TraceDump>(); // 响应结束或连接断开时释放
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [dump](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                   { return dump->read((char *)buffer, maxLen); });
+  request->send(response);
+}
+
+// Prometheus格式的运行指标
+void handleMetrics(AsyncWebServerRequest *request)
+{
+  AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+  metrics.print(*response);
+  request->send(response);
+}
+
+// 运行统计
+void handleStats(AsyncWebServerRequest *request)
+{
+  AsyncResponseStream *response = request->beginResponseStream("text/plain; charset=utf-8");
+  printRunStats(*response);
+  request->send(response);
+}
 
-    EEPROM.write(Ro_addr, web_setro);
-    EEPROM.commit(); // 保存更改的数据
-    delay(5);
-    if (web_setro != LCD_Rotation)
+// 应用web页面提交的设置，在任务A中调用
+void applyWebConfig()
+{
+  if (!webConfig.pending)
+    return;
+  portENTER_CRITICAL(&webConfigMux);
+  WebConfig cfg = webConfig;
+  webConfig.pending = false;
+  portEXIT_CRITICAL(&webConfigMux);
+
+  Serial.println("");
+  int web_cc = (cfg.cc == 101281001) ? 101281009 : cfg.cc; // 湛江的代码改为霞山代码，解决湛江的代码取不到其他区的预警信号
+  if (web_cc >= 101000000 && web_cc <= 102000000)
+  {
+    settings.setCityCode(web_cc);
+    cityCode = web_cc;
+    Serial.print("城市代码:");
+    Serial.println(web_cc);
+    UpdateWeater_en = 1;
+    weatherWarn.config(HeUserKey, cityCode); // 配置请求信息  101230201厦门 101230201 厦门  101281006 湛江 101281009 霞山
+    UpdateScreen = 1;
+  }
+  else if (web_cc == WebCityAuto)
+  {
+    applyCityCode(0); // 和串口设置0一样重新定位
+    Serial.print("城市代码调整为自动：");
+    Serial.println(cityCode);
+    UpdateScreen = 1;
+  }
+  if (cfg.lcdbl > 0 && settings.setBacklight(cfg.lcdbl))
+  {
+    LCD_BL_PWM = settings.backlight();
+    Serial.print("亮度调整为：");
+    ledcAnalogWrite(pwm_channel0, LCD_BL_PWM);
+    Serial.println(LCD_BL_PWM);
+  }
+  if (settings.setUpdateMinutes(cfg.upt))
+  {
+    updateweater_time = settings.updateMinutes();
+    Serial.print("天气更新时间（分钟）:");
+    Serial.println(updateweater_time);
+  }
+#if DHT_EN
+  if (cfg.dhten == 0 || cfg.dhten == 1)
+  {
+    settings.setDhtEnable(cfg.dhten);
+    if (cfg.dhten != DHT_img_flag)
     {
-      LCD_Rotation = web_setro;
-      tft.setRotation(LCD_Rotation);
+      DHT_img_flag = cfg.dhten;
+      applyLayout();
       tft.fillScreen(0x0000);
-      isNewWeather = 1;
       UpdateScreen = 1;
-      msg = "Sent OK!!!";
- 
-      TJpgDec.drawJpg(15, 183, temperature, sizeof(temperature)); // 温度图标
-      TJpgDec.drawJpg(15, 213, humidity, sizeof(humidity));       // 湿度图标
+      isNewWeather = 1;
     }
+    Serial.print("DHT Sensor Enable： ");
+    Serial.println(DHT_img_flag);
+  }
+#endif
+  if (settings.setRotation(cfg.setro) && cfg.setro != LCD_Rotation)
+  {
+    LCD_Rotation = cfg.setro;
+    rotateScreen(LCD_Rotation);
     Serial.print("LCD Rotation:");
     Serial.println(LCD_Rotation);
   }
-
-  // 网页界面代码段
-  String content = "<html><style>html,body{ background: #1aceff; color: #fff; font-size: 10px;}</style>";
-  content += "<body><form action='/' method='POST'><br><div>SDD Web Config</div><br>";
-  content += "City Code:<br><input type='text' list='fruits' id='cityid' onclick='clearinput()' name='web_ccode' placeholder='city code' value='" + cityCode + "'><br>";
-  content += "<datalist id='fruits'>\
-              <option value='101281001'>\
-              <option value='101281002'>\
-              <option value='101281003'>\
-              <option value='101281004'>\
-              <option value='101281005'>\
-              <option value='101281006'>\
-              <option value='101281007'>\
-              <option value='101281008'>\
-              <option value='101281009'>\
-              <option value='101010100'>\
-              <option value='101020100'>\
-              <option value='101230201'>\
-              <option value='101280101'>\
-              <option value='101250101'>\
-              <option value='101110101'>\
-              </datalist>";
-  content += "<br>Back Light(1-255):(default:50)<br><input type='text' name='web_bl' placeholder='50' value='" + String(LCD_BL_PWM, DEC) + "'><br>";
-  content += "<br>Weather Update(1-60) Time:(default:10)<br><input type='text' name='web_upwe_t' placeholder='10' value= '" + String(updateweater_time, DEC) + "'><br>";
-#if DHT_EN
-  content += "<br>DHT Sensor Enable  <input type='radio' name='web_DHT11_en' value='0' ";
-  content += (DHT_img_flag == 0) ? "checked" : "";
-  content += "> DIS <input type='radio' name='web_DHT11_en' value='1' ";
-  content += (DHT_img_flag == 1) ? "checked" : "";
-  content += "> EN<br>";
-#endif
-  content += "<br>LCD Rotation<br>\
-                    <input type='radio' name='web_set_rotation' value='0'";
-  content += (LCD_Rotation == 0) ? "checked" : "";
-  content += "> USB Down<br>\
-                    <input type='radio' name='web_set_rotation' value='1'";
-  content += (LCD_Rotation == 1) ? "checked" : "";
-  content += "> USB Right<br>\
-                    <input type='radio' name='web_set_rotation' value='2'";
-  content += (LCD_Rotation == 2) ? "checked" : "";
-  content += "> USB Up<br>\
-                    <input type='radio' name='web_set_rotation' value='3'";
-  content += (LCD_Rotation == 3) ? "checked" : "";
-  content += "> USB Left<br>";
-  content += "<br><div><input type='submit' name='Save' value='Save'></form></div>" + msg + "<br>";
-  content += "By WCY<br>";
-  content += "<script> function clearinput(){document.getElementById('cityid').value='';}</script>";
-  content += "</body>";
-  content += "</html>";
-
-  server.send(200, "text/html", content);
+  if (settings.setCpuPolicy(cfg.cpu) && cfg.cpu != governor.policy())
+  {
+    governor.setPolicy(cfg.cpu);
+    Serial.print("CPU频率策略:");
+    Serial.println(cfg.cpu);
+  }
+  settings.commit(); // 所有参数一次保存
 }
 
 // no need authentication
-void handleNotFound()
+void handleNotFound(AsyncWebServerRequest *request)
 {
-  String message = "File Not Found\n\n";
-  message += "URI: ";
-  message += server.uri();
-  message += "\nMethod: ";
-  message += (server.method() == HTTP_GET) ? "GET" : "POST";
-  message += "\nArguments: ";
-  message += server.args();
-  message += "\n";
-  for (uint8_t i = 0; i < server.args(); i++)
+  AsyncResponseStream *response = request->beginResponseStream("text/plain");
+  response->setCode(404);
+  response->printf("File Not Found\n\nURI: %s\nMethod: %s\nArguments: %u\n",
+                   request->url().c_str(), request->methodToString(), request->params());
+  for (size_t i = 0; i < request->params(); i++)
   {
-    message += " " + server.argName(i) + ": " + server.arg(i) + "\n";
+    const AsyncWebParameter *p = request->getParam(i);
+    response->printf(" %s: %s\n", p->name().c_str(), p->value().c_str());
   }
-  server.send(404, "text/plain", message);
+  request->send(response);
 }
 
 String mdnsName;
@@ -3269,7 +4241,18 @@ void Web_Sever_Init()
 
   Serial.println("mDNS responder started");
 
-  server.on("/", handleconfig);
+  server.on("/", HTTP_GET, handleconfig);
+  server.on("/", HTTP_POST, handleconfigPost);
+  server.on("/stats", HTTP_GET, handleStats);
+  server.on("/metrics", HTTP_GET, handleMetrics);
+  server.on("/trace", HTTP_GET, handleTrace);
+  server.on("/api/settings", HTTP_GET, handleApiSettingsGet);
+  server.on("/api/weather", HTTP_GET, handleApiWeather);
+  server.on("/api/warning", HTTP_GET, handleApiWarning);
+  server.on("/api/calendar", HTTP_GET, handleApiCalendar);
+  AsyncCallbackJsonWebHandler *settingsHandler = new AsyncCallbackJsonWebHandler("/api/settings", handleApiSettingsPut);
+  settingsHandler->setMethod(HTTP_PUT);
+  server.addHandler(settingsHandler);
   server.onNotFound(handleNotFound);
 
   // 开启TCP服务
@@ -3282,22 +4265,6 @@ void Web_Sever_Init()
   // 将服务器添加到mDNS
   MDNS.addService("http", "tcp", 80);
 }
-// Web网页设置函数
-void Web_Sever()
-{
-  if (WiFi.status() != WL_CONNECTED)
-  {
-    Serial.println("getCitycode Error:WiFi is not Connected.");
-    LostWiFi = true;
-    return;
-  }
-  else
-  {
-    LostWiFi = false;
-  }
-  // MDNS.update();
-  server.handleClient();
-}
 // web服务打开后LCD显示登陆网址及IP
 void Web_sever_Win()
 {
@@ -3314,7 +4281,7 @@ void Web_sever_Win()
   clk.drawString("WEB服务器已开启", 100, 40, 2);
   clk.setTextColor(TFT_WHITE, 0x0000);
   clk.drawRightString("可用网页进行配置", 180, 60, 2);
-  clk.pushSprite(10, 120); // 窗口位置
+  lcdPush(clk, 10, 120); // 窗口位置
   clk.deleteSprite();
 
   clk.createSprite(240, 20);
@@ -3322,7 +4289,7 @@ void Web_sever_Win()
   clk.setTextDatum(CC_DATUM);
   clk.setTextColor(TFT_WHITE, 0x0000);
   clk.drawCentreString("http://" + mdnsName + ".local", 120, 0, 0);
-  clk.pushSprite(10, 100);
+  lcdPush(clk, 10, 100);
   clk.deleteSprite();
 
   clk.createSprite(240, 20);
@@ -3330,29 +4297,377 @@ void Web_sever_Win()
   clk.setTextDatum(CC_DATUM);
   clk.setTextColor(TFT_ORANGE, 0x0000);
   clk.drawCentreString("IP:" + IP_adr.toString(), 120, 0, 2);
-  clk.pushSprite(0, 70);
+  lcdPush(clk, 0, 70);
   clk.deleteSprite();
 
   clk.unloadFont();
 }
-// 读取保存城市代码
-void saveCityCodetoEEP(int *citycode)
+#endif
+
+// 运行统计信息，供串口和web页面显示
+void printRunStats(Print &out)
 {
-  for (int cnum = 0; cnum < 5; cnum++)
+  out.printf("天气图标缓存 命中:%u 未命中:%u\n", wrat.getCacheHits(), wrat.getCacheMisses());
+  out.printf("天气 304:%u 跳过重画:%u 节省字节:%u\n", weatherNotModified, weatherRedrawSkipped, weatherBytesSaved);
+  out.printf("预警 304:%u 未变跳过解析:%u 节省字节:%u\n", weatherWarn.getNotModifiedCount(), weatherWarn.getUnchangedCount(), weatherWarn.getBytesSaved());
+  for (int i = 0; i < FETCH_SOURCE_COUNT; i++)
   {
-    EEPROM.write(CC_addr + cnum, *citycode % 100); // 城市地址写入城市代码
-    EEPROM.commit();                               // 保存更改的数据
-    *citycode = *citycode / 100;
-    delay(5);
+    FetchSource src = (FetchSource)i;
+    out.printf("%s 下次更新:%us后 连续失败:%u\n", fetcher.name(src), fetcher.nextDueIn(src, millis()) / 1000, fetcher.failStreak(src));
   }
+  out.printf("设置累计写入:%u次 本次开机写入:%u次/%u字节 未变跳过:%u次\n", settings.getSeq(), settings.getCommitCount(), settings.getBytesWritten(), settings.getSkipCount());
+  out.printf("开机显示:%ums 取得最新天气:%ums%s\n", bootFirstPixelMs, bootFreshDataMs, fastBoot ? " (缓存开机)" : "");
+  uint32_t upSec = millis() / 1000;
+  out.printf("时钟 任务B唤醒:%u次(%.1f次/s) 整秒通知:%u 重画数字:%u 整秒延迟:平均%uus 最大%uus\n",
+             clockStats.wakeups, upSec ? (float)clockStats.wakeups / upSec : 0.0f, clockStats.ticks, clockStats.digitsDrawn,
+             clockStats.phaseCount ? (unsigned)(clockStats.phaseSumUs / clockStats.phaseCount) : 0, clockStats.phaseMaxUs);
+  LockStats::print(out);
+  power.print(out);
+  governor.print(out);
+  conn.print(out);
+  cities.print(out);
+  out.printf("多日预报 %u天 页面:%u 重画:%u次 分配失败:%u 解析:%uus(最大%uus) 扫描%u字节\n", forecast.count, forecastPageCount,
+             forecastRenders, forecastAllocFailures, forecastParseUs, forecastParseMaxUs, forecastScanned);
+  out.printf("  内存:解析器%u字节 预报%u字节 页面%u字节\n", (unsigned)sizeof(ForecastParser), (unsigned)sizeof(ForecastData),
+             forecastPixels != NULL ? ForecastPages * ForecastPageBytes : 0);
+  history.print(out);
+  out.printf("  温度曲线 整体重画:%u次 移动后只重画最后几列:%u次 内存:%u字节\n", chartFullDraws, chartPartDraws,
+             chartSpr.created() ? ChartW * ChartH : 0);
+  layout.print(out);
+  out.printf("农历 本地计算:%u次 %uus(最大%uus) 宜忌日期:%d\n", nongliStats.builds, nongliStats.buildUs,
+             nongliStats.buildMaxUs, almanac.date);
+  out.printf("宜忌 请求:%u次 压缩:%u 失败:%u 收到%u字节 解压%u字节 内存峰值:%u字节 耗时:%ums(最大%ums)\n", nongliStats.fetches,
+             nongliStats.gzip, nongliStats.failures, nongliStats.inBytes, nongliStats.outBytes, nongliStats.heapBytes,
+             nongliStats.lastMs, nongliStats.maxMs);
+  out.printf("旋转屏幕 %u次 清屏重画:%u 离屏绘制:%ums 推送:%uus 到画面稳定:%ums(最大%ums)\n", rotateStats.count,
+             rotateStats.fallbacks, rotateStats.renderMs, rotateStats.pushUs, rotateStats.stableMs, rotateStats.stableMaxMs);
+#if DHT_EN
+#if DHT_RMT
+  dhtReader.print(out);
+#else
+  out.printf("DHT(Adafruit) 上次读取:%uus 最大:%uus\n", dhtLegacyUs, dhtLegacyMaxUs);
+#endif
+  indoor.print(out);
+  out.printf("  室内显示 更新:%u次 全部重画:%u 数字未变:%u 推送字形:%u个 像素:%llu(%.0f/小时) 字库加载:%u次 缓存:%u字节\n",
+             indoorStats.updates, indoorStats.fullDraws, indoorStats.unchanged, indoorTempField.glyphs() + indoorLine2Field.glyphs(),
+             indoorStats.pixels, upSec ? indoorStats.pixels * 3600.0f / upSec : 0.0f,
+             indoorTempAtlas.builds() + indoorHumiAtlas.builds() + indoorCo2Atlas.builds(),
+             indoorTempAtlas.bytes() + indoorHumiAtlas.bytes() + indoorCo2Atlas.bytes());
+#endif
+  out.printf("0.1秒定时中断抖动 最大:%uus 读DHT期间最大:%uus\n", tickJitterMaxUs, tickJitterDhtMaxUs);
 }
-void readCityCodefromEEP(int *citycode)
+
+// 保存天气实况到缓存
+// 主城市的天气实况在全局变量中
+void currentWeather(WeatherRecord &rec)
 {
-  for (int cnum = 5; cnum > 0; cnum--)
+  rec.temp = tempnum;
+  rec.humi = huminum;
+  rec.aqi = pm25V;
+  rec.icon = Iconsname;
+  DataCache::copyText(rec.city, sizeof(rec.city), cityname);
+  for (int i = 0; i < 6; i++)
+    DataCache::copyText(rec.scroll[i], sizeof(rec.scroll[i]), scrollText[i]);
+}
+
+void applyWeatherRecord(const WeatherRecord &rec)
+{
+  tempnum = rec.temp;
+  huminum = rec.humi;
+  pm25V = rec.aqi;
+  Iconsname = rec.icon;
+  cityname = rec.city;
+  for (int i = 0; i < 6; i++)
+    scrollText[i] = rec.scroll[i];
+}
+
+// 开机时还没有天气数据，和原来的占位JSON一样显示"等待更新"，不写缓存，取到后由任务A替换
+void weatherPlaceholder()
+{
+  WeatherRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.icon = 99; // 未知天气图标
+  DataCache::copyText(rec.city, sizeof(rec.city), "等待更新");
+  DataCache::copyText(rec.scroll[0], sizeof(rec.scroll[0]), "实时天气 等待更新");
+  DataCache::copyText(rec.scroll[1], sizeof(rec.scroll[1]), "空气质量 等待更新");
+  DataCache::copyText(rec.scroll[2], sizeof(rec.scroll[2]), "风向 等待更新");
+  DataCache::copyText(rec.scroll[3], sizeof(rec.scroll[3]), "今日等待更新");
+  DataCache::copyText(rec.scroll[4], sizeof(rec.scroll[4]), "最低温度 等待更新");
+  DataCache::copyText(rec.scroll[5], sizeof(rec.scroll[5]), "最高温度 等待更新");
+  applyWeatherRecord(rec);
+  cities.setWeather(0, rec, 0);
+  Serial.println("没有天气缓存，显示等待更新");
+}
+
+// 同时交给城市轮播，主城市是第0个
+void saveWeatherCache()
+{
+  WeatherRecord rec;
+  currentWeather(rec);
+  cities.setWeather(0, rec, weatherHash);
+  setSnapshot(&weatherSnap, &weatherSnapTime, &rec, sizeof(rec), rtc.getEpoch());
+  DataCache::save(WeatherCacheFile, &rec, sizeof(rec), rtc.getEpoch());
+}
+
+bool loadWeatherCache()
+{
+  WeatherRecord rec;
+  uint32_t timestamp = 0;
+  if (!DataCache::load(WeatherCacheFile, &rec, sizeof(rec), &timestamp))
+    return false;
+  applyWeatherRecord(rec);
+  cities.setWeather(0, rec, 0);
+  setSnapshot(&weatherSnap, &weatherSnapTime, &rec, sizeof(rec), timestamp);
+  Serial.printf("读取天气缓存，保存时间：%u\n", timestamp);
+  return true;
+}
+
+// 保存农历滚动信息到缓存
+void saveNongliCache()
+{
+  CalendarRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.count = min(TotalDis, CacheCalLines);
+  for (int i = 0; i < rec.count; i++)
+  {
+    rec.color[i] = scrollNongLi[i].color;
+    DataCache::copyText(rec.title[i], sizeof(rec.title[i]), scrollNongLi[i].title);
+  }
+  setSnapshot(&calendarSnap, &calendarSnapTime, &rec, sizeof(rec), rtc.getEpoch());
+  DataCache::save(NongliCacheFile, &rec, sizeof(rec), rtc.getEpoch());
+}
+
+// 宜忌太长时截到最后一个完整的项
+void copyWords(char *dst, size_t size, const String &src)
+{
+  DataCache::copyText(dst, size, src);
+  if (src.length() >= size)
+  {
+    char *p = strrchr(dst, '.');
+    if (p != NULL)
+      *p = 0;
+  }
+}
+
+// 读取当天的宜忌，不是今天的在生成滚动信息时不用
+bool loadAlmanacCache()
+{
+  AlmanacRecord rec;
+  if (!DataCache::load(AlmanacCacheFile, &rec, sizeof(rec)))
+    return false;
+  almanac = rec;
+  return true;
+}
+
+bool loadNongliCache()
+{
+  CalendarRecord rec;
+  uint32_t timestamp = 0;
+  if (!DataCache::load(NongliCacheFile, &rec, sizeof(rec), &timestamp) || rec.count == 0 || rec.count > CacheCalLines)
+    return false;
+  setSnapshot(&calendarSnap, &calendarSnapTime, &rec, sizeof(rec), timestamp);
+  if (scrollNongLi != NULL)
+    delete[] scrollNongLi;
+  scrollNongLi = new Display[rec.count];
+  for (int i = 0; i < rec.count; i++)
+  {
+    scrollNongLi[i].color = rec.color[i];
+    scrollNongLi[i].title = rec.title[i];
+  }
+  TotalDis = rec.count;
+  CurrentDisDate = 0;
+  return true;
+}
+
+// 保存预警到缓存
+void saveWarnCache()
+{
+  WarnRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  weatherWarn.toRecord(rec);
+  setSnapshot(&warnSnap, &warnSnapTime, &rec, sizeof(rec), rtc.getEpoch());
+  DataCache::save(WarnCacheFile, &rec, sizeof(rec), rtc.getEpoch());
+}
+
+// 恢复上次的预警，只显示滚动字幕，不重播预警画面
+bool loadWarnCache()
+{
+  WarnRecord rec;
+  uint32_t timestamp = 0;
+  if (!DataCache::load(WarnCacheFile, &rec, sizeof(rec), &timestamp))
+    return false;
+  weatherWarn.fromRecord(rec);
+  setSnapshot(&warnSnap, &warnSnapTime, &rec, sizeof(rec), timestamp);
+  String status = rec.status;
+  if (status.equals("update") || status.equals("active"))
   {
-    *citycode = *citycode * 100;
-    *citycode += EEPROM.read(CC_addr + cnum - 1);
-    delay(5);
+    scrollText[6] = warnShortTitle(rec.title);
+  }
+  return true;
+}
+
+// 更新web接口用的数据快照
+void setSnapshot(void *snap, uint32_t *snapTime, const void *rec, size_t len, uint32_t timestamp)
+{
+  portENTER_CRITICAL(&snapMux);
+  memcpy(snap, rec, len);
+  *snapTime = timestamp;
+  portEXIT_CRITICAL(&snapMux);
+}
+
+// 复制数据快照，复制后再序列化，不会读到更新到一半的数据
+void getSnapshot(void *rec, uint32_t *timestamp, const void *snap, const uint32_t *snapTime, size_t len)
+{
+  portENTER_CRITICAL(&snapMux);
+  memcpy(rec, snap, len);
+  *timestamp = *snapTime;
+  portEXIT_CRITICAL(&snapMux);
+}
+
+// 取数并记录结果和耗时
+bool runFetch(FetchSource src)
+{
+  CpuScope cpu(CPU_LEVEL_BOOST, CPU_PATH_FETCH); // TLS握手和解压
+  uint32_t start = millis();
+  uint32_t prevSuccess = fetcher.lastSuccess(src);
+  uint32_t rxStart = HttpsGetUtils::rxBytes;
+  bool ok;
+  if (src == FETCH_WEATHER)
+    ok = getCityWeater();
+  else if (src == FETCH_WARNING)
+    ok = getWarning();
+  else
+    ok = getNongli();
+  if (!ok && !conn.isOnline())
+  {
+    // 断网造成的失败不退避，联网后重新取
+    conn.queueFetch(src);
+    return false;
+  }
+  metrics.observeFetch(src, millis() - start, ok);
+  if (ok)
+  {
+    fetcher.onSuccess(src, millis());
+    conn.onFetched(src, prevSuccess, HttpsGetUtils::rxBytes - rxStart, millis() - start);
+  }
+  else
+  {
+    fetcher.onFailure(src, millis());
+  }
+  return ok;
+}
+
+// 推送精灵到屏幕并统计推送的字节数(屏幕为16位色)；离屏绘制时画进整屏帧
+void lcdPush(TFT_eSprite &spr, int32_t x, int32_t y)
+{
+  if (lcdFrame != NULL)
+  {
+    spr.pushToSprite(lcdFrame, x, y);
+    return;
+  }
+  spr.pushSprite(x, y);
+  metrics.addSpiBytes(spr.width() * spr.height() * 2);
+}
+
+// 直接画图形的部件通过它画，离屏绘制时是整屏帧
+TFT_eSPI &lcdTarget()
+{
+  if (lcdFrame != NULL)
+    return *lcdFrame;
+  return tft;
+}
+
+#define FrameStripLines 10 // 每次DMA推送的行数，两块缓冲轮流用
+
+// 8位色的整屏帧按条转成16位色，上一条DMA发送时转换下一条
+void pushFrame(TFT_eSprite &frame)
+{
+  int32_t w = frame.width();
+  int32_t h = frame.height();
+  uint16_t *buf[2];
+  buf[0] = (uint16_t *)heap_caps_malloc(w * FrameStripLines * 2, MALLOC_CAP_DMA);
+  buf[1] = (uint16_t *)heap_caps_malloc(w * FrameStripLines * 2, MALLOC_CAP_DMA);
+  if (buf[0] == NULL || buf[1] == NULL)
+  {
+    frame.pushSprite(0, 0); // DMA内存不够时普通推送
+  }
+  else
+  {
+    const uint8_t *src = (const uint8_t *)frame.getPointer();
+    tft.startWrite();
+    for (int32_t y = 0, n = 0; y < h; y += FrameStripLines, n ^= 1)
+    {
+      int32_t lines = min((int32_t)FrameStripLines, h - y);
+      uint16_t *dst = buf[n];
+      for (int32_t i = 0; i < w * lines; i++)
+      {
+        uint16_t c = tft.color8to16(src[y * w + i]);
+        dst[i] = c << 8 | c >> 8; // 屏幕按高字节在前接收
+      }
+      tft.pushImageDMA(0, y, w, lines, dst); // 先等上一条发完
+    }
+    tft.dmaWait();
+    tft.endWrite();
+  }
+  heap_caps_free(buf[0]);
+  heap_caps_free(buf[1]);
+  metrics.addSpiBytes(w * h * 2);
+}
+
+// 旋转屏幕：按新方向在离屏帧里画出整个界面，再一次推到屏幕，不清屏也不重新取数据。
+// 在任务A中调用，任务C被循环锁挡住，任务B画完手上这一轮后等在绘制锁上。
+// 不能挂起任务B：它可能正在JPG解码中途等推送锁，再从这里解码会共用TJpgDec和clkJpeg。
+// 屏幕是正方形，各方向共用一套布局
+void rotateScreen(uint8_t rot)
+{
+  uint32_t start = millis();
+  rotateStats.count++;
+  rotatePending = -1;
+  SmartLocker renderLocker(&shared_var_mutex_render, LockTimeout);
+  frameSpr.setColorDepth(8);
+  if (!renderLocker.IsLocked() || frameSpr.createSprite(tft.width(), tft.height()) == NULL)
+  {
+    rotateStats.fallbacks++;
+    {
+      SmartLocker smartLocker2(&shared_var_mutex_pushSprite, LockTimeout);
+      if (!smartLocker2.IsLocked())
+      {
+        rotatePending = rot;
+        return;
+      }
+      tft.setRotation(rot);
+      tft.fillScreen(bgColor);
+    }
+    layout.invalidate();
+    UpdateScreen = 1;
+    Serial.println("旋转屏幕：整屏帧内存不足或任务B未让出，清屏重画");
+    return;
+  }
+  frameSpr.fillSprite(bgColor);
+  lcdFrame = &frameSpr;
+  layout.renderAll();
+  lcdFrame = NULL;
+  rotateStats.renderMs = millis() - start;
+
+  uint32_t pushStart = micros();
+  {
+    SmartLocker smartLocker2(&shared_var_mutex_pushSprite, LockTimeout);
+    if (!smartLocker2.IsLocked())
+    {
+      frameSpr.deleteSprite();
+      rotatePending = rot;
+      return;
+    }
+    tft.setRotation(rot);
+    pushFrame(frameSpr);
   }
+  rotateStats.pushUs = micros() - pushStart;
+  frameSpr.deleteSprite();
+  // 帧是8位色，图标和文字按RGB332显示；很多部件只在数据变化时才画，全部标记后各任务按16位色重画
+  layout.invalidate();
+
+  rotateStats.stableMs = millis() - start;
+  if (rotateStats.stableMs > rotateStats.stableMaxMs)
+    rotateStats.stableMaxMs = rotateStats.stableMs;
+  Serial.printf("旋转屏幕：离屏绘制%ums 推送%uus\n", rotateStats.renderMs, rotateStats.pushUs);
 }
-#endif
\ No newline at end of file
@@ -3,6 +3,15 @@
  * 实现互斥量的自动上锁和自动解锁，即构造函数实现上锁，析构函数实现解锁，如此SmartLocker的实例在离开作用域时就自动对Mutex解锁了。   
  *
 ********************************************************************************************************************* */
+#ifndef _MAIN_H_
+#define _MAIN_H_
+
+#include "Trace.h"
+#include "LockStats.h"
+
+// 互斥量等待上限，超时后打印警告并放弃本次操作，不再无限等待
+#define LockTimeout pdMS_TO_TICKS(5000)
+
 class SmartLocker
 {
   //#define debugEnable
@@ -11,7 +20,22 @@ class SmartLocker
     {
       if(m_Mutex != NULL)
       {
+        TRACE_SCOPE("mutex_wait");
+        m_Stats = LockStats::find(m_Mutex);
+        TaskHandle_t holder = xSemaphoreGetMutexHolder(*m_Mutex);
+        const char *blocker = holder != NULL ? pcTaskGetName(holder) : NULL;
+        uint32_t start = micros();
         isLocked = xSemaphoreTake(*m_Mutex, xTicksToWait) == pdTRUE;
+        m_Start = micros();
+        if(m_Stats != NULL)
+        {
+          m_Stats->onAcquire(isLocked, m_Start - start, blocker);
+        }
+        if(!isLocked)
+        {
+          Serial.printf("互斥量%s等待超时，任务:%s 持有者:%s\n", m_Stats != NULL ? m_Stats->name : "?",
+                        pcTaskGetName(NULL), blocker != NULL ? blocker : "?");
+        }
         #ifdef debugEnable
         if(isLocked)
         {
@@ -28,7 +52,12 @@ class SmartLocker
     {
       if(isLocked)
       {
+        uint32_t hold = micros() - m_Start;
         xSemaphoreGive(*m_Mutex);
+        if(m_Stats != NULL)
+        {
+          m_Stats->onRelease(hold);
+        }
       }
     }
     bool IsLocked() const
@@ -38,7 +67,11 @@ class SmartLocker
   private:
     SemaphoreHandle_t* m_Mutex = NULL;
     bool isLocked = false;
+    LockStats* m_Stats = NULL;
+    uint32_t m_Start = 0;
 };
 // ————————————————
 // 版权声明：本文为CSDN博主「香菇滑稽之谈」的原创文章，遵循CC 4.0 BY-SA版权协议，转载请附上原文出处链接及本声明。
-// 原文链接：https://blog.csdn.net/wwplh5520370/article/details/129942160
\ No newline at end of file
+// 原文链接：https://blog.csdn.net/wwplh5520370/article/details/129942160
+
+#endif
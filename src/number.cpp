@@ -2,6 +2,7 @@
 #include "number.h"
 
 #include <TJpg_Decoder.h>
+#include "Metrics.h"
 //int numx;
 //int numy;
 //int numn;
@@ -9,6 +10,7 @@
 //显示白色36*60大小数字
 void Number::printfW3660(int numx,int numy,int numn)
 {
+  metrics.countJpeg();
   switch(numn)
   {
     case 0:
@@ -49,6 +51,7 @@ void Number::printfW3660(int numx,int numy,int numn)
 //显示橙色36*60大小数字
 void Number::printfO3660(int numx,int numy,int numn)
 {
+  metrics.countJpeg();
   switch(numn)
   {
     case 0:
@@ -89,6 +92,7 @@ void Number::printfO3660(int numx,int numy,int numn)
 //显示白色18*30大小数字
 void Number::printfW1830(int numx,int numy,int numn)
 {
+  metrics.countJpeg();
   switch(numn)
   {
     case 0:
@@ -1,102 +1,265 @@
 #include "Arduino.h"
 #include "weathernum.h"
+#include "main.h"
 
 #include <TJpg_Decoder.h>
+#include "Metrics.h"
 //int numx;
 //int numy;
 //int numw;
 
-//显示天气图标
-void WeatherNum::printfweather(int numx,int numy,int numw)
+extern TFT_eSPI tft;
+extern TFT_eSprite *lcdFrame; // 旋转屏幕时的离屏帧
+extern SemaphoreHandle_t shared_var_mutex_pushSprite;
+bool tft_output(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap);
+
+uint16_t *WeatherNum::_decodeBuf = NULL;
+uint16_t WeatherNum::_decodeW = 0;
+uint16_t WeatherNum::_decodeH = 0;
+
+//根据天气代码取对应的图标
+void WeatherNum::getIcon(int numw, const uint8_t *&jpg, size_t &len)
 {
   if(numw==00)
   {
-    TJpgDec.drawJpg(numx,numy,t0, sizeof(t0));
+    jpg = t0;
+    len = sizeof(t0);
   }
   else if(numw==01)
   {
-    TJpgDec.drawJpg(numx,numy,t1, sizeof(t1));
+    jpg = t1;
+    len = sizeof(t1);
   }
   else if(numw==02)
   {
-    TJpgDec.drawJpg(numx,numy,t2, sizeof(t2));
+    jpg = t2;
+    len = sizeof(t2);
   }
   else if(numw==03)
   {
-    TJpgDec.drawJpg(numx,numy,t3, sizeof(t3));
+    jpg = t3;
+    len = sizeof(t3);
   }
   else if(numw==04)
   {
-    TJpgDec.drawJpg(numx,numy,t4, sizeof(t4));
+    jpg = t4;
+    len = sizeof(t4);
   }
   else if(numw==05)
   {
-    TJpgDec.drawJpg(numx,numy,t5, sizeof(t5));
+    jpg = t5;
+    len = sizeof(t5);
   }
   else if(numw==06)
   {
-    TJpgDec.drawJpg(numx,numy,t6, sizeof(t6));
+    jpg = t6;
+    len = sizeof(t6);
   }
   else if(numw==07||numw==8||numw==21||numw==22)
   {
-    TJpgDec.drawJpg(numx,numy,t7, sizeof(t7));
+    jpg = t7;
+    len = sizeof(t7);
   }
   else if(numw==9||numw==10||numw==23||numw==24)
   {
-    TJpgDec.drawJpg(numx,numy,t9, sizeof(t9));
+    jpg = t9;
+    len = sizeof(t9);
   }
   else if(numw==11||numw==12||numw==25||numw==301)
   {
-    TJpgDec.drawJpg(numx,numy,t11, sizeof(t11));
+    jpg = t11;
+    len = sizeof(t11);
   }
   else if(numw==13)
   {
-    TJpgDec.drawJpg(numx,numy,t13, sizeof(t13));
+    jpg = t13;
+    len = sizeof(t13);
   }
   else if(numw==14||numw==26)
   {
-    TJpgDec.drawJpg(numx,numy,t14, sizeof(t14));
+    jpg = t14;
+    len = sizeof(t14);
   }
   else if(numw==15||numw==27)
   {
-    TJpgDec.drawJpg(numx,numy,t15, sizeof(t15));
+    jpg = t15;
+    len = sizeof(t15);
   }
   else if(numw==16||numw==17||numw==28||numw==302)
   {
-    TJpgDec.drawJpg(numx,numy,t16, sizeof(t16));
+    jpg = t16;
+    len = sizeof(t16);
   }
   else if(numw==18)
   {
-    TJpgDec.drawJpg(numx,numy,t18, sizeof(t18));
+    jpg = t18;
+    len = sizeof(t18);
   }
   else if(numw==19)
   {
-    TJpgDec.drawJpg(numx,numy,t19, sizeof(t19));
+    jpg = t19;
+    len = sizeof(t19);
   }
   else if(numw==20)
   {
-    TJpgDec.drawJpg(numx,numy,t20, sizeof(t20));
+    jpg = t20;
+    len = sizeof(t20);
   }
   else if(numw==29)
   {
-    TJpgDec.drawJpg(numx,numy,t29, sizeof(t29));
+    jpg = t29;
+    len = sizeof(t29);
   }
   else if(numw==30)
   {
-    TJpgDec.drawJpg(numx,numy,t30, sizeof(t30));
+    jpg = t30;
+    len = sizeof(t30);
   }
   else if(numw==31)
   {
-    TJpgDec.drawJpg(numx,numy,t31, sizeof(t31));
+    jpg = t31;
+    len = sizeof(t31);
   }
   else if(numw==53||numw==32||numw==49||numw==54||numw==55||numw==56||numw==57||numw==58)
   {
-    TJpgDec.drawJpg(numx,numy,t53, sizeof(t53));
+    jpg = t53;
+    len = sizeof(t53);
+  }
+  else
+  {
+    jpg = t99;
+    len = sizeof(t99);
+  }
+}
+
+// 解码回调：把解码出的块写入缓存缓冲区，而不是推送到屏幕
+bool WeatherNum::_decodeOutput(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap)
+{
+  if (_decodeBuf == NULL)
+    return 0;
+
+  for (uint16_t j = 0; j < h; j++)
+  {
+    if (y + j >= _decodeH)
+      break;
+    uint16_t cw = (x + w > _decodeW) ? _decodeW - x : w;
+    memcpy(_decodeBuf + (y + j) * _decodeW + x, bitmap + j * w, cw * sizeof(uint16_t));
+  }
+  // Return 1 to decode next block
+  return 1;
+}
+
+// 将图标解码到最久未使用的缓存槽位，失败返回NULL
+WeatherNum::IconSlot *WeatherNum::decodeToSlot(int numw)
+{
+  const uint8_t *jpg = NULL;
+  size_t len = 0;
+  uint16_t w = 0, h = 0;
+
+  getIcon(numw, jpg, len);
+  if (TJpgDec.getJpgSize(&w, &h, jpg, len) != JDR_OK || w == 0 || h == 0)
+    return NULL;
+
+  IconSlot *slot = &_slots[0];
+  for (int i = 1; i < IconCacheSize; i++)
+  {
+    if (_slots[i].lastUse < slot->lastUse)
+      slot = &_slots[i];
+  }
+
+  if (slot->pixels != NULL && (slot->w != w || slot->h != h))
+  {
+    free(slot->pixels);
+    slot->pixels = NULL;
+  }
+  if (slot->pixels == NULL)
+  {
+    slot->pixels = (uint16_t *)malloc(w * h * sizeof(uint16_t));
+    if (slot->pixels == NULL)
+    {
+      Serial.println("天气图标缓存分配失败");
+      return NULL;
+    }
+  }
+  slot->code = numw;
+  slot->w = w;
+  slot->h = h;
+
+  _decodeBuf = slot->pixels;
+  _decodeW = w;
+  _decodeH = h;
+  TJpgDec.setCallback(_decodeOutput);
+  JRESULT res = TJpgDec.drawJpg(0, 0, jpg, len);
+  TJpgDec.setCallback(tft_output);
+  metrics.countJpeg();
+  _decodeBuf = NULL;
+
+  if (res != JDR_OK)
+  {
+    slot->lastUse = 0;
+    slot->code = -1;
+    return NULL;
+  }
+  return slot;
+}
+
+//显示天气图标，相同图标直接从缓存推送，不再重复解码JPEG
+void WeatherNum::printfweather(int numx,int numy,int numw)
+{
+  IconSlot *slot = NULL;
+
+  for (int i = 0; i < IconCacheSize; i++)
+  {
+    if (_slots[i].pixels != NULL && _slots[i].code == numw)
+    {
+      slot = &_slots[i];
+      break;
+    }
+  }
+
+  if (slot != NULL)
+  {
+    _hits++;
   }
   else
   {
-    TJpgDec.drawJpg(numx,numy,t99, sizeof(t99));
+    _misses++;
+    slot = decodeToSlot(numw);
+  }
+
+  if (slot == NULL)
+  {
+    // 缓存不可用时退回直接解码显示
+    const uint8_t *jpg = NULL;
+    size_t len = 0;
+    getIcon(numw, jpg, len);
+    TJpgDec.drawJpg(numx, numy, jpg, len);
+    metrics.countJpeg();
+    return;
   }
 
-  
+  slot->lastUse = ++_useTick;
+
+  // 解码时已按TJpgDec.setSwapBytes(true)交换字节，可直接推送
+  if (lcdFrame != NULL)
+  {
+    lcdFrame->pushImage(numx, numy, slot->w, slot->h, slot->pixels);
+    return;
+  }
+  SmartLocker smartLocker(&shared_var_mutex_pushSprite, LockTimeout);
+  if (smartLocker.IsLocked())
+  {
+    tft.pushImage(numx, numy, slot->w, slot->h, slot->pixels);
+  }
+  metrics.addSpiBytes(slot->w * slot->h * 2);
+}
+
+uint32_t WeatherNum::getCacheHits()
+{
+  return _hits;
+}
+
+uint32_t WeatherNum::getCacheMisses()
+{
+  return _misses;
 }
@@ -27,14 +27,36 @@
 #include "img/tianqi/t53.h"
 #include "img/tianqi/t99.h"
 
+#define IconCacheSize 4 // 天气图标缓存槽位数，每个60*60图标解码后占用7200字节
 
 class WeatherNum
 {
 private:
-
+  // 已解码的图标缓存，按Iconsname索引，保存RGB565像素
+  struct IconSlot
+  {
+    int code;          // 天气图标代码Iconsname
+    uint16_t *pixels;  // 解码后的像素
+    uint16_t w;
+    uint16_t h;
+    uint32_t lastUse;  // 最近使用序号，用于淘汰最久未用的槽位
+  };
+  IconSlot _slots[IconCacheSize] = {};
+  uint32_t _useTick = 0;
+  uint32_t _hits = 0;
+  uint32_t _misses = 0;
+
+  static uint16_t *_decodeBuf; // 解码回调写入的目标缓冲区
+  static uint16_t _decodeW;
+  static uint16_t _decodeH;
+  static bool _decodeOutput(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap);
+  void getIcon(int numw, const uint8_t *&jpg, size_t &len);
+  IconSlot *decodeToSlot(int numw);
 
 public:
   void printfweather(int numx,int numy,int numw);
+  uint32_t getCacheHits();
+  uint32_t getCacheMisses();
 };
 
 
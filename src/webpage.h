@@ -0,0 +1,79 @@
+#ifndef _WEBPAGE_H_
+#define _WEBPAGE_H_
+
+#include "Arduino.h"
+#include <pgmspace.h> // PROGMEM support header
+
+// web设置页面，由web/config.html压缩生成(原始2722字节)，修改页面后运行python3 web/mkpage.py
+const uint8_t config_html_gz[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x9d, 0x56, 0x5b, 0x4f, 0xdb, 0x48,
+    0x14, 0x7e, 0xcf, 0xaf, 0x18, 0xa6, 0x0f, 0x8d, 0x05, 0x38, 0x71, 0x68, 0x58, 0x36, 0xb1, 0xb3,
+    0x5a, 0x12, 0x56, 0xad, 0x96, 0x2e, 0x88, 0x80, 0x50, 0x55, 0x55, 0x68, 0x32, 0x3e, 0x8e, 0x67,
+    0x71, 0x66, 0xdc, 0xf1, 0x38, 0xe0, 0x46, 0xfc, 0xf7, 0x3d, 0x63, 0x3b, 0x81, 0x74, 0x31, 0x2a,
+    0x08, 0x89, 0x71, 0xce, 0xe5, 0x3b, 0x97, 0x39, 0x97, 0xf1, 0x77, 0x26, 0x67, 0xe3, 0xcb, 0x2f,
+    0xe7, 0x27, 0x24, 0x36, 0x8b, 0x64, 0xd4, 0xf2, 0xd7, 0x07, 0xb0, 0x10, 0x8f, 0x05, 0x18, 0x46,
+    0x78, 0xcc, 0x74, 0x06, 0x26, 0xa0, 0xb9, 0x89, 0xf6, 0x8f, 0xe8, 0x9a, 0x2c, 0xd9, 0x02, 0x02,
+    0xba, 0x14, 0x70, 0x97, 0x2a, 0x6d, 0x28, 0xe1, 0x4a, 0x1a, 0x90, 0x28, 0x76, 0x27, 0x42, 0x13,
+    0x07, 0x21, 0x2c, 0x05, 0x87, 0xfd, 0xf2, 0xc7, 0x9e, 0x90, 0xc2, 0x08, 0x96, 0xec, 0x67, 0x9c,
+    0x25, 0x10, 0x78, 0x16, 0xc3, 0x08, 0x93, 0xc0, 0x68, 0x3a, 0x99, 0x90, 0x6b, 0x98, 0x91, 0xb1,
+    0x92, 0x91, 0x98, 0xfb, 0x9d, 0x8a, 0xda, 0xf2, 0x33, 0x53, 0xe0, 0x69, 0x9d, 0xd9, 0x9b, 0xa9,
+    0xb0, 0x58, 0xcd, 0x18, 0xbf, 0x9d, 0x6b, 0x95, 0xcb, 0x70, 0xf0, 0xce, 0x63, 0x1c, 0xa2, 0x68,
+    0xc8, 0x55, 0xa2, 0xf4, 0xe0, 0x5d, 0x84, 0x9f, 0x11, 0x9a, 0xde, 0xcf, 0xc4, 0x0f, 0x18, 0x78,
+    0xdd, 0xf4, 0x7e, 0xf8, 0x90, 0x6a, 0x58, 0x3d, 0xa1, 0x79, 0x96, 0xe6, 0x77, 0x2a, 0xcc, 0x96,
+    0xdf, 0xa9, 0x83, 0xb3, 0xc0, 0x78, 0x44, 0x4a, 0x2f, 0x08, 0xe3, 0x46, 0x28, 0x19, 0xd0, 0x0e,
+    0x25, 0x18, 0x5c, 0xac, 0xc2, 0x80, 0x9e, 0x9f, 0x4d, 0x2f, 0xe9, 0xc8, 0x9f, 0xe9, 0x91, 0x1f,
+    0x8a, 0xe5, 0xff, 0x3c, 0xb5, 0x34, 0xcb, 0x6c, 0x8d, 0x85, 0x29, 0x90, 0x1a, 0xc2, 0xa0, 0x94,
+    0x15, 0x32, 0xcd, 0x0d, 0x31, 0x45, 0x8a, 0xc9, 0x31, 0x70, 0x8f, 0x89, 0x49, 0x44, 0x86, 0x59,
+    0xe1, 0x98, 0x01, 0xc8, 0x28, 0x11, 0x61, 0xf9, 0x5d, 0x88, 0x90, 0x12, 0x25, 0x79, 0x22, 0xf8,
+    0x2d, 0x0a, 0xc6, 0x22, 0x73, 0x97, 0x2c, 0xc9, 0x21, 0x78, 0xff, 0x9e, 0xd6, 0xa9, 0xbd, 0x83,
+    0xd9, 0x0d, 0xe7, 0x08, 0x4c, 0x49, 0x9a, 0x60, 0xcc, 0xb1, 0x4a, 0x42, 0xd0, 0x95, 0x36, 0x29,
+    0xe9, 0x95, 0x03, 0x7e, 0xc8, 0x0c, 0xb3, 0x46, 0xd6, 0xd8, 0xd6, 0x0e, 0x92, 0x55, 0x6a, 0x63,
+    0x22, 0x15, 0x2c, 0xf5, 0xba, 0x5e, 0xef, 0xc8, 0xeb, 0x76, 0x31, 0xf9, 0x0d, 0x9c, 0x5e, 0x23,
+    0xe7, 0xa0, 0x91, 0xf3, 0xa1, 0xd9, 0x50, 0xbf, 0x51, 0xe9, 0xb0, 0x91, 0xf3, 0x5b, 0x23, 0xe7,
+    0xa8, 0xd9, 0xd0, 0xef, 0xcf, 0x29, 0x95, 0x7f, 0xdd, 0x67, 0x39, 0xbd, 0x26, 0x4e, 0xef, 0xc0,
+    0xf2, 0x1a, 0x0c, 0x59, 0xc0, 0x67, 0x95, 0xfa, 0x4d, 0x1c, 0xcf, 0xab, 0x38, 0x58, 0x71, 0xeb,
+    0x1b, 0xb2, 0x55, 0xa7, 0x47, 0xc7, 0x58, 0xcc, 0xe4, 0x54, 0xcc, 0x63, 0xd3, 0xf6, 0xf6, 0x7b,
+    0xfd, 0xbe, 0x33, 0x68, 0x87, 0x10, 0xb1, 0x3c, 0x31, 0x83, 0x7e, 0xd7, 0x69, 0xa8, 0xa2, 0xc7,
+    0x9a, 0x98, 0x25, 0x55, 0x15, 0xd9, 0x73, 0xab, 0x30, 0xfa, 0xdd, 0x75, 0x45, 0xe0, 0xbf, 0x6b,
+    0x60, 0x26, 0x06, 0x4d, 0xae, 0x52, 0x34, 0x0e, 0x68, 0xe8, 0xb0, 0xeb, 0x90, 0x4b, 0xb1, 0x80,
+    0x47, 0x63, 0xde, 0x2f, 0x18, 0xcb, 0xd3, 0x3b, 0xb8, 0x31, 0x95, 0xc1, 0x3c, 0x35, 0x3f, 0x59,
+    0xf4, 0x36, 0x16, 0xb1, 0x1d, 0x4a, 0x99, 0x30, 0x46, 0x99, 0xb2, 0xd3, 0xf0, 0x5b, 0x64, 0x28,
+    0x5d, 0x0c, 0xa4, 0x92, 0x75, 0xad, 0x4e, 0x3e, 0x5e, 0x92, 0x29, 0xc8, 0x4c, 0x69, 0x72, 0x22,
+    0xd9, 0x2c, 0x81, 0xd6, 0x96, 0x71, 0xcd, 0x42, 0xa1, 0x9e, 0x5a, 0x47, 0x79, 0xcf, 0xbb, 0x01,
+    0x49, 0xd7, 0x69, 0x45, 0x7b, 0x64, 0xf2, 0x69, 0xfa, 0x5a, 0x35, 0xbc, 0x05, 0x72, 0xf2, 0x4f,
+    0x19, 0x6c, 0xd9, 0xb8, 0x65, 0x86, 0x4e, 0xc7, 0x13, 0x72, 0xa1, 0x0c, 0xb3, 0xd7, 0x56, 0x05,
+    0xf1, 0x22, 0x28, 0x8e, 0xc0, 0x1b, 0x5d, 0x8b, 0x6f, 0xf9, 0x73, 0x35, 0x3d, 0x26, 0x13, 0x75,
+    0xf7, 0x66, 0x0c, 0xaf, 0xc6, 0xb8, 0xb0, 0x15, 0xf1, 0x56, 0x90, 0x5e, 0x0d, 0x72, 0x95, 0xbe,
+    0x15, 0xe1, 0xa0, 0x46, 0x38, 0x85, 0xc8, 0x6c, 0xaa, 0x68, 0x7c, 0x7e, 0x45, 0xfe, 0xd2, 0xf0,
+    0x3d, 0x07, 0xc9, 0x8b, 0x5f, 0x40, 0xe6, 0x69, 0xbe, 0x95, 0x9b, 0x3f, 0x73, 0xa3, 0x5e, 0xa9,
+    0x66, 0xd3, 0xd1, 0xfb, 0xd0, 0xfd, 0xfc, 0xf1, 0xc7, 0x2b, 0x94, 0x6c, 0xf8, 0xde, 0xe1, 0x2b,
+    0x95, 0x6c, 0xc4, 0x47, 0x56, 0x67, 0x13, 0x6e, 0x39, 0xe9, 0xb7, 0x00, 0xb2, 0x7c, 0xb6, 0x10,
+    0x9b, 0x8e, 0x98, 0xb2, 0x25, 0x6c, 0xd4, 0xcb, 0x1f, 0x75, 0x41, 0xf9, 0x1d, 0xbb, 0x46, 0xec,
+    0xe2, 0x4a, 0x99, 0x2c, 0x1b, 0x61, 0x91, 0xcd, 0xe9, 0xe8, 0x02, 0x37, 0x4d, 0xe1, 0xba, 0x2e,
+    0x2e, 0x1f, 0xa4, 0xd7, 0xad, 0x82, 0xdb, 0xa9, 0x94, 0xc8, 0xf0, 0x02, 0x32, 0x0b, 0x80, 0x84,
+    0x51, 0xeb, 0xb8, 0x20, 0xd7, 0xe3, 0x2f, 0x95, 0x44, 0xc6, 0xb5, 0x48, 0x71, 0x58, 0x44, 0xb9,
+    0x2c, 0xf7, 0x12, 0x29, 0xc3, 0x68, 0xcb, 0xbd, 0xa5, 0xb3, 0x5a, 0x32, 0x4d, 0x20, 0x08, 0x15,
+    0xcf, 0x17, 0xb8, 0x6d, 0x5d, 0xbc, 0x19, 0x5d, 0x4c, 0x21, 0x01, 0x6e, 0x94, 0x6e, 0xd3, 0xd2,
+    0xf5, 0xaf, 0x95, 0xb3, 0xbb, 0x72, 0x97, 0x7e, 0xfb, 0x5a, 0x6f, 0x15, 0xba, 0xbb, 0xdc, 0xa5,
+    0xef, 0xbf, 0x51, 0x67, 0x28, 0xa2, 0x36, 0x38, 0xe0, 0xf2, 0x18, 0xf8, 0x2d, 0x84, 0x81, 0xd1,
+    0x39, 0x0c, 0x1f, 0x5a, 0x11, 0x18, 0x1e, 0xb7, 0x69, 0x87, 0xa5, 0xa2, 0x83, 0xe5, 0x61, 0x84,
+    0x9c, 0x67, 0xd4, 0x71, 0x71, 0x84, 0xc8, 0xf6, 0xda, 0x8d, 0xb6, 0x76, 0x56, 0x1a, 0x4c, 0xae,
+    0xd1, 0x21, 0xf7, 0xdf, 0x0c, 0x09, 0xce, 0xf0, 0xe1, 0x67, 0x99, 0xcc, 0x59, 0xb5, 0x36, 0xde,
+    0xcd, 0xc1, 0x9c, 0x24, 0x60, 0x3f, 0x8f, 0x8b, 0x4f, 0x61, 0x7b, 0xbd, 0xf8, 0x9c, 0x7a, 0xd7,
+    0x65, 0xae, 0x25, 0xd8, 0xdd, 0x39, 0x6c, 0xd6, 0xc1, 0x31, 0xf7, 0x28, 0x6f, 0xdf, 0x01, 0x89,
+    0xed, 0x93, 0x17, 0x14, 0xec, 0x98, 0x7a, 0xd4, 0xc8, 0xcb, 0xf9, 0xf7, 0x59, 0xc8, 0xdc, 0x40,
+    0x36, 0x6c, 0x61, 0xf4, 0x99, 0x8b, 0x43, 0xaa, 0x1a, 0x3f, 0x3b, 0x41, 0x80, 0x4f, 0x0a, 0x88,
+    0x84, 0x84, 0xd0, 0x59, 0x35, 0x22, 0xda, 0xa1, 0xe6, 0xb8, 0xe5, 0x54, 0x73, 0xeb, 0xa1, 0x66,
+    0xc7, 0xaf, 0xe2, 0xb7, 0x74, 0x58, 0x5d, 0xcd, 0xf6, 0xd8, 0xd9, 0x7b, 0x62, 0xe2, 0x0f, 0x6f,
+    0xd0, 0xc5, 0x34, 0xb5, 0x9e, 0xc8, 0x6d, 0xb5, 0x1f, 0xca, 0xae, 0xbf, 0x9d, 0xa7, 0x60, 0xb6,
+    0x50, 0x91, 0x87, 0xc7, 0xb9, 0xc2, 0x47, 0x42, 0x61, 0x53, 0x3d, 0xdc, 0x5c, 0x53, 0x55, 0x3b,
+    0x2f, 0xdd, 0x8f, 0x1d, 0xe4, 0xcf, 0xdd, 0x8f, 0x79, 0x21, 0xce, 0x0d, 0x2a, 0xea, 0x8e, 0xeb,
+    0xe7, 0x9c, 0x29, 0xed, 0x62, 0xda, 0x30, 0xdc, 0xd2, 0x4b, 0x37, 0x03, 0xa6, 0x79, 0xec, 0x0a,
+    0x4c, 0xdc, 0xfd, 0x59, 0x84, 0x5a, 0xd8, 0x07, 0x78, 0xa7, 0xa3, 0xa0, 0xeb, 0x34, 0x22, 0xdb,
+    0x6e, 0xd8, 0xc6, 0xa5, 0xb8, 0x07, 0x0c, 0x39, 0xfb, 0x7b, 0x67, 0x67, 0x87, 0x0e, 0x71, 0x45,
+    0xae, 0x6b, 0xde, 0xef, 0xd4, 0xef, 0xb2, 0x4e, 0xf5, 0x14, 0xfd, 0x0f, 0xf3, 0xf2, 0x72, 0xa6,
+    0xa2, 0x0a, 0x00, 0x00,
+};
+const size_t config_html_gz_len = sizeof(config_html_gz);
+
+#endif
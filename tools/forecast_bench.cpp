@@ -0,0 +1,99 @@
+// 多日预报解析在PC上的耗时和内存测量，页面样本在tools/fixtures中
+// 对比原来的indexOf+substring截取第一天(不含之后的JSON解析)
+// 用法：g++ -O2 -Isrc tools/forecast_bench.cpp src/Forecast.cpp -o forecast_bench
+//       ./forecast_bench tools/fixtures/*.html
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include "Forecast.h"
+
+static const int Rounds = 20000;
+
+static bool readFile(const char *path, std::string &out)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return false;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    out.append(buf, n);
+  fclose(f);
+  return true;
+}
+
+static double nowUs()
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+// 原来的做法：两次查找再复制出第一天的JSON
+static size_t oldExtract(const std::string &str)
+{
+  size_t start = str.find("\"f\":[");
+  size_t end = str.find(",{\"fa");
+  if (start == std::string::npos || end == std::string::npos)
+    return 0;
+  std::string json = str.substr(start + 5, end - start - 5);
+  return json.size();
+}
+
+static void bench(const char *path)
+{
+  std::string page;
+  if (!readFile(path, page))
+  {
+    printf("%s: 读取失败\n", path);
+    return;
+  }
+
+  ForecastData fc;
+  ForecastParser parser(fc);
+  parser.feed(page.data(), page.size());
+  printf("%s: %zu字节 预报%u天 扫描%u字节%s\n", path, page.size(), fc.count, parser.bytesScanned(),
+         parser.done() ? "" : " (数组不完整)");
+  for (uint8_t i = 0; i < fc.count; i++)
+  {
+    const ForecastDay &d = fc.days[i];
+    printf("  %2u/%-2u %-9s %-8s", d.month, d.mday, d.week, ForecastParser::weatherText(d.dayCode));
+    if (d.high == ForecastNoTemp)
+      printf(" --~%d\n", d.low);
+    else
+      printf(" %d~%d\n", d.high, d.low);
+  }
+
+  // 分段输入应得到相同结果
+  ForecastData chunked;
+  ForecastParser chunkParser(chunked);
+  for (size_t i = 0; i < page.size(); i += 7)
+    chunkParser.feed(page.data() + i, page.size() - i < 7 ? page.size() - i : 7);
+  printf("  分段输入%s\n", memcmp(&fc, &chunked, sizeof(fc)) == 0 ? "一致" : "不一致!");
+
+  double start = nowUs();
+  for (int r = 0; r < Rounds; r++)
+  {
+    parser.reset();
+    parser.feed(page.data(), page.size());
+  }
+  double streamUs = (nowUs() - start) / Rounds;
+
+  size_t sink = 0;
+  start = nowUs();
+  for (int r = 0; r < Rounds; r++)
+    sink += oldExtract(page);
+  double oldUs = (nowUs() - start) / Rounds;
+
+  printf("  扫描全部%u天: %.2fus/次 (%.0fMB/s)  原来截取第一天: %.2fus/次 (%zu)\n", fc.count, streamUs,
+         page.size() / streamUs, oldUs, sink / Rounds);
+}
+
+int main(int argc, char **argv)
+{
+  printf("内存: ForecastDay %zu字节 ForecastData %zu字节 ForecastParser %zu字节，不分配堆内存\n",
+         sizeof(ForecastDay), sizeof(ForecastData), sizeof(ForecastParser));
+  for (int i = 1; i < argc; i++)
+    bench(argv[i]);
+  return 0;
+}
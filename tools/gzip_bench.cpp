@@ -0,0 +1,263 @@
+// 宜忌响应边收边解压(GzipStream)在PC上的核对，以及和原来路径的内存峰值、耗时对比
+//   1. tools/fixtures/almanac.json.gz和.zz按整块、128字节、13字节、1字节分块送入，解出的内容和almanac.json一致
+//   2. 截断和CRC错误的响应不会报告解压完成
+//   3. 原来的ESP32-targz在PC上编译不了，按它每次请求的分配模拟：32KB字典、4KB输入和4KB输出缓冲，
+//      解到文件后再整个读成String，同样用uzlib解压
+// 内存峰值统计源文件里的malloc(GzipStream和模拟的原路径)，不含JSON文档
+// 用法：UZ=.pio/libdeps/esp32dev/ArduinoUZlib/src/uzlib (pio编译一次后才有)
+//       g++ -O2 -Wall -Itools/host -Isrc -I$UZ tools/gzip_bench.cpp src/GzipStream.cpp
+//           -x c $UZ/tinflate.c $UZ/tinfgzip.c $UZ/tinfzlib.c $UZ/adler32.c $UZ/crc32.c
+//           -Wl,--wrap=malloc,--wrap=free,--wrap=realloc -o gzip_bench
+//       ./gzip_bench tools/fixtures
+#include <stdio.h>
+#include <malloc.h>
+#include <string>
+#include <chrono>
+#include "GzipStream.h"
+
+#define NongliWindow 2048 // 和main.cpp一致
+#define OldDictBytes 32768
+#define OldBufBytes 4096
+
+static const int Rounds = 2000;
+static int failures = 0;
+
+// 堆统计：当前和峰值，按实际分配的块大小
+static size_t heapNow = 0, heapPeak = 0;
+
+extern "C"
+{
+  void *__real_malloc(size_t size);
+  void __real_free(void *p);
+  void *__real_realloc(void *p, size_t size);
+
+  void *__wrap_malloc(size_t size)
+  {
+    void *p = __real_malloc(size);
+    if (p != NULL)
+    {
+      heapNow += malloc_usable_size(p);
+      if (heapNow > heapPeak)
+        heapPeak = heapNow;
+    }
+    return p;
+  }
+
+  void __wrap_free(void *p)
+  {
+    if (p != NULL)
+      heapNow -= malloc_usable_size(p);
+    __real_free(p);
+  }
+
+  void *__wrap_realloc(void *p, size_t size)
+  {
+    size_t old = p != NULL ? malloc_usable_size(p) : 0;
+    void *q = __real_realloc(p, size);
+    if (q != NULL)
+    {
+      heapNow += malloc_usable_size(q) - old;
+      if (heapNow > heapPeak)
+        heapPeak = heapNow;
+    }
+    return q;
+  }
+}
+
+static void heapReset()
+{
+  heapPeak = heapNow;
+}
+
+static double nowUs()
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+static bool readFile(const std::string &path, std::string &out)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == NULL)
+    return false;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    out.append(buf, n);
+  fclose(f);
+  return true;
+}
+
+// 代替网络连接：每次最多交出chunk字节，模拟TLS分段到达
+class FixtureStream : public Stream
+{
+public:
+  FixtureStream(const std::string &data, size_t chunk) : _data(data), _pos(0), _chunk(chunk) {}
+  int available() override
+  {
+    size_t left = _data.size() - _pos;
+    return left < _chunk ? left : _chunk;
+  }
+  int read() override { return _pos < _data.size() ? (uint8_t)_data[_pos++] : -1; }
+  int peek() override { return _pos < _data.size() ? (uint8_t)_data[_pos] : -1; }
+  size_t write(uint8_t) override { return 0; }
+  size_t readBytes(uint8_t *buf, size_t len) override
+  {
+    size_t n = available();
+    if (n > len)
+      n = len;
+    memcpy(buf, _data.data() + _pos, n);
+    _pos += n;
+    return n;
+  }
+
+private:
+  const std::string &_data;
+  size_t _pos, _chunk;
+};
+
+// 现在的路径：超时为0，数据读完就算连接断开
+static bool newPath(const std::string &data, GzipStream::Format format, size_t chunk, std::string &out)
+{
+  FixtureStream src(data, chunk);
+  GzipStream gz(src, NongliWindow, 0);
+  if (!gz.begin(format))
+    return false;
+  int c;
+  while ((c = gz.read()) >= 0)
+    out += (char)c;
+  return gz.done();
+}
+
+// 模拟原来的路径，TINF_DATA在最前，回调从它找到输入
+struct OldState
+{
+  TINF_DATA d;
+  FixtureStream *src;
+  uint8_t *in;
+};
+
+static int oldReadSource(TINF_DATA *d)
+{
+  OldState *s = (OldState *)d;
+  size_t n = s->src->readBytes(s->in, OldBufBytes);
+  if (n == 0)
+    return -1;
+  s->d.source = s->in + 1;
+  s->d.source_limit = s->in + n;
+  return s->in[0];
+}
+
+static bool oldPath(const std::string &data, GzipStream::Format format, std::string &out)
+{
+  FixtureStream src(data, data.size());
+  OldState *s = (OldState *)malloc(sizeof(OldState));
+  uint8_t *dict = (uint8_t *)malloc(OldDictBytes);
+  uint8_t *buf = (uint8_t *)malloc(OldBufBytes); // 解出的数据先写到这里再写文件
+  s->src = &src;
+  s->in = (uint8_t *)malloc(OldBufBytes);
+  uzlib_init();
+  uzlib_uncompress_init(&s->d, dict, OldDictBytes);
+  s->d.source = s->d.source_limit = s->in;
+  s->d.source_read_cb = oldReadSource;
+  int res = format == GzipStream::Gzip ? uzlib_gzip_parse_header(&s->d) : uzlib_zlib_parse_header(&s->d);
+  char *file = NULL; // 文件内容，之后整个读成String
+  size_t fileLen = 0;
+  while (res >= 0 && res != TINF_DONE)
+  {
+    s->d.dest = buf;
+    s->d.dest_limit = buf + OldBufBytes;
+    res = uzlib_uncompress_chksum(&s->d);
+    size_t n = s->d.dest - buf;
+    file = (char *)realloc(file, fileLen + n + 1);
+    memcpy(file + fileLen, buf, n);
+    fileLen += n;
+  }
+  free(s->in);
+  free(buf);
+  free(dict);
+  free(s);
+  if (file != NULL)
+    out.assign(file, fileLen);
+  free(file);
+  return res == TINF_DONE;
+}
+
+static void check(const char *name, bool ok)
+{
+  if (ok)
+    return;
+  printf("  不符: %s\n", name);
+  failures++;
+}
+
+static void benchFile(const std::string &dir, const char *file, GzipStream::Format format, const std::string &json)
+{
+  std::string data;
+  if (!readFile(dir + "/" + file, data))
+  {
+    printf("%s/%s: 读取失败\n", dir.c_str(), file);
+    failures++;
+    return;
+  }
+  printf("%s 收到%zu字节 解压%zu字节\n", file, data.size(), json.size());
+  printf("  %-10s %-8s %10s %10s\n", "路径", "分块", "内存峰值", "平均耗时");
+
+  static const size_t chunks[] = {0, GzipInChunk, 13, 1}; // 0为整块
+  for (size_t chunk : chunks)
+  {
+    size_t size = chunk ? chunk : data.size();
+    std::string out;
+    heapReset();
+    bool done = newPath(data, format, size, out);
+    size_t peak = heapPeak - heapNow;
+    char name[48];
+    snprintf(name, sizeof(name), "%s %zu字节分块", file, size);
+    check(name, done && out == json);
+    double start = nowUs();
+    for (int i = 0; i < Rounds; i++)
+    {
+      out.clear();
+      newPath(data, format, size, out);
+    }
+    printf("  %-10s %-8zu %8zu字节 %8.1fus\n", "GzipStream", size, peak, (nowUs() - start) / Rounds);
+  }
+
+  std::string out;
+  heapReset();
+  bool done = oldPath(data, format, out);
+  size_t peak = heapPeak - heapNow;
+  check("原路径解压", done && out == json);
+  double start = nowUs();
+  for (int i = 0; i < Rounds; i++)
+  {
+    out.clear();
+    oldPath(data, format, out);
+  }
+  printf("  %-10s %-8zu %8zu字节 %8.1fus\n", "原路径", data.size(), peak, (nowUs() - start) / Rounds);
+
+  // 截断：连接提前断开
+  std::string cut = data.substr(0, data.size() - 4);
+  out.clear();
+  check("截断的响应报告完成", !newPath(cut, format, GzipInChunk, out));
+  // 校验错误：gzip改CRC，zlib改adler32
+  std::string bad = data;
+  bad[bad.size() - (format == GzipStream::Gzip ? 8 : 1)] ^= 0x55;
+  out.clear();
+  check("校验错误的响应报告完成", !newPath(bad, format, GzipInChunk, out));
+}
+
+int main(int argc, char **argv)
+{
+  std::string dir = argc > 1 ? argv[1] : "tools/fixtures";
+  std::string json;
+  if (!readFile(dir + "/almanac.json", json))
+  {
+    printf("%s/almanac.json: 读取失败\n", dir.c_str());
+    return 1;
+  }
+  benchFile(dir, "almanac.json.gz", GzipStream::Gzip, json);
+  benchFile(dir, "almanac.json.zz", GzipStream::Zlib, json);
+  printf(failures ? "失败%d项\n" : "全部通过\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,46 @@
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+/* *****************************************************************
+ * 在PC上编译不依赖硬件的源文件(如GzipStream)时代替Arduino.h，
+ * 只有用到的Stream接口和millis/delay。
+ * *****************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+inline uint32_t millis()
+{
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline void delay(uint32_t ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+class Stream
+{
+public:
+  virtual ~Stream() {}
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t write(uint8_t) = 0;
+  virtual void flush() {}
+  // 和Arduino一样逐字节读，子类可以改成整块复制
+  virtual size_t readBytes(uint8_t *buf, size_t len)
+  {
+    size_t n = 0;
+    int c;
+    while (n < len && (c = read()) >= 0)
+      buf[n++] = c;
+    return n;
+  }
+};
+
+#endif
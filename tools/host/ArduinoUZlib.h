@@ -0,0 +1,7 @@
+#ifndef _HOST_ARDUINO_UZLIB_H_
+#define _HOST_ARDUINO_UZLIB_H_
+
+// 在PC上只用ArduinoUZlib里的uzlib，编译时用-I指向库中的uzlib目录
+#include "uzlib.h"
+
+#endif
@@ -0,0 +1,276 @@
+// 本地农历在PC上的核对和耗时测量
+//   1. tools/fixtures/lunar_months.txt(ICU导出的每个农历月初一)逐月对比
+//   2. 1900-2100每一天农历日期连续，月长29或30天
+//   3. 周数和strftime的%V一致
+//   4. tools/fixtures/lunar_known.txt中公开的春节、闰月、节气和干支
+// 用法：g++ -O2 -Isrc tools/lunar_check.cpp src/Lunar.cpp -o lunar_check
+//       ./lunar_check tools/fixtures
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <chrono>
+#include "Lunar.h"
+
+// ICU和天文计算不同的月份(ICU的初一日期)。ICU的朔是近似算法，离午夜十几分钟以内的会差一天，
+// 1929年以前ICU按北京地方时；另有3处闰月位置不同。有公开历书的都和本地一致
+struct KnownDiff
+{
+  int date;
+  const char *reason;
+};
+static const KnownDiff knownDiffs[] = {
+    {19141117, "朔在11月18日0时01分，ICU按北京地方时"},
+    {19160203, "朔在2月4日0时05分，ICU按北京地方时"},
+    {19170323, "ICU闰三月，本地闰二月，与通行的万年历一致"},
+    {19170421, ""},
+    {19201110, "朔在11月11日0时04分，ICU按北京地方时"},
+    {19220625, "ICU闰六月，本地闰五月，与通行的万年历一致"},
+    {19220724, ""},
+    {19540204, "朔在2月3日23时55分"},
+    {19550223, "朔在2月22日23时54分"},
+    {19870726, "ICU闰七月，本地闰六月，与当年历书一致"},
+    {19870824, ""},
+    {19990118, "朔在1月17日23时46分"},
+    {20120818, "朔在8月17日23时54分，历书七月初一为8月17日"},
+    {20181107, "朔在11月8日0时02分，历书十月初一为11月8日"},
+    {20270207, "朔在2月6日23时56分，春节为2月6日"},
+    {20300202, "朔在2月3日0时07分，春节为2月3日"},
+    {20570929, "朔在9月28日23时59分，离午夜不到1秒，有争议"},
+    {20700313, "朔在3月12日23时51分"},
+    {0, NULL},
+};
+
+static int failures = 0;
+
+static void fail(const char *fmt, const char *a, int b)
+{
+  printf(fmt, a, b);
+  printf("\n");
+  failures++;
+}
+
+static bool knownDiff(int date)
+{
+  for (const KnownDiff *k = knownDiffs; k->reason; k++)
+    if (k->date == date)
+      return true;
+  return false;
+}
+
+static double nowNs()
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// 公历日期逐日前进
+static void nextDay(int &y, int &m, int &d)
+{
+  static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+  if (++d > days[m - 1] + (m == 2 && leap))
+  {
+    d = 1;
+    if (++m > 12)
+    {
+      m = 1;
+      y++;
+    }
+  }
+}
+
+static void checkMonths(const char *dir)
+{
+  std::string path = std::string(dir) + "/lunar_months.txt";
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL)
+  {
+    fail("%s: 读取失败%d", path.c_str(), 0);
+    return;
+  }
+  int date, year, month, leap, rows = 0, diffs = 0;
+  while (fscanf(f, "%d %d %d %d", &date, &year, &month, &leap) == 4)
+  {
+    LunarDay d;
+    if (!Lunar::convert(date / 10000, date / 100 % 100, date % 100, d))
+      continue; // 2101年的月份
+    rows++;
+    if (d.day == 1 && d.year == year && d.month == month && d.leap == (leap != 0))
+      continue;
+    if (knownDiff(date))
+    {
+      diffs++;
+      continue;
+    }
+    char text[LunarTextLen];
+    Lunar::dateText(d, text, sizeof(text));
+    printf("%d ICU:%d年%s%d月初一 本地:%d年%s\n", date, year, leap ? "闰" : "", month, d.year, text);
+    failures++;
+  }
+  fclose(f);
+  printf("ICU月份 %d个 已知不同%d个\n", rows, diffs);
+  for (const KnownDiff *k = knownDiffs; k->reason; k++)
+    if (k->reason[0])
+      printf("  %d %s\n", k->date, k->reason);
+}
+
+static void checkDays()
+{
+  int y = 1900, m = 1, d = 31, days = 0;
+  LunarDay prev;
+  Lunar::convert(y, m, d, prev);
+  while (y <= LunarLastYear)
+  {
+    nextDay(y, m, d);
+    if (y > LunarLastYear)
+      break;
+    LunarDay cur;
+    char name[32];
+    snprintf(name, sizeof(name), "%04d-%02d-%02d", y, m, d);
+    if (!Lunar::convert(y, m, d, cur))
+    {
+      fail("%s 转换失败%d", name, 0);
+      break;
+    }
+    days++;
+    bool sameMonth = cur.year == prev.year && cur.month == prev.month && cur.leap == prev.leap;
+    if (sameMonth ? cur.day != prev.day + 1 : (cur.day != 1 || prev.day < 29))
+      fail("%s 日期不连续 前一天%d日", name, prev.day);
+    if (!sameMonth && cur.year != prev.year && !(cur.month == 1 && !cur.leap))
+      fail("%s 换年不在正月 月%d", name, cur.month);
+
+    struct tm t = {};
+    t.tm_year = y - 1900;
+    t.tm_mon = m - 1;
+    t.tm_mday = d;
+    t.tm_hour = 12;
+    time_t tt = timegm(&t);
+    struct tm *g = gmtime(&tt);
+    char week[4];
+    strftime(week, sizeof(week), "%V", g);
+    if (atoi(week) != cur.week)
+      fail("%s 周数不同 %%V为%d", name, atoi(week));
+    prev = cur;
+  }
+  printf("逐日检查 %d天\n", days);
+}
+
+static void checkKnown(const char *dir)
+{
+  std::string path = std::string(dir) + "/lunar_known.txt";
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL)
+  {
+    fail("%s: 读取失败%d", path.c_str(), 0);
+    return;
+  }
+  char line[128];
+  int rows = 0;
+  while (fgets(line, sizeof(line), f))
+  {
+    char kind[8], a[32], b[32], c[32];
+    int n = sscanf(line, "%7s %31s %31s %31s", kind, a, b, c);
+    if (n < 3 || kind[0] == '#')
+      continue;
+    rows++;
+    int y, m, d;
+    LunarDay day;
+    char text[LunarTextLen];
+    if (!strcmp(kind, "date") || !strcmp(kind, "term"))
+    {
+      if (sscanf(a, "%d-%d-%d", &y, &m, &d) != 3 || !Lunar::convert(y, m, d, day))
+      {
+        fail("%s 转换失败%d", a, 0);
+        continue;
+      }
+      if (!strcmp(kind, "date"))
+        Lunar::dateText(day, text, sizeof(text));
+      else
+        snprintf(text, sizeof(text), "%s", day.term == LunarNoTerm ? "" : Lunar::termName(day.term));
+      if (strcmp(text, b))
+      {
+        printf("%s 应为%s 本地:%s\n", a, b, text);
+        failures++;
+      }
+    }
+    else if (!strcmp(kind, "leap"))
+    {
+      // 从这一年春节找到下一年春节，看有没有闰月
+      int year = atoi(a), month = atoi(b), found = 0;
+      y = year, m = 1, d = 1;
+      while (y <= year + 1)
+      {
+        if (Lunar::convert(y, m, d, day) && day.year == year && day.leap)
+        {
+          found = day.month;
+          break;
+        }
+        nextDay(y, m, d);
+      }
+      if (found != month)
+      {
+        printf("%d 应闰%d月 本地:%d\n", year, month, found);
+        failures++;
+      }
+    }
+    else if (!strcmp(kind, "year"))
+    {
+      int year = atoi(a);
+      Lunar::ganZhi(year, text, sizeof(text));
+      if (strcmp(text, b) || strcmp(Lunar::zodiac(year), c))
+      {
+        printf("%d 应为%s%s 本地:%s%s\n", year, b, c, text, Lunar::zodiac(year));
+        failures++;
+      }
+    }
+  }
+  fclose(f);
+  printf("公开数据 %d条\n", rows);
+}
+
+static void bench()
+{
+  const int rounds = 20;
+  int count = 0;
+  uint32_t sum = 0;
+  double start = nowNs();
+  for (int r = 0; r < rounds; r++)
+  {
+    int y = 1900, m = 1, d = 31;
+    while (y <= LunarLastYear)
+    {
+      LunarDay day;
+      Lunar::convert(y, m, d, day);
+      sum += day.day;
+      count++;
+      nextDay(y, m, d);
+    }
+  }
+  double ns = nowNs() - start;
+  printf("转换 %d次 平均%.0fns(校验和%u)\n", count, ns / count, sum);
+}
+
+int main(int argc, char **argv)
+{
+  const char *dir = argc > 1 ? argv[1] : "tools/fixtures";
+  checkMonths(dir);
+  checkDays();
+  checkKnown(dir);
+  bench();
+
+  LunarDay d;
+  char text[LunarTextLen], term[LunarTextLen], gz[8];
+  time_t now = time(NULL);
+  struct tm *t = localtime(&now);
+  if (Lunar::convert(t->tm_year + 1900, t->tm_mon + 1, t->tm_mday, d))
+  {
+    Lunar::dateText(d, text, sizeof(text));
+    Lunar::termText(d, term, sizeof(term));
+    Lunar::ganZhi(d.year, gz, sizeof(gz));
+    printf("今天 %s年 %s %s年%u周 今日%s\n", gz, text, Lunar::zodiac(d.year), d.week, term);
+  }
+  printf(failures ? "失败%d项\n" : "全部通过\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+// 用ICU的农历(Node的Intl，完整ICU数据)导出1900-2100每个农历月初一的公历日期，
+// 作为src/Lunar.cpp的参考数据：每行"公历日期 农历年 月 是否闰月"
+// 用法：node tools/lunar_months.js > tools/fixtures/lunar_months.txt
+const f = new Intl.DateTimeFormat('zh-CN-u-ca-chinese', { year: 'numeric', month: 'numeric', day: 'numeric', timeZone: 'UTC' });
+const names = ['正月', '二月', '三月', '四月', '五月', '六月', '七月', '八月', '九月', '十月', '十一月', '腊月'];
+const pad = (n) => String(n).padStart(2, '0');
+const out = [];
+for (let t = Date.UTC(1900, 0, 31); t < Date.UTC(2101, 1, 28); t += 86400000)
+{
+  const parts = f.formatToParts(new Date(t));
+  const get = (type) => parts.find((p) => p.type == type).value;
+  if (get('day') !== '1')
+    continue;
+  let month = get('month');
+  const leap = month.startsWith('闰');
+  if (leap)
+    month = month.slice(1);
+  const d = new Date(t);
+  out.push(`${d.getUTCFullYear()}${pad(d.getUTCMonth() + 1)}${pad(d.getUTCDate())} ${get('relatedYear')} ${names.indexOf(month) + 1} ${leap ? 1 : 0}`);
+}
+console.log(out.join('\n'));
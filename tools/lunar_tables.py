@@ -0,0 +1,255 @@
+# 生成src/Lunar.cpp中的表，全部按天文计算：
+#   LunarYearInfo  每个农历年各月大小和闰月。朔日用Meeus《天文算法》第49章的合朔公式，
+#                  冬至所在月为十一月，两个冬至之间有13个月时第一个没有中气的月为闰月
+#   LunarNewYear   每年正月初一距公历1月1日的天数
+#   LunarTermBits  每年24节气在当月的日期。太阳黄经用截断的VSOP87，加FK5修正、章动和光行差，
+#                  ΔT用Espenak-Meeus多项式，已知的节气时刻误差约1分钟
+# 日期一律按北京时间(UTC+8，GB/T 33661-2017)，1929年以前的历书用北京地方平时，个别月份会差一天。
+# tools/fixtures/lunar_months.txt是ICU独立算出的参考，由tools/lunar_check.cpp对比。
+# 用法：python3 tools/lunar_tables.py [--near]，--near列出离午夜3分钟以内、日期可能有争议的朔和节气
+import datetime
+import math
+import os
+import sys
+
+FIRST, LAST = 1900, 2100
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# ---------------- 太阳视黄经 ----------------
+# VSOP87D地球黄经L0-L5的主要项(Meeus《天文算法》附录III)，(A, B, C)：A*cos(B + C*t)
+L0 = [(175347046, 0, 0), (3341656, 4.6692568, 6283.0758500), (34894, 4.62610, 12566.15170), (3497, 2.7441, 5753.3849),
+      (3418, 2.8289, 3.5231), (3136, 3.6277, 77713.7715), (2676, 4.4181, 7860.4194), (2343, 6.1352, 3930.2097),
+      (1324, 0.7425, 11506.7698), (1273, 2.0371, 529.6910), (1199, 1.1096, 1577.3435), (990, 5.233, 5884.927),
+      (902, 2.045, 26.298), (857, 3.508, 398.149), (780, 1.179, 5223.694), (753, 2.533, 5507.553),
+      (505, 4.583, 18849.228), (492, 4.205, 775.523), (357, 2.920, 0.067), (317, 5.849, 11790.629),
+      (284, 1.899, 796.298), (271, 0.315, 10977.079), (243, 0.345, 5486.778), (206, 4.806, 2544.314),
+      (205, 1.869, 5573.143), (202, 2.458, 6069.777), (156, 0.833, 213.299), (132, 3.411, 2942.463),
+      (126, 1.083, 20.775), (115, 0.645, 0.980), (103, 0.636, 4694.003), (102, 0.976, 15720.839),
+      (102, 4.267, 7.114), (99, 6.21, 2146.17), (98, 0.68, 155.42), (86, 5.98, 161000.69),
+      (85, 1.30, 6275.96), (85, 3.67, 71430.70), (80, 1.81, 17260.15), (79, 3.04, 12036.46),
+      (75, 1.76, 5088.63), (74, 3.50, 3154.69), (74, 4.68, 801.82), (70, 0.83, 9437.76),
+      (62, 3.98, 8827.39), (61, 1.82, 7084.90), (57, 2.78, 6286.60), (56, 4.39, 14143.50),
+      (56, 3.47, 6279.55), (52, 0.19, 12139.55), (52, 1.33, 1748.02), (51, 0.28, 5856.48),
+      (49, 0.49, 1194.45), (41, 5.37, 8429.24), (41, 2.40, 19651.05), (39, 6.17, 10447.39),
+      (37, 6.04, 10213.29), (37, 2.57, 1059.38), (36, 1.71, 2352.87), (36, 1.78, 6812.77),
+      (33, 0.59, 17789.85), (30, 0.44, 83996.85), (30, 2.74, 1349.87), (25, 3.16, 4690.48)]
+L1 = [(628331966747, 0, 0), (206059, 2.678235, 6283.07585), (4303, 2.6351, 12566.1517), (425, 1.590, 3.523),
+      (119, 5.796, 26.298), (109, 2.966, 1577.344), (93, 2.59, 18849.23), (72, 1.14, 529.69),
+      (68, 1.87, 398.15), (67, 4.41, 5507.55), (59, 2.89, 5223.69), (56, 2.17, 155.42),
+      (45, 0.40, 796.30), (36, 0.47, 775.52), (29, 2.65, 7.11), (21, 5.34, 0.98),
+      (19, 1.85, 5486.78), (19, 4.97, 213.30), (17, 2.99, 6275.96), (16, 0.03, 2544.31),
+      (16, 1.43, 2146.17), (15, 1.21, 10977.08), (12, 2.83, 1748.02), (12, 3.26, 5088.63),
+      (12, 5.27, 1194.45), (12, 2.08, 4694.00), (11, 0.77, 553.57), (10, 1.30, 6286.60),
+      (10, 4.24, 1349.87), (9, 2.70, 242.73), (9, 5.64, 951.72), (8, 5.30, 2352.87),
+      (6, 2.65, 9437.76), (6, 4.67, 4690.48)]
+L2 = [(52919, 0, 0), (8720, 1.0721, 6283.0758), (309, 0.867, 12566.152), (27, 0.05, 3.52),
+      (16, 5.19, 26.30), (16, 3.68, 155.42), (10, 0.76, 18849.23), (9, 2.06, 77713.77),
+      (7, 0.83, 775.52), (5, 4.66, 1577.34), (4, 1.03, 7.11), (4, 3.44, 5573.14),
+      (3, 5.14, 796.30), (3, 6.05, 5507.55), (3, 1.19, 242.73), (3, 6.12, 529.69),
+      (3, 0.31, 398.15), (3, 2.28, 553.57), (2, 4.38, 5223.69), (2, 3.75, 0.98)]
+L3 = [(289, 5.844, 6283.076), (35, 0, 0), (17, 5.49, 12566.15), (3, 5.20, 155.42),
+      (1, 4.72, 3.52), (1, 5.30, 18849.23), (1, 5.97, 242.73)]
+L4 = [(114, 3.142, 0), (8, 4.13, 6283.08), (1, 3.84, 12566.15)]
+L5 = [(1, 3.14, 0)]
+R0 = [(100013989, 0, 0), (1670700, 3.0984635, 6283.0758500), (13956, 3.05525, 12566.15170),
+      (3084, 5.1985, 77713.7715), (1628, 1.1739, 5753.3849), (1576, 2.8469, 7860.4194)]
+
+
+def series(terms, t):
+    return sum(a * math.cos(b + c * t) for a, b, c in terms)
+
+
+def sun_longitude(jde):
+    t = (jde - 2451545) / 365250
+    L = sum(series(s, t) * t ** i for i, s in enumerate((L0, L1, L2, L3, L4, L5))) / 1e8
+    R = series(R0, t) / 1e8
+    T = t * 10
+    om = math.radians(125.04452 - 1934.136261 * T)
+    ls = math.radians(280.4665 + 36000.7698 * T)
+    lm = math.radians(218.3165 + 481267.8813 * T)
+    dpsi = -17.20 * math.sin(om) - 1.32 * math.sin(2 * ls) - 0.23 * math.sin(2 * lm) + 0.21 * math.sin(2 * om)
+    lon = math.degrees(L) + 180 - 0.09033 / 3600 + dpsi / 3600 - 20.4898 / 3600 / R
+    return lon % 360
+
+
+def delta_t(y):
+    if y < 1920:
+        t = y - 1900
+        return -2.79 + 1.494119 * t - 0.0598939 * t ** 2 + 0.0061966 * t ** 3 - 0.000197 * t ** 4
+    if y < 1941:
+        t = y - 1920
+        return 21.20 + 0.84493 * t - 0.076100 * t ** 2 + 0.0020936 * t ** 3
+    if y < 1961:
+        t = y - 1950
+        return 29.07 + 0.407 * t - t * t / 233 + t ** 3 / 2547
+    if y < 1986:
+        t = y - 1975
+        return 45.45 + 1.067 * t - t * t / 260 - t ** 3 / 718
+    if y < 2005:
+        t = y - 2000
+        return 63.86 + 0.3345 * t - 0.060374 * t ** 2 + 0.0017275 * t ** 3 + 0.000651814 * t ** 4 + 0.00002373599 * t ** 5
+    if y < 2050:
+        t = y - 2000
+        return 62.92 + 0.32217 * t + 0.005589 * t * t
+    u = (y - 1820) / 100
+    return -20 + 32 * u * u - 0.5628 * (2150 - y)
+
+
+def julian_day(y, m, d):
+    if m <= 2:
+        y -= 1
+        m += 12
+    a = y // 100
+    return int(365.25 * (y + 4716)) + int(30.6001 * (m + 1)) + d + 2 - a + a // 4 - 1524.5
+
+
+def to_datetime(jd):
+    return datetime.datetime(2000, 1, 1, 12) + datetime.timedelta(days=jd - 2451545)
+
+
+# 力学时转成北京时间
+def local_time(jde):
+    return to_datetime(jde - delta_t(to_datetime(jde).year) / 86400 + 8 / 24)
+
+
+# 节气k(0为小寒，黄经285度)的时刻
+def term_jde(y, k):
+    lon = (285 + 15 * k) % 360
+    jde = julian_day(y, 1, 6) + k * 15.2184
+    for _ in range(10):
+        jde += ((lon - sun_longitude(jde) + 180) % 360 - 180) * 365.2422 / 360
+    return jde
+
+
+# 节气的北京时间，返回(日, 当天的分钟数)
+def term_time(y, k):
+    t = local_time(term_jde(y, k))
+    assert t.year == y and t.month == k // 2 + 1, (y, k, t)
+    return t.day, t.hour * 60 + t.minute
+
+
+# 第k个朔(k=0为2000年1月6日)
+def new_moon(k):
+    r = math.radians
+    T = k / 1236.85
+    jde = 2451550.09766 + 29.530588861 * k + 0.00015437 * T * T - 0.000000150 * T ** 3 + 0.00000000073 * T ** 4
+    E = 1 - 0.002516 * T - 0.0000074 * T * T
+    M = r(2.5534 + 29.10535670 * k - 0.0000014 * T * T - 0.00000011 * T ** 3)
+    Mp = r(201.5643 + 385.81693528 * k + 0.0107582 * T * T + 0.00001238 * T ** 3 - 0.000000058 * T ** 4)
+    F = r(160.7108 + 390.67050284 * k - 0.0016118 * T * T - 0.00000227 * T ** 3 + 0.000000011 * T ** 4)
+    Om = r(124.7746 - 1.56375588 * k + 0.0020672 * T * T + 0.00000215 * T ** 3)
+    sin = math.sin
+    jde += (-0.40720 * sin(Mp) + 0.17241 * E * sin(M) + 0.01608 * sin(2 * Mp) + 0.01039 * sin(2 * F)
+            + 0.00739 * E * sin(Mp - M) - 0.00514 * E * sin(Mp + M) + 0.00208 * E * E * sin(2 * M)
+            - 0.00111 * sin(Mp - 2 * F) - 0.00057 * sin(Mp + 2 * F) + 0.00056 * E * sin(2 * Mp + M)
+            - 0.00042 * sin(3 * Mp) + 0.00042 * E * sin(M + 2 * F) + 0.00038 * E * sin(M - 2 * F)
+            - 0.00024 * E * sin(2 * Mp - M) - 0.00017 * sin(Om) - 0.00007 * sin(Mp + 2 * M)
+            + 0.00004 * sin(2 * Mp - 2 * F) + 0.00004 * sin(3 * M) + 0.00003 * sin(Mp + M - 2 * F)
+            + 0.00003 * sin(2 * Mp + 2 * F) - 0.00003 * sin(Mp + M + 2 * F) + 0.00003 * sin(Mp - M + 2 * F)
+            - 0.00002 * sin(Mp - M - 2 * F) - 0.00002 * sin(3 * Mp + M) + 0.00002 * sin(4 * Mp))
+    planets = [(299.77, 0.107408, 0.000325), (251.88, 0.016321, 0.000165), (251.83, 26.651886, 0.000164),
+               (349.42, 36.412478, 0.000126), (84.66, 18.206239, 0.000110), (141.74, 53.303771, 0.000062),
+               (207.14, 2.453732, 0.000060), (154.84, 7.306860, 0.000056), (34.52, 27.261239, 0.000047),
+               (207.19, 0.121824, 0.000042), (291.34, 1.844379, 0.000040), (161.72, 24.198154, 0.000037),
+               (239.56, 25.513099, 0.000035), (331.55, 3.592518, 0.000023)]
+    for i, (a, b, c) in enumerate(planets):
+        jde += c * sin(r(a + b * k - (0.009173 * T * T if i == 0 else 0)))
+    return jde
+
+
+# 每个农历月初一：(公历日期, 农历年, 月, 是否闰月)
+def month_starts():
+    moons = [local_time(new_moon(k)) for k in range(-1260, 1270)]
+    major = sorted(local_time(term_jde(y, k)).date() for y in range(FIRST - 1, LAST + 2) for k in range(1, 24, 2))
+    solstice = {y: local_time(term_jde(y, 23)).date() for y in range(FIRST - 1, LAST + 2)}
+    starts = []
+    for y in range(FIRST - 1, LAST + 1):
+        first = max(i for i, m in enumerate(moons) if m.date() <= solstice[y])
+        last = max(i for i, m in enumerate(moons) if m.date() <= solstice[y + 1])
+        leap_pending = last - first == 13
+        month = 11
+        for i in range(first, last):
+            begin, end = moons[i].date(), moons[i + 1].date()
+            leap = False
+            if i != first:
+                if leap_pending and not any(begin <= z < end for z in major):
+                    leap = True
+                    leap_pending = False
+                else:
+                    month = month % 12 + 1
+            starts.append((begin, y + 1 if month < 11 else y, month, leap))
+    return starts
+
+
+def year_info(starts):
+    info = {}
+    for i in range(len(starts) - 1):
+        day, year, month, leap = starts[i]
+        if not FIRST <= year <= LAST:
+            continue
+        days = (starts[i + 1][0] - day).days
+        assert days in (29, 30), (day, days)
+        v = info.get(year, 0)
+        if leap:
+            v |= month
+            if days == 30:
+                v |= 0x10000
+        elif days == 30:
+            v |= 0x8000 >> (month - 1)
+        info[year] = v
+    return [info[y] for y in range(FIRST, LAST + 1)]
+
+
+def term_table():
+    days = {}
+    near = []
+    for y in range(FIRST, LAST + 1):
+        for k in range(24):
+            day, minute = term_time(y, k)
+            days[y, k] = day
+            if minute < 3 or minute > 24 * 60 - 3:
+                near.append((y, k, day, minute))
+    base = [min(days[y, k] for y in range(FIRST, LAST + 1)) for k in range(24)]
+    for y in range(FIRST, LAST + 1):
+        for k in range(24):
+            assert days[y, k] - base[k] < 4, (y, k)
+    bits = []
+    for y in range(FIRST, LAST + 1):
+        row = [0] * 6
+        for k in range(24):
+            row[k // 4] |= (days[y, k] - base[k]) << (k % 4 * 2)
+        bits.append(row)
+    return base, bits, near
+
+
+def main():
+    starts = month_starts()
+    info = year_info(starts)
+    new_year = [(day - datetime.date(year, 1, 1)).days for day, year, month, leap in starts
+                if FIRST <= year <= LAST and month == 1 and not leap]
+    base, bits, near = term_table()
+    if '--near' in sys.argv:
+        for k in range(-1260, 1270):
+            t = local_time(new_moon(k))
+            if FIRST <= t.year <= LAST and (t.hour * 60 + t.minute < 3 or t.hour * 60 + t.minute > 24 * 60 - 3):
+                print('朔 %s' % t.strftime('%Y-%m-%d %H:%M'))
+        for y, k, day, minute in near:
+            print('%d 节气%d %d日 %02d:%02d' % (y, k, day, minute // 60, minute % 60))
+        return
+    print('static const uint32_t LunarYearInfo[LunarLastYear - LunarFirstYear + 1] = {')
+    for i in range(0, len(info), 10):
+        print('    ' + ', '.join('0x%05x' % v for v in info[i:i + 10]) + ',')
+    print('};')
+    print('static const uint8_t LunarNewYear[LunarLastYear - LunarFirstYear + 1] = {')
+    for i in range(0, len(new_year), 20):
+        print('    ' + ', '.join(str(v) for v in new_year[i:i + 20]) + ',')
+    print('};')
+    print('static const uint8_t LunarTermBase[24] = {%s};' % ', '.join(str(b) for b in base))
+    print('static const uint8_t LunarTermBits[LunarLastYear - LunarFirstYear + 1][6] = {')
+    for i in range(0, len(bits), 4):
+        print('    ' + ', '.join('{%s}' % ', '.join('0x%02x' % b for b in row) for row in bits[i:i + 4]) + ',')
+    print('};')
+
+
+if __name__ == '__main__':
+    main()
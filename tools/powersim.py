@@ -0,0 +1,90 @@
+# 省电模式调度模拟：按任务唤醒周期和每次耗时模拟一天，估算平均电流
+# 电流常数与src/PowerManager.cpp一致，任务耗时可用/trace导出的实测值替换
+# 用法：python3 tools/powersim.py [白天背光0-255] [夜间背光0-255]
+import sys
+
+ACTIVE_MA = 68.0      # 240MHz运行
+IDLE_MAX_MA = 30.0    # 240MHz空闲
+IDLE_MIN_MA = 20.0    # 80MHz空闲
+LIGHT_SLEEP_MA = 0.8  # 浅睡眠
+WIFI_MA = 10.0        # modem sleep下WiFi平均
+BACKLIGHT_MA = 30.0   # 背光满亮度
+
+NIGHT_START = 21 * 60      # 21:00
+NIGHT_END = 8 * 60 + 30    # 08:30
+
+# (名称, 白天周期ms, 夜间周期ms, 每次耗时ms)，周期为0表示不运行
+TASKS_POWER = [
+    ('taskA轮询', 20, 100, 0.05),
+    ('时钟(秒)', 1000, 0, 6.0),
+    ('时钟(分)', 60000, 60000, 12.0),
+    ('太空人动画', 150, 0, 9.0),
+    ('室内温度', 150, 60000, 0.3),
+    ('taskC字幕', 100, 500, 0.2),
+    ('字幕切换', 1500, 1500, 15.0),
+    ('天气/预警/黄历', 20 * 60000, 20 * 60000, 1500.0),
+]
+# 改动前：taskA忙循环占满一个核，其余任务按150ms/100ms轮询
+TASKS_OLD = [
+    ('taskA忙循环', 1, 1, 1.0),
+    ('taskB轮询', 150, 150, 9.5),
+    ('taskC字幕', 100, 100, 0.2),
+    ('字幕切换', 1500, 1500, 15.0),
+    ('天气/预警/黄历', 20 * 60000, 20 * 60000, 1500.0),
+]
+
+
+def is_night(minute):
+    if NIGHT_START > NIGHT_END:
+        return minute >= NIGHT_START or minute < NIGHT_END
+    return NIGHT_START <= minute < NIGHT_END
+
+
+def busy_ratio(tasks, night):
+    busy = 0.0
+    wakeups = 0.0
+    for name, day_period, night_period, cost in tasks:
+        period = night_period if night else day_period
+        if period > 0:
+            busy += cost / period
+            wakeups += 1000.0 / period
+    return min(busy, 1.0), wakeups
+
+
+def current(mode, busy, backlight):
+    if mode == 'full':
+        idle = IDLE_MAX_MA
+    elif mode == 'dfs':
+        idle = IDLE_MIN_MA
+    else:
+        # 背光点亮时持有禁止浅睡眠锁，夜间最低亮度也一样
+        idle = IDLE_MIN_MA if backlight > 0 else LIGHT_SLEEP_MA
+    return busy * ACTIVE_MA + (1 - busy) * idle + WIFI_MA + BACKLIGHT_MA * backlight / 255
+
+
+def simulate(mode, tasks, day_bl, night_bl, night_cadence=True):
+    total = 0.0
+    for minute in range(24 * 60):
+        night = is_night(minute)
+        busy, _ = busy_ratio(tasks, night and night_cadence)
+        total += current(mode, busy, night_bl if night else day_bl)
+    return total / (24 * 60)
+
+
+def main():
+    day_bl = int(sys.argv[1]) if len(sys.argv) > 1 else 250
+    night_bl = int(sys.argv[2]) if len(sys.argv) > 2 else 88
+    for label, tasks in (('改动前', TASKS_OLD), ('省电模式', TASKS_POWER)):
+        for night in (False, True):
+            busy, wakeups = busy_ratio(tasks, night)
+            print('%s %s: CPU忙 %.1f%%, 唤醒 %.1f次/s' % (label, '夜间' if night else '白天', busy * 100, wakeups))
+    print('平均电流(mA)，背光 白天%d 夜间%d：' % (day_bl, night_bl))
+    print('  改动前 全速:          %.1f' % simulate('full', TASKS_OLD, day_bl, night_bl, False))
+    print('  省电任务 全速:        %.1f' % simulate('full', TASKS_POWER, day_bl, night_bl))
+    print('  省电任务 降频:        %.1f' % simulate('dfs', TASKS_POWER, day_bl, night_bl))
+    print('  省电任务 降频+浅睡眠: %.1f' % simulate('light', TASKS_POWER, day_bl, night_bl))
+    print('  夜间关背光 浅睡眠:    %.1f' % simulate('light', TASKS_POWER, day_bl, 0))
+
+
+if __name__ == '__main__':
+    main()
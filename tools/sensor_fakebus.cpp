@@ -0,0 +1,199 @@
+// 室内传感器层在PC上用假I2C总线运行：模拟SHT3x、BME280、SCD4x的寄存器和命令，
+// 检查换算结果、合并优先级、出错时由后面的传感器补上，以及每批的I2C收发次数，不符时返回1
+// 用法：g++ -O2 -Wall -Wextra -Isrc tools/sensor_fakebus.cpp src/IndoorSensors.cpp -o sensor_fakebus && ./sensor_fakebus
+#include <stdio.h>
+#include <string.h>
+#include "IndoorSensors.h"
+
+class FakeBus : public I2cBus
+{
+public:
+  bool shtPresent = true;
+  bool shtCorrupt = false; // 返回错误的CRC
+  bool bmePresent = true;
+  bool scdPresent = true;
+  bool scdReady = true;
+  uint16_t shtT = 26214, shtH = 32768;  // 25.0℃ 50.0%
+  uint16_t scdCo2 = 812, scdT = 26500, scdH = 30000;
+  uint32_t waitedMs = 0;
+
+  void delayMs(uint16_t ms) override { waitedMs += ms; }
+
+protected:
+  uint8_t _bmeReg = 0;
+  uint16_t _shtCmd = 0, _scdCmd = 0;
+
+  bool rawWrite(uint8_t addr, const uint8_t *data, size_t len, bool) override
+  {
+    if (addr == 0x44 && shtPresent && len == 2)
+      _shtCmd = (data[0] << 8) | data[1];
+    else if (addr == 0x76 && bmePresent && len >= 1)
+      _bmeReg = data[0]; // 写寄存器时只记地址，ctrl_meas等不用模拟
+    else if (addr == 0x62 && scdPresent && len == 2)
+      _scdCmd = (data[0] << 8) | data[1];
+    else
+      return false;
+    return true;
+  }
+
+  static void putWord(uint8_t *p, uint16_t w)
+  {
+    p[0] = w >> 8;
+    p[1] = w & 0xFF;
+    p[2] = sensirionCrc(p, 2);
+  }
+
+  bool rawRead(uint8_t addr, uint8_t *data, size_t len) override
+  {
+    if (addr == 0x44 && shtPresent)
+    {
+      if (_shtCmd == 0xF32D && len == 3)
+        putWord(data, 0x8010);
+      else if (_shtCmd == 0x2400 && len == 6)
+      {
+        putWord(data, shtT);
+        putWord(data + 3, shtH);
+        if (shtCorrupt)
+          data[2] ^= 0xFF;
+      }
+      else
+        return false;
+      return true;
+    }
+    if (addr == 0x76 && bmePresent)
+    {
+      // 数据手册中的计算示例：adc_T=519888得25.08℃，adc_P=415148得100653Pa
+      static const uint8_t calib[26] = {0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC, 0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B, 0x27, 0x0B,
+                                        0x8C, 0x00, 0xF9, 0xFF, 0x8C, 0x3C, 0xF8, 0xC6, 0x70, 0x17, 0x00, 0x4B};
+      static const uint8_t calibH[7] = {0x6A, 0x01, 0x00, 0x14, 0x24, 0x03, 0x1E};
+      static const uint8_t sample[8] = {0x65, 0x5A, 0xC0, 0x7E, 0xED, 0x00, 0x75, 0x30};
+      if (_bmeReg == 0xD0 && len == 1)
+        data[0] = 0x60;
+      else if (_bmeReg == 0x88 && len == sizeof(calib))
+        memcpy(data, calib, len);
+      else if (_bmeReg == 0xE1 && len == sizeof(calibH))
+        memcpy(data, calibH, len);
+      else if (_bmeReg == 0xF7 && len == sizeof(sample))
+        memcpy(data, sample, len);
+      else
+        return false;
+      return true;
+    }
+    if (addr == 0x62 && scdPresent)
+    {
+      if (_scdCmd == 0x3682 && len == 9)
+      {
+        putWord(data, 0x1234);
+        putWord(data + 3, 0x5678);
+        putWord(data + 6, 0x9ABC);
+      }
+      else if (_scdCmd == 0xE4B8 && len == 3)
+        putWord(data, scdReady ? 0x8006 : 0x8000);
+      else if (_scdCmd == 0xEC05 && len == 9)
+      {
+        putWord(data, scdCo2);
+        putWord(data + 3, scdT);
+        putWord(data + 6, scdH);
+      }
+      else
+        return false;
+      return true;
+    }
+    return false;
+  }
+};
+
+static int failures = 0;
+
+static void expect(const char *what, long actual, long expected)
+{
+  if (actual == expected)
+    return;
+  printf("  不符: %s 为%ld，应为%ld\n", what, actual, expected);
+  failures++;
+}
+
+// 采集一批并显示，返回这一批的I2C收发次数
+static uint32_t show(const char *title, FakeBus &bus, IndoorSensors &sensors, IndoorReading &r)
+{
+  uint32_t transfers = bus.transfers();
+  bus.waitedMs = 0;
+  bool ok = sensors.sample();
+  uint32_t seq = sensors.get(r);
+  printf("%-22s %s seq:%u I2C收发:%u 等待:%ums |", title, ok ? "更新" : "无数据", seq, bus.transfers() - transfers, bus.waitedMs);
+  if (r.fields & INDOOR_TEMP)
+    printf(" 温度%.1f", r.temp10 / 10.0);
+  if (r.fields & INDOOR_HUMI)
+    printf(" 湿度%.1f", r.humi10 / 10.0);
+  if (r.fields & INDOOR_CO2)
+    printf(" CO2 %u", r.co2);
+  if (r.fields & INDOOR_PRESS)
+    printf(" 气压%.1f", r.press10 / 10.0);
+  printf("\n");
+  expect("更新", ok, true);
+  return bus.transfers() - transfers;
+}
+
+// SHT3x 25.0℃ 50.0%，BME280数据手册示例25.08℃ 100653Pa，SCD4x 812ppm；温湿度按SHT3x、BME280、SCD4x的顺序取
+static void expectMerged(IndoorReading &r, int16_t temp10, int16_t humi10, bool co2)
+{
+  expect("字段", r.fields, INDOOR_TEMP | INDOOR_HUMI | INDOOR_PRESS | (co2 ? INDOOR_CO2 : 0));
+  expect("温度", r.temp10, temp10);
+  expect("湿度", r.humi10, humi10);
+  expect("气压", r.press10, 10065);
+  if (co2)
+    expect("CO2", r.co2, 812);
+}
+
+int main()
+{
+  FakeBus bus;
+  Sht3xSensor sht(bus);
+  Bme280Sensor bme(bus);
+  Scd4xSensor scd(bus);
+  IndoorSensors sensors(bus);
+  sensors.add(&sht);
+  sensors.add(&bme);
+  sensors.add(&scd);
+  printf("找到%u个传感器:", sensors.begin());
+  for (uint8_t i = 0; i < sensors.count(); i++)
+    printf(" %s%s", sensors.sensor(i)->name(), sensors.present(i) ? "" : "(无)");
+  printf("\n");
+
+  expect("传感器数", sensors.count(), 3);
+  for (uint8_t i = 0; i < sensors.count(); i++)
+    expect(sensors.sensor(i)->name(), sensors.present(i), true);
+
+  // 每批：SHT3x触发1次、读1次；BME280触发1次、读1次；SCD4x查就绪2次、读2次(未就绪时不读)
+  IndoorReading r;
+  expect("全部正常 收发", show("全部正常", bus, sensors, r), 8);
+  expect("全部正常 等待", bus.waitedMs, 17);
+  expectMerged(r, 250, 500, true);
+
+  bus.scdReady = false;
+  expect("SCD4x未就绪 收发", show("SCD4x数据未就绪", bus, sensors, r), 6);
+  expectMerged(r, 250, 500, false);
+  bus.scdReady = true;
+
+  bus.shtCorrupt = true;
+  expect("SHT3x出错 收发", show("SHT3x CRC错误", bus, sensors, r), 8);
+  expectMerged(r, 251, 511, true); // 温湿度改由BME280提供
+  expect("BME280补上 收发", show("SHT3x出错后BME280补上", bus, sensors, r), 8);
+  expectMerged(r, 251, 511, true);
+  bus.shtCorrupt = false;
+  expect("SHT3x恢复 收发", show("SHT3x恢复", bus, sensors, r), 8);
+  expectMerged(r, 250, 500, true);
+  expect("恢复后 收发", show("SHT3x恢复后", bus, sensors, r), 8);
+  expectMerged(r, 250, 500, true);
+
+  for (uint8_t i = 0; i < sensors.count(); i++)
+    printf("  %s 失败%u次\n", sensors.sensor(i)->name(), sensors.failures(i));
+  printf("SCD4x未就绪%u次，I2C共收发%u次，错误%u次\n", scd.notReady(), bus.transfers(), bus.errors());
+  expect("SHT3x失败", sensors.failures(0), 2);
+  expect("BME280失败", sensors.failures(1), 0);
+  expect("SCD4x失败", sensors.failures(2), 0);
+  expect("SCD4x未就绪", scd.notReady(), 1);
+  expect("I2C错误", bus.errors(), 0);
+  printf(failures ? "失败%d项\n" : "全部通过\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+# web设置页面的并发压力测试，在PC上对设备运行，统计每个请求从发出到收完的延迟(按最近秩取百分位)
+# 每个客户端一个线程，依次请求给出的路径，每次新建连接(和浏览器打开页面一样)
+# 用法：python3 tools/web_load.py 设备IP [-c 并发数] [-n 每个客户端的请求数] [--p99 毫秒] [路径...]
+#       默认路径为/ /stats /api/settings；有请求失败或p99超过--p99时返回1
+#       python3 tools/web_load.py 设备IP --api [-n 次数]
+#       逐个请求JSON接口，列出响应大小、传输方式和延迟，检查JSON能解析；
+#       再提交几个超出范围的设置，应返回400(不会改动设备的设置)
+import argparse
+import http.client
+import json
+import math
+import threading
+import time
+
+
+def percentile(values, p):
+    values = sorted(values)
+    if not values:
+        return 0.0
+    k = min(len(values) - 1, max(0, math.ceil(p / 100.0 * len(values)) - 1))
+    return values[k]
+
+
+def request(host, port, path, timeout):
+    start = time.perf_counter()
+    conn = http.client.HTTPConnection(host, port, timeout=timeout)
+    try:
+        conn.request('GET', path, headers={'Accept-Encoding': 'gzip'})
+        resp = conn.getresponse()
+        body = resp.read()
+        return resp.status, len(body), (time.perf_counter() - start) * 1000
+    finally:
+        conn.close()
+
+
+API_PATHS = ['/api/settings', '/api/weather', '/api/warning', '/api/calendar']
+BAD_SETTINGS = ['{"rotation":9}', '{"cityCode":5}', '{"backlight":0}', '{"updateMinutes":61}', '{"cpuPolicy":9}', '[]',
+                '{"cityCode":"101010100"}', '{"rotation":1.5}', '{"backlight":null}', '{"dhtEnable":"yes"}']
+
+
+def api_check(args):
+    failed = 0
+    print('%-14s %6s %-10s %-6s %9s %9s %9s' % ('接口', '字节', '传输', 'JSON', 'p50', 'p99', '最大'))
+    for path in API_PATHS:
+        ms = []
+        size, mode, valid = 0, '', True
+        for _ in range(args.n):
+            start = time.perf_counter()
+            conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+            try:
+                conn.request('GET', path)
+                resp = conn.getresponse()
+                body = resp.read()
+                ms.append((time.perf_counter() - start) * 1000)
+                size = len(body)
+                mode = 'chunked' if resp.getheader('Transfer-Encoding', '') == 'chunked' else 'length'
+                try:
+                    json.loads(body)
+                except ValueError:
+                    valid = False
+                if resp.status != 200:
+                    valid = False
+            except Exception as e:
+                print('  %s: %s' % (path, type(e).__name__))
+                valid = False
+                break
+            finally:
+                conn.close()
+        if not valid:
+            failed += 1
+        print('%-14s %6d %-10s %-6s %7.1fms %7.1fms %7.1fms' % (path, size, mode, '正确' if valid else '错误',
+                                                             percentile(ms, 50), percentile(ms, 99), max(ms) if ms else 0))
+    for body in BAD_SETTINGS:
+        conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+        try:
+            conn.request('PUT', '/api/settings', body=body, headers={'Content-Type': 'application/json'})
+            status = conn.getresponse().status
+        except Exception as e:
+            status = type(e).__name__
+        finally:
+            conn.close()
+        print('PUT %-22s %s%s' % (body, status, '' if status == 400 else ' 应为400'))
+        if status != 400:
+            failed += 1
+    return failed
+
+
+def client(args, results, lock):
+    for i in range(args.n):
+        path = args.paths[i % len(args.paths)]
+        try:
+            status, size, ms = request(args.host, args.port, path, args.timeout)
+            error = None if status == 200 else 'HTTP %d' % status
+        except Exception as e:  # 超时、连接被拒绝等
+            size, ms, error = 0, 0.0, type(e).__name__
+        with lock:
+            results.append((path, ms, size, error))
+
+
+def report(results, seconds):
+    ok = [r for r in results if r[3] is None]
+    failed = [r for r in results if r[3] is not None]
+    print('请求 %d次 成功 %d 失败 %d 用时 %.1fs 吞吐 %.1f次/秒' % (len(results), len(ok), len(failed), seconds,
+                                                          len(ok) / seconds if seconds > 0 else 0))
+    for path in sorted(set(r[0] for r in results)):
+        ms = [r[1] for r in ok if r[0] == path]
+        sizes = [r[2] for r in ok if r[0] == path]
+        if ms:
+            print('  %-14s %4d次 %6d字节 p50 %7.1fms p99 %7.1fms 最大 %7.1fms' % (path, len(ms), max(sizes), percentile(ms, 50),
+                                                                             percentile(ms, 99), max(ms)))
+    errors = {}
+    for r in failed:
+        errors[r[3]] = errors.get(r[3], 0) + 1
+    for e, n in sorted(errors.items()):
+        print('  失败 %s: %d次' % (e, n))
+    all_ms = [r[1] for r in ok]
+    p50, p99 = percentile(all_ms, 50), percentile(all_ms, 99)
+    print('全部 p50 %.1fms p99 %.1fms' % (p50, p99))
+    return len(failed), p99
+
+
+def main():
+    parser = argparse.ArgumentParser(description='web设置页面并发压力测试')
+    parser.add_argument('host')
+    parser.add_argument('paths', nargs='*', default=['/', '/stats', '/api/settings'])
+    parser.add_argument('--port', type=int, default=80)
+    parser.add_argument('-c', type=int, default=8, help='并发客户端数')
+    parser.add_argument('-n', type=int, default=50, help='每个客户端的请求数')
+    parser.add_argument('--timeout', type=float, default=10.0)
+    parser.add_argument('--p99', type=float, default=0, help='p99上限(毫秒)，0为不检查')
+    parser.add_argument('--api', action='store_true', help='检查JSON接口')
+    args = parser.parse_intermixed_args()
+
+    if args.api:
+        failed = api_check(args)
+        print('未通过' if failed else '通过')
+        return 1 if failed else 0
+
+    results = []
+    lock = threading.Lock()
+    threads = [threading.Thread(target=client, args=(args, results, lock)) for _ in range(args.c)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    failed, p99 = report(results, time.perf_counter() - start)
+    if failed or (args.p99 > 0 and p99 > args.p99):
+        print('未通过')
+        return 1
+    print('通过')
+    return 0
+
+
+if __name__ == '__main__':
+    raise SystemExit(main())
@@ -0,0 +1,26 @@
+# 把config.html压缩后生成src/webpage.h，修改页面后运行：python3 web/mkpage.py
+import gzip
+import os
+
+root = os.path.dirname(os.path.abspath(__file__))
+raw = open(os.path.join(root, 'config.html'), 'rb').read()
+gz = gzip.compress(raw, 9, mtime=0)
+lines = []
+for i in range(0, len(gz), 16):
+    lines.append('    ' + ', '.join('0x%02x' % b for b in gz[i:i + 16]) + ',')
+out = '''#ifndef _WEBPAGE_H_
+#define _WEBPAGE_H_
+
+#include "Arduino.h"
+#include <pgmspace.h> // PROGMEM support header
+
+// web设置页面，由web/config.html压缩生成(原始%d字节)，修改页面后运行python3 web/mkpage.py
+const uint8_t config_html_gz[] PROGMEM = {
+%s
+};
+const size_t config_html_gz_len = sizeof(config_html_gz);
+
+#endif
+''' % (len(raw), '\n'.join(lines))
+open(os.path.join(root, '..', 'src', 'webpage.h'), 'w').write(out)
+print('config.html: %d -> %d bytes' % (len(raw), len(gz)))